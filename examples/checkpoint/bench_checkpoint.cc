@@ -0,0 +1,86 @@
+#include <stdio.h>
+#include <sys/resource.h>
+
+#include <algorithm>
+#include <chrono>
+#include <iostream>
+#include <string>
+
+#include "../src/checkpoint.h"
+#include "../src/parameter.h"
+#include "../src/tensor.h"
+
+using namespace rnnpp;
+
+static double cpu_seconds() {
+  struct rusage ru;
+  getrusage(RUSAGE_SELF, &ru);
+  return ru.ru_utime.tv_sec + ru.ru_stime.tv_sec
+    + 1e-6 * (ru.ru_utime.tv_usec + ru.ru_stime.tv_usec);
+}
+
+static double seconds_since(std::chrono::system_clock::time_point start) {
+  return std::chrono::duration<double>(std::chrono::system_clock::now() - start).count();
+}
+
+// Saves a model of n_million million parameters in 1000x1000 matrices plus
+// a (100000, 256) lookup table, then measures how long loading it takes.
+//
+// usage: bench_checkpoint [n_million] [path]
+int main(int argc, char** argv) {
+  int n_million = argc > 1 ? atoi(argv[1]) : 512;
+  std::string path = argc > 2 ? argv[2] : "bench_checkpoint.bin";
+  // the default reservation of a collection holds 1 GiB of floats
+  size_t capacity = std::max((size_t)n_million * 1000000 + 100000 * 256,
+      ParameterCollection::kDefaultCapacity);
+
+  {
+    ParameterCollection model(capacity);
+    for (int i=0; i < n_million; ++i) {
+      Parameter p = model.add_parameter(Dim({1000, 1000}));
+    }
+    model.add_lookup_parameter(Dim({100000, 256}));
+
+    auto start = std::chrono::system_clock::now();
+    save_checkpoint(path, model);
+    double sec = seconds_since(start);
+    double gb = model.values_size() * sizeof(float) / 1e9;
+    std::cout << "save: " << gb << " GB in " << sec << " s ("
+      << gb / sec << " GB/s)" << std::endl;
+  }
+
+  ParameterCollection model(capacity);
+  double cpu = cpu_seconds();
+  auto start = std::chrono::system_clock::now();
+  load_checkpoint(path, model);
+  double sec = seconds_since(start);
+  cpu = cpu_seconds() - cpu;
+  std::cout << "load: " << model.parameters.size() << " parameters, "
+    << model.lookup_parameters.size() << " lookup parameters in "
+    << sec * 1e3 << " ms (" << cpu * 1e3 << " ms cpu)" << std::endl;
+
+  // the payload is paged in when first read
+  start = std::chrono::system_clock::now();
+  double s = 0.;
+  for (int i=0; i < model.parameters.size(); ++i) {
+    s += sum(model.parameters[i].value.data, model.parameters[i].value.dim.size());
+  }
+  sec = seconds_since(start);
+  std::cout << "first read of all parameters: " << sec * 1e3 << " ms (sum "
+    << s << ")" << std::endl;
+
+  // a frozen table is mapped instead of allocated and initialized
+  start = std::chrono::system_clock::now();
+  MappedLookupParameter frozen(path, "lookup_parameter_0");
+  sec = seconds_since(start);
+  std::cout << "map frozen (100000, 256) table: " << sec * 1e3 << " ms" << std::endl;
+
+  start = std::chrono::system_clock::now();
+  LookupParameter eager(Dim({100000, 256}));
+  sec = seconds_since(start);
+  std::cout << "allocate and initialize (100000, 256) table: " << sec * 1e3
+    << " ms" << std::endl;
+
+  remove(path.c_str());
+  return 0;
+}
@@ -0,0 +1,66 @@
+#include <chrono>
+#include <iostream>
+#include <thread>
+#include <vector>
+
+#include "../src/expr.h"
+#include "../src/graph.h"
+#include "../src/optimizer.h"
+#include "../src/rnnpp.h"
+#include "../src/trainer.h"
+
+using namespace rnnpp;
+
+static double seconds_since(std::chrono::system_clock::time_point start) {
+  return std::chrono::duration<double>(std::chrono::system_clock::now() - start).count();
+}
+
+// Trains a bag-of-words regressor, the mean of n_tok embeddings from a
+// (n_vocab, 64) table times a (64, 8) matrix, with HogwildTrainer on
+// 1, 2, 4, ... up to max_threads threads and prints examples/s.
+//
+// usage: bench_hogwild [max_threads] [n_examples] [n_vocab]
+int main(int argc, char** argv) {
+  int max_threads = argc > 1 ? atoi(argv[1]) : std::thread::hardware_concurrency();
+  int n_examples = argc > 2 ? atoi(argv[2]) : 20000;
+  int n_vocab = argc > 3 ? atoi(argv[3]) : 1000000;
+  int n_tok = 20;
+  int dim_emb = 64;
+  int n_out = 8;
+
+  std::vector<std::vector<int>> tokens(n_examples);
+  std::vector<std::vector<float>> targets(n_examples);
+  for (int i=0; i < n_examples; ++i) {
+    for (int j=0; j < n_tok; ++j) {
+      tokens[i].push_back((int)((i * 7919LL + j * 104729LL) % n_vocab));
+    }
+    for (int k=0; k < n_out; ++k) {
+      targets[i].push_back(((i + k) % 3) - 1.f);
+    }
+  }
+  std::vector<int> offsets = {0};
+
+  auto loss = [&](Graph &g, ParameterReplica &r, int i) {
+    Expression h = embedding_bag(g, r.lookup_parameters[0], tokens[i], offsets, kBagMean);
+    Expression y = h * parameter(g, r.parameters[0]);
+    return squared_distance(y, input(g, Dim({1, n_out}), targets[i]));
+  };
+
+  double base = 0.;
+  for (int nt=1; nt <= max_threads; nt *= 2) {
+    AdagradOptimizer optimizer;
+    optimizer.add_lookup_parameter({n_vocab, dim_emb});
+    optimizer.add_parameter({dim_emb, n_out});
+
+    HogwildTrainer trainer(optimizer, nt);
+    auto start = std::chrono::system_clock::now();
+    float l = trainer.train(n_examples, loss);
+    double rate = n_examples / seconds_since(start);
+    if (nt == 1) {
+      base = rate;
+    }
+    std::cout << nt << " threads: " << rate << " examples/s (x" << rate / base
+      << "), loss " << l << std::endl;
+  }
+  return 0;
+}
@@ -0,0 +1,57 @@
+#include <chrono>
+#include <iostream>
+#include <random>
+
+#include "../src/initializer.h"
+#include "../src/tensor.h"
+
+using namespace rnnpp;
+
+static double seconds_since(std::chrono::system_clock::time_point start) {
+  return std::chrono::duration<double>(std::chrono::system_clock::now() - start).count();
+}
+
+// Times each initializer on a (n_million * 1000, 1000) tensor and compares
+// with drawing N(0, 1) from std::mt19937 one element at a time.
+//
+// usage: bench_init [n_million] [n_threads]
+int main(int argc, char** argv) {
+  int n_million = argc > 1 ? atoi(argv[1]) : 100;
+  int n_threads = argc > 2 ? atoi(argv[2]) : 0;
+
+  Tensor t;
+  t.dim = Dim({n_million * 1000, 1000});
+  t.data = new float[t.dim.size()];
+
+  {
+    auto start = std::chrono::system_clock::now();
+    std::mt19937 mt(1);
+    std::normal_distribution<> norm(0.0, 1.);
+    for (int i=0; i < t.dim.size(); ++i) {
+      t.data[i] = norm(mt);
+    }
+    std::cout << "mt19937 normal: " << seconds_since(start) * 1e3 << " ms" << std::endl;
+  }
+
+  NormalInitializer normal;
+  UniformInitializer uniform;
+  GlorotInitializer glorot;
+  HeInitializer he;
+  std::vector<std::pair<std::string, Initializer*>> inits{
+    {"normal", &normal}, {"uniform", &uniform}, {"glorot", &glorot}, {"he", &he},
+  };
+  for (auto &p : inits) {
+    p.second->num_threads = n_threads;
+    auto start = std::chrono::system_clock::now();
+    p.second->init(t);
+    std::cout << p.first << ": " << seconds_since(start) * 1e3 << " ms" << std::endl;
+  }
+
+  Tensor w;
+  w.dim = Dim({512, 512});
+  w.data = new float[w.dim.size()];
+  auto start = std::chrono::system_clock::now();
+  OrthogonalInitializer().init(w);
+  std::cout << "orthogonal (512, 512): " << seconds_since(start) * 1e3 << " ms" << std::endl;
+  return 0;
+}
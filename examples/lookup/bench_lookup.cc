@@ -0,0 +1,79 @@
+#include <chrono>
+#include <iostream>
+#include <vector>
+
+#include "../src/expr.h"
+#include "../src/graph.h"
+#include "../src/optimizer.h"
+#include "../src/rnnpp.h"
+
+using namespace rnnpp;
+
+static double seconds_since(std::chrono::system_clock::time_point start) {
+  return std::chrono::duration<double>(std::chrono::system_clock::now() - start).count();
+}
+
+// Forward and backward of the embeddings of a minibatch of n_sent sentences
+// of n_tok tokens: one node per token summed with Add nodes, one batched
+// lookup, and one embedding bag per sentence.
+//
+// usage: bench_lookup [n_vocab] [dim_emb] [n_iter]
+int main(int argc, char** argv) {
+  int n_vocab = argc > 1 ? atoi(argv[1]) : 1000000;
+  int dim_emb = argc > 2 ? atoi(argv[2]) : 128;
+  int n_iter = argc > 3 ? atoi(argv[3]) : 10;
+  int n_sent = 64;
+  int n_tok = 50;
+
+  SGDOptimizer optimizer;
+  LookupParameter lp = optimizer.add_lookup_parameter({n_vocab, dim_emb});
+
+  std::vector<std::vector<int>> batches(n_iter);
+  for (int t=0; t < n_iter; ++t) {
+    for (int j=0; j < n_sent * n_tok; ++j) {
+      batches[t].push_back((int)((t * 7919LL + j * 104729LL) % n_vocab));
+    }
+  }
+
+  {
+    auto start = std::chrono::system_clock::now();
+    for (int t=0; t < n_iter; ++t) {
+      Graph g;
+      Expression x = lookup(g, lp, batches[t][0]);
+      for (int j=1; j < batches[t].size(); ++j) {
+        x = x + lookup(g, lp, batches[t][j]);
+      }
+      Expression e = sum(x, -1);
+      e.forward();
+      e.backward();
+    }
+    std::cout << "per token: " << seconds_since(start) / n_iter * 1e3 << " ms/batch" << std::endl;
+  }
+
+  {
+    auto start = std::chrono::system_clock::now();
+    for (int t=0; t < n_iter; ++t) {
+      Graph g;
+      Expression e = sum(lookup(g, lp, batches[t]), -1);
+      e.forward();
+      e.backward();
+    }
+    std::cout << "batched:   " << seconds_since(start) / n_iter * 1e3 << " ms/batch" << std::endl;
+  }
+
+  {
+    std::vector<int> offsets;
+    for (int b=0; b < n_sent; ++b) {
+      offsets.push_back(b * n_tok);
+    }
+    auto start = std::chrono::system_clock::now();
+    for (int t=0; t < n_iter; ++t) {
+      Graph g;
+      Expression e = sum(embedding_bag(g, lp, batches[t], offsets), -1);
+      e.forward();
+      e.backward();
+    }
+    std::cout << "bag:       " << seconds_since(start) / n_iter * 1e3 << " ms/batch" << std::endl;
+  }
+  return 0;
+}
@@ -0,0 +1,113 @@
+#include <limits.h>
+
+#include <algorithm>
+#include <chrono>
+#include <iostream>
+#include <string>
+
+#include "../src/optimizer.h"
+#include "../src/parameter.h"
+
+using namespace rnnpp;
+
+Optimizer *create(const std::string &name, size_t capacity) {
+  if (name == "sgd") return new SGDOptimizer(0.1, 0., capacity);
+  if (name == "momentum") return new SGDOptimizer(0.1, 0.9, capacity);
+  if (name == "adam") return new AdamOptimizer(0.001, 0.9, 0.999, 1e-8, capacity);
+  if (name == "adagrad") return new AdagradOptimizer(0.1, 1e-8, capacity);
+  if (name == "rmsprop") return new RMSPropOptimizer(0.001, 0.9, 1e-8, capacity);
+  std::cerr << "unknown optimizer: " << name << std::endl;
+  return nullptr;
+}
+
+// Updates a (n_million million, 128) lookup table with Adam when only
+// n_rows rows are touched per step.
+int bench_lookup(int n_million, int n_iter) {
+  // the number of rows is an int
+  if (n_million < 1 || n_million > INT_MAX / 1000000) {
+    std::cerr << "n_million must be between 1 and " << INT_MAX / 1000000 << std::endl;
+    return 1;
+  }
+  int n_rows = 512;
+  size_t capacity = std::max((size_t)n_million * 1000000 * 128,
+      ParameterCollection::kDefaultCapacity);
+  AdamOptimizer optimizer(0.001, 0.9, 0.999, 1e-8, capacity);
+  LookupParameter lp = optimizer.add_lookup_parameter({n_million * 1000000, 128});
+
+  double sec = 0.;
+  for (int t=0; t < n_iter; ++t) {
+    for (int j=0; j < n_rows; ++j) {
+      int r = (int)((t * 7919LL + j * 104729LL) % lp.all_values.dim[0]);
+      for (int k=0; k < 128; ++k) {
+        lp.grad(r).data[k] = 1e-3;
+      }
+      lp.touch(r);
+    }
+    auto start = std::chrono::system_clock::now();
+    optimizer.update();
+    auto end = std::chrono::system_clock::now();
+    // the first update allocates the optimizer state
+    if (t > 0) {
+      sec += std::chrono::duration<double>(end - start).count();
+    }
+  }
+  std::cout << "lookup adam: " << sec / (n_iter - 1) * 1e3 << " ms/update for "
+    << n_rows << " of " << lp.all_values.dim[0] << " rows" << std::endl;
+  return 0;
+}
+
+// Measures update throughput on a model of n_million million parameters
+// split into 1000x1000 matrices, or with `lookup` on a table of n_million
+// million rows.
+//
+// usage: bench_optimizer [sgd|momentum|adam|adagrad|rmsprop|all|lookup] [n_million] [n_iter]
+int main(int argc, char** argv) {
+  std::string which = argc > 1 ? argv[1] : "all";
+  int n_iter = argc > 3 ? atoi(argv[3]) : 10;
+
+  if (which == "lookup") {
+    return bench_lookup(argc > 2 ? atoi(argv[2]) : 1, n_iter);
+  }
+  int n_million = argc > 2 ? atoi(argv[2]) : 100;
+  size_t capacity = std::max((size_t)n_million * 1000000,
+      ParameterCollection::kDefaultCapacity);
+
+  std::vector<std::string> names;
+  if (which == "all") {
+    names = {"sgd", "momentum", "adam", "adagrad", "rmsprop"};
+  } else {
+    names = {which};
+  }
+
+  for (auto &name : names) {
+    Optimizer *optimizer = create(name, capacity);
+    if (optimizer == nullptr) {
+      return 1;
+    }
+
+    std::vector<Parameter> params;
+    for (int i=0; i < n_million; ++i) {
+      params.push_back(optimizer->add_parameter({1000, 1000}));
+    }
+    for (auto &p : params) {
+      p.grad = Scalar(1e-3);
+    }
+
+    // the first update allocates the optimizer state
+    optimizer->update();
+
+    auto start = std::chrono::system_clock::now();
+    for (int t=0; t < n_iter; ++t) {
+      optimizer->update();
+    }
+    auto end = std::chrono::system_clock::now();
+    double sec = std::chrono::duration<double>(end - start).count();
+
+    double n = 1e6 * n_million * n_iter;
+    std::cout << name << ": " << sec / n_iter * 1e3 << " ms/update, "
+      << n / sec / 1e9 << " G params/s" << std::endl;
+
+    delete optimizer;
+  }
+  return 0;
+}
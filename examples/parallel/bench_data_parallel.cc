@@ -0,0 +1,126 @@
+#include <chrono>
+#include <iostream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "../src/expr.h"
+#include "../src/graph.h"
+#include "../src/initializer.h"
+#include "../src/lazy.h"
+#include "../src/optimizer.h"
+#include "../src/rnnpp.h"
+#include "../src/trainer.h"
+
+using namespace rnnpp;
+
+static double seconds_since(std::chrono::system_clock::time_point start) {
+  return std::chrono::duration<double>(std::chrono::system_clock::now() - start).count();
+}
+
+// Each example is a minibatch of n_batch XOR inputs through a tanh layer.
+static void xor_model(Optimizer &optimizer, std::vector<std::vector<float>> &data,
+    LossBuilder &loss) {
+  const int n_batch = 64;
+  const int n_hidden = 256;
+  optimizer.add_parameter({n_hidden, 2});
+  optimizer.add_parameter({n_hidden, 1});
+  optimizer.add_parameter({1, n_hidden});
+  optimizer.add_parameter({1, 1});
+
+  std::vector<float> x, y;
+  for (int b=0; b < n_batch; ++b) {
+    float x0 = b & 1 ? 1. : -1.;
+    float x1 = b & 2 ? 1. : -1.;
+    x.push_back(x0);
+    x.push_back(x1);
+    y.push_back(x0 * x1 > 0 ? -1. : 1.);
+  }
+  data = {x, y};
+
+  loss = [&data, n_batch](Graph &g, ParameterReplica &r, int i) {
+    Expression x = input(g, Dim({2, 1}, n_batch), data[0]);
+    Expression y = input(g, Dim({1, 1}, n_batch), data[1]);
+    Expression h = tanh(parameter(g, r.parameters[0]) * x + parameter(g, r.parameters[1]));
+    Expression y_pred = parameter(g, r.parameters[2]) * h + parameter(g, r.parameters[3]);
+    return sum(square(lazy(y_pred) - lazy(y)), 2) / n_batch;
+  };
+}
+
+// Each example is a sequence of n_steps inputs through an LSTM composed of
+// the basic nodes, one weight matrix per gate, with the loss on the last
+// hidden state.
+static void lstm_model(Optimizer &optimizer, std::vector<std::vector<float>> &data,
+    LossBuilder &loss) {
+  const int n_in = 32;
+  const int n_hidden = 64;
+  const int n_steps = 10;
+  for (int k=0; k < 4; ++k) {
+    optimizer.add_parameter({n_hidden, n_in + n_hidden});
+    optimizer.add_parameter({n_hidden, 1});
+  }
+
+  data.resize(n_steps + 2);
+  for (int t=0; t < n_steps; ++t) {
+    for (int k=0; k < n_in; ++k) {
+      data[t].push_back(((t * 31 + k * 17) % 13) / 6.f - 1.f);
+    }
+  }
+  data[n_steps].assign(n_hidden, 0.f);
+  data[n_steps + 1].assign(n_hidden, 0.5f);
+
+  loss = [&data, n_in, n_hidden, n_steps](Graph &g, ParameterReplica &r, int i) {
+    std::vector<Expression> w, b;
+    for (int k=0; k < 4; ++k) {
+      w.push_back(parameter(g, r.parameters[2 * k]));
+      b.push_back(parameter(g, r.parameters[2 * k + 1]));
+    }
+    Expression h = input(g, Dim({n_hidden, 1}), data[n_steps]);
+    Expression c = h;
+    for (int t=0; t < n_steps; ++t) {
+      Expression xh = concat({input(g, Dim({n_in, 1}), data[t]), h}, 0);
+      Expression in = sigmoid(w[0] * xh + b[0]);
+      Expression forget = sigmoid(w[1] * xh + b[1]);
+      Expression cell = tanh(w[2] * xh + b[2]);
+      Expression out = sigmoid(w[3] * xh + b[3]);
+      c = cmult(forget, c) + cmult(in, cell);
+      h = cmult(out, tanh(c));
+    }
+    return squared_distance(h, input(g, Dim({n_hidden, 1}), data[n_steps + 1]));
+  };
+}
+
+// Time per minibatch of DataParallelTrainer on 1, 2, 4, ... max_threads.
+//
+// usage: bench_data_parallel [xor|lstm] [max_threads] [batch_size] [n_batches]
+int main(int argc, char** argv) {
+  std::string which = argc > 1 ? argv[1] : "xor";
+  int max_threads = argc > 2 ? atoi(argv[2]) : std::thread::hardware_concurrency();
+  int batch_size = argc > 3 ? atoi(argv[3]) : 16;
+  int n_batches = argc > 4 ? atoi(argv[4]) : 10;
+
+  double base = 0.;
+  for (int nt=1; nt <= max_threads; nt *= 2) {
+    // same initial values for every thread count
+    set_seed(1);
+    SGDOptimizer optimizer(0.01 / batch_size);
+    std::vector<std::vector<float>> data;
+    LossBuilder loss;
+    if (which == "lstm") {
+      lstm_model(optimizer, data, loss);
+    } else {
+      xor_model(optimizer, data, loss);
+    }
+
+    DataParallelTrainer trainer(optimizer, nt);
+    auto start = std::chrono::system_clock::now();
+    float l = trainer.train(batch_size * n_batches, batch_size, loss);
+    double ms = seconds_since(start) / n_batches * 1e3;
+    if (nt == 1) {
+      base = ms;
+    }
+    std::cout << which << " " << nt << " threads: " << ms << " ms/batch (x"
+      << base / ms << "), loss " << l << std::endl;
+  }
+  return 0;
+}
@@ -0,0 +1,105 @@
+#include <chrono>
+#include <iostream>
+#include <math.h>
+
+#include "../src/expr.h"
+#include "../src/rnnpp.h"
+#include "../src/node.h"
+#include "../src/optimizer.h"
+#include "../src/graph.h"
+#include "../src/quantize.h"
+
+using namespace rnnpp;
+
+// Trains the batched XOR network, quantizes its weights to int8 and
+// compares predictions, then compares latency of fp32 and int8 layers.
+//
+// usage: quantize_mlp [n_hidden] [n_batch] [n_iter]
+int main(int argc, char** argv) {
+  int n_hidden = argc > 1 ? atoi(argv[1]) : 512;
+  int n_batch = argc > 2 ? atoi(argv[2]) : 32;
+  int n_iter = argc > 3 ? atoi(argv[3]) : 20;
+
+  SGDOptimizer optimizer;
+
+  // accuracy
+  {
+    Graph g;
+    std::vector<float> x_val{
+      1., 1.,
+      1., -1.,
+      -1., 1.,
+      -1., -1.,
+    };
+    Expression x = input(g, Dim({2, 1}, 4), x_val);
+    std::vector<float> y_val{
+      -1., 1., 1., -1.,
+    };
+    Expression y = input(g, Dim({1, 1}, 4), y_val);
+
+    Parameter p_w = optimizer.add_parameter({8, 2});
+    Parameter p_b = optimizer.add_parameter({8, 1});
+    Parameter p_w2 = optimizer.add_parameter({1, 8});
+    Parameter p_b2 = optimizer.add_parameter({1, 1});
+
+    Expression w = parameter(g, p_w);
+    Expression b = parameter(g, p_b);
+    Expression w2 = parameter(g, p_w2);
+    Expression b2 = parameter(g, p_b2);
+
+    Expression y_pred = w2 * tanh(w * x + b) + b2;
+    Expression loss = sum(squared_distance(y_pred, y), 2) / 4;
+    for (int i=0; i < 100; ++i) {
+      loss.forward();
+      loss.backward();
+      optimizer.update();
+    }
+
+    QuantizedParameter q_w = quantize(p_w);
+    QuantizedParameter q_w2 = quantize(p_w2);
+    Expression yq_pred = affine(q_w2, affine(q_w, x, b, kTanh), b2);
+
+    Tensor fp32 = y_pred.forward();
+    Tensor int8 = yq_pred.forward();
+    float max_diff = 0.;
+    for (int i=0; i < 4; ++i) {
+      std::cout << "x:(" << x_val[2 * i] << "," << x_val[2 * i + 1] << ")"
+                << " y:" << y_val[i]
+                << " fp32:" << fp32.data[i]
+                << " int8:" << int8.data[i] << std::endl;
+      max_diff = std::max(max_diff, fabsf(fp32.data[i] - int8.data[i]));
+    }
+    std::cout << "max |fp32 - int8|: " << max_diff << std::endl;
+  }
+
+  // latency
+  {
+    Graph g, gq;
+    std::vector<float> x_val(n_hidden * n_batch);
+    for (int i=0; i < x_val.size(); ++i) x_val[i] = sinf(i);
+
+    Parameter p_w = optimizer.add_parameter({n_hidden, n_hidden});
+    Parameter p_b = optimizer.add_parameter({n_hidden, 1});
+    QuantizedParameter q_w = quantize(p_w);
+
+    Expression x = input(g, Dim({n_hidden, 1}, n_batch), x_val);
+    Expression h = tanh(parameter(g, p_w) * x + parameter(g, p_b));
+
+    Expression xq = input(gq, Dim({n_hidden, 1}, n_batch), x_val);
+    Expression hq = affine(q_w, xq, parameter(gq, p_b), kTanh);
+
+    auto start = std::chrono::system_clock::now();
+    for (int i=0; i < n_iter; ++i) h.forward();
+    auto mid = std::chrono::system_clock::now();
+    for (int i=0; i < n_iter; ++i) hq.forward();
+    auto end = std::chrono::system_clock::now();
+
+    double t_fp32 = std::chrono::duration<double, std::milli>(mid - start).count() / n_iter;
+    double t_int8 = std::chrono::duration<double, std::milli>(end - mid).count() / n_iter;
+    std::cout << "layer " << n_hidden << "x" << n_hidden << " batch " << n_batch << std::endl;
+    std::cout << "fp32: " << t_fp32 << " ms/forward" << std::endl;
+    std::cout << "int8: " << t_int8 << " ms/forward" << std::endl;
+  }
+
+  return 0;
+}
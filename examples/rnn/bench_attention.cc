@@ -0,0 +1,89 @@
+#include <math.h>
+
+#include <chrono>
+#include <iostream>
+#include <vector>
+
+#include "../src/arena.h"
+#include "../src/expr.h"
+#include "../src/graph.h"
+#include "../src/lazy.h"
+#include "../src/rnnpp.h"
+
+using namespace rnnpp;
+
+static double seconds_since(std::chrono::system_clock::time_point start) {
+  return std::chrono::duration<double>(std::chrono::system_clock::now() - start).count();
+}
+
+// Attention from existing nodes: a Mult per encoder position, a concat,
+// a softmax and a weighted sum. rows and cols view the same states.
+static Expression composed(Graph &g, std::vector<std::vector<float>> &states,
+    std::vector<float> &query, int B, int H) {
+  Expression q = input(g, Dim({H, 1}, B), query);
+  std::vector<Expression> cols, scores;
+  for (auto &e : states) {
+    scores.push_back(input(g, Dim({1, H}, B), e) * q);
+    cols.push_back(input(g, Dim({H, 1}, B), e));
+  }
+  Expression ex = exp(lazy(concat(scores, 0)));
+  Expression a = ex / sum(ex, -1);
+  Expression c = cmult(cols[0], slice_rows(a, 0, 1));
+  for (int t=1; t < cols.size(); ++t) {
+    c = c + cmult(cols[t], slice_rows(a, t, t + 1));
+  }
+  return c;
+}
+
+// Time per attention call, forward and forward + backward, of the fused
+// Attention node and of the composed version, for a batch of queries over
+// source sentences of growing length.
+//
+// usage: bench_attention [batch_size] [hidden_dim] [n_calls]
+int main(int argc, char** argv) {
+  int B = argc > 1 ? atoi(argv[1]) : 16;
+  int H = argc > 2 ? atoi(argv[2]) : 128;
+  int n_calls = argc > 3 ? atoi(argv[3]) : 50;
+
+  Arena arena;
+  std::vector<float> query(B * H);
+  for (int i=0; i < query.size(); ++i) {
+    query[i] = 0.1f * cosf(0.7f * i);
+  }
+  for (int T : {10, 25, 50, 100, 200}) {
+    std::vector<float> enc(T * B * H);
+    for (int i=0; i < enc.size(); ++i) {
+      enc[i] = sinf(0.37f * i);
+    }
+    std::vector<std::vector<float>> states(T);
+    for (int t=0; t < T; ++t) {
+      states[t].assign(enc.begin() + t * B * H, enc.begin() + (t + 1) * B * H);
+    }
+
+    double us[2][2];
+    for (int fused=0; fused < 2; ++fused) {
+      for (int train=0; train < 2; ++train) {
+        auto start = std::chrono::system_clock::now();
+        for (int i=0; i < n_calls; ++i) {
+          arena.reset();
+          ArenaScope scope(arena);
+          Graph g;
+          Expression c = fused
+            ? attention(input(g, Dim({T, B, H}), enc), input(g, Dim({H, 1}, B), query))
+            : composed(g, states, query, B, H);
+          Expression loss = sum(c, -1);
+          loss.forward();
+          if (train) {
+            loss.backward();
+          }
+        }
+        us[fused][train] = seconds_since(start) / n_calls * 1e6;
+      }
+    }
+    std::cout << "T=" << T << ": forward " << us[0][0] << " us composed, " << us[1][0]
+      << " us fused (" << us[0][0] / us[1][0] << "x); forward + backward "
+      << us[0][1] << " us composed, " << us[1][1] << " us fused ("
+      << us[0][1] / us[1][1] << "x)" << std::endl;
+  }
+  return 0;
+}
@@ -0,0 +1,117 @@
+#include <math.h>
+
+#include <algorithm>
+#include <chrono>
+#include <iostream>
+#include <vector>
+
+#include "../src/decode.h"
+#include "../src/expr.h"
+#include "../src/graph.h"
+#include "../src/optimizer.h"
+#include "../src/rnn.h"
+#include "../src/rnnpp.h"
+
+using namespace rnnpp;
+
+static double seconds_since(std::chrono::system_clock::time_point start) {
+  return std::chrono::duration<double>(std::chrono::system_clock::now() - start).count();
+}
+
+// Beam search that builds a graph over the whole prefix of every
+// hypothesis at every step. Returns the number of tokens generated.
+static long graph_beam(LSTMBuilder &lstm, const LookupParameter &emb, const Parameter &w,
+    const Parameter &b, int beam_size, int bos, int eos, int max_length) {
+  int V = w.value.dim[0];
+  std::vector<std::vector<int>> beams(1, std::vector<int>(1, bos));
+  std::vector<float> scores(1, 0.f);
+  int n_finished = 0;
+  long n_steps = 0;
+  for (int t=0; t < max_length && !beams.empty(); ++t) {
+    std::vector<std::pair<float, int>> cand;
+    for (int k=0; k < beams.size(); ++k) {
+      Graph g;
+      lstm.start_new_sequence(g);
+      std::vector<std::vector<float>> xs;
+      for (int tok : beams[k]) {
+        const float *row = emb.value(tok).data;
+        xs.push_back(std::vector<float>(row, row + emb.all_values.dim[1]));
+      }
+      Expression h;
+      for (auto &x : xs) {
+        h = lstm.add_input(input(g, Dim({(int)x.size(), 1}), x));
+      }
+      Tensor y = (parameter(g, w) * h + parameter(g, b)).forward();
+      float lse = logsumexp(y.data, V);
+      for (int j=0; j < V; ++j) {
+        cand.push_back(std::make_pair(-(scores[k] + y.data[j] - lse), k * V + j));
+      }
+    }
+    int n = std::min(beam_size - n_finished, (int)cand.size());
+    std::partial_sort(cand.begin(), cand.begin() + n, cand.end());
+    std::vector<std::vector<int>> next;
+    std::vector<float> next_scores;
+    for (int i=0; i < n; ++i) {
+      int k = cand[i].second / V, j = cand[i].second % V;
+      if (j == eos) {
+        ++n_finished;
+      } else {
+        next.push_back(beams[k]);
+        next.back().push_back(j);
+        next_scores.push_back(-cand[i].first);
+      }
+    }
+    n_steps += n;
+    beams.swap(next);
+    scores.swap(next_scores);
+  }
+  return n_steps;
+}
+
+// Decoding throughput of BeamSearchDecoder against rebuilding a graph per
+// hypothesis, on an LSTM language model with random weights. Tokens are
+// those kept in the beam: one per hypothesis per step, summed over beams.
+//
+// usage: bench_beam [vocab_size] [dim] [max_length] [n_iter]
+int main(int argc, char** argv) {
+  int n_vocab = argc > 1 ? atoi(argv[1]) : 8000;
+  int dim = argc > 2 ? atoi(argv[2]) : 256;
+  int max_length = argc > 3 ? atoi(argv[3]) : 30;
+  int n_iter = argc > 4 ? atoi(argv[4]) : 3;
+
+  SGDOptimizer optimizer;
+  LSTMBuilder lstm(optimizer.model, dim, dim);
+  LookupParameter emb = optimizer.add_lookup_parameter({n_vocab, dim});
+  Parameter w = optimizer.add_parameter({n_vocab, dim});
+  Parameter b = optimizer.add_parameter({n_vocab, 1});
+  for (int i=0; i < w.value.dim.size(); ++i) {
+    w.value.data[i] = 0.3f * sinf(0.7f * i);
+  }
+  int bos = 0, eos = 1;
+
+  for (int beam_size : {1, 2, 4, 8, 16}) {
+    BeamSearchDecoder decoder(lstm, emb, w, b, beam_size);
+    decoder.decode(bos, eos, max_length);
+
+    long n_tokens = 0;
+    auto start = std::chrono::system_clock::now();
+    for (int it=0; it < n_iter; ++it) {
+      std::vector<Hypothesis> hyps = decoder.decode(bos, eos, max_length);
+      for (auto &hyp : hyps) {
+        n_tokens += hyp.tokens.size();
+      }
+    }
+    double sec = seconds_since(start);
+
+    // the graph version is quadratic in the length, so it gets a third
+    int graph_length = std::max(1, max_length / 3);
+    start = std::chrono::system_clock::now();
+    long n_graph = graph_beam(lstm, emb, w, b, beam_size, bos, eos, graph_length);
+    double graph_sec = seconds_since(start);
+
+    std::cout << "beam " << beam_size << ": decoder " << n_tokens / sec << " tokens/s, "
+      << "graph " << n_graph / graph_sec << " tokens/s (" << graph_length << " steps)"
+      << std::endl;
+  }
+  return 0;
+}
@@ -0,0 +1,129 @@
+#include <chrono>
+#include <iostream>
+#include <vector>
+
+#include "../src/expr.h"
+#include "../src/graph.h"
+#include "../src/optimizer.h"
+#include "../src/rnn.h"
+#include "../src/rnnpp.h"
+
+using namespace rnnpp;
+
+static double seconds_since(std::chrono::system_clock::time_point start) {
+  return std::chrono::duration<double>(std::chrono::system_clock::now() - start).count();
+}
+
+// n_steps GRU steps with the same cell composed of Mult, Add, sigmoid, tanh
+// and cmult nodes, one weight matrix per gate and projection.
+static Expression unfused_gru(Graph &g, std::vector<Parameter> &p, const Expression &x,
+    Expression h, int n_steps, std::vector<float> &minus_one) {
+  std::vector<Expression> e;
+  for (auto &q : p) {
+    e.push_back(parameter(g, q));
+  }
+  Expression neg = input(g, Dim({(int)minus_one.size(), 1}), minus_one);
+  for (int t=0; t < n_steps; ++t) {
+    Expression r = sigmoid(e[0] * x + e[1] * h + e[2]);
+    Expression z = sigmoid(e[3] * x + e[4] * h + e[5]);
+    Expression n = tanh(e[6] * x + cmult(r, e[7] * h + e[8]) + e[9]);
+    h = n + cmult(z, h + cmult(neg, n));
+  }
+  return h;
+}
+
+// Latency of one step of a fused GRUBuilder and of the unfused cell:
+// forward only on a single sequence, and forward+backward on a batch.
+//
+// usage: bench_gru [dim] [batch_size] [n_steps] [n_iter]
+int main(int argc, char** argv) {
+  int dim = argc > 1 ? atoi(argv[1]) : 128;
+  int n_batch = argc > 2 ? atoi(argv[2]) : 16;
+  int n_steps = argc > 3 ? atoi(argv[3]) : 20;
+  int n_iter = argc > 4 ? atoi(argv[4]) : 3;
+
+  std::vector<float> x_val(dim * n_batch, 0.1f);
+  std::vector<float> zeros(dim * n_batch, 0.f);
+  std::vector<float> minus_one(dim, -1.f);
+
+  SGDOptimizer optimizer;
+  GRUBuilder gru(optimizer.model, dim, dim);
+  std::vector<Parameter> p;
+  for (int k=0; k < 3; ++k) {
+    p.push_back(optimizer.add_parameter({dim, dim}));
+    p.push_back(optimizer.add_parameter({dim, dim}));
+    p.push_back(optimizer.add_parameter({dim, 1}));
+  }
+  p.push_back(optimizer.add_parameter({dim, 1}));
+
+  for (int batch : {1, n_batch}) {
+    bool train = batch > 1;
+    double fused = 0., unfused = 0.;
+    for (int it=0; it < n_iter; ++it) {
+      auto start = std::chrono::system_clock::now();
+      {
+        Graph g;
+        gru.start_new_sequence(g, batch);
+        Expression x = input(g, Dim({dim, 1}, batch), x_val);
+        Expression h;
+        for (int t=0; t < n_steps; ++t) {
+          h = gru.add_input(x);
+        }
+        Expression e = sum(h, -1);
+        e.forward();
+        if (train) e.backward();
+      }
+      fused += seconds_since(start);
+
+      start = std::chrono::system_clock::now();
+      {
+        Graph g;
+        Expression x = input(g, Dim({dim, 1}, batch), x_val);
+        Expression h0 = input(g, Dim({dim, 1}, batch), zeros);
+        Expression e = sum(unfused_gru(g, p, x, h0, n_steps, minus_one), -1);
+        e.forward();
+        if (train) e.backward();
+      }
+      unfused += seconds_since(start);
+    }
+    double scale = 1e6 / n_iter / n_steps;
+    std::cout << (train ? "forward+backward" : "forward") << ", batch " << batch
+      << ": fused " << fused * scale << " us/step, unfused " << unfused * scale
+      << " us/step" << std::endl;
+  }
+
+  // the whole sequence in one GRUSequence node against one GRUCell per step
+  std::vector<float> seq((size_t)n_steps * n_batch * dim, 0.1f);
+  double steps = 0., sequence = 0.;
+  for (int it=0; it < n_iter; ++it) {
+    auto start = std::chrono::system_clock::now();
+    {
+      Graph g;
+      gru.start_new_sequence(g, n_batch);
+      Expression x = input(g, Dim({dim, 1}, n_batch), x_val);
+      Expression h;
+      for (int t=0; t < n_steps; ++t) {
+        h = gru.add_input(x);
+      }
+      Expression e = sum(h, -1);
+      e.forward();
+      e.backward();
+    }
+    steps += seconds_since(start);
+
+    start = std::chrono::system_clock::now();
+    {
+      Graph g;
+      gru.start_new_sequence(g, n_batch);
+      Expression e = sum(gru.transduce(input(g, Dim({n_steps, n_batch, dim}), seq)), -1);
+      e.forward();
+      e.backward();
+    }
+    sequence += seconds_since(start);
+  }
+  double scale = 1e6 / n_iter / n_steps;
+  std::cout << "forward+backward, batch " << n_batch << ": per-step nodes "
+    << steps * scale << " us/step, sequence node " << sequence * scale << " us/step"
+    << std::endl;
+  return 0;
+}
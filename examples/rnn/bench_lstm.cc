@@ -0,0 +1,88 @@
+#include <chrono>
+#include <iostream>
+#include <vector>
+
+#include "../src/expr.h"
+#include "../src/graph.h"
+#include "../src/optimizer.h"
+#include "../src/rnn.h"
+#include "../src/rnnpp.h"
+
+using namespace rnnpp;
+
+static double seconds_since(std::chrono::system_clock::time_point start) {
+  return std::chrono::duration<double>(std::chrono::system_clock::now() - start).count();
+}
+
+// Forward and backward of n_steps LSTM steps on a batch, with the fused
+// LSTMBuilder and with the same cell composed of Mult, Add, sigmoid, tanh
+// and cmult nodes.
+//
+// usage: bench_lstm [dim] [batch_size] [n_steps] [n_iter]
+int main(int argc, char** argv) {
+  int dim = argc > 1 ? atoi(argv[1]) : 128;
+  int n_batch = argc > 2 ? atoi(argv[2]) : 16;
+  int n_steps = argc > 3 ? atoi(argv[3]) : 20;
+  int n_iter = argc > 4 ? atoi(argv[4]) : 3;
+
+  std::vector<float> x_val(dim * n_batch, 0.1f);
+  std::vector<float> zeros(dim * n_batch, 0.f);
+
+  SGDOptimizer optimizer;
+  LSTMBuilder lstm(optimizer.model, dim, dim);
+  {
+    auto start = std::chrono::system_clock::now();
+    for (int it=0; it < n_iter; ++it) {
+      Graph g;
+      lstm.start_new_sequence(g, n_batch);
+      Expression x = input(g, Dim({dim, 1}, n_batch), x_val);
+      Expression h;
+      for (int t=0; t < n_steps; ++t) {
+        h = lstm.add_input(x);
+      }
+      Expression e = sum(h, -1);
+      e.forward();
+      e.backward();
+    }
+    double us = seconds_since(start) / n_iter / n_steps * 1e6;
+    std::cout << "fused:   " << us << " us/step, 2 nodes/step" << std::endl;
+  }
+
+  std::vector<Parameter> w, b;
+  for (int k=0; k < 4; ++k) {
+    w.push_back(optimizer.add_parameter({dim, 2 * dim}));
+    b.push_back(optimizer.add_parameter({dim, 1}));
+  }
+  {
+    auto start = std::chrono::system_clock::now();
+    int n_nodes = 0;
+    for (int it=0; it < n_iter; ++it) {
+      Graph g;
+      std::vector<Expression> we, be;
+      for (int k=0; k < 4; ++k) {
+        we.push_back(parameter(g, w[k]));
+        be.push_back(parameter(g, b[k]));
+      }
+      Expression x = input(g, Dim({dim, 1}, n_batch), x_val);
+      Expression h = input(g, Dim({dim, 1}, n_batch), zeros);
+      Expression c = h;
+      int before = g.nodes().size();
+      for (int t=0; t < n_steps; ++t) {
+        Expression xh = concat({x, h}, 0);
+        Expression in = sigmoid(we[0] * xh + be[0]);
+        Expression forget = sigmoid(we[1] * xh + be[1]);
+        Expression cell = tanh(we[2] * xh + be[2]);
+        Expression out = sigmoid(we[3] * xh + be[3]);
+        c = cmult(forget, c) + cmult(in, cell);
+        h = cmult(out, tanh(c));
+      }
+      n_nodes = (g.nodes().size() - before) / n_steps;
+      Expression e = sum(h, -1);
+      e.forward();
+      e.backward();
+    }
+    double us = seconds_since(start) / n_iter / n_steps * 1e6;
+    std::cout << "unfused: " << us << " us/step, " << n_nodes << " nodes/step" << std::endl;
+  }
+  return 0;
+}
@@ -0,0 +1,89 @@
+#include <math.h>
+
+#include <algorithm>
+#include <chrono>
+#include <iostream>
+#include <random>
+#include <vector>
+
+#include "../src/expr.h"
+#include "../src/graph.h"
+#include "../src/optimizer.h"
+#include "../src/rnn.h"
+#include "../src/rnnpp.h"
+
+using namespace rnnpp;
+
+static double seconds_since(std::chrono::system_clock::time_point start) {
+  return std::chrono::duration<double>(std::chrono::system_clock::now() - start).count();
+}
+
+// Forward and backward of a GRU over minibatches of sentences whose
+// lengths follow a log-normal distribution (median 18, 1 to 100 tokens),
+// padded to the longest sentence of each minibatch or packed. Tokens/s
+// counts only the real tokens.
+//
+// usage: bench_packed [dim] [batch_size] [n_batches]
+int main(int argc, char** argv) {
+  int dim = argc > 1 ? atoi(argv[1]) : 128;
+  int n_batch = argc > 2 ? atoi(argv[2]) : 32;
+  int n_batches = argc > 3 ? atoi(argv[3]) : 10;
+
+  std::mt19937 gen(1);
+  std::lognormal_distribution<double> length(log(18.), 0.6);
+  std::vector<std::vector<std::vector<float>>> batches(n_batches);
+  long n_tokens = 0, n_padded = 0;
+  for (auto &batch : batches) {
+    int max_len = 0;
+    for (int b=0; b < n_batch; ++b) {
+      int len = std::min(100, std::max(1, (int)length(gen)));
+      batch.push_back(std::vector<float>((size_t)len * dim, 0.1f));
+      max_len = std::max(max_len, len);
+      n_tokens += len;
+    }
+    n_padded += (long)max_len * n_batch;
+  }
+  std::cout << n_tokens << " tokens, " << n_padded << " with padding" << std::endl;
+
+  SGDOptimizer optimizer;
+  GRUBuilder gru(optimizer.model, dim, dim);
+
+  double padded = 0.;
+  for (auto &batch : batches) {
+    int max_len = 0;
+    for (auto &s : batch) {
+      max_len = std::max(max_len, (int)s.size() / dim);
+    }
+    // zero padding in time major order
+    std::vector<float> xs((size_t)max_len * n_batch * dim, 0.f);
+    for (int b=0; b < n_batch; ++b) {
+      for (size_t i=0; i < batch[b].size(); ++i) {
+        xs[((i / dim) * n_batch + b) * dim + i % dim] = batch[b][i];
+      }
+    }
+    auto start = std::chrono::system_clock::now();
+    Graph g;
+    gru.start_new_sequence(g, n_batch);
+    Expression e = sum(gru.transduce(input(g, Dim({max_len, n_batch, dim}), xs)), -1);
+    e.forward();
+    e.backward();
+    padded += seconds_since(start);
+  }
+
+  double packed = 0.;
+  for (auto &batch : batches) {
+    auto start = std::chrono::system_clock::now();
+    PackedSequences p = pack_sequences(batch, dim);
+    Graph g;
+    gru.start_new_sequence(g, n_batch);
+    Expression xs = input(g, Dim({dim, 1}, p.n_tokens()), p.data);
+    Expression e = sum(gru.transduce(xs, p.batch_sizes), -1);
+    e.forward();
+    e.backward();
+    packed += seconds_since(start);
+  }
+
+  std::cout << "padded: " << n_tokens / padded << " tokens/s" << std::endl;
+  std::cout << "packed: " << n_tokens / packed << " tokens/s (including packing)" << std::endl;
+  return 0;
+}
@@ -0,0 +1,59 @@
+#include <chrono>
+#include <iostream>
+#include <thread>
+#include <vector>
+
+#include "../src/expr.h"
+#include "../src/graph.h"
+#include "../src/optimizer.h"
+#include "../src/rnn.h"
+#include "../src/rnnpp.h"
+
+using namespace rnnpp;
+
+static double seconds_since(std::chrono::system_clock::time_point start) {
+  return std::chrono::duration<double>(std::chrono::system_clock::now() - start).count();
+}
+
+// Forward and backward of a 4 layer StackedGRUBuilder over one minibatch
+// of sequences on 1 thread and on 2, 4, ... max_threads, forward only and
+// bidirectional.
+//
+// usage: bench_stacked_gru [max_threads] [dim] [batch_size] [n_steps] [n_iter]
+int main(int argc, char** argv) {
+  int max_threads = argc > 1 ? atoi(argv[1]) : std::thread::hardware_concurrency();
+  int dim = argc > 2 ? atoi(argv[2]) : 128;
+  int n_batch = argc > 3 ? atoi(argv[3]) : 16;
+  int n_steps = argc > 4 ? atoi(argv[4]) : 20;
+  int n_iter = argc > 5 ? atoi(argv[5]) : 3;
+  const int n_layers = 4;
+
+  std::vector<float> xs((size_t)n_steps * n_batch * dim, 0.1f);
+  for (bool bidirectional : {false, true}) {
+    SGDOptimizer optimizer;
+    StackedGRUBuilder rnn(optimizer.model, n_layers, dim, dim, bidirectional);
+    double serial = 0.;
+    for (int nt=1; nt <= max_threads; nt *= 2) {
+      rnn.num_threads = nt;
+      double sec = 0.;
+      // the first iteration is not timed
+      for (int it=0; it <= n_iter; ++it) {
+        auto start = std::chrono::system_clock::now();
+        Graph g;
+        Expression e = sum(rnn.transduce(input(g, Dim({n_steps, n_batch, dim}), xs)), -1);
+        e.forward();
+        e.backward();
+        if (it > 0) {
+          sec += seconds_since(start);
+        }
+      }
+      sec /= n_iter;
+      if (nt == 1) {
+        serial = sec;
+      }
+      std::cout << (bidirectional ? "bidirectional" : "forward") << ", " << nt
+        << " threads: " << sec * 1e3 << " ms/batch, speedup " << serial / sec << std::endl;
+    }
+  }
+  return 0;
+}
@@ -0,0 +1,114 @@
+#include <math.h>
+#include <stdio.h>
+#include <unistd.h>
+
+#include <chrono>
+#include <iostream>
+#include <vector>
+
+#include "../src/expr.h"
+#include "../src/graph.h"
+#include "../src/optimizer.h"
+#include "../src/rnn.h"
+#include "../src/rnnpp.h"
+#include "../src/trainer.h"
+
+using namespace rnnpp;
+
+static double seconds_since(std::chrono::system_clock::time_point start) {
+  return std::chrono::duration<double>(std::chrono::system_clock::now() - start).count();
+}
+
+// resident memory in MB
+static double rss_mb() {
+  long pages = 0, resident = 0;
+  FILE *fp = fopen("/proc/self/statm", "r");
+  if (fp) {
+    if (fscanf(fp, "%ld %ld", &pages, &resident) != 2) resident = 0;
+    fclose(fp);
+  }
+  return resident * (double)sysconf(_SC_PAGESIZE) / (1 << 20);
+}
+
+const int kDim = 64;
+const int kSteps = 20;
+
+// steps w * kSteps ... (w + 1) * kSteps of a synthetic stream
+static void read_window(int w, std::vector<float> &inputs) {
+  inputs.resize((size_t)(kSteps + 1) * kDim);
+  for (int t=0; t <= kSteps; ++t) {
+    for (int k=0; k < kDim; ++k) {
+      inputs[t * kDim + k] = 0.5f * sin(0.01f * (w * kSteps + t) * (k + 1));
+    }
+  }
+}
+
+// an LSTM predicting the next input of the stream
+static Expression window_loss(Graph &g, LSTMBuilder &lstm, Parameter &w_out,
+    std::vector<float> &inputs, Expression &state) {
+  lstm.start_new_sequence(g, state);
+  Expression w = parameter(g, w_out);
+  Expression e;
+  for (int t=0; t < kSteps; ++t) {
+    Tensor x, y;
+    x.dim = y.dim = Dim({kDim, 1});
+    x.data = &inputs[t * kDim];
+    y.data = &inputs[(t + 1) * kDim];
+    Expression d = squared_distance(w * lstm.add_input(input(g, x)), input(g, y));
+    e = t == 0 ? d : e + d;
+  }
+  state = lstm.state();
+  return e;
+}
+
+// Truncated BPTT over a stream in windows of kSteps steps, with
+// TruncatedBPTTTrainer and with a new Graph per window and the state
+// copied out, reporting time per window and resident memory.
+//
+// usage: bench_tbptt [n_windows]
+int main(int argc, char** argv) {
+  int n_windows = argc > 1 ? atoi(argv[1]) : 400;
+  int report = n_windows / 4;
+
+  {
+    SGDOptimizer optimizer(0.01);
+    LSTMBuilder lstm(optimizer.model, kDim, kDim);
+    Parameter w_out = optimizer.add_parameter({kDim, kDim});
+    TruncatedBPTTTrainer trainer(optimizer, Dim({2 * kDim, 1}));
+    WindowLoss loss = [&](Graph &g, std::vector<float> &inputs, Expression &state) {
+      return window_loss(g, lstm, w_out, inputs, state);
+    };
+    for (int done=0; done < n_windows; done += report) {
+      auto start = std::chrono::system_clock::now();
+      trainer.train(report, read_window, loss);
+      std::cout << "trainer, " << done + report << " windows: "
+        << seconds_since(start) / report * 1e3 << " ms/window, rss " << rss_mb() << " MB"
+        << std::endl;
+    }
+  }
+
+  {
+    SGDOptimizer optimizer(0.01);
+    LSTMBuilder lstm(optimizer.model, kDim, kDim);
+    Parameter w_out = optimizer.add_parameter({kDim, kDim});
+    std::vector<float> state(2 * kDim, 0.f), inputs;
+    for (int done=0; done < n_windows; done += report) {
+      auto start = std::chrono::system_clock::now();
+      for (int w=done; w < done + report; ++w) {
+        Graph g;
+        read_window(w, inputs);
+        Expression s = input(g, Dim({2 * kDim, 1}), state);
+        Expression e = window_loss(g, lstm, w_out, inputs, s);
+        e.forward();
+        e.backward();
+        optimizer.update();
+        const Tensor &next = g.outputs[s.id()];
+        state.assign(next.data, next.data + 2 * kDim);
+      }
+      std::cout << "graph per window, " << done + report << " windows: "
+        << seconds_since(start) / report * 1e3 << " ms/window, rss " << rss_mb() << " MB"
+        << std::endl;
+    }
+  }
+  return 0;
+}
@@ -0,0 +1,106 @@
+#include <math.h>
+
+#include <chrono>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include "../src/arena.h"
+#include "../src/expr.h"
+#include "../src/graph.h"
+#include "../src/optimizer.h"
+#include "../src/rnnpp.h"
+#include "../src/softmax.h"
+
+using namespace rnnpp;
+
+static double seconds_since(std::chrono::system_clock::time_point start) {
+  return std::chrono::duration<double>(std::chrono::system_clock::now() - start).count();
+}
+
+// A bigram stream over a Zipf vocabulary: the next word is a fixed
+// successor of the current one half of the time and a Zipf draw
+// otherwise.
+struct Corpus {
+  Corpus(const std::vector<float> &counts, int n_tokens) {
+    AliasSampler zipf(counts, 1);
+    AliasSampler coin({1., 1.}, 2);
+    std::vector<int> successor(counts.size());
+    zipf.sample(successor.size(), successor.data());
+    tokens.push_back(0);
+    for (int t=1; t < n_tokens; ++t) {
+      tokens.push_back(coin.sample() ? successor[tokens.back()] : zipf.sample());
+    }
+  }
+
+  std::vector<int> tokens;
+};
+
+// Trains a bigram model h = tanh(E[previous word]) with a full softmax,
+// a sampled softmax and a class factored softmax over the same tokens,
+// then reports -log p of held-out tokens as perplexity, with all V words
+// for the first two.
+//
+// usage: bench_softmax [n_vocab] [dim] [batch_size] [n_batches] [n_samples]
+int main(int argc, char** argv) {
+  int n_vocab = argc > 1 ? atoi(argv[1]) : 100000;
+  int dim = argc > 2 ? atoi(argv[2]) : 64;
+  int n_batch = argc > 3 ? atoi(argv[3]) : 64;
+  int n_batches = argc > 4 ? atoi(argv[4]) : 200;
+  int n_samples = argc > 5 ? atoi(argv[5]) : 512;
+  int n_eval = 20;
+
+  std::vector<float> counts(n_vocab);
+  for (int i=0; i < n_vocab; ++i) {
+    counts[i] = 1e6f / powf(i + 1, 1.1f);
+  }
+  Corpus corpus(counts, (n_batches + n_eval) * n_batch + 1);
+  int n_classes = (int)sqrtf(n_vocab);
+
+  for (std::string method : {"full", "sampled", "class"}) {
+    AdagradOptimizer optimizer;
+    LookupParameter emb = optimizer.add_lookup_parameter({n_vocab, dim});
+    SampledSoftmaxBuilder sampled(optimizer.model, dim, counts, n_samples);
+    ClassFactoredSoftmaxBuilder factored(optimizer.model, dim,
+        frequency_classes(counts, n_classes));
+
+    auto batch = [&](Graph &g, int k, bool train) {
+      std::vector<int> prev(corpus.tokens.begin() + k * n_batch,
+          corpus.tokens.begin() + (k + 1) * n_batch);
+      std::vector<int> next(corpus.tokens.begin() + k * n_batch + 1,
+          corpus.tokens.begin() + (k + 1) * n_batch + 1);
+      Expression h = tanh(lookup(g, emb, prev));
+      if (method == "class") return factored.loss(h, next);
+      if (method == "sampled" && train) return sampled.loss(h, next);
+      return sampled.full_loss(h, next);
+    };
+
+    // graphs of the full softmax hold several (V, H) tensors
+    Arena arena;
+    auto start = std::chrono::system_clock::now();
+    for (int k=0; k < n_batches; ++k) {
+      arena.reset();
+      ArenaScope scope(arena);
+      Graph g;
+      Expression loss = batch(g, k, true);
+      loss.forward();
+      loss.backward();
+      optimizer.update();
+    }
+    double sec = seconds_since(start);
+
+    double nll = 0.;
+    for (int k=n_batches; k < n_batches + n_eval; ++k) {
+      arena.reset();
+      ArenaScope scope(arena);
+      Graph g;
+      const Tensor &y = batch(g, k, false).forward();
+      for (int b=0; b < n_batch; ++b) {
+        nll += y.data[b];
+      }
+    }
+    std::cout << method << ": " << n_batches * n_batch / sec << " tokens/s, perplexity "
+      << exp(nll / (n_eval * n_batch)) << std::endl;
+  }
+  return 0;
+}
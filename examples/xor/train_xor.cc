@@ -1,5 +1,6 @@
 #include <iostream>
 
+#include "../src/dtype.h"
 #include "../src/expr.h"
 #include "../src/rnnpp.h"
 #include "../src/node.h"
@@ -8,9 +9,11 @@
 
 using namespace rnnpp;
 
+// usage: train_xor [float32|float16|bfloat16]
 int main(int argc, char** argv) {
   Graph g;
-  Optimizer optimizer;
+  SGDOptimizer optimizer;
+  DType dtype = argc > 1 ? dtype_from_name(argv[1]) : kFloat32;
 
   std::vector<float> x_val{
     1., 2.,
@@ -23,10 +26,10 @@ int main(int argc, char** argv) {
   Expression y = input(g, Dim({1, 1}, 1), y_val);
 
   int n_hidden = 4;
-  Parameter p_w = optimizer.add_parameter({n_hidden, 2});
-  Parameter p_b = optimizer.add_parameter({n_hidden, 1});
-  Parameter p_w2 = optimizer.add_parameter({1, n_hidden});
-  Parameter p_b2 = optimizer.add_parameter({1, 1});
+  Parameter p_w = optimizer.add_parameter({n_hidden, 2}, dtype);
+  Parameter p_b = optimizer.add_parameter({n_hidden, 1}, dtype);
+  Parameter p_w2 = optimizer.add_parameter({1, n_hidden}, dtype);
+  Parameter p_b2 = optimizer.add_parameter({1, 1}, dtype);
 
   Expression w = parameter(g, p_w);
   Expression b = parameter(g, p_b);
@@ -1,6 +1,8 @@
 #include <iostream>
 
+#include "../src/dtype.h"
 #include "../src/expr.h"
+#include "../src/lazy.h"
 #include "../src/rnnpp.h"
 #include "../src/node.h"
 #include "../src/optimizer.h"
@@ -8,9 +10,11 @@
 
 using namespace rnnpp;
 
+// usage: train_xor_batch [float32|float16|bfloat16]
 int main(int argc, char** argv) {
   Graph g;
-  Optimizer optimizer;
+  SGDOptimizer optimizer;
+  DType dtype = argc > 1 ? dtype_from_name(argv[1]) : kFloat32;
 
   int n_batch = 4;
 
@@ -28,10 +32,10 @@ int main(int argc, char** argv) {
   Expression y = input(g, Dim({1, 1}, n_batch), y_val);
 
   int n_hidden = 8;
-  Parameter p_w = optimizer.add_parameter({n_hidden, 2});
-  Parameter p_b = optimizer.add_parameter({n_hidden, 1});
-  Parameter p_w2 = optimizer.add_parameter({1, n_hidden});
-  Parameter p_b2 = optimizer.add_parameter({1, 1});
+  Parameter p_w = optimizer.add_parameter({n_hidden, 2}, dtype);
+  Parameter p_b = optimizer.add_parameter({n_hidden, 1}, dtype);
+  Parameter p_w2 = optimizer.add_parameter({1, n_hidden}, dtype);
+  Parameter p_b2 = optimizer.add_parameter({1, 1}, dtype);
 
   Expression w = parameter(g, p_w);
   Expression b = parameter(g, p_b);
@@ -41,10 +45,9 @@ int main(int argc, char** argv) {
   Expression h = tanh(w * x + b);
   Expression y_pred = w2 * h + b2;
 
-  Expression losses = squared_distance(y_pred, y);
-
+  // squared distance, sum along batch and mean in one node
   int axis = 2;
-  Expression loss = sum(losses, axis)/n_batch;
+  Expression loss = sum(square(lazy(y_pred) - lazy(y)), axis) / n_batch;
 
   for (int i=0; i < 30; ++i) {
     float err = as_scalar(loss.forward());
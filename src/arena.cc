@@ -0,0 +1,65 @@
+#include <algorithm>
+
+#include "arena.h"
+
+namespace rnnpp {
+
+static thread_local Arena *current_arena = nullptr;
+
+Arena::~Arena() {
+  for (int i=0; i < blocks_.size(); ++i) {
+    delete[] blocks_[i];
+  }
+}
+
+float *Arena::allocate(size_t n) {
+  // 64 byte aligned offsets within a block
+  n = (n + 15) / 16 * 16;
+  while (current_ < blocks_.size() && used_ + n > sizes_[current_]) {
+    ++current_;
+    used_ = 0;
+  }
+  if (current_ == blocks_.size()) {
+    size_t size = std::max(n, std::max(min_block_, 2 * capacity()));
+    blocks_.push_back(new float[size]);
+    sizes_.push_back(size);
+  }
+  float *p = blocks_[current_] + used_;
+  used_ += n;
+  return p;
+}
+
+void Arena::reset() {
+  if (blocks_.size() > 1) {
+    size_t size = capacity();
+    for (int i=0; i < blocks_.size(); ++i) {
+      delete[] blocks_[i];
+    }
+    blocks_.assign(1, new float[size]);
+    sizes_.assign(1, size);
+  }
+  current_ = 0;
+  used_ = 0;
+}
+
+size_t Arena::capacity() const {
+  size_t n = 0;
+  for (int i=0; i < sizes_.size(); ++i) {
+    n += sizes_[i];
+  }
+  return n;
+}
+
+ArenaScope::ArenaScope(Arena &arena): prev_(current_arena) {
+  current_arena = &arena;
+}
+
+ArenaScope::~ArenaScope() {
+  current_arena = prev_;
+}
+
+float *alloc_floats(size_t n) {
+  return current_arena ? current_arena->allocate(n) : new float[n];
+}
+
+} // namespace rnnpp
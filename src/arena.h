@@ -0,0 +1,63 @@
+#ifndef RNNPP_ARENA_H_
+#define RNNPP_ARENA_H_
+
+#include <stddef.h>
+
+#include <vector>
+
+namespace rnnpp {
+
+/**
+ * Bump allocator for the outputs and gradients of a graph.
+ * Nothing is freed one by one: reset() releases everything at once and
+ * keeps the memory, so building the same graph again allocates nothing.
+ * If a pass needed several blocks, reset() replaces them by one block of
+ * their total size.
+ */
+class Arena {
+  public:
+    Arena(size_t min_block=1 << 16): min_block_(min_block), current_(0), used_(0) {}
+
+    ~Arena();
+
+    float *allocate(size_t n);
+
+    void reset();
+
+    // floats held by the arena
+    size_t capacity() const;
+
+  private:
+    Arena(const Arena&);
+    Arena &operator=(const Arena&);
+
+    size_t min_block_;
+    std::vector<float*> blocks_;
+    std::vector<size_t> sizes_;
+    int current_;
+    size_t used_;
+};
+
+/**
+ * Makes alloc_floats() allocate from arena on this thread until the scope
+ * ends.
+ */
+class ArenaScope {
+  public:
+    ArenaScope(Arena &arena);
+
+    ~ArenaScope();
+
+  private:
+    Arena *prev_;
+};
+
+/**
+ * Storage for the tensors of a graph: from the arena of the innermost
+ * ArenaScope of the calling thread, or new[] without one.
+ */
+float *alloc_floats(size_t n);
+
+} // namespace rnnpp
+
+#endif // RNNPP_ARENA_H_
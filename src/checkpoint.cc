@@ -0,0 +1,286 @@
+#include <fcntl.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+
+#include "checkpoint.h"
+#include "error.h"
+
+namespace rnnpp {
+
+static const char kMagic[8] = {'R', 'N', 'N', 'P', 'P', 'C', 'K', 'P'};
+
+static uint64_t round_up(uint64_t n, uint64_t m) {
+  return (n + m - 1) / m * m;
+}
+
+template<typename T>
+static void put(std::string &buf, T v) {
+  buf.append(reinterpret_cast<const char*>(&v), sizeof(T));
+}
+
+template<typename T>
+static T get(const std::string &buf, size_t &pos) {
+  RNNPP_CHECK(pos + sizeof(T) <= buf.size(), "Truncated checkpoint header");
+  T v;
+  memcpy(&v, buf.data() + pos, sizeof(T));
+  pos += sizeof(T);
+  return v;
+}
+
+static bool by_offset(const CheckpointEntry &a, const CheckpointEntry &b) {
+  return a.offset < b.offset;
+}
+
+// entries of model in the order they appear in its values buffer
+static std::vector<CheckpointEntry> entries_of(const ParameterCollection &model) {
+  std::vector<CheckpointEntry> entries;
+  const char *base = reinterpret_cast<const char*>(model.values());
+  for (int i=0; i < model.parameters.size(); ++i) {
+    const Parameter &p = model.parameters[i];
+    const char *v = p.dtype == kFloat32 ? reinterpret_cast<const char*>(p.value.data)
+                                        : reinterpret_cast<const char*>(p.packed);
+    CheckpointEntry e;
+    e.name = model.parameter_names[i];
+    e.kind = 0;
+    e.dtype = p.dtype;
+    e.dim = p.value.dim;
+    e.offset = v - base;
+    e.nbytes = p.value.dim.elements() * dtype_size(p.dtype);
+    entries.push_back(e);
+  }
+  for (int i=0; i < model.lookup_parameters.size(); ++i) {
+    const LookupParameter &p = model.lookup_parameters[i];
+    const char *v = p.dtype == kFloat32 ? reinterpret_cast<const char*>(p.all_values.data)
+                                        : reinterpret_cast<const char*>(p.packed);
+    CheckpointEntry e;
+    e.name = model.lookup_parameter_names[i];
+    e.kind = 1;
+    e.dtype = p.dtype;
+    e.dim = p.all_values.dim;
+    e.offset = v - base;
+    e.nbytes = p.all_values.dim.elements() * dtype_size(p.dtype);
+    entries.push_back(e);
+  }
+  std::sort(entries.begin(), entries.end(), by_offset);
+  return entries;
+}
+
+void save_checkpoint(const std::string &path, const ParameterCollection &model) {
+  std::vector<CheckpointEntry> entries = entries_of(model);
+  uint64_t payload_size = model.values_size() * sizeof(float);
+
+  std::string header;
+  for (int i=0; i < entries.size(); ++i) {
+    const CheckpointEntry &e = entries[i];
+    put<uint32_t>(header, e.kind);
+    put<uint32_t>(header, e.dtype);
+    put<uint32_t>(header, e.dim.shape.size());
+    for (int k=0; k < e.dim.shape.size(); ++k) {
+      put<int32_t>(header, e.dim.shape[k]);
+    }
+    put<uint64_t>(header, e.offset);
+    put<uint64_t>(header, e.nbytes);
+    put<uint32_t>(header, e.name.size());
+    header.append(e.name);
+  }
+  uint64_t fixed = sizeof(kMagic) + 2 * sizeof(uint32_t) + 2 * sizeof(uint64_t);
+  uint64_t payload_offset = round_up(fixed + header.size(), kCheckpointPageSize);
+
+  std::string head(kMagic, sizeof(kMagic));
+  put<uint32_t>(head, kCheckpointVersion);
+  put<uint32_t>(head, entries.size());
+  put<uint64_t>(head, payload_offset);
+  put<uint64_t>(head, payload_size);
+  head.append(header);
+  head.resize(payload_offset, '\0');
+
+  FILE *fp = fopen(path.c_str(), "wb");
+  RNNPP_CHECK(fp != nullptr, "Cannot open " << path);
+
+  // the payload is written straight from the values buffer
+  std::string tail(round_up(payload_size, kCheckpointPageSize) - payload_size, '\0');
+  bool ok = fwrite(head.data(), 1, head.size(), fp) == head.size();
+  ok = ok && fwrite(model.values(), 1, payload_size, fp) == payload_size;
+  ok = ok && fwrite(tail.data(), 1, tail.size(), fp) == tail.size();
+  ok = fclose(fp) == 0 && ok;
+  RNNPP_CHECK(ok, "Failed to write " << path);
+}
+
+std::vector<CheckpointEntry> read_checkpoint_header(const std::string &path,
+    uint64_t *payload_offset, uint64_t *payload_size) {
+  FILE *fp = fopen(path.c_str(), "rb");
+  RNNPP_CHECK(fp != nullptr, "Cannot open " << path);
+
+  size_t fixed = sizeof(kMagic) + 2 * sizeof(uint32_t) + 2 * sizeof(uint64_t);
+  std::string buf(fixed, '\0');
+  bool ok = fread(&buf[0], 1, fixed, fp) == fixed;
+  if (!ok || memcmp(buf.data(), kMagic, sizeof(kMagic)) != 0) {
+    fclose(fp);
+    RNNPP_CHECK(false, path << " is not a checkpoint");
+  }
+
+  size_t pos = sizeof(kMagic);
+  uint32_t version = get<uint32_t>(buf, pos);
+  uint32_t n_entries = get<uint32_t>(buf, pos);
+  uint64_t offset = get<uint64_t>(buf, pos);
+  uint64_t size = get<uint64_t>(buf, pos);
+  // files written with smaller pages are still read; load_checkpoint
+  // only maps the payload when it is page aligned here
+  if (version != kCheckpointVersion || offset < fixed || offset % 64 != 0) {
+    fclose(fp);
+    RNNPP_CHECK(false, "Unsupported checkpoint " << path << " (version " << version << ")");
+  }
+
+  buf.resize(offset);
+  ok = fread(&buf[fixed], 1, offset - fixed, fp) == offset - fixed;
+  fclose(fp);
+  RNNPP_CHECK(ok, "Truncated checkpoint " << path);
+
+  std::vector<CheckpointEntry> entries(n_entries);
+  for (int i=0; i < n_entries; ++i) {
+    CheckpointEntry &e = entries[i];
+    e.kind = get<uint32_t>(buf, pos);
+    e.dtype = static_cast<DType>(get<uint32_t>(buf, pos));
+    uint32_t ndim = get<uint32_t>(buf, pos);
+    RNNPP_CHECK(ndim <= 8, "Invalid number of dimensions: " << ndim);
+    std::vector<int> shape(ndim);
+    for (int k=0; k < ndim; ++k) {
+      shape[k] = get<int32_t>(buf, pos);
+    }
+    e.dim = Dim(shape);
+    e.offset = get<uint64_t>(buf, pos);
+    e.nbytes = get<uint64_t>(buf, pos);
+    uint32_t len = get<uint32_t>(buf, pos);
+    RNNPP_CHECK(pos + len <= buf.size(), "Truncated checkpoint header");
+    e.name = buf.substr(pos, len);
+    pos += len;
+    RNNPP_CHECK(e.offset + e.nbytes <= size, "Entry " << e.name << " is out of range");
+  }
+
+  if (payload_offset) *payload_offset = offset;
+  if (payload_size) *payload_size = size;
+  return entries;
+}
+
+void load_checkpoint(const std::string &path, ParameterCollection &model) {
+  uint64_t payload_offset, payload_size;
+  std::vector<CheckpointEntry> entries =
+    read_checkpoint_header(path, &payload_offset, &payload_size);
+  std::sort(entries.begin(), entries.end(), by_offset);
+
+  if (model.parameters.empty() && model.lookup_parameters.empty()) {
+    RNNPP_CHECK(payload_size <= model.capacity() * sizeof(float),
+        path << " needs a ParameterCollection with a capacity of at least "
+        << payload_size / sizeof(float) << " floats, not " << model.capacity());
+    for (int i=0; i < entries.size(); ++i) {
+      const CheckpointEntry &e = entries[i];
+      if (e.kind == 0) {
+        model.place_parameter(e.dim, e.dtype, e.name);
+      } else {
+        model.place_lookup_parameter(e.dim, e.dtype, e.name);
+      }
+    }
+  }
+
+  // the layout is deterministic, so it matches if the same parameters were
+  // added in the same order
+  std::vector<CheckpointEntry> expected = entries_of(model);
+  RNNPP_CHECK(expected.size() == entries.size(),
+      path << " has " << entries.size() << " parameters, expected " << expected.size());
+  for (int i=0; i < entries.size(); ++i) {
+    const CheckpointEntry &a = entries[i];
+    const CheckpointEntry &b = expected[i];
+    RNNPP_CHECK(a.name == b.name && a.kind == b.kind && a.dtype == b.dtype &&
+        a.dim.shape == b.dim.shape && a.offset == b.offset,
+        "Parameter " << a.name << " " << a.dim << " in " << path
+        << " does not match " << b.name << " " << b.dim);
+  }
+  RNNPP_CHECK(model.values_size() * sizeof(float) == payload_size,
+      "Payload size of " << path << " does not match");
+
+  if (payload_size == 0) {
+    return;
+  }
+
+  int fd = open(path.c_str(), O_RDONLY);
+  RNNPP_CHECK(fd >= 0, "Cannot open " << path);
+  struct stat st;
+  if (fstat(fd, &st) != 0 || (uint64_t)st.st_size < payload_offset + payload_size) {
+    close(fd);
+    RNNPP_CHECK(false, "Truncated checkpoint " << path);
+  }
+
+  uint64_t page = sysconf(_SC_PAGESIZE);
+  if (payload_offset % page == 0) {
+    // replaces the pages of the values buffer; private so that updates
+    // after loading never reach the file. The last page may run past the
+    // end of the file, which reads as zeros.
+    void *p = mmap(model.values_, round_up(payload_size, page), PROT_READ | PROT_WRITE,
+        MAP_PRIVATE | MAP_FIXED, fd, payload_offset);
+    close(fd);
+    RNNPP_CHECK(p == model.values_, "Failed to map " << path);
+    return;
+  }
+
+  char *dst = reinterpret_cast<char*>(model.values_);
+  uint64_t done = 0;
+  while (done < payload_size) {
+    ssize_t n = pread(fd, dst + done, payload_size - done, payload_offset + done);
+    if (n <= 0) {
+      close(fd);
+      RNNPP_CHECK(false, "Failed to read " << path);
+    }
+    done += n;
+  }
+  close(fd);
+}
+
+MappedLookupParameter::MappedLookupParameter(const std::string &path,
+    const std::string &name) {
+  uint64_t payload_offset;
+  std::vector<CheckpointEntry> entries = read_checkpoint_header(path, &payload_offset);
+  int k = -1;
+  for (int i=0; i < entries.size(); ++i) {
+    if (entries[i].kind == 1 && entries[i].name == name) {
+      k = i;
+    }
+  }
+  RNNPP_CHECK(k >= 0, "No lookup parameter " << name << " in " << path);
+  const CheckpointEntry &e = entries[k];
+
+  // mmap needs a page aligned file offset
+  uint64_t page = sysconf(_SC_PAGESIZE);
+  uint64_t offset = payload_offset + e.offset;
+  uint64_t start = offset / page * page;
+  uint64_t length = offset - start + e.nbytes;
+
+  int fd = open(path.c_str(), O_RDONLY);
+  RNNPP_CHECK(fd >= 0, "Cannot open " << path);
+  struct stat st;
+  if (fstat(fd, &st) != 0 || (uint64_t)st.st_size < offset + e.nbytes) {
+    close(fd);
+    RNNPP_CHECK(false, "Truncated checkpoint " << path);
+  }
+  void *p = mmap(nullptr, length, PROT_READ, MAP_SHARED, fd, start);
+  close(fd);
+  RNNPP_CHECK(p != MAP_FAILED, "Failed to map " << path);
+  // lookups touch rows at random, so read-ahead only wastes I/O
+  madvise(p, length, MADV_RANDOM);
+
+  mapping_ = p;
+  mapping_size_ = length;
+
+  float *values = reinterpret_cast<float*>(static_cast<char*>(p) + (offset - start));
+  LookupParameter::operator=(LookupParameter(e.dim, e.dtype, values, nullptr));
+}
+
+MappedLookupParameter::~MappedLookupParameter() {
+  munmap(mapping_, mapping_size_);
+}
+
+} // namespace rnnpp
@@ -0,0 +1,101 @@
+#ifndef RNNPP_CHECKPOINT_H_
+#define RNNPP_CHECKPOINT_H_
+
+#include <stdint.h>
+
+#include <string>
+#include <vector>
+
+#include "dim.h"
+#include "dtype.h"
+#include "parameter.h"
+
+namespace rnnpp {
+
+/**
+ * Binary checkpoint of a ParameterCollection (little endian).
+ *
+ *   char     magic[8]         "RNNPPCKP"
+ *   uint32_t version          kCheckpointVersion
+ *   uint32_t n_entries
+ *   uint64_t payload_offset   multiple of kCheckpointPageSize when written,
+ *                             of 64 when read
+ *   uint64_t payload_size     bytes of the values buffer
+ *   entries, each:
+ *     uint32_t kind           0: Parameter, 1: LookupParameter
+ *     uint32_t dtype
+ *     uint32_t ndim
+ *     int32_t  shape[ndim]
+ *     uint64_t offset         from payload_offset, multiple of 64
+ *     uint64_t nbytes
+ *     uint32_t name_length
+ *     char     name[name_length]
+ *   zero padding up to payload_offset
+ *   payload: the values buffer of the collection as is, zero padded to a
+ *   multiple of kCheckpointPageSize
+ *
+ * Since the payload is the values buffer itself, writing is a single
+ * write of that buffer and loading maps the file over it.
+ * kCheckpointPageSize is the largest page size in use (64 KiB), so the
+ * payload can be mapped whatever the page size of the reader.
+ */
+const uint32_t kCheckpointVersion = 1;
+const size_t kCheckpointPageSize = 65536;
+
+struct CheckpointEntry {
+  std::string name;
+  int kind;
+  DType dtype;
+  Dim dim;
+  uint64_t offset;
+  uint64_t nbytes;
+};
+
+void save_checkpoint(const std::string &path, const ParameterCollection &model);
+
+/**
+ * Reads the entries of the checkpoint at path without touching the payload.
+ */
+std::vector<CheckpointEntry> read_checkpoint_header(const std::string &path,
+    uint64_t *payload_offset=nullptr, uint64_t *payload_size=nullptr);
+
+/**
+ * Maps the payload of a checkpoint over the values of model, so nothing
+ * is copied or parsed beyond the header; pages are read on first access
+ * and copied only when written. A payload that is not aligned to the
+ * page size of this system, as in files written with smaller pages, is
+ * read into the values instead.
+ * If model is empty its parameters are created from the checkpoint, and
+ * its capacity must hold the payload: a model over 1 GiB needs a
+ * collection constructed with a larger capacity.
+ * Otherwise they must match the checkpoint in order, name, shape and
+ * dtype, and existing views see the loaded values.
+ */
+void load_checkpoint(const std::string &path, ParameterCollection &model);
+
+/**
+ * The lookup parameter `name` of a checkpoint, mapped read-only and
+ * shared, so processes mapping the same file share one copy in the page
+ * cache. Rows are paged in when first looked up. The table is frozen: it
+ * has no gradient storage and must not be written.
+ * The mapping belongs to this object and is unmapped when it is
+ * destroyed, so copies of it as a LookupParameter, and graphs that look
+ * rows up in it, must not outlive it.
+ */
+class MappedLookupParameter: public LookupParameter {
+  public:
+    MappedLookupParameter(const std::string &path, const std::string &name);
+
+    ~MappedLookupParameter();
+
+  private:
+    MappedLookupParameter(const MappedLookupParameter&);
+    MappedLookupParameter &operator=(const MappedLookupParameter&);
+
+    void *mapping_;
+    size_t mapping_size_;
+};
+
+} // namespace rnnpp
+
+#endif // RNNPP_CHECKPOINT_H_
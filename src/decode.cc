@@ -0,0 +1,180 @@
+#include <string.h>
+
+#include <algorithm>
+
+#include "decode.h"
+#include "error.h"
+#include "tensor.h"
+
+namespace rnnpp {
+
+static bool by_score(const Hypothesis &a, const Hypothesis &b) {
+  return a.score > b.score;
+}
+
+BeamSearchDecoder::BeamSearchDecoder(const LSTMBuilder &rnn,
+    const LookupParameter &embeddings, const Parameter &w_out, const Parameter &b_out,
+    int beam_size)
+  : beam_size(beam_size), cell_(new LSTMCell()), input_dim_(rnn.input_dim),
+    hidden_dim_(rnn.hidden_dim), state_dim_(2 * rnn.hidden_dim) {
+  weights_ = {rnn.w, rnn.b};
+  init(embeddings, w_out, b_out);
+}
+
+BeamSearchDecoder::BeamSearchDecoder(const GRUBuilder &rnn,
+    const LookupParameter &embeddings, const Parameter &w_out, const Parameter &b_out,
+    int beam_size)
+  : beam_size(beam_size), cell_(new GRUCell()), input_dim_(rnn.input_dim),
+    hidden_dim_(rnn.hidden_dim), state_dim_(rnn.hidden_dim) {
+  weights_ = {rnn.wx, rnn.wh, rnn.bx, rnn.bh};
+  init(embeddings, w_out, b_out);
+}
+
+BeamSearchDecoder::~BeamSearchDecoder() {
+  delete cell_;
+}
+
+void BeamSearchDecoder::init(const LookupParameter &embeddings, const Parameter &w_out,
+    const Parameter &b_out) {
+  RNNPP_CHECK(beam_size > 0, "Invalid beam size: " << beam_size);
+  const Dim &e = embeddings.all_values.dim;
+  const Dim &w = w_out.value.dim;
+  RNNPP_CHECK(e[1] == input_dim_ && e[0] >= w_out.value.dim[0], "Embeddings " << e
+      << " do not match input dim " << input_dim_ << " and the output layer");
+  RNNPP_CHECK(w[1] == hidden_dim_ && b_out.value.dim.size() == w[0],
+      "Invalid output layer " << w << " and " << b_out.value.dim
+      << " for hidden dim " << hidden_dim_);
+  embeddings_ = embeddings;
+  w_out_ = w_out;
+  b_out_ = b_out;
+  vocab_size_ = w[0];
+}
+
+void BeamSearchDecoder::step(int k) {
+  int D = input_dim_, H = hidden_dim_, S = state_dim_, V = vocab_size_;
+  arena_.reset();
+  ArenaScope scope(arena_);
+
+  if (embeddings_.dtype == kFloat32) {
+    gather_rows(embeddings_.all_values.data, D, tokens_.data(), k, x_.data());
+  } else {
+    for (int b=0; b < k; ++b) {
+      embeddings_.read_row(tokens_[b], &x_[(size_t)b * D]);
+    }
+  }
+  inputs_[0].dim = Dim({D, 1}, k);
+  inputs_[0].data = x_.data();
+  inputs_[1].dim = Dim({S, 1}, k);
+  inputs_[1].data = state_.data();
+  cell_->forward(inputs_, out_);
+
+  // h is the first H rows of the state
+  for (int b=0; b < k; ++b) {
+    memcpy(&h_[(size_t)b * H], out_.data + (size_t)b * S, H * sizeof(float));
+    memcpy(&logits_[(size_t)b * V], b_, V * sizeof(float));
+  }
+  gemm_nt(h_.data(), w_, logits_.data(), k, V, H);
+  for (int b=0; b < k; ++b) {
+    float *row = &logits_[(size_t)b * V];
+    float shift = scores_[b] - logsumexp(row, V);
+    for (int j=0; j < V; ++j) {
+      row[j] += shift;
+    }
+  }
+}
+
+Hypothesis BeamSearchDecoder::backtrack(int entry, float score) const {
+  Hypothesis hyp;
+  for (int e=entry; e >= 0; e = back_entry_[e]) {
+    hyp.tokens.push_back(back_token_[e]);
+  }
+  std::reverse(hyp.tokens.begin(), hyp.tokens.end());
+  hyp.score = score;
+  return hyp;
+}
+
+std::vector<Hypothesis> BeamSearchDecoder::decode(int bos, int eos, int max_length) {
+  return decode(std::vector<float>(state_dim_, 0.f), bos, eos, max_length);
+}
+
+std::vector<Hypothesis> BeamSearchDecoder::decode(const std::vector<float> &state,
+    int bos, int eos, int max_length) {
+  int S = state_dim_, V = vocab_size_, K = beam_size;
+  RNNPP_CHECK(state.size() == S, "Invalid state size " << state.size()
+      << ", expected " << S);
+  RNNPP_CHECK(bos >= 0 && bos < embeddings_.all_values.dim[0] && eos >= 0 && eos < V,
+      "Invalid tokens bos " << bos << " and eos " << eos);
+
+  inputs_.resize(2 + weights_.size());
+  for (int i=0; i < weights_.size(); ++i) {
+    inputs_[2 + i] = weights_[i].value;
+  }
+  if (w_out_.dtype == kFloat32) {
+    w_ = w_out_.value.data;
+    b_ = b_out_.value.data;
+  } else {
+    w_buf_.resize(w_out_.value.dim.size());
+    w_out_.read(w_buf_.data());
+    w_ = w_buf_.data();
+    b_buf_.resize(V);
+    b_out_.read(b_buf_.data());
+    b_ = b_buf_.data();
+  }
+
+  state_.resize((size_t)K * S);
+  x_.resize((size_t)K * input_dim_);
+  h_.resize((size_t)K * hidden_dim_);
+  logits_.resize((size_t)K * V);
+  tokens_.resize(K);
+  scores_.resize(K);
+  entries_.resize(K);
+  next_entries_.resize(K);
+  best_.resize(K);
+  parents_.resize(K);
+  back_token_.clear();
+  back_entry_.clear();
+
+  std::copy(state.begin(), state.end(), state_.begin());
+  tokens_[0] = bos;
+  scores_[0] = 0.;
+  entries_[0] = -1;
+
+  std::vector<Hypothesis> hyps;
+  int k = 1;
+  for (int t=0; t < max_length && k > 0; ++t) {
+    step(k);
+    // every finished hypothesis takes a slot of the beam
+    int n = std::min(K - (int)hyps.size(), k * V);
+    top_k(logits_.data(), k * V, n, best_.data());
+
+    int live = 0;
+    for (int i=0; i < n; ++i) {
+      int p = best_[i] / V;
+      int j = best_[i] % V;
+      back_token_.push_back(j);
+      back_entry_.push_back(entries_[p]);
+      int e = back_token_.size() - 1;
+      if (j == eos) {
+        hyps.push_back(backtrack(e, logits_[best_[i]]));
+      } else {
+        parents_[live] = p;
+        tokens_[live] = j;
+        scores_[live] = logits_[best_[i]];
+        next_entries_[live] = e;
+        ++live;
+      }
+    }
+    entries_.swap(next_entries_);
+    // the new states are the outputs of the parents
+    gather_rows(out_.data, S, parents_.data(), live, state_.data());
+    k = live;
+  }
+
+  for (int b=0; b < k; ++b) {
+    hyps.push_back(backtrack(entries_[b], scores_[b]));
+  }
+  std::stable_sort(hyps.begin(), hyps.end(), by_score);
+  return hyps;
+}
+
+} // namespace rnnpp
@@ -0,0 +1,111 @@
+#ifndef RNNPP_DECODE_H_
+#define RNNPP_DECODE_H_
+
+#include <vector>
+
+#include "arena.h"
+#include "node.h"
+#include "parameter.h"
+#include "rnn.h"
+
+namespace rnnpp {
+
+struct Hypothesis {
+  // the generated tokens, ending with eos unless max_length was reached
+  std::vector<int> tokens;
+  // sum of the log probabilities of the tokens
+  float score;
+};
+
+/**
+ * Beam search over a single layer LSTM or GRU with an output layer
+ * log_softmax(W_out h + b_out) (V, 1) and input embeddings (V, D).
+ *
+ *   BeamSearchDecoder decoder(lstm, embeddings, w_out, b_out, 8);
+ *   std::vector<Hypothesis> hyps = decoder.decode(bos, eos, 50);
+ *
+ * No graph is built. The states of all live beams are kept in one
+ * preallocated (K, state) buffer and every step runs the cell node once
+ * over the batch of K beams, then the output layer as one GEMM. The best
+ * K of the K * V extensions are picked with top_k and the states are
+ * reordered by gathering the rows of their parents. The tensors of a step
+ * come from an Arena that is reset every step.
+ *
+ * A hypothesis that emits eos is finished and leaves the beam, which
+ * shrinks by one, so decode() returns beam_size hypotheses, best first.
+ * The weights are read when decode() is called, so the decoder sees
+ * updates made in between.
+ */
+class BeamSearchDecoder {
+  public:
+    BeamSearchDecoder(const LSTMBuilder &rnn, const LookupParameter &embeddings,
+        const Parameter &w_out, const Parameter &b_out, int beam_size);
+    BeamSearchDecoder(const GRUBuilder &rnn, const LookupParameter &embeddings,
+        const Parameter &w_out, const Parameter &b_out, int beam_size);
+
+    ~BeamSearchDecoder();
+
+    /**
+     * Decodes from the zero state, or from state ([h; c] for an LSTM, h
+     * for a GRU), starting with the token bos.
+     */
+    std::vector<Hypothesis> decode(int bos, int eos, int max_length);
+    std::vector<Hypothesis> decode(const std::vector<float> &state, int bos, int eos,
+        int max_length);
+
+    int beam_size;
+
+  private:
+    BeamSearchDecoder(const BeamSearchDecoder&);
+    BeamSearchDecoder &operator=(const BeamSearchDecoder&);
+
+    void init(const LookupParameter &embeddings, const Parameter &w_out,
+        const Parameter &b_out);
+
+    // runs the cell over the first k beams into out_ and leaves the scores
+    // of their extensions, score + log p, in logits_
+    void step(int k);
+
+    Hypothesis backtrack(int entry, float score) const;
+
+    Node *cell_;
+    std::vector<Parameter> weights_;
+    LookupParameter embeddings_;
+    Parameter w_out_;
+    Parameter b_out_;
+    int input_dim_;
+    int hidden_dim_;
+    int state_dim_;
+    int vocab_size_;
+
+    // float copies of w_out and b_out if they are stored as half
+    std::vector<float> w_buf_;
+    std::vector<float> b_buf_;
+    const float *w_;
+    const float *b_;
+
+    // per beam: state, embedded token, h, last token, score and the entry
+    // of its last token in the back pointers
+    std::vector<float> state_;
+    std::vector<float> x_;
+    std::vector<float> h_;
+    std::vector<int> tokens_;
+    std::vector<float> scores_;
+    std::vector<int> entries_;
+    std::vector<int> next_entries_;
+    // (K, V) scores of all extensions, and the chosen ones
+    std::vector<float> logits_;
+    std::vector<int> best_;
+    std::vector<int> parents_;
+    // token and previous entry of every extension kept, for backtracking
+    std::vector<int> back_token_;
+    std::vector<int> back_entry_;
+    // the cell's inputs and output, which lives in arena_
+    std::vector<Tensor> inputs_;
+    Tensor out_;
+    Arena arena_;
+};
+
+} // namespace rnnpp
+
+#endif // RNNPP_DECODE_H_
@@ -1,4 +1,7 @@
+#include <algorithm>
+
 #include "dim.h"
+#include "error.h"
 
 namespace rnnpp {
 
@@ -14,5 +17,26 @@ bool operator==(const Dim &lhs, const Dim &rhs) {
   return true;
 }
 
+Dim broadcast(const Dim &a, const Dim &b) {
+  int na = a.shape.size();
+  int nb = b.shape.size();
+  int n = std::max(na, nb);
+  std::vector<int> shape(n);
+  for (int k=0; k < n; ++k) {
+    int sa = k - (n - na) >= 0 ? a.shape[k - (n - na)] : 1;
+    int sb = k - (n - nb) >= 0 ? b.shape[k - (n - nb)] : 1;
+    RNNPP_CHECK(sa == sb || sa == 1 || sb == 1,
+        "Dimensions are not broadcastable: " << a << " " << b);
+    shape[k] = std::max(sa, sb);
+  }
+  RNNPP_CHECK(a.batch_size == b.batch_size || a.batch_size == 1 || b.batch_size == 1,
+      "Batch sizes are not broadcastable: " << a << " " << b);
+  return Dim(shape, std::max(a.batch_size, b.batch_size));
+}
+
+// true if a tensor of dimension from has to be expanded to become to
+bool is_broadcast(const Dim &from, const Dim &to) {
+  return !(from == to) || from.batch_size != to.batch_size;
+}
 
 } // namespace rnnpp
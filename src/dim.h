@@ -1,6 +1,8 @@
 #ifndef RNNPP_DIM_H_
 #define RNNPP_DIM_H_
 
+#include <stddef.h>
+
 #include <iostream>
 #include <vector>
 
@@ -60,6 +62,17 @@ class Dim {
       return s;
     }
 
+    /**
+     * size() as size_t, for parameter tables too large for int.
+     */
+    size_t elements() const {
+      size_t s = 1;
+      for (int i=0; i < shape.size(); ++i) {
+        s *= shape[i];
+      }
+      return s;
+    }
+
     void set_stride(std::vector<int> s) {
       stride = std::vector<int>(s.size());
       stride.back() = 1;
@@ -86,6 +99,15 @@ class Dim {
 
 bool operator==(const Dim &lhs, const Dim &rhs);
 
+/**
+ * Dimension of the result of broadcasting a against b.
+ * Shapes are aligned from the last axis and each pair of sizes must be equal
+ * or contain 1; batch sizes follow the same rule.
+ */
+Dim broadcast(const Dim &a, const Dim &b);
+
+bool is_broadcast(const Dim &from, const Dim &to);
+
 } // namespace rnnpp
 
 #endif // RNNPP_DIM_H_
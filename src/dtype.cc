@@ -0,0 +1,168 @@
+#include <string.h>
+
+#if defined(__F16C__) || defined(__AVX2__) || defined(__AVX512BF16__)
+#include <immintrin.h>
+#endif
+
+#include "dtype.h"
+#include "error.h"
+
+namespace rnnpp {
+
+int dtype_size(DType dtype) {
+  switch (dtype) {
+    case kFloat32: return 4;
+    case kFloat16: return 2;
+    case kBFloat16: return 2;
+  }
+  RNNPP_CHECK(false, "Unknown dtype: " << dtype);
+  return 0;
+}
+
+std::string dtype_name(DType dtype) {
+  switch (dtype) {
+    case kFloat32: return "float32";
+    case kFloat16: return "float16";
+    case kBFloat16: return "bfloat16";
+  }
+  RNNPP_CHECK(false, "Unknown dtype: " << dtype);
+  return "";
+}
+
+DType dtype_from_name(const std::string &name) {
+  if (name == "float32" || name == "fp32") return kFloat32;
+  if (name == "float16" || name == "fp16") return kFloat16;
+  if (name == "bfloat16" || name == "bf16") return kBFloat16;
+  RNNPP_CHECK(false, "Unknown dtype name: " << name);
+  return kFloat32;
+}
+
+// IEEE 754 binary16 with round-to-nearest-even.
+uint16_t float_to_half(float x) {
+  uint32_t f;
+  memcpy(&f, &x, sizeof(f));
+  uint32_t sign = (f >> 16) & 0x8000;
+  uint32_t a = f & 0x7fffffff;
+
+  if (a > 0x7f800000) { // nan
+    return sign | 0x7e00;
+  }
+  if (a >= 0x47800000) { // overflow or inf
+    return sign | 0x7c00;
+  }
+  if (a < 0x38800000) { // subnormal or zero in half
+    if (a < 0x33000000) {
+      return sign;
+    }
+    uint32_t e = a >> 23;
+    uint32_t m = (a & 0x7fffff) | 0x800000;
+    uint32_t shift = 126 - e;
+    uint32_t h = m >> shift;
+    uint32_t rem = m & ((1u << shift) - 1);
+    uint32_t halfway = 1u << (shift - 1);
+    if (rem > halfway || (rem == halfway && (h & 1))) h += 1;
+    return sign | h;
+  }
+
+  uint32_t h = (a >> 13) - (112 << 10);
+  uint32_t rem = a & 0x1fff;
+  if (rem > 0x1000 || (rem == 0x1000 && (h & 1))) h += 1;
+  return sign | h;
+}
+
+float half_to_float(uint16_t h) {
+  uint32_t sign = (uint32_t)(h & 0x8000) << 16;
+  uint32_t e = (h >> 10) & 0x1f;
+  uint32_t m = h & 0x3ff;
+  uint32_t f;
+
+  if (e == 0) {
+    float v = m * 5.9604644775390625e-8f; // m * 2^-24
+    return sign ? -v : v;
+  } else if (e == 31) {
+    f = sign | 0x7f800000 | (m << 13);
+  } else {
+    f = sign | ((e + 112) << 23) | (m << 13);
+  }
+  float x;
+  memcpy(&x, &f, sizeof(x));
+  return x;
+}
+
+uint16_t float_to_bfloat16(float x) {
+  uint32_t f;
+  memcpy(&f, &x, sizeof(f));
+  if ((f & 0x7fffffff) > 0x7f800000) { // nan
+    return (f >> 16) | 0x40;
+  }
+  f += 0x7fff + ((f >> 16) & 1);
+  return f >> 16;
+}
+
+float bfloat16_to_float(uint16_t h) {
+  uint32_t f = (uint32_t)h << 16;
+  float x;
+  memcpy(&x, &f, sizeof(x));
+  return x;
+}
+
+void encode(const float *src, void *dst, size_t n, DType dtype) {
+  size_t i = 0;
+  if (dtype == kFloat32) {
+    memcpy(dst, src, sizeof(float) * n);
+  } else if (dtype == kFloat16) {
+    uint16_t *d = static_cast<uint16_t*>(dst);
+#ifdef __F16C__
+    for (; i + 8 <= n; i += 8) {
+      __m128i h = _mm256_cvtps_ph(_mm256_loadu_ps(src + i), _MM_FROUND_TO_NEAREST_INT);
+      _mm_storeu_si128(reinterpret_cast<__m128i*>(d + i), h);
+    }
+#endif
+    for (; i < n; ++i) {
+      d[i] = float_to_half(src[i]);
+    }
+  } else if (dtype == kBFloat16) {
+    uint16_t *d = static_cast<uint16_t*>(dst);
+#ifdef __AVX512BF16__
+    for (; i + 16 <= n; i += 16) {
+      __m256bh h = _mm512_cvtneps_pbh(_mm512_loadu_ps(src + i));
+      _mm256_storeu_si256(reinterpret_cast<__m256i*>(d + i), (__m256i)h);
+    }
+#endif
+    for (; i < n; ++i) {
+      d[i] = float_to_bfloat16(src[i]);
+    }
+  }
+}
+
+void decode(const void *src, float *dst, size_t n, DType dtype) {
+  size_t i = 0;
+  if (dtype == kFloat32) {
+    memcpy(dst, src, sizeof(float) * n);
+  } else if (dtype == kFloat16) {
+    const uint16_t *s = static_cast<const uint16_t*>(src);
+#ifdef __F16C__
+    for (; i + 8 <= n; i += 8) {
+      __m128i h = _mm_loadu_si128(reinterpret_cast<const __m128i*>(s + i));
+      _mm256_storeu_ps(dst + i, _mm256_cvtph_ps(h));
+    }
+#endif
+    for (; i < n; ++i) {
+      dst[i] = half_to_float(s[i]);
+    }
+  } else if (dtype == kBFloat16) {
+    const uint16_t *s = static_cast<const uint16_t*>(src);
+#ifdef __AVX2__
+    for (; i + 8 <= n; i += 8) {
+      __m128i h = _mm_loadu_si128(reinterpret_cast<const __m128i*>(s + i));
+      __m256i f = _mm256_slli_epi32(_mm256_cvtepu16_epi32(h), 16);
+      _mm256_storeu_ps(dst + i, _mm256_castsi256_ps(f));
+    }
+#endif
+    for (; i < n; ++i) {
+      dst[i] = bfloat16_to_float(s[i]);
+    }
+  }
+}
+
+} // namespace rnnpp
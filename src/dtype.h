@@ -0,0 +1,42 @@
+#ifndef RNNPP_DTYPE_H_
+#define RNNPP_DTYPE_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <string>
+
+namespace rnnpp {
+
+/**
+ * Element type of parameter storage.
+ * Computation is always done in float; kFloat16 and kBFloat16 only change
+ * how values are kept in memory and are widened to float when read.
+ */
+enum DType {
+  kFloat32 = 0,
+  kFloat16 = 1,
+  kBFloat16 = 2,
+};
+
+int dtype_size(DType dtype);
+
+std::string dtype_name(DType dtype);
+
+DType dtype_from_name(const std::string &name);
+
+uint16_t float_to_half(float x);
+float half_to_float(uint16_t h);
+
+uint16_t float_to_bfloat16(float x);
+float bfloat16_to_float(uint16_t h);
+
+// dst[i] = (dtype) src[i]
+void encode(const float *src, void *dst, size_t n, DType dtype);
+
+// dst[i] = (float) src[i]
+void decode(const void *src, float *dst, size_t n, DType dtype);
+
+} // namespace rnnpp
+
+#endif // RNNPP_DTYPE_H_
@@ -1,5 +1,9 @@
+#include <string.h>
+
 #include <iostream>
 
+#include "arena.h"
+#include "error.h"
 #include "expr.h"
 #include "node.h"
 
@@ -45,19 +49,47 @@ std::vector<Tensor> Expression::forward2() {
   return ret;
 }
 
+// The first gradient reaching a node is copied into the node's own buffer
+// and later ones, from other uses of the node, are added to it. dEdx may
+// alias the gradient of another node (Add passes dEdy through), so it is
+// never taken as is.
+static void accumulate_grad(Tensor &grad, const Tensor &dEdx, char &has_grad) {
+  if (!has_grad) {
+    size_t n = (size_t)dEdx.dim.size() * dEdx.dim.batch_size;
+    if (n != (size_t)grad.dim.size() * grad.dim.batch_size) {
+      grad.data = alloc_floats(n);
+    }
+    grad.dim = dEdx.dim;
+    memcpy(grad.data, dEdx.data, n * sizeof(float));
+    has_grad = 1;
+    return;
+  }
+  int n = grad.dim.size() * grad.dim.batch_size;
+  RNNPP_CHECK(dEdx.dim.size() * dEdx.dim.batch_size == n,
+      "Gradients of different sizes: " << grad.dim << " and " << dEdx.dim);
+  for (int i=0; i < n; ++i) {
+    grad.data[i] += dEdx.data[i];
+  }
+}
+
 void Expression::backward() {
   int num_nodes = g_->nodes().size();
   g_->grads.resize(num_nodes);
 
   for (int i=0; i < num_nodes; ++i) {
-    int k = g_->outputs[i].dim.size();
+    int k = g_->outputs[i].dim.size() * g_->outputs[i].dim.batch_size;
     g_->grads[i].dim = g_->outputs[i].dim;
-    g_->grads[i].data = new float[k]; 
+    g_->grads[i].data = alloc_floats(k); 
   }
 
   g_->grads.back() = Scalar(1.);
+  std::vector<char> has_grad(num_nodes, 0);
+  has_grad.back() = 1;
 
   for (int i=num_nodes-1; i >= 0; --i) {
+    if (!has_grad[i]) {
+      continue;
+    }
     Node* node = g_->nodes()[i];
     Tensor output = g_->outputs[i];
     Tensor dEdy = g_->grads[i];
@@ -68,13 +100,18 @@ void Expression::backward() {
     }
 
     for (int j=0; j < node->args.size(); ++j) {
-      Tensor &dEdx = g_->grads[node->args[j]];
+      int a = node->args[j];
+      Tensor dEdx;
       node->backward(inputs, output, dEdy, j, dEdx);
+      accumulate_grad(g_->grads[a], dEdx, has_grad[a]);
     }
   }
 
   for (int i=0; i < g_->parameter_nodes().size(); ++i) {
     int nid = g_->parameter_nodes()[i];
+    if (!has_grad[nid]) {
+      continue;
+    }
     ParameterNodeBase* n = static_cast<ParameterNodeBase*>(g_->nodes()[nid]);
     n->add_gradient(g_->grads[nid]);
   }
@@ -87,12 +124,14 @@ void Expression::backward2() {
   g_->grads.resize(g_->n_outputs());
 
   for (int i=0; i < n_out; ++i) {
-    int k = g_->outputs[i].dim.size();
+    int k = g_->outputs[i].dim.size() * g_->outputs[i].dim.batch_size;
     g_->grads[i].dim = g_->outputs[i].dim;
-    g_->grads[i].data = new float[k]; 
+    g_->grads[i].data = alloc_floats(k); 
   }
 
   g_->grads.back() = Scalar(1.);
+  std::vector<char> has_grad(n_out, 0);
+  has_grad.back() = 1;
 
   for (int i=n_out-1; i >= 0; --i) {
     Node* node = g_->nodes()[i];
@@ -116,14 +155,27 @@ void Expression::backward2() {
       dEdy[j] = g_->grads[node->args_out[j]];
     }
 
+    bool reached = false;
+    for (int j=0; j < node->args_out.size(); ++j) {
+      reached = reached || has_grad[node->args_out[j]];
+    }
+    if (!reached) {
+      continue;
+    }
+
     for (int j=0; j < node->args.size(); ++j) {
-      Tensor &dEdx = g_->grads[node->args[j]];
+      int a = node->args[j];
+      Tensor dEdx;
       node->backward2(inputs, outputs, dEdy, j, dEdx);
+      accumulate_grad(g_->grads[a], dEdx, has_grad[a]);
     }
   }
 
   for (int i=0; i < g_->parameter_nodes().size(); ++i) {
     int nid = g_->parameter_nodes()[i];
+    if (!has_grad[nid]) {
+      continue;
+    }
     ParameterNodeBase* n = static_cast<ParameterNodeBase*>(g_->nodes()[nid]);
     n->add_gradient(g_->grads[nid]);
   }
@@ -151,6 +203,14 @@ Expression operator*(const Expression &a, const Expression &b) {
   return e;
 }
 
+Expression cmult(const Expression &a, const Expression &b) {
+  int i = a.g_->nodes().size();
+  Node* node = new CwiseMult({a.id(), b.id()}, {i});
+  a.g_->add_node(node);
+  Expression e(a.g_, i);
+  return e;
+}
+
 Expression operator/(const Expression &a, const Expression &b) {
   int i = a.g_->nodes().size();
   Node* node = new Divide({a.id(), b.id()}, {i});
@@ -193,6 +253,20 @@ Expression concat(const std::initializer_list<Expression> &xs, int axis) {
   return e;
 }
 
+Expression concat(const std::vector<Expression> &xs, int axis) {
+  std::vector<int> ids(xs.size());
+  for (int k=0; k < xs.size(); ++k) {
+    ids[k] = xs[k].id();
+  }
+  Graph* g = xs[0].g_;
+  int nid = g->nodes().size();
+
+  Node* node = new Concat(ids, {nid}, axis);
+  g->add_node(node);
+  Expression e(g, nid);
+  return e;
+}
+
 std::vector<Expression> split(const Expression &x, int n, int axis) {
 
   std::vector<Expression> ret(n);
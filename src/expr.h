@@ -42,10 +42,14 @@ float as_scalar(const Tensor& e);
 Expression operator+(const Expression &a, const Expression &b);
 Expression operator*(const Expression &a, const Expression &b);
 Expression operator/(const Expression &a, const Expression &b);
+
+// elementwise product, a and b are broadcast against each other
+Expression cmult(const Expression &a, const Expression &b);
 Expression operator/(const Expression &a, float b);
 Expression operator/(float a, const Expression &b);
 
 Expression concat(const std::initializer_list<Expression> &xs, int axis);
+Expression concat(const std::vector<Expression> &xs, int axis);
 
 std::vector<Expression> split(const Expression &x, int n, int axis);
 
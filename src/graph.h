@@ -6,10 +6,25 @@
 
 namespace rnnpp {
 
+/**
+ * A graph owns its nodes. The tensors in outputs and grads are allocated
+ * with alloc_floats() and are not freed with the graph.
+ */
 class Graph {
   public:
     Graph(){}
-    ~Graph(){}
+    ~Graph(){ clear(); }
+
+    // removes all nodes, keeping the capacity of the vectors
+    void clear() {
+      for (int i=0; i < nodes_.size(); ++i) {
+        delete nodes_[i];
+      }
+      nodes_.clear();
+      parameter_node_ids_.clear();
+      outputs.clear();
+      grads.clear();
+    }
 
     const std::vector<Node*>& nodes() { return nodes_; }
 
@@ -33,6 +48,9 @@ class Graph {
     std::vector<Tensor> grads;
 
   private:
+    Graph(const Graph&);
+    Graph &operator=(const Graph&);
+
     std::vector<Node*> nodes_;
     std::vector<int> parameter_node_ids_;
 
@@ -0,0 +1,413 @@
+#include <math.h>
+#include <string.h>
+
+#include <algorithm>
+#include <atomic>
+#include <random>
+#include <thread>
+#include <vector>
+
+#ifdef __AVX2__
+#include <immintrin.h>
+#endif
+
+#include "error.h"
+#include "initializer.h"
+
+namespace rnnpp {
+
+static const uint32_t kPhiloxM0 = 0xD2511F53;
+static const uint32_t kPhiloxM1 = 0xCD9E8D57;
+static const uint32_t kPhiloxW0 = 0x9E3779B9;
+static const uint32_t kPhiloxW1 = 0xBB67AE85;
+
+void philox4x32(const uint32_t ctr[4], const uint32_t key[2], uint32_t out[4]) {
+  uint32_t c0 = ctr[0], c1 = ctr[1], c2 = ctr[2], c3 = ctr[3];
+  uint32_t k0 = key[0], k1 = key[1];
+  for (int r=0; r < 10; ++r) {
+    uint64_t p0 = (uint64_t)kPhiloxM0 * c0;
+    uint64_t p1 = (uint64_t)kPhiloxM1 * c2;
+    uint32_t n0 = (uint32_t)(p1 >> 32) ^ c1 ^ k0;
+    uint32_t n2 = (uint32_t)(p0 >> 32) ^ c3 ^ k1;
+    c1 = (uint32_t)p1;
+    c3 = (uint32_t)p0;
+    c0 = n0;
+    c2 = n2;
+    k0 += kPhiloxW0;
+    k1 += kPhiloxW1;
+  }
+  out[0] = c0; out[1] = c1; out[2] = c2; out[3] = c3;
+}
+
+// Element i of a tensor is word (i % 32) / 8 of Philox block
+// 8 * (i / 32) + i % 8, so that eight blocks fill 32 consecutive elements
+// with one vector per word.
+static void philox_group(uint64_t group, const uint32_t key[2], uint64_t stream,
+    uint32_t words[32]) {
+#ifdef __AVX2__
+  uint64_t b = group * 8;
+  __m256i c0 = _mm256_add_epi32(_mm256_set1_epi32((uint32_t)b),
+      _mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7));
+  __m256i c1 = _mm256_set1_epi32((uint32_t)(b >> 32));
+  __m256i c2 = _mm256_set1_epi32((uint32_t)stream);
+  __m256i c3 = _mm256_set1_epi32((uint32_t)(stream >> 32));
+  __m256i m0 = _mm256_set1_epi32(kPhiloxM0);
+  __m256i m1 = _mm256_set1_epi32(kPhiloxM1);
+  uint32_t k0 = key[0], k1 = key[1];
+  for (int r=0; r < 10; ++r) {
+    // 32 x 32 -> 64 bit products of even and odd lanes
+    __m256i e0 = _mm256_mul_epu32(c0, m0);
+    __m256i o0 = _mm256_mul_epu32(_mm256_srli_epi64(c0, 32), m0);
+    __m256i e1 = _mm256_mul_epu32(c2, m1);
+    __m256i o1 = _mm256_mul_epu32(_mm256_srli_epi64(c2, 32), m1);
+    __m256i lo0 = _mm256_blend_epi32(e0, _mm256_slli_epi64(o0, 32), 0xAA);
+    __m256i hi0 = _mm256_blend_epi32(_mm256_srli_epi64(e0, 32), o0, 0xAA);
+    __m256i lo1 = _mm256_blend_epi32(e1, _mm256_slli_epi64(o1, 32), 0xAA);
+    __m256i hi1 = _mm256_blend_epi32(_mm256_srli_epi64(e1, 32), o1, 0xAA);
+    c0 = _mm256_xor_si256(_mm256_xor_si256(hi1, c1), _mm256_set1_epi32(k0));
+    c2 = _mm256_xor_si256(_mm256_xor_si256(hi0, c3), _mm256_set1_epi32(k1));
+    c1 = lo1;
+    c3 = lo0;
+    k0 += kPhiloxW0;
+    k1 += kPhiloxW1;
+  }
+  _mm256_storeu_si256(reinterpret_cast<__m256i*>(words), c0);
+  _mm256_storeu_si256(reinterpret_cast<__m256i*>(words + 8), c1);
+  _mm256_storeu_si256(reinterpret_cast<__m256i*>(words + 16), c2);
+  _mm256_storeu_si256(reinterpret_cast<__m256i*>(words + 24), c3);
+#else
+  for (int j=0; j < 8; ++j) {
+    uint64_t b = group * 8 + j;
+    uint32_t ctr[4] = {(uint32_t)b, (uint32_t)(b >> 32),
+      (uint32_t)stream, (uint32_t)(stream >> 32)};
+    uint32_t w[4];
+    philox4x32(ctr, key, w);
+    for (int k=0; k < 4; ++k) {
+      words[k * 8 + j] = w[k];
+    }
+  }
+#endif
+}
+
+// log(x) for normal x > 0 (cephes logf)
+static inline float log_approx(float x) {
+  uint32_t xi;
+  memcpy(&xi, &x, sizeof(xi));
+  float e = (float)((int)(xi >> 23) - 127);
+  xi = (xi & 0x007fffff) | 0x3f800000;
+  float m;
+  memcpy(&m, &xi, sizeof(m));
+  if (m > 1.41421356f) {
+    m *= 0.5f;
+    e += 1.f;
+  }
+  float f = m - 1.f;
+  float z = f * f;
+  float y = 7.0376836292E-2f;
+  y = y * f - 1.1514610310E-1f;
+  y = y * f + 1.1676998740E-1f;
+  y = y * f - 1.2420140846E-1f;
+  y = y * f + 1.4249322787E-1f;
+  y = y * f - 1.6668057665E-1f;
+  y = y * f + 2.0000714765E-1f;
+  y = y * f - 2.4999993993E-1f;
+  y = y * f + 3.3333331174E-1f;
+  y = y * f * z;
+  y += e * -2.12194440e-4f;
+  y += -0.5f * z;
+  return f + y + e * 0.693359375f;
+}
+
+// sin and cos of x in [-pi, pi] (cephes sinf and cosf)
+static inline void sincos_approx(float x, float &s, float &c) {
+  int q = (int)lrintf(x * 0.63661977f);
+  float y = x - q * 1.5703125f - q * 4.837512969970703125e-4f - q * 7.54978995489188216e-8f;
+  float z = y * y;
+  float sy = y + y * z * (-1.6666654611E-1f + z * (8.3321608736E-3f + z * -1.9515295891E-4f));
+  float cy = 1.f - 0.5f * z + z * z * (4.166664568298827E-2f
+      + z * (-1.388731625493765E-3f + z * 2.443315711809948E-5f));
+  s = (q & 1) ? cy : sy;
+  c = (q & 1) ? sy : cy;
+  if (q & 2) s = -s;
+  if ((q + 1) & 2) c = -c;
+}
+
+static const float k2Pow24 = 5.9604644775390625e-8f; // 2^-24
+static const float kPi = 3.14159265f;
+
+static void uniform_group(uint64_t group, const uint32_t key[2], uint64_t stream,
+    float lo, float hi, float *out) {
+  uint32_t w[32];
+  philox_group(group, key, stream, w);
+  int i = 0;
+  float scale = (hi - lo) * k2Pow24;
+#ifdef __AVX2__
+  __m256 vs = _mm256_set1_ps(scale);
+  __m256 vl = _mm256_set1_ps(lo);
+  for (; i < 32; i += 8) {
+    __m256i v = _mm256_srli_epi32(_mm256_loadu_si256(reinterpret_cast<__m256i*>(w + i)), 8);
+    _mm256_storeu_ps(out + i, _mm256_add_ps(vl, _mm256_mul_ps(vs, _mm256_cvtepi32_ps(v))));
+  }
+#endif
+  for (; i < 32; ++i) {
+    out[i] = lo + scale * (float)(w[i] >> 8);
+  }
+}
+
+#ifdef __AVX2__
+static inline __m256 log_approx(__m256 x) {
+  __m256i xi = _mm256_castps_si256(x);
+  __m256 e = _mm256_cvtepi32_ps(_mm256_sub_epi32(_mm256_srli_epi32(xi, 23),
+        _mm256_set1_epi32(127)));
+  __m256 m = _mm256_castsi256_ps(_mm256_or_si256(
+        _mm256_and_si256(xi, _mm256_set1_epi32(0x007fffff)), _mm256_set1_epi32(0x3f800000)));
+  __m256 big = _mm256_cmp_ps(m, _mm256_set1_ps(1.41421356f), _CMP_GT_OQ);
+  m = _mm256_blendv_ps(m, _mm256_mul_ps(m, _mm256_set1_ps(0.5f)), big);
+  e = _mm256_add_ps(e, _mm256_and_ps(big, _mm256_set1_ps(1.f)));
+
+  __m256 f = _mm256_sub_ps(m, _mm256_set1_ps(1.f));
+  __m256 z = _mm256_mul_ps(f, f);
+  __m256 y = _mm256_set1_ps(7.0376836292E-2f);
+  y = _mm256_add_ps(_mm256_mul_ps(y, f), _mm256_set1_ps(-1.1514610310E-1f));
+  y = _mm256_add_ps(_mm256_mul_ps(y, f), _mm256_set1_ps(1.1676998740E-1f));
+  y = _mm256_add_ps(_mm256_mul_ps(y, f), _mm256_set1_ps(-1.2420140846E-1f));
+  y = _mm256_add_ps(_mm256_mul_ps(y, f), _mm256_set1_ps(1.4249322787E-1f));
+  y = _mm256_add_ps(_mm256_mul_ps(y, f), _mm256_set1_ps(-1.6668057665E-1f));
+  y = _mm256_add_ps(_mm256_mul_ps(y, f), _mm256_set1_ps(2.0000714765E-1f));
+  y = _mm256_add_ps(_mm256_mul_ps(y, f), _mm256_set1_ps(-2.4999993993E-1f));
+  y = _mm256_add_ps(_mm256_mul_ps(y, f), _mm256_set1_ps(3.3333331174E-1f));
+  y = _mm256_mul_ps(_mm256_mul_ps(y, f), z);
+  y = _mm256_add_ps(y, _mm256_mul_ps(e, _mm256_set1_ps(-2.12194440e-4f)));
+  y = _mm256_add_ps(y, _mm256_mul_ps(z, _mm256_set1_ps(-0.5f)));
+  return _mm256_add_ps(_mm256_add_ps(f, y), _mm256_mul_ps(e, _mm256_set1_ps(0.693359375f)));
+}
+
+static inline void sincos_approx(__m256 x, __m256 &s, __m256 &c) {
+  __m256i q = _mm256_cvtps_epi32(_mm256_mul_ps(x, _mm256_set1_ps(0.63661977f)));
+  __m256 qf = _mm256_cvtepi32_ps(q);
+  __m256 y = _mm256_sub_ps(x, _mm256_mul_ps(qf, _mm256_set1_ps(1.5703125f)));
+  y = _mm256_sub_ps(y, _mm256_mul_ps(qf, _mm256_set1_ps(4.837512969970703125e-4f)));
+  y = _mm256_sub_ps(y, _mm256_mul_ps(qf, _mm256_set1_ps(7.54978995489188216e-8f)));
+  __m256 z = _mm256_mul_ps(y, y);
+
+  __m256 ps = _mm256_add_ps(_mm256_set1_ps(8.3321608736E-3f),
+      _mm256_mul_ps(z, _mm256_set1_ps(-1.9515295891E-4f)));
+  ps = _mm256_add_ps(_mm256_set1_ps(-1.6666654611E-1f), _mm256_mul_ps(z, ps));
+  __m256 sy = _mm256_add_ps(y, _mm256_mul_ps(_mm256_mul_ps(y, z), ps));
+
+  __m256 pc = _mm256_add_ps(_mm256_set1_ps(-1.388731625493765E-3f),
+      _mm256_mul_ps(z, _mm256_set1_ps(2.443315711809948E-5f)));
+  pc = _mm256_add_ps(_mm256_set1_ps(4.166664568298827E-2f), _mm256_mul_ps(z, pc));
+  __m256 cy = _mm256_add_ps(_mm256_sub_ps(_mm256_set1_ps(1.f),
+        _mm256_mul_ps(_mm256_set1_ps(0.5f), z)), _mm256_mul_ps(_mm256_mul_ps(z, z), pc));
+
+  __m256i one = _mm256_set1_epi32(1);
+  __m256i two = _mm256_set1_epi32(2);
+  __m256 swap = _mm256_castsi256_ps(_mm256_cmpeq_epi32(_mm256_and_si256(q, one), one));
+  __m256 ssign = _mm256_castsi256_ps(_mm256_slli_epi32(_mm256_and_si256(q, two), 30));
+  __m256 csign = _mm256_castsi256_ps(_mm256_slli_epi32(
+        _mm256_and_si256(_mm256_add_epi32(q, one), two), 30));
+  s = _mm256_xor_ps(_mm256_blendv_ps(sy, cy, swap), ssign);
+  c = _mm256_xor_ps(_mm256_blendv_ps(cy, sy, swap), csign);
+}
+#endif
+
+// Box-Muller on words 0 and 1 gives elements 0 and 1, words 2 and 3
+// give elements 2 and 3. The angle is taken in [-pi, pi).
+static void normal_group(uint64_t group, const uint32_t key[2], uint64_t stream,
+    float mean, float stddev, float *out) {
+  uint32_t w[32];
+  philox_group(group, key, stream, w);
+  for (int k=0; k < 4; k += 2) {
+    const uint32_t *a = w + k * 8;
+    const uint32_t *b = w + (k + 1) * 8;
+    int j = 0;
+#ifdef __AVX2__
+    __m256i va = _mm256_srli_epi32(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(a)), 8);
+    __m256i vb = _mm256_srli_epi32(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(b)), 8);
+    __m256 u1 = _mm256_mul_ps(_mm256_cvtepi32_ps(_mm256_add_epi32(va, _mm256_set1_epi32(1))),
+        _mm256_set1_ps(k2Pow24));
+    __m256 th = _mm256_sub_ps(_mm256_mul_ps(_mm256_cvtepi32_ps(vb),
+          _mm256_set1_ps(2.f * kPi * k2Pow24)), _mm256_set1_ps(kPi));
+    __m256 r = _mm256_sqrt_ps(_mm256_mul_ps(_mm256_set1_ps(-2.f), log_approx(u1)));
+    r = _mm256_mul_ps(r, _mm256_set1_ps(stddev));
+    __m256 s, c;
+    sincos_approx(th, s, c);
+    __m256 vm = _mm256_set1_ps(mean);
+    _mm256_storeu_ps(out + k * 8, _mm256_add_ps(vm, _mm256_mul_ps(r, c)));
+    _mm256_storeu_ps(out + (k + 1) * 8, _mm256_add_ps(vm, _mm256_mul_ps(r, s)));
+    j = 8;
+#endif
+    for (; j < 8; ++j) {
+      float u1 = (float)((a[j] >> 8) + 1) * k2Pow24;
+      float th = (float)(b[j] >> 8) * (2.f * kPi * k2Pow24) - kPi;
+      float r = stddev * sqrtf(-2.f * log_approx(u1));
+      float s, c;
+      sincos_approx(th, s, c);
+      out[k * 8 + j] = mean + r * c;
+      out[(k + 1) * 8 + j] = mean + r * s;
+    }
+  }
+}
+
+template<typename F>
+static void fill(float *x, size_t n, uint64_t seed, uint64_t stream, int num_threads,
+    F group_fn) {
+  uint32_t key[2] = {(uint32_t)seed, (uint32_t)(seed >> 32)};
+  size_t n_groups = (n + 31) / 32;
+
+  auto run = [=](size_t g0, size_t g1) {
+    for (size_t g=g0; g < g1; ++g) {
+      if (32 * (g + 1) <= n) {
+        group_fn(g, key, stream, x + 32 * g);
+      } else {
+        float tmp[32];
+        group_fn(g, key, stream, tmp);
+        memcpy(x + 32 * g, tmp, sizeof(float) * (n - 32 * g));
+      }
+    }
+  };
+
+  // below this a thread costs more than it saves
+  const size_t min_groups = 1 << 13;
+  int nt = num_threads > 0 ? num_threads : std::thread::hardware_concurrency();
+  nt = std::max(1, std::min<int>(nt, n_groups / min_groups));
+  if (nt == 1) {
+    run(0, n_groups);
+    return;
+  }
+
+  std::vector<std::thread> threads;
+  size_t chunk = (n_groups + nt - 1) / nt;
+  for (int t=0; t < nt; ++t) {
+    size_t g0 = std::min(n_groups, t * chunk);
+    size_t g1 = std::min(n_groups, g0 + chunk);
+    threads.push_back(std::thread(run, g0, g1));
+  }
+  for (auto &th : threads) {
+    th.join();
+  }
+}
+
+void fill_uniform(float *x, size_t n, float lo, float hi,
+    uint64_t seed, uint64_t stream, int num_threads) {
+  fill(x, n, seed, stream, num_threads,
+      [=](uint64_t g, const uint32_t *key, uint64_t s, float *out) {
+        uniform_group(g, key, s, lo, hi, out);
+      });
+}
+
+void fill_normal(float *x, size_t n, float mean, float stddev,
+    uint64_t seed, uint64_t stream, int num_threads) {
+  fill(x, n, seed, stream, num_threads,
+      [=](uint64_t g, const uint32_t *key, uint64_t s, float *out) {
+        normal_group(g, key, s, mean, stddev, out);
+      });
+}
+
+static uint64_t random_seed() {
+  std::random_device rnd;
+  return ((uint64_t)rnd() << 32) | rnd();
+}
+
+static std::atomic<uint64_t> g_seed(random_seed());
+static std::atomic<uint64_t> g_stream(0);
+
+void set_seed(uint64_t seed) {
+  g_seed = seed;
+  g_stream = 0;
+}
+
+void Initializer::uniform(Tensor &t, float lo, float hi) {
+  fill_uniform(t.data, t.dim.elements(), lo, hi, g_seed, g_stream++, num_threads);
+}
+
+void Initializer::normal(Tensor &t, float mean, float stddev) {
+  fill_normal(t.data, t.dim.elements(), mean, stddev, g_seed, g_stream++, num_threads);
+}
+
+void Initializer::fans(const Dim &d, float &fan_in, float &fan_out) {
+  if (d.shape.size() < 2) {
+    fan_in = fan_out = d.elements();
+  } else {
+    fan_out = d[0];
+    fan_in = d.elements() / d[0];
+  }
+}
+
+void GlorotInitializer::init(Tensor &t) {
+  float fan_in, fan_out;
+  fans(t.dim, fan_in, fan_out);
+  if (is_uniform) {
+    float a = gain * sqrtf(6.f / (fan_in + fan_out));
+    uniform(t, -a, a);
+  } else {
+    normal(t, 0.f, gain * sqrtf(2.f / (fan_in + fan_out)));
+  }
+}
+
+void HeInitializer::init(Tensor &t) {
+  float fan_in, fan_out;
+  fans(t.dim, fan_in, fan_out);
+  if (is_uniform) {
+    float a = sqrtf(6.f / fan_in);
+    uniform(t, -a, a);
+  } else {
+    normal(t, 0.f, sqrtf(2.f / fan_in));
+  }
+}
+
+void OrthogonalInitializer::init(Tensor &t) {
+  int rows = t.dim.shape.size() < 2 ? 1 : t.dim[0];
+  int cols = t.dim.size() / rows;
+  // orthonormalize the shorter side as rows of a (m, k) matrix
+  int m = std::min(rows, cols);
+  int k = std::max(rows, cols);
+
+  std::vector<float> a(m * k);
+  Tensor tmp;
+  tmp.dim = Dim({m, k});
+  tmp.data = a.data();
+  normal(tmp, 0.f, 1.f);
+
+  // modified Gram-Schmidt in double
+  std::vector<double> q(m * k);
+  for (int i=0; i < m; ++i) {
+    double *qi = q.data() + i * k;
+    for (int j=0; j < k; ++j) {
+      qi[j] = a[i * k + j];
+    }
+    for (int p=0; p < i; ++p) {
+      const double *qp = q.data() + p * k;
+      double d = 0.;
+      for (int j=0; j < k; ++j) {
+        d += qi[j] * qp[j];
+      }
+      for (int j=0; j < k; ++j) {
+        qi[j] -= d * qp[j];
+      }
+    }
+    double norm = 0.;
+    for (int j=0; j < k; ++j) {
+      norm += qi[j] * qi[j];
+    }
+    norm = sqrt(norm);
+    RNNPP_CHECK(norm > 0., "Failed to orthogonalize " << t.dim);
+    for (int j=0; j < k; ++j) {
+      qi[j] /= norm;
+    }
+  }
+
+  for (int i=0; i < m; ++i) {
+    for (int j=0; j < k; ++j) {
+      float v = gain * q[i * k + j];
+      if (rows <= cols) {
+        t.data[i * cols + j] = v;
+      } else {
+        t.data[j * cols + i] = v;
+      }
+    }
+  }
+}
+
+} // namespace rnnpp
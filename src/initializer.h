@@ -0,0 +1,121 @@
+#ifndef RNNPP_INITIALIZER_H_
+#define RNNPP_INITIALIZER_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "tensor.h"
+
+namespace rnnpp {
+
+/**
+ * Philox4x32-10 counter-based generator: four random words from a counter
+ * and a key, with no state in between.
+ */
+void philox4x32(const uint32_t ctr[4], const uint32_t key[2], uint32_t out[4]);
+
+/**
+ * x[i] for i < n depends only on (seed, stream, i), so the result is the
+ * same for any num_threads (0 means all hardware threads).
+ */
+void fill_uniform(float *x, size_t n, float lo, float hi,
+    uint64_t seed, uint64_t stream, int num_threads=0);
+
+void fill_normal(float *x, size_t n, float mean, float stddev,
+    uint64_t seed, uint64_t stream, int num_threads=0);
+
+/**
+ * Sets the seed of all initializers and restarts their streams, so the
+ * same sequence of init() calls gives the same values.
+ */
+void set_seed(uint64_t seed);
+
+/**
+ * Base class of parameter initializers.
+ * Every init() call draws a new stream, so tensors initialized one after
+ * another get independent values.
+ */
+class Initializer {
+  public:
+    Initializer(): num_threads(0) {}
+
+    virtual ~Initializer() {}
+
+    virtual void init(Tensor &t) = 0;
+
+    // threads used to fill a tensor, 0 for all hardware threads
+    int num_threads;
+
+  protected:
+    void uniform(Tensor &t, float lo, float hi);
+
+    void normal(Tensor &t, float mean, float stddev);
+
+    // fan_in is the size of a row and fan_out the number of rows
+    static void fans(const Dim &d, float &fan_in, float &fan_out);
+};
+
+class NormalInitializer: public Initializer {
+  public:
+    NormalInitializer(float mean=0., float stddev=1.): mean(mean), stddev(stddev) {}
+
+    void init(Tensor &t) { normal(t, mean, stddev); }
+
+    float mean;
+    float stddev;
+};
+
+class UniformInitializer: public Initializer {
+  public:
+    UniformInitializer(float lo=-1., float hi=1.): lo(lo), hi(hi) {}
+
+    void init(Tensor &t) { uniform(t, lo, hi); }
+
+    float lo;
+    float hi;
+};
+
+/**
+ * uniform: U(-a, a) with a = gain * sqrt(6 / (fan_in + fan_out))
+ * normal:  N(0, s^2) with s = gain * sqrt(2 / (fan_in + fan_out))
+ */
+class GlorotInitializer: public Initializer {
+  public:
+    GlorotInitializer(bool is_uniform=true, float gain=1.)
+      : is_uniform(is_uniform), gain(gain) {}
+
+    void init(Tensor &t);
+
+    bool is_uniform;
+    float gain;
+};
+
+/**
+ * uniform: U(-a, a) with a = sqrt(6 / fan_in)
+ * normal:  N(0, s^2) with s = sqrt(2 / fan_in)
+ */
+class HeInitializer: public Initializer {
+  public:
+    HeInitializer(bool is_uniform=false): is_uniform(is_uniform) {}
+
+    void init(Tensor &t);
+
+    bool is_uniform;
+};
+
+/**
+ * A random matrix with orthonormal rows (or columns if there are more rows
+ * than columns), scaled by gain.
+ */
+class OrthogonalInitializer: public Initializer {
+  public:
+    OrthogonalInitializer(float gain=1.): gain(gain) {}
+
+    void init(Tensor &t);
+
+    float gain;
+};
+
+} // namespace rnnpp
+
+#endif // RNNPP_INITIALIZER_H_
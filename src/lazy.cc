@@ -0,0 +1,201 @@
+#include <map>
+
+#include "error.h"
+#include "lazy.h"
+
+namespace rnnpp {
+
+using internal::LazyTerm;
+
+LazyExpression::LazyExpression(const Expression &e)
+  : g_(e.g_), axis_(-2), scale_(1.) {
+  term_ = std::make_shared<LazyTerm>();
+  term_->code = kFusedLoad;
+  term_->id = e.id();
+}
+
+// Flattens the term tree into ops in post order. Shared subterms and loads
+// of the same expression are emitted once.
+static int compile(const std::shared_ptr<LazyTerm> &t,
+    std::map<const LazyTerm*, int> &emitted, std::map<int, int> &loaded,
+    std::vector<int> &ids, std::vector<FusedOp> &ops) {
+  auto it = emitted.find(t.get());
+  if (it != emitted.end()) {
+    return it->second;
+  }
+
+  FusedOp op;
+  op.code = t->code;
+  op.a = -1;
+  op.b = -1;
+  op.value = t->value;
+  if (t->code == kFusedLoad) {
+    auto l = loaded.find(t->id);
+    if (l != loaded.end()) {
+      return l->second;
+    }
+    op.a = ids.size();
+    ids.push_back(t->id);
+  } else {
+    if (t->a) op.a = compile(t->a, emitted, loaded, ids, ops);
+    if (t->b) op.b = compile(t->b, emitted, loaded, ids, ops);
+  }
+
+  int k = ops.size();
+  ops.push_back(op);
+  emitted[t.get()] = k;
+  if (t->code == kFusedLoad) {
+    loaded[t->id] = k;
+  }
+  return k;
+}
+
+LazyExpression::operator Expression() const {
+  RNNPP_CHECK(g_ != nullptr, "LazyExpression has no graph");
+  if (term_->code == kFusedLoad && !reduced() && scale_ == 1.) {
+    return Expression(g_, term_->id);
+  }
+
+  std::map<const LazyTerm*, int> emitted;
+  std::map<int, int> loaded;
+  std::vector<int> ids;
+  std::vector<FusedOp> ops;
+  compile(term_, emitted, loaded, ids, ops);
+
+  int i = g_->nodes().size();
+  Node* node = new FusedElementwise(ids, {i}, ops, axis_, scale_);
+  g_->add_node(node);
+  return Expression(g_, i);
+}
+
+LazyExpression lazy(const Expression &e) {
+  return LazyExpression(e);
+}
+
+static std::shared_ptr<LazyTerm> constant_term(float v) {
+  std::shared_ptr<LazyTerm> t = std::make_shared<LazyTerm>();
+  t->code = kFusedConst;
+  t->value = v;
+  return t;
+}
+
+static LazyExpression constant(Graph *g, float v) {
+  return LazyExpression(g, constant_term(v));
+}
+
+// Returns x as a plain chain that further ops can extend.
+static LazyExpression pending(const LazyExpression &x) {
+  if (x.reduced()) {
+    return LazyExpression(Expression(x));
+  }
+  if (x.scale_ != 1.) {
+    std::shared_ptr<LazyTerm> t = std::make_shared<LazyTerm>();
+    t->code = kFusedMul;
+    t->a = x.term_;
+    t->b = constant_term(x.scale_);
+    return LazyExpression(x.g_, t);
+  }
+  return x;
+}
+
+static LazyExpression unary(FusedOpCode code, const LazyExpression &x) {
+  LazyExpression a = pending(x);
+  std::shared_ptr<LazyTerm> t = std::make_shared<LazyTerm>();
+  t->code = code;
+  t->a = a.term_;
+  return LazyExpression(a.g_, t);
+}
+
+static LazyExpression binary(FusedOpCode code, const LazyExpression &x,
+    const LazyExpression &y) {
+  LazyExpression a = pending(x);
+  LazyExpression b = pending(y);
+  RNNPP_CHECK(a.g_ == b.g_, "LazyExpressions belong to different graphs");
+  std::shared_ptr<LazyTerm> t = std::make_shared<LazyTerm>();
+  t->code = code;
+  t->a = a.term_;
+  t->b = b.term_;
+  return LazyExpression(a.g_, t);
+}
+
+LazyExpression operator+(const LazyExpression &a, const LazyExpression &b) {
+  return binary(kFusedAdd, a, b);
+}
+
+LazyExpression operator-(const LazyExpression &a, const LazyExpression &b) {
+  return binary(kFusedSub, a, b);
+}
+
+LazyExpression operator*(const LazyExpression &a, const LazyExpression &b) {
+  return binary(kFusedMul, a, b);
+}
+
+LazyExpression operator/(const LazyExpression &a, const LazyExpression &b) {
+  return binary(kFusedDiv, a, b);
+}
+
+LazyExpression operator+(const LazyExpression &a, float b) {
+  return binary(kFusedAdd, a, constant(a.g_, b));
+}
+
+LazyExpression operator-(const LazyExpression &a, float b) {
+  return binary(kFusedSub, a, constant(a.g_, b));
+}
+
+// scaling is kept outside the chain so that it can follow a sum
+LazyExpression operator*(const LazyExpression &a, float b) {
+  LazyExpression ret = a;
+  ret.scale_ *= b;
+  return ret;
+}
+
+LazyExpression operator/(const LazyExpression &a, float b) {
+  LazyExpression ret = a;
+  ret.scale_ /= b;
+  return ret;
+}
+
+LazyExpression operator+(float a, const LazyExpression &b) {
+  return binary(kFusedAdd, constant(b.g_, a), b);
+}
+
+LazyExpression operator-(float a, const LazyExpression &b) {
+  return binary(kFusedSub, constant(b.g_, a), b);
+}
+
+LazyExpression operator*(float a, const LazyExpression &b) {
+  return b * a;
+}
+
+LazyExpression operator/(float a, const LazyExpression &b) {
+  return binary(kFusedDiv, constant(b.g_, a), b);
+}
+
+LazyExpression operator-(const LazyExpression &x) {
+  return unary(kFusedNeg, x);
+}
+
+LazyExpression square(const LazyExpression &x) {
+  return unary(kFusedSquare, x);
+}
+
+LazyExpression exp(const LazyExpression &x) {
+  return unary(kFusedExp, x);
+}
+
+LazyExpression tanh(const LazyExpression &x) {
+  return unary(kFusedTanh, x);
+}
+
+LazyExpression sigmoid(const LazyExpression &x) {
+  return unary(kFusedSigmoid, x);
+}
+
+LazyExpression sum(const LazyExpression &x, int axis) {
+  RNNPP_CHECK(axis >= -1, "Invalid axis: " << axis);
+  LazyExpression ret = x.reduced() ? LazyExpression(Expression(x)) : x;
+  ret.axis_ = axis;
+  return ret;
+}
+
+} // namespace rnnpp
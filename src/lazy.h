@@ -0,0 +1,89 @@
+#ifndef RNNPP_LAZY_H_
+#define RNNPP_LAZY_H_
+
+#include <memory>
+#include <vector>
+
+#include "expr.h"
+#include "node.h"
+
+namespace rnnpp {
+
+namespace internal {
+
+struct LazyTerm {
+  FusedOpCode code;
+  int id;      // expression id for kFusedLoad
+  float value; // for kFusedConst
+  std::shared_ptr<LazyTerm> a;
+  std::shared_ptr<LazyTerm> b;
+};
+
+} // namespace internal
+
+/**
+ * An elementwise computation that has not been added to the graph yet.
+ * Operations on LazyExpression only record terms. Converting to
+ * Expression adds a single FusedElementwise node that computes the whole
+ * chain, so no intermediate tensor is materialized:
+ *
+ *   Expression loss = sum(square(lazy(y_pred) - lazy(y)), 2) / n_batch;
+ *
+ * After a sum only scaling by a constant is recorded; any other operation
+ * first materializes the reduced value as an Expression.
+ */
+class LazyExpression {
+  public:
+    LazyExpression(): g_(nullptr), axis_(-2), scale_(1.) {}
+
+    explicit LazyExpression(const Expression &e);
+
+    LazyExpression(Graph *g, std::shared_ptr<internal::LazyTerm> t)
+      : g_(g), term_(t), axis_(-2), scale_(1.) {}
+
+    ~LazyExpression() {}
+
+    operator Expression() const;
+
+    bool reduced() const { return axis_ != -2; }
+
+    Graph* g_;
+    std::shared_ptr<internal::LazyTerm> term_;
+
+    // reduction axis, -2 for none
+    int axis_;
+    float scale_;
+};
+
+LazyExpression lazy(const Expression &e);
+
+LazyExpression operator+(const LazyExpression &a, const LazyExpression &b);
+LazyExpression operator-(const LazyExpression &a, const LazyExpression &b);
+LazyExpression operator*(const LazyExpression &a, const LazyExpression &b);
+LazyExpression operator/(const LazyExpression &a, const LazyExpression &b);
+
+LazyExpression operator+(const LazyExpression &a, float b);
+LazyExpression operator-(const LazyExpression &a, float b);
+LazyExpression operator*(const LazyExpression &a, float b);
+LazyExpression operator/(const LazyExpression &a, float b);
+LazyExpression operator+(float a, const LazyExpression &b);
+LazyExpression operator-(float a, const LazyExpression &b);
+LazyExpression operator*(float a, const LazyExpression &b);
+LazyExpression operator/(float a, const LazyExpression &b);
+
+LazyExpression operator-(const LazyExpression &x);
+
+LazyExpression square(const LazyExpression &x);
+LazyExpression exp(const LazyExpression &x);
+LazyExpression tanh(const LazyExpression &x);
+LazyExpression sigmoid(const LazyExpression &x);
+
+/**
+ * axis == -1 sums all elements of each batch element,
+ * axis == ndim sums along batch.
+ */
+LazyExpression sum(const LazyExpression &x, int axis);
+
+} // namespace rnnpp
+
+#endif // RNNPP_LAZY_H_
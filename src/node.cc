@@ -1,6 +1,13 @@
 #include <math.h>
+#include <string.h>
+#include <algorithm>
+#include <condition_variable>
+#include <functional>
 #include <iostream>
+#include <mutex>
+#include <thread>
 
+#include "arena.h"
 #include "dim.h"
 #include "error.h"
 #include "expr.h"
@@ -19,52 +26,270 @@ void InputNode::forward2(const std::vector<Tensor> &inputs,
   output[0]->data = const_cast<float*>(&data_->front());
 }
 
+// float parameters are passed through without a copy, fp16/bf16 ones are
+// widened into a fresh buffer
 void ParameterNode::forward(const std::vector<Tensor> &inputs, Tensor &output) {
   output.dim = dim;
-  output.data = param.value.data;
+  if (param.dtype == kFloat32) {
+    output.data = param.value.data;
+  } else {
+    output.data = alloc_floats(dim.size());
+    param.read(output.data);
+  }
 }
 
 void ParameterNode::forward2(const std::vector<Tensor> &inputs,
     std::vector<Tensor*> &output) {
   output[0]->dim = dim;
-  output[0]->data = param.value.data;
+  if (param.dtype == kFloat32) {
+    output[0]->data = param.value.data;
+  } else {
+    output[0]->data = alloc_floats(dim.size());
+    param.read(output[0]->data);
+  }
 }
 
 void LookupNode::forward(const std::vector<Tensor> &inputs, Tensor &output) {
-  output.dim = Dim({1, param.values[index].dim.shape[1]}, 1);
-  output.data = param.values[index].data;
+  output.dim = Dim({1, param.all_values.dim.shape[1]}, 1);
+  if (param.dtype == kFloat32) {
+    output.data = param.value(index).data;
+  } else {
+    output.data = alloc_floats(output.dim.size());
+    param.read_row(index, output.data);
+  }
 }
 
 void LookupNode::forward2(const std::vector<Tensor> &inputs,
     std::vector<Tensor*> &output) {
-  output[0]->dim = Dim({1, param.values[index].dim.shape[1]}, 1);
-  output[0]->data = param.values[index].data;
+  output[0]->dim = Dim({1, param.all_values.dim.shape[1]}, 1);
+  if (param.dtype == kFloat32) {
+    output[0]->data = param.value(index).data;
+  } else {
+    output[0]->data = alloc_floats(output[0]->dim.size());
+    param.read_row(index, output[0]->data);
+  }
 }
 
 void LookupNode::backward(const std::vector<Tensor> &inputs, const Tensor &output,
     const Tensor &dEdy, int ii, Tensor &dEdxi) {
-  dEdxi.dim = Dim({1, param.values[index].dim.shape[1]}, 1);
+  dEdxi.dim = Dim({1, param.all_values.dim.shape[1]}, 1);
   int k = dEdxi.dim.size() * dEdxi.dim.batch_size;
-  dEdxi.data = new float[k];
+  dEdxi.data = alloc_floats(k);
   dEdxi = dEdy;
 }
 
 void LookupNode::backward2(const std::vector<Tensor> &inputs,
     const std::vector<Tensor> &output,
     const std::vector<Tensor> &dEdy, int ii, Tensor &dEdxi) {
-  dEdxi.dim = Dim({1, param.values[index].dim.shape[1]}, 1);
+  dEdxi.dim = Dim({1, param.all_values.dim.shape[1]}, 1);
   int k = dEdxi.dim.size() * dEdxi.dim.batch_size;
-  dEdxi.data = new float[k];
+  dEdxi.data = alloc_floats(k);
   dEdxi = dEdy[0];
 }
 
+BatchedLookupNode::BatchedLookupNode(LookupParameter p, const std::vector<int> &indices,
+    std::initializer_list<int> out)
+  : ParameterNodeBase({}, out), param(p), indices(indices) {
+  int n_rows = p.all_values.dim.shape[0];
+  RNNPP_CHECK(!indices.empty(), "No indices to look up");
+  for (int b=0; b < indices.size(); ++b) {
+    RNNPP_CHECK(indices[b] >= 0 && indices[b] < n_rows,
+        "Index out of range: " << indices[b] << " (" << n_rows << " rows)");
+  }
+  dim = Dim({1, p.all_values.dim.shape[1]}, indices.size());
+
+  order.resize(indices.size());
+  for (int b=0; b < order.size(); ++b) {
+    order[b] = b;
+  }
+  const std::vector<int> &idx = this->indices;
+  std::stable_sort(order.begin(), order.end(),
+      [&idx](int a, int b) { return idx[a] < idx[b]; });
+}
+
+void BatchedLookupNode::forward(const std::vector<Tensor> &inputs, Tensor &output) {
+  int dim_emb = dim.shape[1];
+  int n = indices.size();
+  output.dim = dim;
+  output.data = alloc_floats((size_t)dim_emb * n);
+  if (param.dtype == kFloat32) {
+    gather_rows(param.all_values.data, dim_emb, indices.data(), n, output.data);
+  } else {
+    for (int b=0; b < n; ++b) {
+      param.read_row(indices[b], output.data + (size_t)b * dim_emb);
+    }
+  }
+}
+
+void BatchedLookupNode::forward2(const std::vector<Tensor> &inputs,
+    std::vector<Tensor*> &output) {
+  forward(inputs, *output[0]);
+}
+
+void BatchedLookupNode::add_gradient(const Tensor &dEdy) {
+  if (param.frozen()) {
+    return;
+  }
+  int n = indices.size();
+  scatter_add_rows(dEdy.data, dim.shape[1], indices.data(), order.data(), n,
+      param.all_grads.data);
+  for (int j=0; j < n; ++j) {
+    param.touch(indices[order[j]]);
+  }
+}
+
+EmbeddingBagNode::EmbeddingBagNode(LookupParameter p, const std::vector<int> &indices,
+    const std::vector<int> &offsets, BagMode mode, std::initializer_list<int> out)
+  : ParameterNodeBase({}, out), param(p), indices(indices), offsets(offsets), mode(mode) {
+  int n_rows = p.all_values.dim.shape[0];
+  int n = indices.size();
+  RNNPP_CHECK(!offsets.empty() && offsets[0] == 0, "offsets must start at 0");
+  for (int b=1; b < offsets.size(); ++b) {
+    RNNPP_CHECK(offsets[b - 1] <= offsets[b] && offsets[b] <= n,
+        "Invalid offset " << offsets[b] << " of bag " << b);
+  }
+  for (int j=0; j < n; ++j) {
+    RNNPP_CHECK(indices[j] >= 0 && indices[j] < n_rows,
+        "Index out of range: " << indices[j] << " (" << n_rows << " rows)");
+  }
+  int n_bags = offsets.size();
+  dim = Dim({1, p.all_values.dim.shape[1]}, n_bags);
+
+  bag.resize(n);
+  scale.resize(n_bags);
+  for (int b=0; b < n_bags; ++b) {
+    int end = b + 1 < n_bags ? offsets[b + 1] : n;
+    for (int j=offsets[b]; j < end; ++j) {
+      bag[j] = b;
+    }
+    scale[b] = end > offsets[b] ? 1.f / (end - offsets[b]) : 0.f;
+  }
+
+  order.resize(n);
+  for (int j=0; j < n; ++j) {
+    order[j] = j;
+  }
+  const std::vector<int> &idx = this->indices;
+  std::stable_sort(order.begin(), order.end(),
+      [&idx](int a, int b) { return idx[a] < idx[b]; });
+}
+
+void EmbeddingBagNode::forward(const std::vector<Tensor> &inputs, Tensor &output) {
+  int dim_emb = dim.shape[1];
+  int n_bags = offsets.size();
+  int n = indices.size();
+  output.dim = dim;
+  output.data = alloc_floats((size_t)dim_emb * n_bags);
+  if (mode == kBagMax) {
+    argmax.resize((size_t)dim_emb * n_bags);
+  }
+
+  if (param.dtype == kFloat32) {
+    bag_rows(param.all_values.data, dim_emb, indices.data(), offsets.data(),
+        n_bags, n, mode, output.data, argmax.data());
+    return;
+  }
+
+  // half precision rows are decoded one bag at a time
+  std::vector<float> rows;
+  std::vector<int> local;
+  int zero = 0;
+  for (int b=0; b < n_bags; ++b) {
+    int begin = offsets[b];
+    int end = b + 1 < n_bags ? offsets[b + 1] : n;
+    rows.resize((size_t)(end - begin) * dim_emb);
+    local.resize(end - begin);
+    for (int j=begin; j < end; ++j) {
+      param.read_row(indices[j], &rows[(size_t)(j - begin) * dim_emb]);
+      local[j - begin] = j - begin;
+    }
+    int *a = mode == kBagMax ? &argmax[(size_t)b * dim_emb] : nullptr;
+    bag_rows(rows.data(), dim_emb, local.data(), &zero, 1, end - begin, mode,
+        output.data + (size_t)b * dim_emb, a);
+    for (int k=0; a && k < dim_emb; ++k) {
+      if (a[k] >= 0) a[k] += begin;
+    }
+  }
+}
+
+void EmbeddingBagNode::forward2(const std::vector<Tensor> &inputs,
+    std::vector<Tensor*> &output) {
+  forward(inputs, *output[0]);
+}
+
+void EmbeddingBagNode::add_gradient(const Tensor &dEdy) {
+  if (param.frozen()) {
+    return;
+  }
+  int dim_emb = dim.shape[1];
+  int n = indices.size();
+  float *grads = param.all_grads.data;
+
+  if (mode == kBagMax) {
+    for (int b=0; b < offsets.size(); ++b) {
+      const int *a = &argmax[(size_t)b * dim_emb];
+      const float *d = dEdy.data + (size_t)b * dim_emb;
+      for (int k=0; k < dim_emb; ++k) {
+        if (a[k] >= 0) {
+          grads[(size_t)indices[a[k]] * dim_emb + k] += d[k];
+        }
+      }
+    }
+  } else {
+    scatter_add_bags(dEdy.data, dim_emb, indices.data(), bag.data(),
+        mode == kBagMean ? scale.data() : nullptr, order.data(), n, grads);
+  }
+  for (int j=0; j < n; ++j) {
+    param.touch(indices[order[j]]);
+  }
+}
+
+void QuantizedLookupNode::forward(const std::vector<Tensor> &inputs, Tensor &output) {
+  output.dim = dim;
+  output.data = alloc_floats(dim.size());
+  dequantize_row(param.all_values, index, output.data);
+}
+
+void QuantizedLookupNode::forward2(const std::vector<Tensor> &inputs,
+    std::vector<Tensor*> &output) {
+  forward(inputs, *output[0]);
+}
+
+void QuantizedMult::forward(const std::vector<Tensor> &inputs, Tensor &output) {
+  RNNPP_CHECK(inputs.size() == 1 || inputs.size() == 2,
+      "Number of inputs is invalid: " << inputs.size());
+
+  output.dim = Dim({w_.value.rows(), inputs[0].dim.shape[1]}, inputs[0].dim.batch_size);
+  int k = output.dim.size() * output.dim.batch_size;
+  output.data = alloc_floats(k);
+
+  const Tensor *bias = inputs.size() == 2 ? &inputs[1] : nullptr;
+  matmul_int8(w_.value, inputs[0], bias, act_, output);
+}
+
+void QuantizedMult::forward2(const std::vector<Tensor> &inputs,
+    std::vector<Tensor*> &output) {
+  forward(inputs, *output[0]);
+}
+
+void QuantizedMult::backward(const std::vector<Tensor> &inputs, const Tensor &output,
+    const Tensor &dEdy, int ii, Tensor &dEdxi) {
+  RNNPP_CHECK(false, "QuantizedMult does not support backward");
+}
+
+void QuantizedMult::backward2(const std::vector<Tensor> &inputs,
+    const std::vector<Tensor> &output,
+    const std::vector<Tensor> &dEdy, int ii, Tensor &dEdxi) {
+  RNNPP_CHECK(false, "QuantizedMult does not support backward");
+}
+
 //void Square::forward(const std::vector<Tensor> &inputs, Tensor &output) {
 //  RNNPP_CHECK(inputs.size() == 1, "Number of inputs is invalid: " << inputs.size());
 
 //  int max_b = inputs[0].dim.batch_size;
 //  output.dim = inputs[0].dim;
 //  int k = output.dim.size() * output.dim.batch_size;
-//  output.data = new float[k];
+//  output.data = alloc_floats(k);
 
 //  for (int b=0; b < max_b; ++b) {
 //    for (int i=0; i < output.dim.size(); ++i) {
@@ -96,7 +321,7 @@ void Sum::forward(const std::vector<Tensor> &inputs, Tensor &output) {
   }
 
   int k = output.dim.size() * output.dim.batch_size;
-  output.data = new float[k];
+  output.data = alloc_floats(k);
 
   output = Scalar(0.);
   for (int i=0; i < inputs.size(); ++i) {
@@ -122,7 +347,7 @@ void Sum::forward2(const std::vector<Tensor> &inputs, std::vector<Tensor*> &outp
   }
 
   int k = output[0]->dim.size() * output[0]->dim.batch_size;
-  output[0]->data = new float[k];
+  output[0]->data = alloc_floats(k);
 
   *output[0] = Scalar(0.);
   for (int i=0; i < inputs.size(); ++i) {
@@ -130,20 +355,39 @@ void Sum::forward2(const std::vector<Tensor> &inputs, std::vector<Tensor*> &outp
   }
 }
 
+// View of dEdy with the summed axis kept as size 1, so that it can be
+// broadcast back to the shape of the input.
+static Tensor unreduce(const Tensor &dEdy, const Dim &d, int axis) {
+  int nd = d.shape.size();
+  Tensor g;
+  g.data = dEdy.data;
+  if (axis == -1) {
+    g.dim = Dim(std::vector<int>(nd, 1), dEdy.dim.batch_size);
+  } else if (axis == nd) {
+    g.dim = Dim(d.shape, 1);
+  } else {
+    std::vector<int> shape = d.shape;
+    shape[axis] = 1;
+    g.dim = Dim(shape, dEdy.dim.batch_size);
+  }
+  return g;
+}
+
+// dE/dx_{i, j, k} = dE/dy_{i, k}
 void Sum::backward(const std::vector<Tensor> &inputs, const Tensor &output,
     const Tensor &dEdy, int ii, Tensor &dEdxi) {
   dEdxi.dim = inputs[ii].dim;
   int k = dEdxi.dim.size() * dEdxi.dim.batch_size;
-  dEdxi.data = new float[k];
-  dEdxi = Scalar(as_scalar(dEdy));
+  dEdxi.data = alloc_floats(k);
+  dEdxi = unreduce(dEdy, dEdxi.dim, axis_).broadcast_to(dEdxi.dim);
 }
 
 void Sum::backward2(const std::vector<Tensor> &inputs, const std::vector<Tensor> &output,
     const std::vector<Tensor> &dEdy, int ii, Tensor &dEdxi) {
   dEdxi.dim = inputs[ii].dim;
   int k = dEdxi.dim.size() * dEdxi.dim.batch_size;
-  dEdxi.data = new float[k];
-  dEdxi = Scalar(as_scalar(dEdy[0]));
+  dEdxi.data = alloc_floats(k);
+  dEdxi = unreduce(dEdy[0], dEdxi.dim, axis_).broadcast_to(dEdxi.dim);
 }
 
 void Concat::forward(const std::vector<Tensor> &inputs, Tensor &output) {
@@ -168,7 +412,7 @@ void Concat::forward(const std::vector<Tensor> &inputs, Tensor &output) {
   }
 
   int s = output.dim.size() * output.dim.batch_size;
-  output.data = new float[s];
+  output.data = alloc_floats(s);
   concatenate(inputs, output, axis_);
 }
 
@@ -194,7 +438,7 @@ void Concat::forward2(const std::vector<Tensor> &inputs, std::vector<Tensor*> &o
   }
 
   int s = output[0]->dim.size() * output[0]->dim.batch_size;
-  output[0]->data = new float[s];
+  output[0]->data = alloc_floats(s);
   concatenate(inputs, *output[0], axis_);
 }
 
@@ -202,7 +446,7 @@ void Concat::backward(const std::vector<Tensor> &inputs, const Tensor &output,
     const Tensor &dEdy, int ii, Tensor &dEdxi) {
   dEdxi.dim = inputs[ii].dim;
   int k = dEdxi.dim.size() * dEdxi.dim.batch_size;
-  dEdxi.data = new float[k];
+  dEdxi.data = alloc_floats(k);
   slice(dEdy, dEdxi, ii, axis_);
 }
 
@@ -210,7 +454,7 @@ void Concat::backward2(const std::vector<Tensor> &inputs, const std::vector<Tens
     const std::vector<Tensor> &dEdy, int ii, Tensor &dEdxi) {
   dEdxi.dim = inputs[ii].dim;
   int k = dEdxi.dim.size() * dEdxi.dim.batch_size;
-  dEdxi.data = new float[k];
+  dEdxi.data = alloc_floats(k);
   slice(dEdy[0], dEdxi, ii, axis_);
 }
 
@@ -220,7 +464,7 @@ void Split::forward(const std::vector<Tensor> &inputs, Tensor &output) {
   }
 
   int s = output.dim.size() * output.dim.batch_size;
-  output.data = new float[s];
+  output.data = alloc_floats(s);
   concatenate(inputs, output, axis_);
 }
 
@@ -228,58 +472,71 @@ void Split::backward(const std::vector<Tensor> &inputs, const Tensor &output,
     const Tensor &dEdy, int ii, Tensor &dEdxi) {
   dEdxi.dim = inputs[ii].dim;
   int k = dEdxi.dim.size() * dEdxi.dim.batch_size;
-  dEdxi.data = new float[k];
+  dEdxi.data = alloc_floats(k);
   slice(dEdy, dEdxi, ii, axis_);
 }
 
 
 // f(a, b) = a + b
-// 
+//
 // dE/da = dEdy * dyda = dEdy
 // dE/db = dEdy * dydb = dEdy
+//
+// a and b are broadcast against each other, and the gradient of a
+// broadcast input is summed over the axes it was expanded along.
 void Add::forward(const std::vector<Tensor> &inputs, Tensor &output) {
   RNNPP_CHECK(inputs.size() == 2, "Number of inputs is invalid: " << inputs.size());
-  RNNPP_CHECK(inputs[0].dim == inputs[1].dim,
-      "Invalid dimensions" << inputs[0].dim << " " << inputs[1].dim);
-  int max_b = std::max(inputs[0].dim.batch_size, inputs[1].dim.batch_size);
-  output.dim = Dim({inputs[0].dim.shape[0], inputs[1].dim.shape[1]}, max_b);
+  output.dim = broadcast(inputs[0].dim, inputs[1].dim);
   int k = output.dim.size() * output.dim.batch_size;
-  output.data = new float[k];
+  output.data = alloc_floats(k);
 
   Tensor a = inputs[0];
   Tensor b = inputs[1];
-  output = a + b;
+  if (a.dim == b.dim) {
+    output = a + b;
+  } else {
+    output = a.broadcast_to(output.dim) + b.broadcast_to(output.dim);
+  }
 }
 
 void Add::forward2(const std::vector<Tensor> &inputs,
     std::vector<Tensor*> &output) {
   RNNPP_CHECK(inputs.size() == 2, "Number of inputs is invalid: " << inputs.size());
-  RNNPP_CHECK(inputs[0].dim == inputs[1].dim,
-      "Invalid dimensions" << inputs[0].dim << " " << inputs[1].dim);
-  int max_b = std::max(inputs[0].dim.batch_size, inputs[1].dim.batch_size);
-  output[0]->dim = Dim({inputs[0].dim.shape[0], inputs[1].dim.shape[1]}, max_b);
+  output[0]->dim = broadcast(inputs[0].dim, inputs[1].dim);
   int k = output[0]->dim.size() * output[0]->dim.batch_size;
-  output[0]->data = new float[k];
+  output[0]->data = alloc_floats(k);
 
   Tensor a = inputs[0];
   Tensor b = inputs[1];
-  *output[0] = a + b;
+  if (a.dim == b.dim) {
+    *output[0] = a + b;
+  } else {
+    *output[0] = a.broadcast_to(output[0]->dim) + b.broadcast_to(output[0]->dim);
+  }
 }
 
 void Add::backward(const std::vector<Tensor> &inputs, const Tensor &output,
     const Tensor &dEdy, int ii, Tensor &dEdxi) {
   dEdxi.dim = inputs[ii].dim;
   int k = dEdxi.dim.size() * dEdxi.dim.batch_size;
-  dEdxi.data = new float[k];
-  dEdxi = dEdy;
+  dEdxi.data = alloc_floats(k);
+  if (is_broadcast(dEdxi.dim, dEdy.dim)) {
+    sum_to(dEdy, dEdxi);
+  } else {
+    dEdxi = dEdy;
+  }
 }
 
 void Add::backward2(const std::vector<Tensor> &inputs, const std::vector<Tensor> &output,
     const std::vector<Tensor> &dEdy, int ii, Tensor &dEdxi) {
   dEdxi.dim = inputs[ii].dim;
   int k = dEdxi.dim.size() * dEdxi.dim.batch_size;
-  dEdxi.data = new float[k];
-  dEdxi = dEdy[0];
+  dEdxi.data = alloc_floats(k);
+  if (is_broadcast(dEdxi.dim, dEdy[0].dim)) {
+    sum_to(dEdy[0], dEdxi);
+  } else {
+    dEdxi = dEdy[0];
+  }
 }
 
 void Mult::forward(const std::vector<Tensor> &inputs, Tensor &output) {
@@ -288,7 +545,7 @@ void Mult::forward(const std::vector<Tensor> &inputs, Tensor &output) {
   int max_b = std::max(inputs[0].dim.batch_size, inputs[1].dim.batch_size);
   output.dim = Dim({inputs[0].dim.shape[0], inputs[1].dim.shape[1]}, max_b);
   int k = output.dim.size() * output.dim.batch_size;
-  output.data = new float[k];
+  output.data = alloc_floats(k);
 
   Tensor w = inputs[0];
   Tensor x = inputs[1];
@@ -302,7 +559,7 @@ void Mult::forward2(const std::vector<Tensor> &inputs,
   int max_b = std::max(inputs[0].dim.batch_size, inputs[1].dim.batch_size);
   output[0]->dim = Dim({inputs[0].dim.shape[0], inputs[1].dim.shape[1]}, max_b);
   int k = output[0]->dim.size() * output[0]->dim.batch_size;
-  output[0]->data = new float[k];
+  output[0]->data = alloc_floats(k);
 
   Tensor w = inputs[0];
   Tensor x = inputs[1];
@@ -317,7 +574,7 @@ void Mult::backward(const std::vector<Tensor> &inputs, const Tensor &output,
     const Tensor &dEdy, int ii, Tensor &dEdxi) {
   dEdxi.dim = inputs[ii].dim;
   int k = dEdxi.dim.size() * dEdxi.dim.batch_size;
-  dEdxi.data = new float[k];
+  dEdxi.data = alloc_floats(k);
 
   Tensor w = inputs[0];
   Tensor x = inputs[1];
@@ -352,7 +609,7 @@ void Mult::backward2(const std::vector<Tensor> &inputs, const std::vector<Tensor
     const std::vector<Tensor> &dEdy, int ii, Tensor &dEdxi) {
   dEdxi.dim = inputs[ii].dim;
   int k = dEdxi.dim.size() * dEdxi.dim.batch_size;
-  dEdxi.data = new float[k];
+  dEdxi.data = alloc_floats(k);
 
   Tensor w = inputs[0];
   Tensor x = inputs[1];
@@ -384,34 +641,84 @@ void Mult::backward2(const std::vector<Tensor> &inputs, const std::vector<Tensor
 }
 
 
+void CwiseMult::forward(const std::vector<Tensor> &inputs, Tensor &output) {
+  RNNPP_CHECK(inputs.size() == 2, "Number of inputs is invalid: " << inputs.size());
+
+  output.dim = broadcast(inputs[0].dim, inputs[1].dim);
+  int k = output.dim.size() * output.dim.batch_size;
+  output.data = alloc_floats(k);
+
+  Tensor a = inputs[0];
+  Tensor b = inputs[1];
+  if (a.dim == b.dim) {
+    output = a * b;
+  } else {
+    output = a.broadcast_to(output.dim) * b.broadcast_to(output.dim);
+  }
+}
+
+void CwiseMult::forward2(const std::vector<Tensor> &inputs, std::vector<Tensor*> &output) {
+  forward(inputs, *output[0]);
+}
+
+// y = a * b
+// dEda = dEdy * b
+// dEdb = dEdy * a
+void CwiseMult::backward(const std::vector<Tensor> &inputs, const Tensor &output,
+    const Tensor &dEdy, int ii, Tensor &dEdxi) {
+  dEdxi.dim = inputs[ii].dim;
+  int k = dEdxi.dim.size() * dEdxi.dim.batch_size;
+  dEdxi.data = alloc_floats(k);
+
+  const Tensor &other = inputs[1 - ii];
+  if (!is_broadcast(inputs[0].dim, dEdy.dim) && !is_broadcast(inputs[1].dim, dEdy.dim)) {
+    dEdxi = dEdy * other;
+    return;
+  }
+
+  std::vector<float> buf(dEdy.dim.size() * dEdy.dim.batch_size);
+  Tensor tmp;
+  tmp.dim = dEdy.dim;
+  tmp.data = buf.data();
+  tmp = dEdy * other.broadcast_to(dEdy.dim);
+  sum_to(tmp, dEdxi);
+}
+
+void CwiseMult::backward2(const std::vector<Tensor> &inputs, const std::vector<Tensor> &output,
+    const std::vector<Tensor> &dEdy, int ii, Tensor &dEdxi) {
+  backward(inputs, output[0], dEdy[0], ii, dEdxi);
+}
+
 void Divide::forward(const std::vector<Tensor> &inputs, Tensor &output) {
   RNNPP_CHECK(inputs.size() == 2, "Number of inputs is invalid: " << inputs.size());
-  RNNPP_CHECK(inputs[0].dim == inputs[1].dim,
-      "Invalid dimensions" << inputs[0].dim << " " << inputs[1].dim);
 
-  int max_b = std::max(inputs[0].dim.batch_size, inputs[1].dim.batch_size);
-  output.dim = Dim(inputs[0].dim.shape, max_b);
+  output.dim = broadcast(inputs[0].dim, inputs[1].dim);
   int k = output.dim.size() * output.dim.batch_size;
-  output.data = new float[k];
+  output.data = alloc_floats(k);
 
   Tensor a = inputs[0];
   Tensor b = inputs[1];
-  output = a / b;
+  if (a.dim == b.dim) {
+    output = a / b;
+  } else {
+    output = a.broadcast_to(output.dim) / b.broadcast_to(output.dim);
+  }
 }
 
 void Divide::forward2(const std::vector<Tensor> &inputs, std::vector<Tensor*> &output) {
   RNNPP_CHECK(inputs.size() == 2, "Number of inputs is invalid: " << inputs.size());
-  RNNPP_CHECK(inputs[0].dim == inputs[1].dim,
-      "Invalid dimensions" << inputs[0].dim << " " << inputs[1].dim);
 
-  int max_b = std::max(inputs[0].dim.batch_size, inputs[1].dim.batch_size);
-  output[0]->dim = Dim(inputs[0].dim.shape, max_b);
+  output[0]->dim = broadcast(inputs[0].dim, inputs[1].dim);
   int k = output[0]->dim.size() * output[0]->dim.batch_size;
-  output[0]->data = new float[k];
+  output[0]->data = alloc_floats(k);
 
   Tensor a = inputs[0];
   Tensor b = inputs[1];
-  *output[0] = a / b;
+  if (a.dim == b.dim) {
+    *output[0] = a / b;
+  } else {
+    *output[0] = a.broadcast_to(output[0]->dim) / b.broadcast_to(output[0]->dim);
+  }
 }
 
 // y = a / b
@@ -421,26 +728,34 @@ void Divide::backward(const std::vector<Tensor> &inputs, const Tensor &output,
     const Tensor &dEdy, int ii, Tensor &dEdxi) {
   dEdxi.dim = inputs[ii].dim;
   int k = dEdxi.dim.size() * dEdxi.dim.batch_size;
-  dEdxi.data = new float[k];
+  dEdxi.data = alloc_floats(k);
 
+  if (!is_broadcast(inputs[0].dim, dEdy.dim) && !is_broadcast(inputs[1].dim, dEdy.dim)) {
+    if (ii == 0) {
+      dEdxi = dEdy / inputs[1];
+    } else {
+      dEdxi = dEdy * (-inputs[0] / square(inputs[1]));
+    }
+    return;
+  }
+
+  std::vector<float> buf(dEdy.dim.size() * dEdy.dim.batch_size);
+  Tensor tmp;
+  tmp.dim = dEdy.dim;
+  tmp.data = buf.data();
+  BroadcastTensor a = inputs[0].broadcast_to(dEdy.dim);
+  BroadcastTensor b = inputs[1].broadcast_to(dEdy.dim);
   if (ii == 0) {
-    dEdxi = dEdy / inputs[1];
+    tmp = dEdy / b;
   } else {
-    dEdxi = dEdy * (-inputs[0] / square(inputs[1]));
+    tmp = dEdy * (-a / square(b));
   }
+  sum_to(tmp, dEdxi);
 }
 
 void Divide::backward2(const std::vector<Tensor> &inputs, const std::vector<Tensor> &output,
     const std::vector<Tensor> &dEdy, int ii, Tensor &dEdxi) {
-  dEdxi.dim = inputs[ii].dim;
-  int k = dEdxi.dim.size() * dEdxi.dim.batch_size;
-  dEdxi.data = new float[k];
-
-  if (ii == 0) {
-    dEdxi = dEdy[0] / inputs[1];
-  } else {
-    dEdxi = dEdy[0] * (-inputs[0] / square(inputs[1]));
-  }
+  backward(inputs, output[0], dEdy[0], ii, dEdxi);
 }
 
 void DivideConst::forward(const std::vector<Tensor> &inputs, Tensor &output) {
@@ -449,7 +764,7 @@ void DivideConst::forward(const std::vector<Tensor> &inputs, Tensor &output) {
   int max_b = inputs[0].dim.batch_size;
   output.dim = Dim(inputs[0].dim.shape, max_b);
   int k = output.dim.size() * output.dim.batch_size;
-  output.data = new float[k];
+  output.data = alloc_floats(k);
 
   Tensor a = inputs[0];
   if (rhs_is_const) {
@@ -465,7 +780,7 @@ void DivideConst::forward2(const std::vector<Tensor> &inputs, std::vector<Tensor
   int max_b = inputs[0].dim.batch_size;
   output[0]->dim = Dim(inputs[0].dim.shape, max_b);
   int k = output[0]->dim.size() * output[0]->dim.batch_size;
-  output[0]->data = new float[k];
+  output[0]->data = alloc_floats(k);
 
   Tensor a = inputs[0];
   if (rhs_is_const) {
@@ -479,7 +794,7 @@ void DivideConst::backward(const std::vector<Tensor> &inputs, const Tensor &outp
     const Tensor &dEdy, int ii, Tensor &dEdxi) {
   dEdxi.dim = inputs[ii].dim;
   int k = dEdxi.dim.size() * dEdxi.dim.batch_size;
-  dEdxi.data = new float[k];
+  dEdxi.data = alloc_floats(k);
 
   if (rhs_is_const) {
     dEdxi = dEdy / Scalar(value);
@@ -492,7 +807,7 @@ void DivideConst::backward2(const std::vector<Tensor> &inputs, const std::vector
     const std::vector<Tensor> &dEdy, int ii, Tensor &dEdxi) {
   dEdxi.dim = inputs[ii].dim;
   int k = dEdxi.dim.size() * dEdxi.dim.batch_size;
-  dEdxi.data = new float[k];
+  dEdxi.data = alloc_floats(k);
 
   if (rhs_is_const) {
     dEdxi = dEdy[0] / Scalar(value);
@@ -505,7 +820,7 @@ void DivideConst::backward2(const std::vector<Tensor> &inputs, const std::vector
 void TanhNode::forward(const std::vector<Tensor> &inputs, Tensor &output) {
   output.dim = inputs[0].dim;
   int k = output.dim.size() * output.dim.batch_size;
-  output.data = new float[k];
+  output.data = alloc_floats(k);
   output = (exp(inputs[0]) - exp(-inputs[0])) / (exp(inputs[0]) + exp(-inputs[0]));
 }
 
@@ -514,7 +829,7 @@ void TanhNode::forward2(const std::vector<Tensor> &inputs,
   RNNPP_CHECK(output.size() == 1, "Number of output must be 1");
   output[0]->dim = inputs[0].dim;
   int k = output[0]->dim.size() * output[0]->dim.batch_size;
-  output[0]->data = new float[k];
+  output[0]->data = alloc_floats(k);
   *output[0] = (exp(inputs[0]) - exp(-inputs[0])) / (exp(inputs[0]) + exp(-inputs[0]));
 }
 
@@ -522,7 +837,7 @@ void TanhNode::backward(const std::vector<Tensor> &inputs, const Tensor &output,
     const Tensor &dEdy, int ii, Tensor &dEdxi) {
   dEdxi.dim = inputs[ii].dim;
   int k = dEdxi.dim.size() * dEdxi.dim.batch_size;
-  dEdxi.data = new float[k];
+  dEdxi.data = alloc_floats(k);
   dEdxi = dEdy * (Scalar(1.) - (output * output));
 }
 
@@ -530,21 +845,21 @@ void TanhNode::backward2(const std::vector<Tensor> &inputs, const std::vector<Te
     const std::vector<Tensor> &dEdy, int ii, Tensor &dEdxi) {
   dEdxi.dim = inputs[ii].dim;
   int k = dEdxi.dim.size() * dEdxi.dim.batch_size;
-  dEdxi.data = new float[k];
+  dEdxi.data = alloc_floats(k);
   dEdxi = dEdy[0] * (Scalar(1.) - (output[0] * output[0]));
 }
 
 void SigmoidNode::forward(const std::vector<Tensor> &inputs, Tensor &output) {
   output.dim = inputs[0].dim;
   int k = output.dim.size() * output.dim.batch_size;
-  output.data = new float[k];
+  output.data = alloc_floats(k);
   output = Scalar(1.) / (Scalar(1.) + exp(-inputs[0]));
 }
 
 void SigmoidNode::forward2(const std::vector<Tensor> &inputs, std::vector<Tensor*> &output) {
   output[0]->dim = inputs[0].dim;
   int k = output[0]->dim.size() * output[0]->dim.batch_size;
-  output[0]->data = new float[k];
+  output[0]->data = alloc_floats(k);
   *output[0] = Scalar(1.) / (Scalar(1.) + exp(-inputs[0]));
 }
 
@@ -552,7 +867,7 @@ void SigmoidNode::backward(const std::vector<Tensor> &inputs, const Tensor &outp
     const Tensor &dEdy, int ii, Tensor &dEdxi) {
   dEdxi.dim = inputs[0].dim;
   int k = dEdxi.dim.size() * dEdxi.dim.batch_size;
-  dEdxi.data = new float[k];
+  dEdxi.data = alloc_floats(k);
   dEdxi = dEdy * (Scalar(1.) - output) * output;
 }
 
@@ -560,7 +875,7 @@ void SigmoidNode::backward2(const std::vector<Tensor> &inputs, const std::vector
     const std::vector<Tensor> &dEdy, int ii, Tensor &dEdxi) {
   dEdxi.dim = inputs[0].dim;
   int k = dEdxi.dim.size() * dEdxi.dim.batch_size;
-  dEdxi.data = new float[k];
+  dEdxi.data = alloc_floats(k);
   dEdxi = dEdy[0] * (Scalar(1.) - output[0]) * output[0];
 }
 
@@ -572,7 +887,7 @@ void SquaredDistance::forward(const std::vector<Tensor> &inputs, Tensor &output)
 
   output.dim = Dim(inputs[0].dim.shape, max_b);
   int k = output.dim.size() * output.dim.batch_size;
-  output.data = new float[k];
+  output.data = alloc_floats(k);
 
   const Tensor &y1 = inputs[0];
   const Tensor &y2 = inputs[1];
@@ -589,7 +904,7 @@ void SquaredDistance::forward2(const std::vector<Tensor> &inputs,
 
   output[0]->dim = Dim(inputs[0].dim.shape, max_b);
   int k = output[0]->dim.size() * output[0]->dim.batch_size;
-  output[0]->data = new float[k];
+  output[0]->data = alloc_floats(k);
 
   const Tensor &y1 = inputs[0];
   const Tensor &y2 = inputs[1];
@@ -603,7 +918,7 @@ void SquaredDistance::backward(const std::vector<Tensor> &inputs, const Tensor &
     const Tensor &dEdy, int ii, Tensor &dEdxi) {
   dEdxi.dim = inputs[ii].dim;
   int k = dEdxi.dim.size() * dEdxi.dim.batch_size;
-  dEdxi.data = new float[k];
+  dEdxi.data = alloc_floats(k);
 
   if (ii == 0) {
     dEdxi = dEdy * Scalar(2.) * (inputs[0] - inputs[1]);
@@ -619,7 +934,7 @@ void SquaredDistance::backward2(const std::vector<Tensor> &inputs,
     const std::vector<Tensor> &dEdy, int ii, Tensor &dEdxi) {
   dEdxi.dim = inputs[ii].dim;
   int k = dEdxi.dim.size() * dEdxi.dim.batch_size;
-  dEdxi.data = new float[k];
+  dEdxi.data = alloc_floats(k);
 
   if (ii == 0) {
     dEdxi = dEdy[0] * Scalar(2.) * (inputs[0] - inputs[1]);
@@ -630,5 +945,1293 @@ void SquaredDistance::backward2(const std::vector<Tensor> &inputs,
 //  std::cout << dEdxi << std::endl;
 }
 
+void PickNegLogSoftmax::forward(const std::vector<Tensor> &inputs, Tensor &output) {
+  RNNPP_CHECK(inputs.size() == 1, "Number of inputs is invalid: " << inputs.size());
+  const Tensor &x = inputs[0];
+  int B = x.dim.batch_size;
+  int n = x.dim.size();
+  RNNPP_CHECK(targets_.size() == B, targets_.size() << " targets for a batch of " << B);
+  for (int b=0; b < B; ++b) {
+    RNNPP_CHECK(targets_[b] >= 0 && targets_[b] < n,
+        "Target " << targets_[b] << " out of range for logits " << x.dim);
+  }
+
+  output.dim = Dim({1}, B);
+  output.data = alloc_floats(B);
+  lse_.resize(B);
+  for (int b=0; b < B; ++b) {
+    const float *xb = x.data + (size_t)b * n;
+    lse_[b] = online_logsumexp(xb, n);
+    output.data[b] = lse_[b] - xb[targets_[b]];
+  }
+}
+
+void PickNegLogSoftmax::forward2(const std::vector<Tensor> &inputs,
+    std::vector<Tensor*> &output) {
+  forward(inputs, *output[0]);
+}
+
+// dE/dx_j = dE/dy * (softmax(x)_j - [j == t])
+void PickNegLogSoftmax::backward(const std::vector<Tensor> &inputs, const Tensor &output,
+    const Tensor &dEdy, int ii, Tensor &dEdxi) {
+  const Tensor &x = inputs[0];
+  int B = x.dim.batch_size;
+  int n = x.dim.size();
+  dEdxi.dim = x.dim;
+  dEdxi.data = alloc_floats((size_t)n * B);
+  for (int b=0; b < B; ++b) {
+    const float *xb = x.data + (size_t)b * n;
+    float *gb = dEdxi.data + (size_t)b * n;
+    float d = dEdy.data[dEdy.dim.batch_size > 1 ? b : 0];
+    float lse = lse_[b];
+    for (int j=0; j < n; ++j) {
+      gb[j] = d * expf(xb[j] - lse);
+    }
+    gb[targets_[b]] -= d;
+  }
+}
+
+void PickNegLogSoftmax::backward2(const std::vector<Tensor> &inputs,
+    const std::vector<Tensor> &output,
+    const std::vector<Tensor> &dEdy, int ii, Tensor &dEdxi) {
+  backward(inputs, output[0], dEdy[0], ii, dEdxi);
+}
+
+void CandidateSoftmaxLoss::forward(const std::vector<Tensor> &inputs, Tensor &output) {
+  RNNPP_CHECK(inputs.size() == 3, "Number of inputs is invalid: " << inputs.size());
+  const Tensor &h = inputs[0];
+  const Tensor &w = inputs[1];
+  const Tensor &bias = inputs[2];
+  int B = h.dim.batch_size;
+  int H = h.dim.size();
+  int n = w.dim.batch_size;
+  RNNPP_CHECK(w.dim.size() == H && bias.dim.size() == 1 && bias.dim.batch_size == n,
+      "Invalid rows " << w.dim << " and biases " << bias.dim << " for " << h.dim);
+  RNNPP_CHECK(begin_.size() == B && end_.size() == B && target_.size() == B,
+      "Candidates of " << begin_.size() << " examples for a batch of " << B);
+  RNNPP_CHECK((shift_.empty() || shift_.size() == n) && (ids_.empty() || ids_.size() == n),
+      "Shifts or ids do not match the " << n << " rows");
+
+  offsets_.resize(B + 1);
+  offsets_[0] = 0;
+  for (int b=0; b < B; ++b) {
+    RNNPP_CHECK(0 <= begin_[b] && begin_[b] <= end_[b] && end_[b] <= n &&
+        0 <= target_[b] && target_[b] < n, "Invalid rows [" << begin_[b] << ", "
+        << end_[b] << ") and target " << target_[b] << " of " << n);
+    offsets_[b + 1] = offsets_[b] + end_[b] - begin_[b];
+  }
+  logits_.assign(offsets_[B], 0.f);
+  target_logits_.resize(B);
+
+  // consecutive examples with the same range are one GEMM
+  for (int b0=0; b0 < B; ) {
+    int b1 = b0 + 1;
+    while (b1 < B && begin_[b1] == begin_[b0] && end_[b1] == end_[b0]) {
+      ++b1;
+    }
+    gemm_nt(h.data + (size_t)b0 * H, w.data + (size_t)begin_[b0] * H,
+        &logits_[offsets_[b0]], b1 - b0, end_[b0] - begin_[b0], H);
+    b0 = b1;
+  }
+
+  output.dim = Dim({1}, B);
+  output.data = alloc_floats(B);
+  for (int b=0; b < B; ++b) {
+    float *l = &logits_[offsets_[b]];
+    int r = end_[b] - begin_[b];
+    int t = target_[b];
+    for (int j=0; j < r; ++j) {
+      int row = begin_[b] + j;
+      l[j] += bias.data[row] - (shift_.empty() ? 0.f : shift_[row]);
+      if (!ids_.empty() && row != t && ids_[row] == ids_[t]) {
+        l[j] = -INFINITY;
+      }
+    }
+
+    bool outside = t < begin_[b] || t >= end_[b];
+    float lt;
+    float lse = logsumexp(l, r);
+    if (outside) {
+      const float *ht = h.data + (size_t)b * H;
+      const float *wt = w.data + (size_t)t * H;
+      lt = bias.data[t] - (shift_.empty() ? 0.f : shift_[t]);
+      for (int k=0; k < H; ++k) {
+        lt += ht[k] * wt[k];
+      }
+      float m = std::max(lse, lt);
+      lse = m + logf(expf(lse - m) + expf(lt - m));
+      target_logits_[b] = expf(lt - lse);
+    } else {
+      lt = l[t - begin_[b]];
+    }
+    output.data[b] = lse - lt;
+    for (int j=0; j < r; ++j) {
+      l[j] = expf(l[j] - lse);
+    }
+  }
+}
+
+void CandidateSoftmaxLoss::forward2(const std::vector<Tensor> &inputs,
+    std::vector<Tensor*> &output) {
+  forward(inputs, *output[0]);
+}
+
+// with g = dE/dy * (p - onehot(target)):
+// dE/dh_b = sum_j g_j W_j, dE/dW_j = sum_b g_j h_b, dE/dbias_j = sum_b g_j
+void CandidateSoftmaxLoss::backward(const std::vector<Tensor> &inputs,
+    const Tensor &output, const Tensor &dEdy, int ii, Tensor &dEdxi) {
+  const Tensor &h = inputs[0];
+  const Tensor &w = inputs[1];
+  int B = h.dim.batch_size;
+  int H = h.dim.size();
+
+  if (ii == 0) {
+    for (int b=0; b < B; ++b) {
+      float d = dEdy.data[dEdy.dim.batch_size > 1 ? b : 0];
+      float *l = &logits_[offsets_[b]];
+      for (int j=offsets_[b]; j < offsets_[b + 1]; ++j) {
+        logits_[j] *= d;
+      }
+      int t = target_[b];
+      if (t < begin_[b] || t >= end_[b]) {
+        target_logits_[b] = d * (target_logits_[b] - 1.f);
+      } else {
+        l[t - begin_[b]] -= d;
+      }
+    }
+  }
+
+  dEdxi.dim = inputs[ii].dim;
+  size_t size = (size_t)dEdxi.dim.size() * dEdxi.dim.batch_size;
+  dEdxi.data = alloc_floats(size);
+  memset(dEdxi.data, 0, size * sizeof(float));
+
+  for (int b0=0; b0 < B; ) {
+    int b1 = b0 + 1;
+    while (b1 < B && begin_[b1] == begin_[b0] && end_[b1] == end_[b0]) {
+      ++b1;
+    }
+    int r = end_[b0] - begin_[b0];
+    const float *g = &logits_[offsets_[b0]];
+    if (ii == 0) {
+      gemm_nn(g, w.data + (size_t)begin_[b0] * H, dEdxi.data + (size_t)b0 * H,
+          b1 - b0, H, r);
+    } else if (ii == 1) {
+      gemm_tn(g, h.data + (size_t)b0 * H, dEdxi.data + (size_t)begin_[b0] * H,
+          r, H, b1 - b0);
+    } else {
+      for (int j=0; j < (b1 - b0) * r; ++j) {
+        dEdxi.data[begin_[b0] + j % r] += g[j];
+      }
+    }
+    b0 = b1;
+  }
+
+  for (int b=0; b < B; ++b) {
+    int t = target_[b];
+    if (t >= begin_[b] && t < end_[b]) {
+      continue;
+    }
+    float gt = target_logits_[b];
+    const float *ht = h.data + (size_t)b * H;
+    const float *wt = w.data + (size_t)t * H;
+    if (ii == 0) {
+      float *dh = dEdxi.data + (size_t)b * H;
+      for (int k=0; k < H; ++k) {
+        dh[k] += gt * wt[k];
+      }
+    } else if (ii == 1) {
+      float *dw = dEdxi.data + (size_t)t * H;
+      for (int k=0; k < H; ++k) {
+        dw[k] += gt * ht[k];
+      }
+    } else {
+      dEdxi.data[t] += gt;
+    }
+  }
+}
+
+void CandidateSoftmaxLoss::backward2(const std::vector<Tensor> &inputs,
+    const std::vector<Tensor> &output,
+    const std::vector<Tensor> &dEdy, int ii, Tensor &dEdxi) {
+  backward(inputs, output[0], dEdy[0], ii, dEdxi);
+}
+
+
+void FusedElementwise::eval(const std::vector<Tensor> &inputs, int i, int b,
+    float *r) const {
+  for (int k=0; k < ops_.size(); ++k) {
+    const FusedOp &op = ops_[k];
+    switch (op.code) {
+      case kFusedLoad: r[k] = inputs[op.a].eval(i, b); break;
+      case kFusedConst: r[k] = op.value; break;
+      case kFusedAdd: r[k] = r[op.a] + r[op.b]; break;
+      case kFusedSub: r[k] = r[op.a] - r[op.b]; break;
+      case kFusedMul: r[k] = r[op.a] * r[op.b]; break;
+      case kFusedDiv: r[k] = r[op.a] / r[op.b]; break;
+      case kFusedNeg: r[k] = -r[op.a]; break;
+      case kFusedSquare: r[k] = r[op.a] * r[op.a]; break;
+      case kFusedExp: r[k] = expf(r[op.a]); break;
+      case kFusedTanh: r[k] = tanhf(r[op.a]); break;
+      case kFusedSigmoid: r[k] = 1.f / (1.f + expf(-r[op.a])); break;
+    }
+  }
+}
+
+void FusedElementwise::forward(const std::vector<Tensor> &inputs, Tensor &output) {
+  RNNPP_CHECK(inputs.size() > 0, "Number of inputs is invalid: " << inputs.size());
+  const Dim &d = inputs[0].dim;
+  int max_b = d.batch_size;
+  for (int i=1; i < inputs.size(); ++i) {
+    RNNPP_CHECK(inputs[i].dim == d, "Invalid dimensions" << d << " " << inputs[i].dim);
+    max_b = std::max(max_b, inputs[i].dim.batch_size);
+  }
+
+  int n = d.size();
+  bool along_batch = axis_ == d.shape.size();
+  RNNPP_CHECK(axis_ == -2 || axis_ == -1 || along_batch,
+      "FusedElementwise only sums all elements or along batch: " << axis_);
+  if (axis_ == -1) {
+    output.dim = Dim({1, 1}, max_b);
+  } else if (along_batch) {
+    output.dim = Dim(d.shape, 1);
+  } else {
+    output.dim = Dim(d.shape, max_b);
+  }
+  int k = output.dim.size() * output.dim.batch_size;
+  output.data = alloc_floats(k);
+  output = Scalar(0.);
+
+  std::vector<float> r(ops_.size());
+  for (int b=0; b < max_b; ++b) {
+    float acc = 0.;
+    for (int i=0; i < n; ++i) {
+      eval(inputs, i, b, r.data());
+      float v = r.back();
+      if (axis_ == -1) {
+        acc += v;
+      } else if (along_batch) {
+        output.data[i] += scale_ * v;
+      } else {
+        output.data[i + b * n] = scale_ * v;
+      }
+    }
+    if (axis_ == -1) {
+      output.data[b] = scale_ * acc;
+    }
+  }
+}
+
+void FusedElementwise::forward2(const std::vector<Tensor> &inputs,
+    std::vector<Tensor*> &output) {
+  forward(inputs, *output[0]);
+}
+
+void FusedElementwise::backward(const std::vector<Tensor> &inputs, const Tensor &output,
+    const Tensor &dEdy, int ii, Tensor &dEdxi) {
+  dEdxi.dim = inputs[ii].dim;
+  int k = dEdxi.dim.size() * dEdxi.dim.batch_size;
+  dEdxi.data = alloc_floats(k);
+  dEdxi = Scalar(0.);
+
+  const Dim &d = inputs[0].dim;
+  int max_b = output.dim.batch_size;
+  bool along_batch = axis_ == d.shape.size();
+  if (along_batch) {
+    for (int i=0; i < inputs.size(); ++i) {
+      max_b = std::max(max_b, inputs[i].dim.batch_size);
+    }
+  }
+  int n = d.size();
+  int skip = dEdxi.dim.batch_size > 1 ? n : 0;
+
+  std::vector<float> r(ops_.size());
+  std::vector<float> adj(ops_.size());
+  for (int b=0; b < max_b; ++b) {
+    for (int i=0; i < n; ++i) {
+      eval(inputs, i, b, r.data());
+
+      std::fill(adj.begin(), adj.end(), 0.f);
+      if (axis_ == -1) {
+        adj.back() = scale_ * dEdy.data[b];
+      } else if (along_batch) {
+        adj.back() = scale_ * dEdy.data[i];
+      } else {
+        adj.back() = scale_ * dEdy.data[i + b * n];
+      }
+
+      for (int j=ops_.size()-1; j >= 0; --j) {
+        const FusedOp &op = ops_[j];
+        float g = adj[j];
+        switch (op.code) {
+          case kFusedLoad:
+            if (op.a == ii) dEdxi.data[i + b * skip] += g;
+            break;
+          case kFusedConst: break;
+          case kFusedAdd: adj[op.a] += g; adj[op.b] += g; break;
+          case kFusedSub: adj[op.a] += g; adj[op.b] -= g; break;
+          case kFusedMul: adj[op.a] += g * r[op.b]; adj[op.b] += g * r[op.a]; break;
+          case kFusedDiv:
+            adj[op.a] += g / r[op.b];
+            adj[op.b] -= g * r[op.a] / (r[op.b] * r[op.b]);
+            break;
+          case kFusedNeg: adj[op.a] -= g; break;
+          case kFusedSquare: adj[op.a] += 2.f * r[op.a] * g; break;
+          case kFusedExp: adj[op.a] += r[j] * g; break;
+          case kFusedTanh: adj[op.a] += (1.f - r[j] * r[j]) * g; break;
+          case kFusedSigmoid: adj[op.a] += r[j] * (1.f - r[j]) * g; break;
+        }
+      }
+    }
+  }
+}
+
+void FusedElementwise::backward2(const std::vector<Tensor> &inputs,
+    const std::vector<Tensor> &output,
+    const std::vector<Tensor> &dEdy, int ii, Tensor &dEdxi) {
+  backward(inputs, output[0], dEdy[0], ii, dEdxi);
+}
+
+void SliceRows::forward(const std::vector<Tensor> &inputs, Tensor &output) {
+  const Tensor &x = inputs[0];
+  RNNPP_CHECK(0 <= begin_ && begin_ < end_ && end_ <= x.dim[0],
+      "Invalid rows [" << begin_ << ", " << end_ << ") of " << x.dim);
+  std::vector<int> shape = x.dim.shape;
+  shape[0] = end_ - begin_;
+  output.dim = Dim(shape, x.dim.batch_size);
+  int row = x.dim.size() / x.dim[0];
+  int n = output.dim.size();
+  output.data = alloc_floats(n * output.dim.batch_size);
+  for (int b=0; b < x.dim.batch_size; ++b) {
+    memcpy(output.data + b * n, x.data + b * x.dim.size() + begin_ * row, n * sizeof(float));
+  }
+}
+
+void SliceRows::forward2(const std::vector<Tensor> &inputs, std::vector<Tensor*> &output) {
+  forward(inputs, *output[0]);
+}
+
+void SliceRows::backward(const std::vector<Tensor> &inputs, const Tensor &output,
+    const Tensor &dEdy, int ii, Tensor &dEdxi) {
+  const Tensor &x = inputs[0];
+  dEdxi.dim = x.dim;
+  int k = dEdxi.dim.size() * dEdxi.dim.batch_size;
+  dEdxi.data = alloc_floats(k);
+  dEdxi = Scalar(0.);
+  int row = x.dim.size() / x.dim[0];
+  int n = output.dim.size();
+  for (int b=0; b < x.dim.batch_size; ++b) {
+    memcpy(dEdxi.data + b * x.dim.size() + begin_ * row, dEdy.data + b * n, n * sizeof(float));
+  }
+}
+
+void SliceRows::backward2(const std::vector<Tensor> &inputs, const std::vector<Tensor> &output,
+    const std::vector<Tensor> &dEdy, int ii, Tensor &dEdxi) {
+  backward(inputs, output[0], dEdy[0], ii, dEdxi);
+}
+
+// i = sigmoid(a_i), f = sigmoid(a_f), g = tanh(a_g), o = sigmoid(a_o)
+// c = f * c_prev + i * g
+// h = o * tanh(c)
+void LSTMCell::forward(const std::vector<Tensor> &inputs, Tensor &output) {
+  RNNPP_CHECK(inputs.size() == 4, "Number of inputs is invalid: " << inputs.size());
+  const Tensor &x = inputs[0];
+  const Tensor &s = inputs[1];
+  const Tensor &w = inputs[2];
+  const Tensor &bias = inputs[3];
+  int D = x.dim[0];
+  int H = s.dim[0] / 2;
+  RNNPP_CHECK(w.dim[0] == 4 * H && w.dim[1] == D + H && bias.dim.size() == 4 * H,
+      "Invalid LSTM weights " << w.dim << " and bias " << bias.dim
+      << " for input " << x.dim << " and state " << s.dim);
+
+  int B = std::max(x.dim.batch_size, s.dim.batch_size);
+  RNNPP_CHECK((x.dim.batch_size == 1 || x.dim.batch_size == B) &&
+      (s.dim.batch_size == 1 || s.dim.batch_size == B), "Invalid batch sizes");
+  int xs = x.dim.batch_size > 1 ? D : 0;
+  int ss = s.dim.batch_size > 1 ? 2 * H : 0;
+  batch_ = B;
+
+  xh_.resize((size_t)B * (D + H));
+  gates_.resize((size_t)B * 4 * H);
+  tanh_c_.resize((size_t)B * H);
+  for (int b=0; b < B; ++b) {
+    memcpy(&xh_[(size_t)b * (D + H)], x.data + b * xs, D * sizeof(float));
+    memcpy(&xh_[(size_t)b * (D + H) + D], s.data + b * ss, H * sizeof(float));
+    memcpy(&gates_[(size_t)b * 4 * H], bias.data, 4 * H * sizeof(float));
+  }
+  gemm_nt(xh_.data(), w.data, gates_.data(), B, 4 * H, D + H);
+
+  output.dim = Dim({2 * H, 1}, B);
+  output.data = alloc_floats((size_t)2 * H * B);
+  for (int b=0; b < B; ++b) {
+    float *g = &gates_[(size_t)b * 4 * H];
+    apply_sigmoid(g, 2 * H);
+    apply_tanh(g + 2 * H, H);
+    apply_sigmoid(g + 3 * H, H);
+
+    const float *c_prev = s.data + b * ss + H;
+    float *h = output.data + (size_t)b * 2 * H;
+    float *c = h + H;
+    float *tc = &tanh_c_[(size_t)b * H];
+    for (int k=0; k < H; ++k) {
+      c[k] = g[H + k] * c_prev[k] + g[k] * g[2 * H + k];
+      tc[k] = c[k];
+    }
+    apply_tanh(tc, H);
+    for (int k=0; k < H; ++k) {
+      h[k] = g[3 * H + k] * tc[k];
+    }
+  }
+}
+
+void LSTMCell::forward2(const std::vector<Tensor> &inputs, std::vector<Tensor*> &output) {
+  forward(inputs, *output[0]);
+}
+
+void LSTMCell::backward(const std::vector<Tensor> &inputs, const Tensor &output,
+    const Tensor &dEdy, int ii, Tensor &dEdxi) {
+  const Tensor &x = inputs[0];
+  const Tensor &s = inputs[1];
+  const Tensor &w = inputs[2];
+  int D = x.dim[0];
+  int H = s.dim[0] / 2;
+  int B = batch_;
+  int xs = x.dim.batch_size > 1 ? D : 0;
+  int ss = s.dim.batch_size > 1 ? 2 * H : 0;
+
+  if (ii == 0) {
+    d_gates_.resize((size_t)B * 4 * H);
+    d_c_.resize((size_t)B * H);
+    for (int b=0; b < B; ++b) {
+      const float *g = &gates_[(size_t)b * 4 * H];
+      const float *tc = &tanh_c_[(size_t)b * H];
+      const float *c_prev = s.data + b * ss + H;
+      const float *dh = dEdy.data + (size_t)b * 2 * H;
+      const float *dc_out = dh + H;
+      float *dg = &d_gates_[(size_t)b * 4 * H];
+      float *dc_prev = &d_c_[(size_t)b * H];
+      for (int k=0; k < H; ++k) {
+        float i = g[k], f = g[H + k], z = g[2 * H + k], o = g[3 * H + k];
+        float dc = dc_out[k] + dh[k] * o * (1.f - tc[k] * tc[k]);
+        dg[k] = dc * z * i * (1.f - i);
+        dg[H + k] = dc * c_prev[k] * f * (1.f - f);
+        dg[2 * H + k] = dc * i * (1.f - z * z);
+        dg[3 * H + k] = dh[k] * tc[k] * o * (1.f - o);
+        dc_prev[k] = dc * f;
+      }
+    }
+    d_xh_.assign((size_t)B * (D + H), 0.f);
+    gemm_nn(d_gates_.data(), w.data, d_xh_.data(), B, D + H, 4 * H);
+  }
+
+  dEdxi.dim = inputs[ii].dim;
+  int k = dEdxi.dim.size() * dEdxi.dim.batch_size;
+  dEdxi.data = alloc_floats(k);
+  dEdxi = Scalar(0.);
+
+  if (ii == 0) {
+    for (int b=0; b < B; ++b) {
+      float *dx = dEdxi.data + b * xs;
+      const float *src = &d_xh_[(size_t)b * (D + H)];
+      for (int j=0; j < D; ++j) {
+        dx[j] += src[j];
+      }
+    }
+  } else if (ii == 1) {
+    for (int b=0; b < B; ++b) {
+      float *ds = dEdxi.data + b * ss;
+      const float *dh = &d_xh_[(size_t)b * (D + H) + D];
+      const float *dc = &d_c_[(size_t)b * H];
+      for (int j=0; j < H; ++j) {
+        ds[j] += dh[j];
+        ds[H + j] += dc[j];
+      }
+    }
+  } else if (ii == 2) {
+    gemm_tn(d_gates_.data(), xh_.data(), dEdxi.data, 4 * H, D + H, B);
+  } else {
+    for (int b=0; b < B; ++b) {
+      const float *dg = &d_gates_[(size_t)b * 4 * H];
+      for (int j=0; j < 4 * H; ++j) {
+        dEdxi.data[j] += dg[j];
+      }
+    }
+  }
+}
+
+void LSTMCell::backward2(const std::vector<Tensor> &inputs, const std::vector<Tensor> &output,
+    const std::vector<Tensor> &dEdy, int ii, Tensor &dEdxi) {
+  backward(inputs, output[0], dEdy[0], ii, dEdxi);
+}
+
+// r = sigmoid(W_xr x + b_xr + W_hr h + b_hr)
+// z = sigmoid(W_xz x + b_xz + W_hz h + b_hz)
+// n = tanh(W_xn x + b_xn + r * (W_hn h + b_hn))
+// h' = (1 - z) * n + z * h
+//
+// One row: g holds the input projections (3H) and becomes r, z, n, ah the
+// recurrent projections, and hn keeps W_hn h + b_hn.
+static void gru_gates(float *g, const float *ah, float *hn, const float *h_prev,
+    float *h, int H) {
+  for (int k=0; k < 2 * H; ++k) {
+    g[k] += ah[k];
+  }
+  apply_sigmoid(g, 2 * H);
+  for (int k=0; k < H; ++k) {
+    hn[k] = ah[2 * H + k];
+    g[2 * H + k] += g[k] * hn[k];
+  }
+  apply_tanh(g + 2 * H, H);
+  for (int k=0; k < H; ++k) {
+    float z = g[H + k];
+    h[k] = g[2 * H + k] + z * (h_prev[k] - g[2 * H + k]);
+  }
+}
+
+// Gradients of both projections of one row from the gradient dh of its
+// output, and the direct part dh * z of the gradient of h_prev.
+static void gru_gates_backward(const float *g, const float *hn, const float *h_prev,
+    const float *dh, float *dax, float *dah, float *dh_prev, int H) {
+  for (int k=0; k < H; ++k) {
+    float r = g[k], z = g[H + k], n = g[2 * H + k];
+    float dn = dh[k] * (1.f - z) * (1.f - n * n);
+    float dr = dn * hn[k] * r * (1.f - r);
+    float dz = dh[k] * (h_prev[k] - n) * z * (1.f - z);
+    dax[k] = dah[k] = dr;
+    dax[H + k] = dah[H + k] = dz;
+    dax[2 * H + k] = dn;
+    dah[2 * H + k] = dn * r;
+    dh_prev[k] = dh[k] * z;
+  }
+}
+
+void GRUCell::forward(const std::vector<Tensor> &inputs, Tensor &output) {
+  RNNPP_CHECK(inputs.size() == 6, "Number of inputs is invalid: " << inputs.size());
+  const Tensor &x = inputs[0];
+  const Tensor &h = inputs[1];
+  const Tensor &wx = inputs[2];
+  const Tensor &wh = inputs[3];
+  const Tensor &bx = inputs[4];
+  const Tensor &bh = inputs[5];
+  int D = x.dim[0];
+  int H = h.dim[0];
+  RNNPP_CHECK(wx.dim[0] == 3 * H && wx.dim[1] == D && wh.dim[0] == 3 * H && wh.dim[1] == H &&
+      bx.dim.size() == 3 * H && bh.dim.size() == 3 * H,
+      "Invalid GRU weights " << wx.dim << ", " << wh.dim << " and biases " << bx.dim
+      << ", " << bh.dim << " for input " << x.dim << " and state " << h.dim);
+
+  int B = std::max(x.dim.batch_size, h.dim.batch_size);
+  RNNPP_CHECK((x.dim.batch_size == 1 || x.dim.batch_size == B) &&
+      (h.dim.batch_size == 1 || h.dim.batch_size == B), "Invalid batch sizes");
+  int xs = x.dim.batch_size > 1 ? D : 0;
+  int hs = h.dim.batch_size > 1 ? H : 0;
+  batch_ = B;
+
+  x_.resize((size_t)B * D);
+  h_.resize((size_t)B * H);
+  gates_.resize((size_t)B * 3 * H);
+  std::vector<float> ah((size_t)B * 3 * H);
+  for (int b=0; b < B; ++b) {
+    memcpy(&x_[(size_t)b * D], x.data + b * xs, D * sizeof(float));
+    memcpy(&h_[(size_t)b * H], h.data + b * hs, H * sizeof(float));
+    memcpy(&gates_[(size_t)b * 3 * H], bx.data, 3 * H * sizeof(float));
+    memcpy(&ah[(size_t)b * 3 * H], bh.data, 3 * H * sizeof(float));
+  }
+  gemm_nt(x_.data(), wx.data, gates_.data(), B, 3 * H, D);
+  gemm_nt(h_.data(), wh.data, ah.data(), B, 3 * H, H);
+
+  hn_.resize((size_t)B * H);
+  output.dim = Dim({H, 1}, B);
+  output.data = alloc_floats((size_t)H * B);
+  for (int b=0; b < B; ++b) {
+    gru_gates(&gates_[(size_t)b * 3 * H], &ah[(size_t)b * 3 * H], &hn_[(size_t)b * H],
+        &h_[(size_t)b * H], output.data + (size_t)b * H, H);
+  }
+}
+
+void GRUCell::forward2(const std::vector<Tensor> &inputs, std::vector<Tensor*> &output) {
+  forward(inputs, *output[0]);
+}
+
+void GRUCell::backward(const std::vector<Tensor> &inputs, const Tensor &output,
+    const Tensor &dEdy, int ii, Tensor &dEdxi) {
+  const Tensor &x = inputs[0];
+  const Tensor &h = inputs[1];
+  const Tensor &wx = inputs[2];
+  const Tensor &wh = inputs[3];
+  int D = x.dim[0];
+  int H = h.dim[0];
+  int B = batch_;
+  int xs = x.dim.batch_size > 1 ? D : 0;
+  int hs = h.dim.batch_size > 1 ? H : 0;
+
+  if (ii == 0) {
+    d_ax_.resize((size_t)B * 3 * H);
+    d_ah_.resize((size_t)B * 3 * H);
+    d_h_.resize((size_t)B * H);
+    for (int b=0; b < B; ++b) {
+      gru_gates_backward(&gates_[(size_t)b * 3 * H], &hn_[(size_t)b * H], &h_[(size_t)b * H],
+          dEdy.data + (size_t)b * H, &d_ax_[(size_t)b * 3 * H], &d_ah_[(size_t)b * 3 * H],
+          &d_h_[(size_t)b * H], H);
+    }
+    d_x_.assign((size_t)B * D, 0.f);
+    gemm_nn(d_ax_.data(), wx.data, d_x_.data(), B, D, 3 * H);
+    gemm_nn(d_ah_.data(), wh.data, d_h_.data(), B, H, 3 * H);
+  }
+
+  dEdxi.dim = inputs[ii].dim;
+  int k = dEdxi.dim.size() * dEdxi.dim.batch_size;
+  dEdxi.data = alloc_floats(k);
+  dEdxi = Scalar(0.);
+
+  if (ii == 0 || ii == 1) {
+    const std::vector<float> &src = ii == 0 ? d_x_ : d_h_;
+    int n = ii == 0 ? D : H;
+    int stride = ii == 0 ? xs : hs;
+    for (int b=0; b < B; ++b) {
+      float *d = dEdxi.data + b * stride;
+      for (int j=0; j < n; ++j) {
+        d[j] += src[(size_t)b * n + j];
+      }
+    }
+  } else if (ii == 2) {
+    gemm_tn(d_ax_.data(), x_.data(), dEdxi.data, 3 * H, D, B);
+  } else if (ii == 3) {
+    gemm_tn(d_ah_.data(), h_.data(), dEdxi.data, 3 * H, H, B);
+  } else {
+    const std::vector<float> &src = ii == 4 ? d_ax_ : d_ah_;
+    for (int b=0; b < B; ++b) {
+      for (int j=0; j < 3 * H; ++j) {
+        dEdxi.data[j] += src[(size_t)b * 3 * H + j];
+      }
+    }
+  }
+}
+
+void GRUCell::backward2(const std::vector<Tensor> &inputs, const std::vector<Tensor> &output,
+    const std::vector<Tensor> &dEdy, int ii, Tensor &dEdxi) {
+  backward(inputs, output[0], dEdy[0], ii, dEdxi);
+}
+
+void GRUSequence::forward(const std::vector<Tensor> &inputs, Tensor &output) {
+  RNNPP_CHECK(inputs.size() == 6, "Number of inputs is invalid: " << inputs.size());
+  const Tensor &xs = inputs[0];
+  const Tensor &h0 = inputs[1];
+  const Tensor &wx = inputs[2];
+  const Tensor &wh = inputs[3];
+  const Tensor &bx = inputs[4];
+  const Tensor &bh = inputs[5];
+  std::vector<int> sizes = batch_sizes_;
+  int D;
+  if (sizes.empty()) {
+    RNNPP_CHECK(xs.dim.shape.size() == 3 && xs.dim.batch_size == 1,
+        "The input of a sequence must be (T, B, D): " << xs.dim);
+    sizes.assign(xs.dim[0], xs.dim[1]);
+    D = xs.dim[2];
+  } else {
+    RNNPP_CHECK(xs.dim.size() == xs.dim[0],
+        "The input of a packed sequence must be (D, 1) with a batch of tokens: " << xs.dim);
+    D = xs.dim[0];
+  }
+  int T = sizes.size();
+  int B = sizes[0];
+  offsets_.assign(T + 1, 0);
+  for (int t=0; t < T; ++t) {
+    RNNPP_CHECK(sizes[t] > 0 && (t == 0 || sizes[t] <= sizes[t - 1]),
+        "Batch sizes of a packed sequence must be positive and non increasing");
+    offsets_[t + 1] = offsets_[t] + sizes[t];
+  }
+  size_t N = offsets_[T];
+  RNNPP_CHECK(xs.dim.size() * xs.dim.batch_size == N * D,
+      "The input " << xs.dim << " does not have the " << N << " tokens of the batch sizes");
+  int H = h0.dim[0];
+  RNNPP_CHECK(h0.dim.batch_size == 1 || h0.dim.batch_size == B,
+      "Invalid batch size of the initial state " << h0.dim << " for " << xs.dim);
+  RNNPP_CHECK(wx.dim[0] == 3 * H && wx.dim[1] == D && wh.dim[0] == 3 * H && wh.dim[1] == H &&
+      bx.dim.size() == 3 * H && bh.dim.size() == 3 * H,
+      "Invalid GRU weights " << wx.dim << ", " << wh.dim << " and biases " << bx.dim
+      << ", " << bh.dim << " for input " << xs.dim << " and state " << h0.dim);
+  int hs = h0.dim.batch_size > 1 ? H : 0;
+
+  h0_.resize((size_t)B * H);
+  for (int b=0; b < B; ++b) {
+    memcpy(&h0_[(size_t)b * H], h0.data + b * hs, H * sizeof(float));
+  }
+
+  gates_.resize(N * 3 * H);
+  for (size_t i=0; i < N; ++i) {
+    memcpy(&gates_[i * 3 * H], bx.data, 3 * H * sizeof(float));
+  }
+  gemm_nt(xs.data, wx.data, gates_.data(), N, 3 * H, D);
+
+  hn_.resize(N * H);
+  output.dim = batch_sizes_.empty() ? Dim({T, B, H}) : Dim({H, 1}, N);
+  output.data = alloc_floats(N * H);
+  std::vector<float> ah((size_t)B * 3 * H);
+  for (int t=0; t < T; ++t) {
+    // the rows of step t are the first sizes[t] of step t - 1
+    const float *h_prev = t == 0 ? h0_.data() : output.data + (size_t)offsets_[t - 1] * H;
+    for (int b=0; b < sizes[t]; ++b) {
+      memcpy(&ah[(size_t)b * 3 * H], bh.data, 3 * H * sizeof(float));
+    }
+    gemm_nt(h_prev, wh.data, ah.data(), sizes[t], 3 * H, H);
+
+    for (int b=0; b < sizes[t]; ++b) {
+      size_t i = (size_t)offsets_[t] + b;
+      gru_gates(&gates_[i * 3 * H], &ah[(size_t)b * 3 * H], &hn_[i * H],
+          h_prev + (size_t)b * H, output.data + i * H, H);
+    }
+  }
+}
+
+void GRUSequence::forward2(const std::vector<Tensor> &inputs, std::vector<Tensor*> &output) {
+  forward(inputs, *output[0]);
+}
+
+void GRUSequence::backward(const std::vector<Tensor> &inputs, const Tensor &output,
+    const Tensor &dEdy, int ii, Tensor &dEdxi) {
+  const Tensor &xs = inputs[0];
+  const Tensor &h0 = inputs[1];
+  const Tensor &wx = inputs[2];
+  const Tensor &wh = inputs[3];
+  int T = offsets_.size() - 1;
+  int B = offsets_[1];
+  size_t N = offsets_[T];
+  int D = wx.dim[1];
+  int H = h0.dim[0];
+  int hs = h0.dim.batch_size > 1 ? H : 0;
+
+  if (ii == 0) {
+    d_ax_.resize(N * 3 * H);
+    d_ah_.resize(N * 3 * H);
+    // gradient of the state flowing into step t, then of h_{t-1}
+    std::vector<float> dh(dEdy.data + (size_t)offsets_[T - 1] * H, dEdy.data + N * H);
+    std::vector<float> dh_prev((size_t)B * H);
+    for (int t=T-1; t >= 0; --t) {
+      int n = offsets_[t + 1] - offsets_[t];
+      const float *h_prev = t == 0 ? h0_.data() : output.data + (size_t)offsets_[t - 1] * H;
+      for (int b=0; b < n; ++b) {
+        size_t i = (size_t)offsets_[t] + b;
+        gru_gates_backward(&gates_[i * 3 * H], &hn_[i * H], h_prev + (size_t)b * H,
+            &dh[(size_t)b * H], &d_ax_[i * 3 * H], &d_ah_[i * 3 * H],
+            &dh_prev[(size_t)b * H], H);
+      }
+      gemm_nn(&d_ah_[(size_t)offsets_[t] * 3 * H], wh.data, dh_prev.data(), n, H, 3 * H);
+      if (t > 0) {
+        // sequences that end at step t - 1 get only the gradient of their output
+        const float *dy = dEdy.data + (size_t)offsets_[t - 1] * H;
+        size_t m = (size_t)(offsets_[t] - offsets_[t - 1]) * H;
+        dh.assign(dy, dy + m);
+        for (size_t j=0; j < (size_t)n * H; ++j) {
+          dh[j] += dh_prev[j];
+        }
+      }
+    }
+    d_h0_ = dh_prev;
+  }
+
+  dEdxi.dim = inputs[ii].dim;
+  int k = dEdxi.dim.size() * dEdxi.dim.batch_size;
+  dEdxi.data = alloc_floats(k);
+  dEdxi = Scalar(0.);
+
+  if (ii == 0) {
+    gemm_nn(d_ax_.data(), wx.data, dEdxi.data, N, D, 3 * H);
+  } else if (ii == 1) {
+    for (int b=0; b < B; ++b) {
+      float *d = dEdxi.data + b * hs;
+      for (int j=0; j < H; ++j) {
+        d[j] += d_h0_[(size_t)b * H + j];
+      }
+    }
+  } else if (ii == 2) {
+    gemm_tn(d_ax_.data(), xs.data, dEdxi.data, 3 * H, D, N);
+  } else if (ii == 3) {
+    gemm_tn(d_ah_.data(), h0_.data(), dEdxi.data, 3 * H, H, B);
+    // the states before steps t..u-1 are the outputs of steps t-1..u-2,
+    // contiguous while no sequence ends, so without packing this is one GEMM
+    int t = 1;
+    while (t < T) {
+      int u = t + 1;
+      int n = offsets_[t + 1] - offsets_[t];
+      if (n == offsets_[t] - offsets_[t - 1]) {
+        while (u < T && offsets_[u + 1] - offsets_[u] == n) ++u;
+      }
+      gemm_tn(&d_ah_[(size_t)offsets_[t] * 3 * H], output.data + (size_t)offsets_[t - 1] * H,
+          dEdxi.data, 3 * H, H, offsets_[u] - offsets_[t]);
+      t = u;
+    }
+  } else {
+    const std::vector<float> &src = ii == 4 ? d_ax_ : d_ah_;
+    for (size_t i=0; i < N; ++i) {
+      for (int j=0; j < 3 * H; ++j) {
+        dEdxi.data[j] += src[i * 3 * H + j];
+      }
+    }
+  }
+}
+
+void GRUSequence::backward2(const std::vector<Tensor> &inputs, const std::vector<Tensor> &output,
+    const std::vector<Tensor> &dEdy, int ii, Tensor &dEdxi) {
+  backward(inputs, output[0], dEdy[0], ii, dEdxi);
+}
+
+// Runs tasks 0..n-1 on nt threads. Task i starts when pending[i] of the
+// tasks listing it in next are done.
+static void run_tasks(int nt, std::vector<int> pending,
+    const std::vector<std::vector<int>> &next, const std::function<void(int)> &run) {
+  std::mutex m;
+  std::condition_variable cv;
+  std::vector<int> ready;
+  int left = pending.size();
+  for (int i=0; i < pending.size(); ++i) {
+    if (pending[i] == 0) {
+      ready.push_back(i);
+    }
+  }
+
+  auto worker = [&]() {
+    std::unique_lock<std::mutex> lock(m);
+    while (true) {
+      cv.wait(lock, [&]() { return left == 0 || !ready.empty(); });
+      if (ready.empty()) {
+        return;
+      }
+      int i = ready.back();
+      ready.pop_back();
+      lock.unlock();
+      run(i);
+      lock.lock();
+      --left;
+      for (int j : next[i]) {
+        if (--pending[j] == 0) {
+          ready.push_back(j);
+        }
+      }
+      cv.notify_all();
+    }
+  };
+
+  std::vector<std::thread> threads;
+  for (int t=1; t < nt; ++t) {
+    threads.push_back(std::thread(worker));
+  }
+  worker();
+  for (auto &t : threads) {
+    t.join();
+  }
+}
+
+int GRUStack::threads(int n_tasks) const {
+  int nt = num_threads_ > 0 ? num_threads_ : std::thread::hardware_concurrency();
+  return std::max(1, std::min(nt, n_tasks));
+}
+
+void GRUStack::forward(const std::vector<Tensor> &inputs, Tensor &output) {
+  int n_cells = n_layers_ * n_dirs_;
+  RNNPP_CHECK(inputs.size() == 1 + 4 * n_cells,
+      "Number of inputs is invalid: " << inputs.size());
+  const Tensor &xs = inputs[0];
+  RNNPP_CHECK(xs.dim.shape.size() == 3 && xs.dim.batch_size == 1,
+      "The input of a sequence must be (T, B, D): " << xs.dim);
+  int T = xs.dim[0];
+  int B = xs.dim[1];
+  int H = inputs[2].dim[1];
+  int Y = n_dirs_ * H;
+  for (int k=0; k < n_cells; ++k) {
+    int in_dim = k < n_dirs_ ? xs.dim[2] : Y;
+    const Tensor &wx = inputs[1 + 4 * k];
+    const Tensor &wh = inputs[2 + 4 * k];
+    RNNPP_CHECK(wx.dim[0] == 3 * H && wx.dim[1] == in_dim && wh.dim[0] == 3 * H &&
+        wh.dim[1] == H && inputs[3 + 4 * k].dim.size() == 3 * H &&
+        inputs[4 + 4 * k].dim.size() == 3 * H,
+        "Invalid GRU weights " << wx.dim << " and " << wh.dim << " of layer "
+        << k / n_dirs_ << " for input " << xs.dim);
+  }
+  size_t TB = (size_t)T * B;
+
+  gates_.resize(n_cells);
+  hn_.resize(n_cells);
+  hs_.resize(n_cells);
+  for (int k=0; k < n_cells; ++k) {
+    gates_[k].resize(TB * 3 * H);
+    hn_[k].resize(TB * H);
+    hs_[k].resize(TB * H);
+  }
+  ys_.resize(n_layers_);
+  for (int l=0; l + 1 < n_layers_; ++l) {
+    ys_[l].resize(TB * Y);
+  }
+  output.dim = Dim({T, B, Y});
+  output.data = alloc_floats(TB * Y);
+  std::vector<float> zeros((size_t)B * H, 0.f);
+
+  // task k * T + t is step t of layer k / n_dirs in direction k % n_dirs
+  std::vector<int> pending(n_cells * T, 0);
+  std::vector<std::vector<int>> next(n_cells * T);
+  for (int k=0; k < n_cells; ++k) {
+    int l = k / n_dirs_, d = k % n_dirs_;
+    for (int t=0; t < T; ++t) {
+      int u = d == 0 ? t + 1 : t - 1;
+      if (0 <= u && u < T) {
+        next[k * T + t].push_back(k * T + u);
+        ++pending[k * T + u];
+      }
+      if (l + 1 < n_layers_) {
+        for (int e=0; e < n_dirs_; ++e) {
+          next[k * T + t].push_back(((l + 1) * n_dirs_ + e) * T + t);
+          ++pending[((l + 1) * n_dirs_ + e) * T + t];
+        }
+      }
+    }
+  }
+
+  run_tasks(threads(n_cells), pending, next, [&](int task) {
+    int k = task / T, t = task % T;
+    int l = k / n_dirs_, d = k % n_dirs_;
+    int in_dim = l == 0 ? xs.dim[2] : Y;
+    const float *x = (l == 0 ? xs.data : ys_[l - 1].data()) + (size_t)t * B * in_dim;
+    int u = d == 0 ? t - 1 : t + 1;
+    const float *h_prev = 0 <= u && u < T ? &hs_[k][(size_t)u * B * H] : zeros.data();
+    const float *bx = inputs[3 + 4 * k].data;
+    const float *bh = inputs[4 + 4 * k].data;
+
+    float *g = &gates_[k][(size_t)t * B * 3 * H];
+    std::vector<float> ah((size_t)B * 3 * H);
+    for (int b=0; b < B; ++b) {
+      memcpy(g + (size_t)b * 3 * H, bx, 3 * H * sizeof(float));
+      memcpy(&ah[(size_t)b * 3 * H], bh, 3 * H * sizeof(float));
+    }
+    gemm_nt(x, inputs[1 + 4 * k].data, g, B, 3 * H, in_dim);
+    gemm_nt(h_prev, inputs[2 + 4 * k].data, ah.data(), B, 3 * H, H);
+
+    float *y = (l + 1 < n_layers_ ? ys_[l].data() : output.data) + (size_t)t * B * Y;
+    for (int b=0; b < B; ++b) {
+      size_t i = (size_t)t * B + b;
+      float *h = &hs_[k][i * H];
+      gru_gates(g + (size_t)b * 3 * H, &ah[(size_t)b * 3 * H], &hn_[k][i * H],
+          h_prev + (size_t)b * H, h, H);
+      memcpy(y + (size_t)b * Y + d * H, h, H * sizeof(float));
+    }
+  });
+}
+
+void GRUStack::forward2(const std::vector<Tensor> &inputs, std::vector<Tensor*> &output) {
+  forward(inputs, *output[0]);
+}
+
+void GRUStack::backward(const std::vector<Tensor> &inputs, const Tensor &output,
+    const Tensor &dEdy, int ii, Tensor &dEdxi) {
+  const Tensor &xs = inputs[0];
+  int n_cells = n_layers_ * n_dirs_;
+  int T = xs.dim[0];
+  int B = xs.dim[1];
+  int H = inputs[2].dim[1];
+  int Y = n_dirs_ * H;
+  size_t TB = (size_t)T * B;
+
+  if (ii == 0) {
+    // gradients of the projections (T, B, 3H) and of the layer input
+    // (T, B, in_dim) of every layer and direction
+    std::vector<std::vector<float>> d_ax(n_cells), d_ah(n_cells), d_x(n_cells);
+    std::vector<std::vector<float>> carry(n_cells);
+    for (int k=0; k < n_cells; ++k) {
+      int in_dim = k < n_dirs_ ? xs.dim[2] : Y;
+      d_ax[k].resize(TB * 3 * H);
+      d_ah[k].resize(TB * 3 * H);
+      d_x[k].resize(TB * in_dim);
+      carry[k].assign((size_t)B * H, 0.f);
+    }
+
+    // the reverse of the forward dependencies
+    std::vector<int> pending(n_cells * T, 0);
+    std::vector<std::vector<int>> next(n_cells * T);
+    for (int k=0; k < n_cells; ++k) {
+      int l = k / n_dirs_, d = k % n_dirs_;
+      for (int t=0; t < T; ++t) {
+        int u = d == 0 ? t - 1 : t + 1;
+        if (0 <= u && u < T) {
+          next[k * T + t].push_back(k * T + u);
+          ++pending[k * T + u];
+        }
+        if (l > 0) {
+          for (int e=0; e < n_dirs_; ++e) {
+            next[k * T + t].push_back(((l - 1) * n_dirs_ + e) * T + t);
+            ++pending[((l - 1) * n_dirs_ + e) * T + t];
+          }
+        }
+      }
+    }
+
+    run_tasks(threads(n_cells), pending, next, [&](int task) {
+      int k = task / T, t = task % T;
+      int l = k / n_dirs_, d = k % n_dirs_;
+      int in_dim = l == 0 ? xs.dim[2] : Y;
+      int u = d == 0 ? t - 1 : t + 1;
+      std::vector<float> zeros;
+      const float *h_prev;
+      if (0 <= u && u < T) {
+        h_prev = &hs_[k][(size_t)u * B * H];
+      } else {
+        zeros.assign((size_t)B * H, 0.f);
+        h_prev = zeros.data();
+      }
+
+      // gradient of the states of step t: from the output or the layer
+      // above, and from the next step
+      std::vector<float> dh(carry[k]);
+      for (int b=0; b < B; ++b) {
+        float *dhb = &dh[(size_t)b * H];
+        size_t row = ((size_t)t * B + b) * Y + d * H;
+        if (l + 1 == n_layers_) {
+          for (int j=0; j < H; ++j) dhb[j] += dEdy.data[row + j];
+        } else {
+          for (int e=0; e < n_dirs_; ++e) {
+            const float *src = &d_x[(l + 1) * n_dirs_ + e][row];
+            for (int j=0; j < H; ++j) dhb[j] += src[j];
+          }
+        }
+      }
+
+      size_t i0 = (size_t)t * B;
+      for (int b=0; b < B; ++b) {
+        size_t i = i0 + b;
+        gru_gates_backward(&gates_[k][i * 3 * H], &hn_[k][i * H], h_prev + (size_t)b * H,
+            &dh[(size_t)b * H], &d_ax[k][i * 3 * H], &d_ah[k][i * 3 * H],
+            &carry[k][(size_t)b * H], H);
+      }
+      gemm_nn(&d_ah[k][i0 * 3 * H], inputs[2 + 4 * k].data, carry[k].data(), B, H, 3 * H);
+      gemm_nn(&d_ax[k][i0 * 3 * H], inputs[1 + 4 * k].data, &d_x[k][i0 * in_dim],
+          B, in_dim, 3 * H);
+    });
+
+    grads_.assign(inputs.size(), std::vector<float>());
+    grads_[0].assign(TB * xs.dim[2], 0.f);
+    for (int e=0; e < n_dirs_; ++e) {
+      for (size_t j=0; j < grads_[0].size(); ++j) {
+        grads_[0][j] += d_x[e][j];
+      }
+    }
+
+    // the weight gradients of each layer and direction
+    std::vector<int> none(n_cells, 0);
+    std::vector<std::vector<int>> no_next(n_cells);
+    run_tasks(threads(n_cells), none, no_next, [&](int k) {
+      int l = k / n_dirs_, d = k % n_dirs_;
+      int in_dim = l == 0 ? xs.dim[2] : Y;
+      const float *x = l == 0 ? xs.data : ys_[l - 1].data();
+      std::vector<float> &dwx = grads_[1 + 4 * k];
+      std::vector<float> &dwh = grads_[2 + 4 * k];
+      std::vector<float> &dbx = grads_[3 + 4 * k];
+      std::vector<float> &dbh = grads_[4 + 4 * k];
+      dwx.assign((size_t)3 * H * in_dim, 0.f);
+      dwh.assign((size_t)3 * H * H, 0.f);
+      dbx.assign(3 * H, 0.f);
+      dbh.assign(3 * H, 0.f);
+      gemm_tn(d_ax[k].data(), x, dwx.data(), 3 * H, in_dim, TB);
+      // the previous state of steps 1..T-1 (or 0..T-2 backwards) is the
+      // state of steps 0..T-2 (1..T-1); the initial state is zero
+      if (T > 1) {
+        size_t skip = (size_t)B * 3 * H;
+        const float *dah = d == 0 ? d_ah[k].data() + skip : d_ah[k].data();
+        const float *h = d == 0 ? hs_[k].data() : hs_[k].data() + (size_t)B * H;
+        gemm_tn(dah, h, dwh.data(), 3 * H, H, (T - 1) * B);
+      }
+      for (size_t i=0; i < TB; ++i) {
+        for (int j=0; j < 3 * H; ++j) {
+          dbx[j] += d_ax[k][i * 3 * H + j];
+          dbh[j] += d_ah[k][i * 3 * H + j];
+        }
+      }
+    });
+  }
+
+  dEdxi.dim = inputs[ii].dim;
+  int k = dEdxi.dim.size() * dEdxi.dim.batch_size;
+  dEdxi.data = alloc_floats(k);
+  memcpy(dEdxi.data, grads_[ii].data(), k * sizeof(float));
+}
+
+void GRUStack::backward2(const std::vector<Tensor> &inputs, const std::vector<Tensor> &output,
+    const std::vector<Tensor> &dEdy, int ii, Tensor &dEdxi) {
+  backward(inputs, output[0], dEdy[0], ii, dEdxi);
+}
+
+// the states of example b: T rows of H floats, ld apart
+static void attention_states(const Tensor &enc, int B, int b, const float **e,
+    size_t *ld) {
+  int H = enc.dim.shape.back();
+  bool shared = enc.dim.shape.size() == 2;
+  *e = enc.data + (shared ? 0 : (size_t)b * H);
+  *ld = shared ? H : (size_t)B * H;
+}
+
+// about 16 KB of states per block
+static int attention_block(int H) {
+  return std::max(4, 4096 / std::max(H, 1));
+}
+
+void Attention::forward(const std::vector<Tensor> &inputs, Tensor &output) {
+  RNNPP_CHECK(inputs.size() == 2 || inputs.size() == 3,
+      "Number of inputs is invalid: " << inputs.size());
+  const Tensor &enc = inputs[0];
+  const Tensor &q = inputs[1];
+  int B = q.dim.batch_size;
+  int Q = q.dim.size();
+  int nd = enc.dim.shape.size();
+  RNNPP_CHECK(enc.dim.batch_size == 1 && (nd == 2 || (nd == 3 && enc.dim[1] == B)),
+      "Encoder states must be (T, B, H) or (T, H): " << enc.dim << " for queries " << q.dim);
+  int T = enc.dim[0];
+  int H = enc.dim.shape.back();
+  if (inputs.size() == 3) {
+    const Tensor &w = inputs[2];
+    RNNPP_CHECK(w.dim.shape.size() == 2 && w.dim[0] == Q && w.dim[1] == H &&
+        w.dim.batch_size == 1, "Invalid bilinear weights " << w.dim << " for queries "
+        << q.dim << " and states " << enc.dim);
+  } else {
+    RNNPP_CHECK(Q == H, "Queries " << q.dim << " do not match the states " << enc.dim);
+  }
+  RNNPP_CHECK(lengths_.empty() || lengths_.size() == B,
+      lengths_.size() << " lengths for a batch of " << B);
+  for (int b=0; b < lengths_.size(); ++b) {
+    RNNPP_CHECK(lengths_[b] > 0 && lengths_[b] <= T,
+        "Invalid length " << lengths_[b] << " of " << T << " states");
+  }
+
+  if (inputs.size() == 3) {
+    u_.assign((size_t)B * H, 0.f);
+    gemm_nn(q.data, inputs[2].data, u_.data(), B, H, Q);
+  } else {
+    u_.assign(q.data, q.data + (size_t)B * H);
+  }
+
+  output.dim = Dim({H, 1}, B);
+  output.data = alloc_floats((size_t)H * B);
+  weights_.assign((size_t)B * T, 0.f);
+  int block = attention_block(H);
+  for (int b=0; b < B; ++b) {
+    const float *e;
+    size_t ld;
+    attention_states(enc, B, b, &e, &ld);
+    const float *u = &u_[(size_t)b * H];
+    float *a = &weights_[(size_t)b * T];
+    float *c = output.data + (size_t)b * H;
+    memset(c, 0, H * sizeof(float));
+    int len = lengths_.empty() ? T : lengths_[b];
+
+    // c and z are kept relative to exp(m) of the largest score so far, and
+    // the weights of each block relative to m as it was for that block
+    float m = -INFINITY;
+    float z = 0.f;
+    block_max_.clear();
+    for (int t0=0; t0 < len; t0 += block) {
+      int n = std::min(block, len - t0);
+      const float *et = e + t0 * ld;
+      float *at = a + t0;
+      dot_strided(u, et, ld, n, H, at);
+      float bm = max(at, n);
+      if (bm > m) {
+        float scale = expf(m - bm);
+        z *= scale;
+        for (int k=0; k < H; ++k) {
+          c[k] *= scale;
+        }
+        m = bm;
+      }
+      for (int j=0; j < n; ++j) {
+        at[j] = expf(at[j] - m);
+        z += at[j];
+      }
+      axpy_strided(at, et, ld, n, H, c);
+      block_max_.push_back(m);
+    }
+
+    float inv = 1.f / z;
+    for (int k=0; k < H; ++k) {
+      c[k] *= inv;
+    }
+    for (int t0=0, i=0; t0 < len; t0 += block, ++i) {
+      float scale = expf(block_max_[i] - m) * inv;
+      for (int t=t0; t < std::min(len, t0 + block); ++t) {
+        a[t] *= scale;
+      }
+    }
+  }
+}
+
+void Attention::forward2(const std::vector<Tensor> &inputs, std::vector<Tensor*> &output) {
+  forward(inputs, *output[0]);
+}
+
+// with g_t = dE/dc . e_t and ds_t = a_t (g_t - dE/dc . c):
+// dE/de_t = a_t dE/dc + ds_t u, dE/du = sum_t ds_t e_t,
+// dE/dq = dE/du W^T and dE/dW = q^T dE/du for bilinear scores
+void Attention::backward(const std::vector<Tensor> &inputs, const Tensor &output,
+    const Tensor &dEdy, int ii, Tensor &dEdxi) {
+  const Tensor &enc = inputs[0];
+  const Tensor &q = inputs[1];
+  int B = q.dim.batch_size;
+  int Q = q.dim.size();
+  int T = enc.dim[0];
+  int H = enc.dim.shape.back();
+
+  dEdxi.dim = inputs[ii].dim;
+  size_t size = (size_t)dEdxi.dim.size() * dEdxi.dim.batch_size;
+  dEdxi.data = alloc_floats(size);
+  memset(dEdxi.data, 0, size * sizeof(float));
+
+  if (ii == 0) {
+    du_.assign((size_t)B * H, 0.f);
+    int block = attention_block(H);
+    std::vector<float> ds(block);
+    for (int b=0; b < B; ++b) {
+      const float *e;
+      size_t ld;
+      attention_states(enc, B, b, &e, &ld);
+      float *de = dEdxi.data + (e - enc.data);
+      const float *u = &u_[(size_t)b * H];
+      float *du = &du_[(size_t)b * H];
+      const float *a = &weights_[(size_t)b * T];
+      const float *dc = dEdy.data + (size_t)b * H;
+      const float *c = output.data + (size_t)b * H;
+      int len = lengths_.empty() ? T : lengths_[b];
+
+      float dcc = 0.f;
+      for (int k=0; k < H; ++k) {
+        dcc += dc[k] * c[k];
+      }
+      for (int t0=0; t0 < len; t0 += block) {
+        int n = std::min(block, len - t0);
+        dot_strided(dc, e + t0 * ld, ld, n, H, ds.data());
+        for (int j=0; j < n; ++j) {
+          ds[j] = a[t0 + j] * (ds[j] - dcc);
+        }
+        axpy_strided(ds.data(), e + t0 * ld, ld, n, H, du);
+        for (int j=0; j < n; ++j) {
+          float *det = de + (t0 + j) * ld;
+          float at = a[t0 + j];
+          float st = ds[j];
+          for (int k=0; k < H; ++k) {
+            det[k] += at * dc[k] + st * u[k];
+          }
+        }
+      }
+    }
+  } else if (ii == 1) {
+    if (inputs.size() == 3) {
+      gemm_nt(du_.data(), inputs[2].data, dEdxi.data, B, Q, H);
+    } else {
+      memcpy(dEdxi.data, du_.data(), size * sizeof(float));
+    }
+  } else {
+    gemm_tn(q.data, du_.data(), dEdxi.data, Q, H, B);
+  }
+}
+
+void Attention::backward2(const std::vector<Tensor> &inputs, const std::vector<Tensor> &output,
+    const std::vector<Tensor> &dEdy, int ii, Tensor &dEdxi) {
+  backward(inputs, output[0], dEdy[0], ii, dEdxi);
+}
 
 } // namespace rnnpp
@@ -6,6 +6,7 @@
 
 #include "dim.h"
 #include "parameter.h"
+#include "quantize.h"
 #include "tensor.h"
 
 namespace rnnpp {
@@ -27,7 +28,7 @@ class Node {
 
     Node(std::vector<int> a): args(a) {}
 
-    ~Node() {}
+    virtual ~Node() {}
 
     virtual void forward(const std::vector<Tensor>& inputs, Tensor &output)=0;
     virtual void forward2(const std::vector<Tensor>& inputs, std::vector<Tensor*> &output)=0;
@@ -86,6 +87,36 @@ class InputNode: public Node {
 };
 
 
+/**
+ * A tensor, typically an output of another graph, as a constant input:
+ * its data is used as is and no gradient flows back into it.
+ */
+class TensorInputNode: public Node {
+  public:
+    TensorInputNode(): Node() {}
+
+    TensorInputNode(const Tensor &value, std::initializer_list<int> out)
+      : Node({}, out), value_(value) {}
+
+    ~TensorInputNode() {}
+
+    void forward(const std::vector<Tensor>& inputs, Tensor &output) { output = value_; }
+    void forward2(const std::vector<Tensor>& inputs, std::vector<Tensor*> &output) {
+      *output[0] = value_;
+    }
+
+    void backward(const std::vector<Tensor>& inputs, const Tensor &output,
+        const Tensor &dEdy, int ii, Tensor &dEdxi){};
+    void backward2(const std::vector<Tensor>& inputs, const std::vector<Tensor> &output,
+        const std::vector<Tensor> &dEdy, int ii, Tensor &dEdxi){};
+
+    std::string type() { return "TensorInputNode"; }
+
+  private:
+    Tensor value_;
+};
+
+
 class ParameterNodeBase: public Node {
   public:
     ParameterNodeBase() : Node() {}
@@ -159,8 +190,12 @@ class LookupNode: public ParameterNodeBase {
         const std::vector<Tensor> &dEdy, int ii, Tensor &dEdxi);
 
     void add_gradient(const Tensor &dEdy) {
-      std::cout << "add gradient at " << index << std::endl;
-      param.grads[index] += dEdy;
+      if (param.frozen()) {
+        return;
+      }
+      Tensor g = param.grad(index);
+      g += dEdy;
+      param.touch(index);
     }
 
   private:
@@ -169,6 +204,138 @@ class LookupNode: public ParameterNodeBase {
 };
 
 
+/**
+ * Looks up many rows at once. The output is (1, dim_emb) with one batch
+ * element per index, gathered in a single kernel.
+ * The gradient is scattered back in index order, so repeated indices
+ * update the same row one after another and each row is touched once.
+ */
+class BatchedLookupNode: public ParameterNodeBase {
+  public:
+    BatchedLookupNode(): ParameterNodeBase() {}
+
+    BatchedLookupNode(LookupParameter p, const std::vector<int> &indices,
+        std::initializer_list<int> out);
+
+    void forward(const std::vector<Tensor>& inputs, Tensor &output);
+    void forward2(const std::vector<Tensor>& inputs, std::vector<Tensor*> &output);
+
+    void backward(const std::vector<Tensor>& inputs, const Tensor &output,
+        const Tensor &dEdy, int ii, Tensor &dEdxi){};
+    void backward2(const std::vector<Tensor>& inputs, const std::vector<Tensor> &output,
+        const std::vector<Tensor> &dEdy, int ii, Tensor &dEdxi){};
+
+    void add_gradient(const Tensor &dEdy);
+
+    std::string type() { return "BatchedLookupNode"; }
+
+  private:
+    LookupParameter param;
+    std::vector<int> indices;
+    // positions sorted by index
+    std::vector<int> order;
+};
+
+
+/**
+ * Sum, mean or max of the rows of each bag, computed straight from the
+ * table. Bag b holds indices [offsets_b, offsets_{b+1}) and the output is
+ * (1, dim_emb) with one batch element per bag.
+ */
+class EmbeddingBagNode: public ParameterNodeBase {
+  public:
+    EmbeddingBagNode(): ParameterNodeBase() {}
+
+    EmbeddingBagNode(LookupParameter p, const std::vector<int> &indices,
+        const std::vector<int> &offsets, BagMode mode, std::initializer_list<int> out);
+
+    void forward(const std::vector<Tensor>& inputs, Tensor &output);
+    void forward2(const std::vector<Tensor>& inputs, std::vector<Tensor*> &output);
+
+    void backward(const std::vector<Tensor>& inputs, const Tensor &output,
+        const Tensor &dEdy, int ii, Tensor &dEdxi){};
+    void backward2(const std::vector<Tensor>& inputs, const std::vector<Tensor> &output,
+        const std::vector<Tensor> &dEdy, int ii, Tensor &dEdxi){};
+
+    void add_gradient(const Tensor &dEdy);
+
+    std::string type() { return "EmbeddingBagNode"; }
+
+  private:
+    LookupParameter param;
+    std::vector<int> indices;
+    std::vector<int> offsets;
+    BagMode mode;
+    // bag of each index and positions sorted by index
+    std::vector<int> bag;
+    std::vector<int> order;
+    // 1 / bag size for kBagMean
+    std::vector<float> scale;
+    // position of the maximum for kBagMax, set by forward
+    std::vector<int> argmax;
+};
+
+
+/**
+ * Dequantizes one row of an int8 lookup table. Inference only.
+ */
+class QuantizedLookupNode: public Node {
+  public:
+    QuantizedLookupNode(): Node() {}
+
+    QuantizedLookupNode(QuantizedLookupParameter p, int index, std::initializer_list<int> out)
+      : Node({}, out), param(p), index(index) {
+      dim = Dim({1, p.all_values.cols()}, 1);
+    }
+
+    ~QuantizedLookupNode() {}
+
+    void forward(const std::vector<Tensor>& inputs, Tensor &output);
+    void forward2(const std::vector<Tensor>& inputs, std::vector<Tensor*> &output);
+
+    void backward(const std::vector<Tensor>& inputs, const Tensor &output,
+        const Tensor &dEdy, int ii, Tensor &dEdxi){};
+    void backward2(const std::vector<Tensor>& inputs, const std::vector<Tensor> &output,
+        const std::vector<Tensor> &dEdy, int ii, Tensor &dEdxi){};
+
+    std::string type() { return "QuantizedLookupNode"; }
+
+  private:
+    QuantizedLookupParameter param;
+    int index;
+};
+
+
+/**
+ * y = act(w * x + b) with int8 w, see matmul_int8. Inference only.
+ * inputs: {x} or {x, b}
+ */
+class QuantizedMult: public Node {
+  public:
+    QuantizedMult(): Node() {}
+
+    QuantizedMult(std::vector<int> in, std::initializer_list<int> out,
+        QuantizedParameter w, Activation act)
+      : Node(in, out), w_(w), act_(act) {}
+
+    ~QuantizedMult() {}
+
+    void forward(const std::vector<Tensor>& inputs, Tensor &output);
+    void forward2(const std::vector<Tensor>& inputs, std::vector<Tensor*> &output);
+
+    void backward(const std::vector<Tensor>& inputs, const Tensor &output,
+        const Tensor &dEdy, int ii, Tensor &dEdxi);
+    void backward2(const std::vector<Tensor>& inputs, const std::vector<Tensor> &output,
+        const std::vector<Tensor> &dEdy, int ii, Tensor &dEdxi);
+
+    std::string type() { return "QuantizedMult"; }
+
+  private:
+    QuantizedParameter w_;
+    Activation act_;
+};
+
+
 /**
  *  y = [a, b]
  *  dEda = dEdy * dEda = dEdy[0: len(a)]
@@ -335,6 +502,29 @@ class Mult: public Node {
     std::string type() { return "Mult"; }
 };
 
+/**
+ * y = a * b  (elementwise, with broadcasting)
+ */
+class CwiseMult: public Node {
+  public:
+    CwiseMult(): Node() {}
+
+    CwiseMult(std::initializer_list<int> in, std::initializer_list<int> out)
+      : Node(in, out) {}
+
+    ~CwiseMult(){}
+
+    void forward(const std::vector<Tensor>& inputs, Tensor &output);
+    void forward2(const std::vector<Tensor>& inputs, std::vector<Tensor*> &output);
+
+    void backward(const std::vector<Tensor>& inputs, const Tensor &output,
+        const Tensor &dEdy, int ii, Tensor &dEdxi);
+    void backward2(const std::vector<Tensor>& inputs, const std::vector<Tensor> &output,
+        const std::vector<Tensor> &dEdy, int ii, Tensor &dEdxi);
+
+    std::string type() { return "CwiseMult"; }
+};
+
 class Divide: public Node {
   public:
     Divide(): Node() {}
@@ -407,6 +597,95 @@ class SquaredDistance: public Node {
     std::string type() { return "SquaredDistance"; }
 };
 
+/**
+ * -log softmax(x)_t for logits x with n classes (any shape) and one
+ * target t per batch element. The output is (1) with the batch of x.
+ *
+ * Forward is one pass over the logits with online_logsumexp and keeps
+ * only the log normalizer of each example. Backward writes
+ * dE/dy * (softmax(x) - onehot(t)) straight into the gradient in one
+ * more pass, so the probabilities are never stored.
+ */
+class PickNegLogSoftmax: public Node {
+  public:
+    PickNegLogSoftmax(): Node() {}
+
+    PickNegLogSoftmax(std::initializer_list<int> in, std::initializer_list<int> out,
+        const std::vector<int> &targets)
+      : Node(in, out), targets_(targets) {}
+
+    ~PickNegLogSoftmax() {}
+
+    void forward(const std::vector<Tensor>& inputs, Tensor &output);
+    void forward2(const std::vector<Tensor>& inputs, std::vector<Tensor*> &output);
+
+    void backward(const std::vector<Tensor>& inputs, const Tensor &output,
+        const Tensor &dEdy, int ii, Tensor &dEdxi);
+    void backward2(const std::vector<Tensor>& inputs, const std::vector<Tensor> &output,
+        const std::vector<Tensor> &dEdy, int ii, Tensor &dEdxi);
+
+    std::string type() { return "PickNegLogSoftmax"; }
+
+  private:
+    std::vector<int> targets_;
+    // log sum exp of the logits of each example
+    std::vector<float> lse_;
+};
+
+/**
+ * -log softmax over a subset of the rows of an output layer. The inputs
+ * are h with H values per batch element, n rows W (1, H) and biases
+ * (1, 1) as gathered by lookup(), one batch element per row. Example b
+ * is scored against rows [begin_b, end_b) and its target row target_b,
+ * which may lie outside that range:
+ *
+ *   l_j = W_j h_b + bias_j - shift_j
+ *
+ * shift (one per row, or empty) corrects for sampling. Rows in the range
+ * with the same id as the target row are left out, unless ids is empty.
+ * The output is the loss (1) of each example.
+ *
+ * Consecutive examples with the same range are one GEMM against it, in
+ * forward and backward. The probabilities replace the logits in place
+ * and are turned into the gradient of the logits in the same buffer.
+ */
+class CandidateSoftmaxLoss: public Node {
+  public:
+    CandidateSoftmaxLoss(): Node() {}
+
+    CandidateSoftmaxLoss(std::initializer_list<int> in, std::initializer_list<int> out,
+        const std::vector<int> &begin, const std::vector<int> &end,
+        const std::vector<int> &target, const std::vector<float> &shift,
+        const std::vector<int> &ids)
+      : Node(in, out), begin_(begin), end_(end), target_(target), shift_(shift),
+        ids_(ids) {}
+
+    ~CandidateSoftmaxLoss() {}
+
+    void forward(const std::vector<Tensor>& inputs, Tensor &output);
+    void forward2(const std::vector<Tensor>& inputs, std::vector<Tensor*> &output);
+
+    void backward(const std::vector<Tensor>& inputs, const Tensor &output,
+        const Tensor &dEdy, int ii, Tensor &dEdxi);
+    void backward2(const std::vector<Tensor>& inputs, const std::vector<Tensor> &output,
+        const std::vector<Tensor> &dEdy, int ii, Tensor &dEdxi);
+
+    std::string type() { return "CandidateSoftmaxLoss"; }
+
+  private:
+    std::vector<int> begin_;
+    std::vector<int> end_;
+    std::vector<int> target_;
+    std::vector<float> shift_;
+    std::vector<int> ids_;
+    // the logits of the range of each example, from offsets_[b], and of the
+    // target if it is outside the range; probabilities after forward and
+    // gradients after the first backward
+    std::vector<float> logits_;
+    std::vector<float> target_logits_;
+    std::vector<int> offsets_;
+};
+
 
 class TanhNode: public Node {
   public:
@@ -453,6 +732,340 @@ class SigmoidNode: public Node {
 };
 
 
+enum FusedOpCode {
+  kFusedLoad,    // inputs[a]
+  kFusedConst,   // value
+  kFusedAdd,     // r[a] + r[b]
+  kFusedSub,     // r[a] - r[b]
+  kFusedMul,     // r[a] * r[b]
+  kFusedDiv,     // r[a] / r[b]
+  kFusedNeg,     // -r[a]
+  kFusedSquare,  // r[a]^2
+  kFusedExp,     // exp(r[a])
+  kFusedTanh,    // tanh(r[a])
+  kFusedSigmoid, // 1 / (1 + exp(-r[a]))
+};
+
+struct FusedOp {
+  FusedOpCode code;
+  int a;
+  int b;
+  float value;
+};
+
+/**
+ * A chain of elementwise operations over inputs of the same shape,
+ * optionally followed by a sum and a constant scale, evaluated in one pass.
+ * ops is in topological order and r[k] is the value of ops[k] at one
+ * element; the last op is the result.
+ *
+ * axis == -1:    y_b = scale * sum_i r(i, b)
+ * axis == ndim:  y_i = scale * sum_b r(i, b)
+ * otherwise:     y_{i, b} = scale * r(i, b)  (use axis == -2)
+ *
+ * backward re-evaluates r at each element and walks ops in reverse to
+ * accumulate the gradient of each input.
+ */
+class FusedElementwise: public Node {
+  public:
+    FusedElementwise(): Node() {}
+
+    FusedElementwise(std::vector<int> in, std::initializer_list<int> out,
+        const std::vector<FusedOp> &ops, int axis, float scale)
+      : Node(in, out), ops_(ops), axis_(axis), scale_(scale) {}
+
+    ~FusedElementwise() {}
+
+    void forward(const std::vector<Tensor>& inputs, Tensor &output);
+    void forward2(const std::vector<Tensor>& inputs, std::vector<Tensor*> &output);
+
+    void backward(const std::vector<Tensor>& inputs, const Tensor &output,
+        const Tensor &dEdy, int ii, Tensor &dEdxi);
+    void backward2(const std::vector<Tensor>& inputs, const std::vector<Tensor> &output,
+        const std::vector<Tensor> &dEdy, int ii, Tensor &dEdxi);
+
+    std::string type() { return "FusedElementwise"; }
+
+  private:
+    void eval(const std::vector<Tensor>& inputs, int i, int b, float *r) const;
+
+    std::vector<FusedOp> ops_;
+    int axis_;
+    float scale_;
+};
+
+
+/**
+ * Rows [begin, end) of each batch element of x.
+ */
+class SliceRows: public Node {
+  public:
+    SliceRows(): Node() {}
+
+    SliceRows(std::initializer_list<int> in, std::initializer_list<int> out,
+        int begin, int end)
+      : Node(in, out), begin_(begin), end_(end) {}
+
+    ~SliceRows() {}
+
+    void forward(const std::vector<Tensor>& inputs, Tensor &output);
+    void forward2(const std::vector<Tensor>& inputs, std::vector<Tensor*> &output);
+
+    void backward(const std::vector<Tensor>& inputs, const Tensor &output,
+        const Tensor &dEdy, int ii, Tensor &dEdxi);
+    void backward2(const std::vector<Tensor>& inputs, const std::vector<Tensor> &output,
+        const std::vector<Tensor> &dEdy, int ii, Tensor &dEdxi);
+
+    std::string type() { return "SliceRows"; }
+
+  private:
+    int begin_;
+    int end_;
+};
+
+
+/**
+ * One LSTM step. The inputs are x (D, 1), the previous state s = [h; c]
+ * (2H, 1), the stacked gate weights W (4H, D + H) and bias b (4H, 1), with
+ * the gates in the order input, forget, cell, output. The output is the
+ * new state [h; c].
+ *
+ * All gates come from one GEMM of the batch of [x; h] rows with W, and the
+ * nonlinearities and the cell update are one pass over the gates.
+ * forward keeps [x; h], the gates and tanh(c) for backward, which computes
+ * the gradient of the gates once, on the call for the first input.
+ */
+class LSTMCell: public Node {
+  public:
+    LSTMCell(): Node() {}
+
+    LSTMCell(std::initializer_list<int> in, std::initializer_list<int> out)
+      : Node(in, out) {}
+
+    ~LSTMCell() {}
+
+    void forward(const std::vector<Tensor>& inputs, Tensor &output);
+    void forward2(const std::vector<Tensor>& inputs, std::vector<Tensor*> &output);
+
+    void backward(const std::vector<Tensor>& inputs, const Tensor &output,
+        const Tensor &dEdy, int ii, Tensor &dEdxi);
+    void backward2(const std::vector<Tensor>& inputs, const std::vector<Tensor> &output,
+        const std::vector<Tensor> &dEdy, int ii, Tensor &dEdxi);
+
+    std::string type() { return "LSTMCell"; }
+
+  private:
+    int batch_;
+    // (batch, D + H), (batch, 4H) and (batch, H)
+    std::vector<float> xh_;
+    std::vector<float> gates_;
+    std::vector<float> tanh_c_;
+    // gradients of the gate inputs, [x; h] and the previous c, from the
+    // last backward
+    std::vector<float> d_gates_;
+    std::vector<float> d_xh_;
+    std::vector<float> d_c_;
+};
+
+
+/**
+ * One GRU step. The inputs are x (D, 1), the previous state h (H, 1), the
+ * stacked input weights W_x (3H, D) and recurrent weights W_h (3H, H), and
+ * the biases b_x and b_h (3H, 1), with the gates in the order reset,
+ * update, candidate. The output is the new h.
+ *
+ * The input and the recurrent projections are one GEMM each over the
+ * batch, and the gate arithmetic is one pass over both. As in LSTMCell,
+ * backward computes the gradient of the projections on the call for the
+ * first input.
+ */
+class GRUCell: public Node {
+  public:
+    GRUCell(): Node() {}
+
+    GRUCell(std::initializer_list<int> in, std::initializer_list<int> out)
+      : Node(in, out) {}
+
+    ~GRUCell() {}
+
+    void forward(const std::vector<Tensor>& inputs, Tensor &output);
+    void forward2(const std::vector<Tensor>& inputs, std::vector<Tensor*> &output);
+
+    void backward(const std::vector<Tensor>& inputs, const Tensor &output,
+        const Tensor &dEdy, int ii, Tensor &dEdxi);
+    void backward2(const std::vector<Tensor>& inputs, const std::vector<Tensor> &output,
+        const std::vector<Tensor> &dEdy, int ii, Tensor &dEdxi);
+
+    std::string type() { return "GRUCell"; }
+
+  private:
+    int batch_;
+    // (batch, D), (batch, H), (batch, 3H) and (batch, H)
+    std::vector<float> x_;
+    std::vector<float> h_;
+    std::vector<float> gates_;
+    std::vector<float> hn_;
+    // gradients of both projections and of x and h, from the last backward
+    std::vector<float> d_ax_;
+    std::vector<float> d_ah_;
+    std::vector<float> d_x_;
+    std::vector<float> d_h_;
+};
+
+/**
+ * A GRU over a whole sequence. The inputs are xs (T, B, D) in time major
+ * order, the initial state h0 (H, 1) with batch size B or 1, and the
+ * weights and biases of GRUCell. The output is the states of all steps
+ * (T, B, H).
+ *
+ * The input projections of all steps are one (T * B, D) GEMM before the
+ * loop, which is left with the recurrent GEMM and the gate arithmetic per
+ * step, in buffers reused across steps. Backward through time keeps the
+ * gradients of the projections of every step, so the weight gradients
+ * and the gradient of xs are again one GEMM each over the sequence.
+ *
+ * With batch_sizes the sequences are packed: xs is (D, 1) with a batch of
+ * all tokens in time major order, sorted longest sequence first, and
+ * batch_sizes[t] sequences are still running at step t. Each step only
+ * computes the rows of those sequences, which are a prefix of the rows of
+ * the step before, and the output is (H, 1) with the same batch.
+ */
+class GRUSequence: public Node {
+  public:
+    GRUSequence(): Node() {}
+
+    GRUSequence(std::initializer_list<int> in, std::initializer_list<int> out,
+        const std::vector<int> &batch_sizes=std::vector<int>())
+      : Node(in, out), batch_sizes_(batch_sizes) {}
+
+    ~GRUSequence() {}
+
+    void forward(const std::vector<Tensor>& inputs, Tensor &output);
+    void forward2(const std::vector<Tensor>& inputs, std::vector<Tensor*> &output);
+
+    void backward(const std::vector<Tensor>& inputs, const Tensor &output,
+        const Tensor &dEdy, int ii, Tensor &dEdxi);
+    void backward2(const std::vector<Tensor>& inputs, const std::vector<Tensor> &output,
+        const std::vector<Tensor> &dEdy, int ii, Tensor &dEdxi);
+
+    std::string type() { return "GRUSequence"; }
+
+  private:
+    std::vector<int> batch_sizes_;
+    // first row of each step, and the number of rows at the end
+    std::vector<int> offsets_;
+    // (B, H)
+    std::vector<float> h0_;
+    // r, z and n (3H) and W_hn h + b_hn (H) of every row
+    std::vector<float> gates_;
+    std::vector<float> hn_;
+    // gradients of the projections of every row and of h0 (B, H), from
+    // the last backward
+    std::vector<float> d_ax_;
+    std::vector<float> d_ah_;
+    std::vector<float> d_h0_;
+};
+
+/**
+ * A stack of n_layers GRU layers over a whole sequence, each either one
+ * forward GRU or a forward and a backward GRU whose states are
+ * concatenated. The inputs are xs (T, B, D) and the W_x, W_h, b_x and b_h
+ * of every layer and direction, in that order; the states start at zero.
+ * The output is the states of the last layer (T, B, H) or (T, B, 2H).
+ *
+ * Forward and backward through time run the steps of all layers and
+ * directions as tasks on num_threads threads, each started as soon as
+ * the steps it depends on are done. Step t of a layer needs the previous
+ * step in its direction and step t of the layer below, so a forward stack
+ * runs as a wavefront along the layers, while the two directions of a
+ * bidirectional layer run side by side. The weight gradients are one
+ * GEMM per weight over the sequence, in parallel across layers.
+ */
+class GRUStack: public Node {
+  public:
+    GRUStack(): Node() {}
+
+    GRUStack(std::vector<int> in, std::initializer_list<int> out, int n_layers,
+        bool bidirectional, int num_threads)
+      : Node(in, out), n_layers_(n_layers), n_dirs_(bidirectional ? 2 : 1),
+        num_threads_(num_threads) {}
+
+    ~GRUStack() {}
+
+    void forward(const std::vector<Tensor>& inputs, Tensor &output);
+    void forward2(const std::vector<Tensor>& inputs, std::vector<Tensor*> &output);
+
+    void backward(const std::vector<Tensor>& inputs, const Tensor &output,
+        const Tensor &dEdy, int ii, Tensor &dEdxi);
+    void backward2(const std::vector<Tensor>& inputs, const std::vector<Tensor> &output,
+        const std::vector<Tensor> &dEdy, int ii, Tensor &dEdxi);
+
+    std::string type() { return "GRUStack"; }
+
+  private:
+    int threads(int n_tasks) const;
+
+    int n_layers_;
+    int n_dirs_;
+    int num_threads_;
+    // for each layer and direction: r, z, n (T, B, 3H), W_hn h + b_hn and
+    // the states (T, B, H)
+    std::vector<std::vector<float>> gates_;
+    std::vector<std::vector<float>> hn_;
+    std::vector<std::vector<float>> hs_;
+    // outputs of each layer but the last (T, B, n_dirs * H)
+    std::vector<std::vector<float>> ys_;
+    // gradients of every input, from the last backward
+    std::vector<std::vector<float>> grads_;
+};
+
+/**
+ * Attention of queries over encoder states. The inputs are the states
+ * enc (T, B, H) in time major order, or (T, H) shared by the whole batch,
+ * the queries q (Q, 1) with batch size B and, for bilinear scores, W
+ * (Q, H):
+ *
+ *   s_t = q^T e_t  or  q^T W e_t,  a = softmax(s),  c = sum_t a_t e_t
+ *
+ * Example b only attends to its first lengths_b states, or to all T if
+ * lengths is empty. The output is the context c (H, 1) with batch size B.
+ *
+ * Forward streams over the states of each example in blocks that stay in
+ * L1: the scores of a block, then its share of c with a running max, so
+ * each state is read from memory once and only the weights a are kept.
+ * Backward is one more such pass on the call for the first input, which
+ * also leaves the gradient of W^T q for the other inputs.
+ */
+class Attention: public Node {
+  public:
+    Attention(): Node() {}
+
+    Attention(std::vector<int> in, std::initializer_list<int> out,
+        const std::vector<int> &lengths)
+      : Node(in, out), lengths_(lengths) {}
+
+    ~Attention() {}
+
+    void forward(const std::vector<Tensor>& inputs, Tensor &output);
+    void forward2(const std::vector<Tensor>& inputs, std::vector<Tensor*> &output);
+
+    void backward(const std::vector<Tensor>& inputs, const Tensor &output,
+        const Tensor &dEdy, int ii, Tensor &dEdxi);
+    void backward2(const std::vector<Tensor>& inputs, const std::vector<Tensor> &output,
+        const std::vector<Tensor> &dEdy, int ii, Tensor &dEdxi);
+
+    std::string type() { return "Attention"; }
+
+  private:
+    std::vector<int> lengths_;
+    // W^T q (B, H), or a copy of q, and its gradient from the last backward
+    std::vector<float> u_;
+    std::vector<float> du_;
+    // the weights a (B, T), and the running max after each block of states
+    std::vector<float> weights_;
+    std::vector<float> block_max_;
+};
+
 class Embed: public Node {
   public:
     Embed(): Node() {}
@@ -1,47 +1,340 @@
+#include <math.h>
+
+#include <algorithm>
 #include <initializer_list>
-#include <random>
+
+#ifdef __AVX__
+#include <immintrin.h>
+#endif
 
 #include "dim.h"
+#include "dtype.h"
+#include "error.h"
 #include "expr.h"
 #include "optimizer.h"
 #include "parameter.h"
 
 namespace rnnpp {
 
-Parameter Optimizer::add_parameter(const std::initializer_list<int> &d) {
-  Parameter p(d);
-  Initializer initializer;
-  initializer.init(p.value);
-  p.grad = Scalar(0.);
+Optimizer::~Optimizer() {
+  delete[] states_;
+  for (int i=0; i < last_update_.size(); ++i) {
+    delete[] last_update_[i];
+  }
+}
+
+Parameter Optimizer::add_parameter(const std::initializer_list<int> &d, DType dtype,
+    const std::string &name, Initializer *init) {
+  return model.add_parameter(Dim(d), dtype, name, init);
+}
 
-  parameters_.push_back(&p);
-  return p;
+LookupParameter Optimizer::add_lookup_parameter(const std::initializer_list<int> &d,
+    DType dtype, const std::string &name, Initializer *init) {
+  return model.add_lookup_parameter(Dim(d), dtype, name, init);
 }
 
-LookupParameter Optimizer::add_lookup_parameter(const std::initializer_list<int> &d) {
-  LookupParameter p(d);
-  Initializer initializer;
-  initializer.init(p.all_values);
-//  p.grad = Scalar(0.);
+void Optimizer::allocate_states() {
+  int ns = n_states();
+  size_t n = model.grads_size();
+  if (ns > 0 && n > state_size_) {
+    // grow to cover parameters added since the last update
+    float *s = new float[ns * n];
+    std::fill(s, s + ns * n, 0.f);
+    for (int k=0; k < ns && states_; ++k) {
+      std::copy(states_ + k * state_size_, states_ + (k + 1) * state_size_, s + k * n);
+    }
+    delete[] states_;
+    states_ = s;
+    state_size_ = n;
+  }
 
-  lparameters_.push_back(&p);
-  return p;
+  for (int i=last_update_.size(); i < model.lookup_parameters.size(); ++i) {
+    last_update_.push_back(new int[model.lookup_parameters[i].all_values.dim.shape[0]]());
+  }
 }
 
+void Optimizer::update_span(float *w, float *g, size_t base, size_t n) {
+  const size_t chunk = 1 << 30;
+  int ns = n_states();
+  for (size_t off=0; off < n; off += chunk) {
+    size_t m = std::min(chunk, n - off);
+    float *s0 = ns > 0 ? states_ + base + off : nullptr;
+    float *s1 = ns > 1 ? states_ + state_size_ + base + off : nullptr;
+    update_block(w + off, g + off, s0, s1, m);
+  }
+}
 
 void Optimizer::update() {
-  for (int i=0; i < parameters_.size(); ++i) {
-    parameters_[i]->value -= Scalar(0.1) * parameters_[i]->grad;
-    parameters_[i]->grad = Scalar(0.);
+  ++t_;
+  begin_update();
+
+  // state is allocated on the first update so that hyperparameters
+  // such as momentum can still be changed after add_parameter()
+  allocate_states();
+
+  update_parameters(model.parameters, model.grads());
+  for (int i=0; i < model.lookup_parameters.size(); ++i) {
+    update_rows(model.lookup_parameters[i], model.grads(), last_update_[i]);
+  }
+}
+
+void Optimizer::start_hogwild() {
+  ++t_;
+  begin_update();
+  allocate_states();
+}
+
+void Optimizer::update(ParameterReplica &r) {
+  RNNPP_CHECK(r.grads_size() == model.grads_size() &&
+      (n_states() == 0 || r.grads_size() <= state_size_),
+      "The replica does not match the model; call start_hogwild() after adding parameters");
+
+  update_parameters(r.parameters, r.grads());
+  for (int i=0; i < r.lookup_parameters.size(); ++i) {
+    update_rows(r.lookup_parameters[i], r.grads(), nullptr);
   }
+}
 
-//  for (int i=0; i < lparameters_.size(); ++i) {
-//    for (int j=0; j < lparameters_[i]->value.dim.size(); ++j) {
-//      lparameters_[i]->value -= Scalar(0.1) * lparameters_[i].grad;
-//    }
-//    parameters_[i]->grad = Scalar(0.);
-//  }
+void Optimizer::update_parameters(std::vector<Parameter> &params, float *grads) {
+  const int block = 256;
+  float buf[block];
+  int ns = n_states();
 
+  // float parameters that are adjacent in the collection, padding
+  // included, are updated as one span
+  float *w = nullptr;
+  float *g = nullptr;
+  size_t n = 0;
+  for (int i=0; i < params.size(); ++i) {
+    Parameter &p = params[i];
+    size_t m = p.value.dim.elements();
+
+    if (p.dtype == kFloat32) {
+      if (w != nullptr && p.value.data == w + n && p.grad.data == g + n) {
+        n += ParameterCollection::aligned(m);
+      } else {
+        if (w != nullptr) {
+          update_span(w, g, g - grads, n);
+        }
+        w = p.value.data;
+        g = p.grad.data;
+        n = ParameterCollection::aligned(m);
+      }
+      continue;
+    }
+
+    // widen a block, update it in float and narrow it back
+    size_t base = p.grad.data - grads;
+    float *s0 = ns > 0 ? states_ + base : nullptr;
+    float *s1 = ns > 1 ? states_ + state_size_ + base : nullptr;
+    for (size_t off=0; off < m; off += block) {
+      int k = std::min((size_t)block, m - off);
+      decode(p.packed + off, buf, k, p.dtype);
+      update_block(buf, p.grad.data + off,
+          s0 ? s0 + off : nullptr, s1 ? s1 + off : nullptr, k);
+      encode(buf, p.packed + off, k, p.dtype);
+    }
+  }
+  if (w != nullptr) {
+    update_span(w, g, g - grads, n);
+  }
+}
+
+void Optimizer::update_rows(LookupParameter &p, float *grads, int *last_update) {
+  int dim_emb = p.all_values.dim.shape[1];
+  int ns = n_states();
+  size_t base = p.all_grads.data - grads;
+  std::vector<float> buf(p.dtype == kFloat32 ? 0 : dim_emb);
+
+  for (int j=0; j < p.touched->size(); ++j) {
+    int r = (*p.touched)[j];
+    size_t off = (size_t)r * dim_emb;
+    float *w;
+    if (p.dtype == kFloat32) {
+      w = p.all_values.data + off;
+    } else {
+      w = buf.data();
+      decode(p.packed + off, w, dim_emb, p.dtype);
+    }
+    float *s0 = ns > 0 ? states_ + base + off : nullptr;
+    float *s1 = ns > 1 ? states_ + state_size_ + base + off : nullptr;
+
+    if (last_update) {
+      int k = t_ - last_update[r] - 1;
+      if (k > 0) {
+        catch_up(w, s0, s1, dim_emb, k);
+      }
+      last_update[r] = t_;
+    }
+    update_block(w, p.all_grads.data + off, s0, s1, dim_emb);
+
+    if (p.dtype != kFloat32) {
+      encode(w, p.packed + off, dim_emb, p.dtype);
+    }
+    p.is_touched[r] = 0;
+  }
+  p.touched->clear();
+}
+
+void SGDOptimizer::update_block(float *w, float *g, float *s0, float *s1, int n) {
+  int i = 0;
+  if (s0 == nullptr) {
+#ifdef __AVX__
+    __m256 lr = _mm256_set1_ps(learning_rate);
+    __m256 zero = _mm256_setzero_ps();
+    for (; i + 8 <= n; i += 8) {
+      __m256 vg = _mm256_loadu_ps(g + i);
+      __m256 vw = _mm256_loadu_ps(w + i);
+      _mm256_storeu_ps(w + i, _mm256_sub_ps(vw, _mm256_mul_ps(lr, vg)));
+      _mm256_storeu_ps(g + i, zero);
+    }
+#endif
+    for (; i < n; ++i) {
+      w[i] -= learning_rate * g[i];
+      g[i] = 0.f;
+    }
+    return;
+  }
+
+#ifdef __AVX__
+  __m256 lr = _mm256_set1_ps(learning_rate);
+  __m256 mu = _mm256_set1_ps(momentum);
+  __m256 zero = _mm256_setzero_ps();
+  for (; i + 8 <= n; i += 8) {
+    __m256 vg = _mm256_loadu_ps(g + i);
+    __m256 vv = _mm256_add_ps(_mm256_mul_ps(mu, _mm256_loadu_ps(s0 + i)), vg);
+    __m256 vw = _mm256_loadu_ps(w + i);
+    _mm256_storeu_ps(s0 + i, vv);
+    _mm256_storeu_ps(w + i, _mm256_sub_ps(vw, _mm256_mul_ps(lr, vv)));
+    _mm256_storeu_ps(g + i, zero);
+  }
+#endif
+  for (; i < n; ++i) {
+    float v = momentum * s0[i] + g[i];
+    s0[i] = v;
+    w[i] -= learning_rate * v;
+    g[i] = 0.f;
+  }
+}
+
+void SGDOptimizer::catch_up(float *w, float *s0, float *s1, int n, int k) {
+  if (s0 == nullptr) {
+    return;
+  }
+  // v_j = mu^j v and w moves by lr * (mu + ... + mu^k) v
+  float decay = pow(momentum, k);
+  float c = learning_rate * (momentum == 1. ? k : momentum * (1. - decay) / (1. - momentum));
+  for (int i=0; i < n; ++i) {
+    w[i] -= c * s0[i];
+    s0[i] *= decay;
+  }
+}
+
+void AdamOptimizer::begin_update() {
+  float c1 = 1. - pow(beta1, t_);
+  float c2 = 1. - pow(beta2, t_);
+  lr_t_ = learning_rate * sqrtf(c2) / c1;
+}
+
+void AdamOptimizer::update_block(float *w, float *g, float *s0, float *s1, int n) {
+  int i = 0;
+#ifdef __AVX__
+  __m256 lr = _mm256_set1_ps(lr_t_);
+  __m256 b1 = _mm256_set1_ps(beta1);
+  __m256 b2 = _mm256_set1_ps(beta2);
+  __m256 c1 = _mm256_set1_ps(1.f - beta1);
+  __m256 c2 = _mm256_set1_ps(1.f - beta2);
+  __m256 e = _mm256_set1_ps(eps);
+  __m256 zero = _mm256_setzero_ps();
+  for (; i + 8 <= n; i += 8) {
+    __m256 vg = _mm256_loadu_ps(g + i);
+    __m256 vm = _mm256_add_ps(_mm256_mul_ps(b1, _mm256_loadu_ps(s0 + i)),
+        _mm256_mul_ps(c1, vg));
+    __m256 vv = _mm256_add_ps(_mm256_mul_ps(b2, _mm256_loadu_ps(s1 + i)),
+        _mm256_mul_ps(c2, _mm256_mul_ps(vg, vg)));
+    __m256 d = _mm256_div_ps(vm, _mm256_add_ps(_mm256_sqrt_ps(vv), e));
+    __m256 vw = _mm256_loadu_ps(w + i);
+    _mm256_storeu_ps(s0 + i, vm);
+    _mm256_storeu_ps(s1 + i, vv);
+    _mm256_storeu_ps(w + i, _mm256_sub_ps(vw, _mm256_mul_ps(lr, d)));
+    _mm256_storeu_ps(g + i, zero);
+  }
+#endif
+  for (; i < n; ++i) {
+    float m = beta1 * s0[i] + (1.f - beta1) * g[i];
+    float v = beta2 * s1[i] + (1.f - beta2) * g[i] * g[i];
+    s0[i] = m;
+    s1[i] = v;
+    w[i] -= lr_t_ * m / (sqrtf(v) + eps);
+    g[i] = 0.f;
+  }
+}
+
+void AdamOptimizer::catch_up(float *w, float *s0, float *s1, int n, int k) {
+  float d1 = pow(beta1, k);
+  float d2 = pow(beta2, k);
+  for (int i=0; i < n; ++i) {
+    s0[i] *= d1;
+    s1[i] *= d2;
+  }
+}
+
+void AdagradOptimizer::update_block(float *w, float *g, float *s0, float *s1, int n) {
+  int i = 0;
+#ifdef __AVX__
+  __m256 lr = _mm256_set1_ps(learning_rate);
+  __m256 e = _mm256_set1_ps(eps);
+  __m256 zero = _mm256_setzero_ps();
+  for (; i + 8 <= n; i += 8) {
+    __m256 vg = _mm256_loadu_ps(g + i);
+    __m256 vh = _mm256_add_ps(_mm256_loadu_ps(s0 + i), _mm256_mul_ps(vg, vg));
+    __m256 d = _mm256_div_ps(vg, _mm256_add_ps(_mm256_sqrt_ps(vh), e));
+    __m256 vw = _mm256_loadu_ps(w + i);
+    _mm256_storeu_ps(s0 + i, vh);
+    _mm256_storeu_ps(w + i, _mm256_sub_ps(vw, _mm256_mul_ps(lr, d)));
+    _mm256_storeu_ps(g + i, zero);
+  }
+#endif
+  for (; i < n; ++i) {
+    float h = s0[i] + g[i] * g[i];
+    s0[i] = h;
+    w[i] -= learning_rate * g[i] / (sqrtf(h) + eps);
+    g[i] = 0.f;
+  }
+}
+
+void RMSPropOptimizer::update_block(float *w, float *g, float *s0, float *s1, int n) {
+  int i = 0;
+#ifdef __AVX__
+  __m256 lr = _mm256_set1_ps(learning_rate);
+  __m256 r = _mm256_set1_ps(rho);
+  __m256 c = _mm256_set1_ps(1.f - rho);
+  __m256 e = _mm256_set1_ps(eps);
+  __m256 zero = _mm256_setzero_ps();
+  for (; i + 8 <= n; i += 8) {
+    __m256 vg = _mm256_loadu_ps(g + i);
+    __m256 vh = _mm256_add_ps(_mm256_mul_ps(r, _mm256_loadu_ps(s0 + i)),
+        _mm256_mul_ps(c, _mm256_mul_ps(vg, vg)));
+    __m256 d = _mm256_div_ps(vg, _mm256_add_ps(_mm256_sqrt_ps(vh), e));
+    __m256 vw = _mm256_loadu_ps(w + i);
+    _mm256_storeu_ps(s0 + i, vh);
+    _mm256_storeu_ps(w + i, _mm256_sub_ps(vw, _mm256_mul_ps(lr, d)));
+    _mm256_storeu_ps(g + i, zero);
+  }
+#endif
+  for (; i < n; ++i) {
+    float h = rho * s0[i] + (1.f - rho) * g[i] * g[i];
+    s0[i] = h;
+    w[i] -= learning_rate * g[i] / (sqrtf(h) + eps);
+    g[i] = 0.f;
+  }
+}
+
+void RMSPropOptimizer::catch_up(float *w, float *s0, float *s1, int n, int k) {
+  float decay = pow(rho, k);
+  for (int i=0; i < n; ++i) {
+    s0[i] *= decay;
+  }
 }
 
 } // namespace rnnpp
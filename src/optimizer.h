@@ -8,21 +8,203 @@
 
 namespace rnnpp {
 
+/**
+ * Base class of optimizers.
+ * update() makes a single pass over the parameters: a subclass reads the
+ * value, the gradient and its per-element state once, writes the new
+ * value and state, and zeroes the gradient in the same loop. Float
+ * parameters that are adjacent in the collection are passed to the
+ * kernel as one span, which is usually the whole model.
+ *
+ * Only the rows of a LookupParameter touched since the last update are
+ * visited. Before a row is updated, catch_up() applies the steps it
+ * missed while its gradient was zero.
+ *
+ * capacity is passed to the ParameterCollection of the model: the number
+ * of floats reserved for its values and for its gradients.
+ */
 class Optimizer {
   public:
-    Optimizer() {}
-    ~Optimizer() {}
+    Optimizer(float learning_rate,
+        size_t capacity=ParameterCollection::kDefaultCapacity)
+      : learning_rate(learning_rate), model(capacity), t_(0), states_(nullptr),
+        state_size_(0) {}
 
-    Parameter add_parameter(const std::initializer_list<int> &d);
+    virtual ~Optimizer();
 
-    LookupParameter add_lookup_parameter(const std::initializer_list<int> &d);
+    Parameter add_parameter(const std::initializer_list<int> &d,
+        DType dtype=kFloat32, const std::string &name="", Initializer *init=nullptr);
+
+    LookupParameter add_lookup_parameter(const std::initializer_list<int> &d,
+        DType dtype=kFloat32, const std::string &name="", Initializer *init=nullptr);
 
     void update();
 
+    /**
+     * Prepares the state for update(ParameterReplica&), advancing the
+     * step once. Called by one thread while no worker is updating.
+     */
+    void start_hogwild();
+
+    /**
+     * Applies the gradients of r to the values of the model and clears
+     * them, for Hogwild training. Several threads may call it at once,
+     * each with its own replica, and they read and write the shared values
+     * and states without locks: a thread may read a value another thread
+     * is about to change, and of two updates to the same element at the
+     * same time one can be lost. Floats are aligned, so a read never sees
+     * half of a write. Updates to sparse rows rarely collide, which is
+     * what makes this converge. Rows skipped by some steps get no
+     * catch_up(), and Adam's bias correction only moves at start_hogwild().
+     */
+    void update(ParameterReplica &r);
+
+    float learning_rate;
+
+    // parameters being optimized
+    ParameterCollection model;
+
+  protected:
+    /**
+     * Number of state values kept per parameter element (at most 2).
+     */
+    virtual int n_states() const = 0;
+
+    /**
+     * Called once per update() before any parameter is touched.
+     */
+    virtual void begin_update() {}
+
+    /**
+     * Updates n elements in place and sets g to zero.
+     * s0 and s1 point to the state values of the same elements.
+     */
+    virtual void update_block(float *w, float *g, float *s0, float *s1, int n) = 0;
+
+    /**
+     * Applies k consecutive updates with zero gradient to n elements.
+     */
+    virtual void catch_up(float *w, float *s0, float *s1, int n, int k) {}
+
+    void allocate_states();
+
+    // base is the offset of g in the gradient buffer, which is also the
+    // offset of its state
+    void update_span(float *w, float *g, size_t base, size_t n);
+
+    // updates params whose gradients are in the buffer starting at grads
+    void update_parameters(std::vector<Parameter> &params, float *grads);
+
+    // last_update may be nullptr to skip catch_up()
+    void update_rows(LookupParameter &p, float *grads, int *last_update);
+
+    // number of update() calls so far
+    int t_;
+
+    // n_states() arrays laid out like model.grads()
+    float *states_;
+    size_t state_size_;
+
+    // step at which each row of each lookup parameter was last updated
+    std::vector<int*> last_update_;
+};
+
+/**
+ * v = momentum * v + g
+ * w = w - learning_rate * v
+ * With momentum 0 no state is kept and this is plain SGD.
+ */
+class SGDOptimizer: public Optimizer {
+  public:
+    SGDOptimizer(float learning_rate=0.1, float momentum=0.,
+        size_t capacity=ParameterCollection::kDefaultCapacity)
+      : Optimizer(learning_rate, capacity), momentum(momentum) {}
+
+    ~SGDOptimizer() {}
+
+    float momentum;
+
   protected:
-    std::vector<Parameter*> parameters_;
+    int n_states() const { return momentum != 0. ? 1 : 0; }
+
+    void update_block(float *w, float *g, float *s0, float *s1, int n);
+
+    void catch_up(float *w, float *s0, float *s1, int n, int k);
+};
+
+/**
+ * m = beta1 * m + (1 - beta1) * g
+ * v = beta2 * v + (1 - beta2) * g^2
+ * w = w - learning_rate * sqrt(1 - beta2^t) / (1 - beta1^t) * m / (sqrt(v) + eps)
+ * Lookup rows skipped for k steps only have m and v decayed, as in lazy
+ * Adam; the weight moves on the next step the row is touched.
+ */
+class AdamOptimizer: public Optimizer {
+  public:
+    AdamOptimizer(float learning_rate=0.001, float beta1=0.9, float beta2=0.999,
+        float eps=1e-8, size_t capacity=ParameterCollection::kDefaultCapacity)
+      : Optimizer(learning_rate, capacity), beta1(beta1), beta2(beta2), eps(eps) {}
+
+    ~AdamOptimizer() {}
+
+    float beta1;
+    float beta2;
+    float eps;
+
+  protected:
+    int n_states() const { return 2; }
+
+    void begin_update();
+
+    void update_block(float *w, float *g, float *s0, float *s1, int n);
+
+    void catch_up(float *w, float *s0, float *s1, int n, int k);
+
+    // bias-corrected learning rate of the current step
+    float lr_t_;
+};
+
+/**
+ * h = h + g^2
+ * w = w - learning_rate * g / (sqrt(h) + eps)
+ */
+class AdagradOptimizer: public Optimizer {
+  public:
+    AdagradOptimizer(float learning_rate=0.1, float eps=1e-8,
+        size_t capacity=ParameterCollection::kDefaultCapacity)
+      : Optimizer(learning_rate, capacity), eps(eps) {}
+
+    ~AdagradOptimizer() {}
+
+    float eps;
+
+  protected:
+    int n_states() const { return 1; }
+
+    void update_block(float *w, float *g, float *s0, float *s1, int n);
+};
+
+/**
+ * h = rho * h + (1 - rho) * g^2
+ * w = w - learning_rate * g / (sqrt(h) + eps)
+ */
+class RMSPropOptimizer: public Optimizer {
+  public:
+    RMSPropOptimizer(float learning_rate=0.001, float rho=0.9, float eps=1e-8,
+        size_t capacity=ParameterCollection::kDefaultCapacity)
+      : Optimizer(learning_rate, capacity), rho(rho), eps(eps) {}
+
+    ~RMSPropOptimizer() {}
+
+    float rho;
+    float eps;
+
+  protected:
+    int n_states() const { return 1; }
+
+    void update_block(float *w, float *g, float *s0, float *s1, int n);
 
-    std::vector<LookupParameter*> lparameters_;
+    void catch_up(float *w, float *s0, float *s1, int n, int k);
 };
 
 } // namespace rnnpp
@@ -1,42 +1,272 @@
-#include <random>
+#include <math.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <unistd.h>
 
+#include <algorithm>
+
+#include "error.h"
 #include "parameter.h"
 #include "tensor.h"
 
 namespace rnnpp {
 
-void Initializer::init(Tensor &t) {
-  std::random_device rnd;
-  std::mt19937 mt(rnd());
-  std::normal_distribution<> norm(0.0, 1.);
-  for (int i=0; i < t.dim.size(); ++i) {
-    t.data[i] = norm(mt);
+// Values from init written as dtype into value (kFloat32) or packed.
+static void init_values(float *value, uint16_t *packed, const Dim &dim, DType dtype,
+    Initializer *init=nullptr) {
+  NormalInitializer normal;
+  Initializer &initializer = init ? *init : normal;
+  Tensor t;
+  t.dim = dim;
+  if (dtype == kFloat32) {
+    t.data = value;
+    initializer.init(t);
+  } else {
+    t.data = new float[dim.elements()];
+    initializer.init(t);
+    encode(t.data, packed, dim.elements(), dtype);
+    delete[] t.data;
+  }
+}
+
+Parameter::Parameter(const Dim &dim, DType dtype): dtype(dtype), packed(nullptr) {
+  value.dim = dim;
+  if (dtype == kFloat32) {
+    value.data = new float[dim.elements()];
+  } else {
+    value.data = nullptr;
+    packed = new uint16_t[dim.elements()];
   }
+  grad.data = new float[dim.elements()];
+  grad.dim = dim;
+}
+
+Parameter::Parameter(const Dim &dim, DType dtype, float *value, float *grad)
+  : dtype(dtype), packed(nullptr) {
+  this->value.dim = dim;
+  if (dtype == kFloat32) {
+    this->value.data = value;
+  } else {
+    this->value.data = nullptr;
+    packed = reinterpret_cast<uint16_t*>(value);
+  }
+  this->grad.data = grad;
+  this->grad.dim = dim;
+}
+
+void Parameter::read(float *dst) const {
+  if (dtype == kFloat32) {
+    decode(value.data, dst, value.dim.elements(), dtype);
+  } else {
+    decode(packed, dst, value.dim.elements(), dtype);
+  }
+}
+
+void Parameter::write(const float *src) {
+  if (dtype == kFloat32) {
+    encode(src, value.data, value.dim.elements(), dtype);
+  } else {
+    encode(src, packed, value.dim.elements(), dtype);
+  }
+}
+
+LookupParameter::LookupParameter(const Dim &dim, DType dtype)
+  : LookupParameter(dim, dtype,
+      dtype == kFloat32 ? new float[dim.elements()]
+                        : reinterpret_cast<float*>(new uint16_t[dim.elements()]),
+      new float[dim.elements()]) {
+  init_values(all_values.data, packed, dim, dtype);
+  all_grads = Scalar(0.);
 }
 
-LookupParameter::LookupParameter(const Dim &dim) {
+LookupParameter::LookupParameter(const Dim &dim, DType dtype, float *values_buf,
+    float *grads_buf)
+  : dtype(dtype), packed(nullptr) {
   all_values.dim = dim;
-  all_values.data = new float[dim.size()];
-  Initializer initializer;
-  initializer.init(all_values);
+  if (dtype == kFloat32) {
+    all_values.data = values_buf;
+  } else {
+    all_values.data = nullptr;
+    packed = reinterpret_cast<uint16_t*>(values_buf);
+  }
 
   all_grads.dim = dim;
-  all_grads.data = new float[dim.size()];
-  all_grads = Scalar(0.);
+  all_grads.data = grads_buf;
+
+  if (grads_buf == nullptr) {
+    touched = nullptr;
+    is_touched = nullptr;
+  } else {
+    touched = new std::vector<int>();
+    is_touched = new char[dim.shape[0]]();
+  }
+}
+
+void LookupParameter::read_row(int index, float *dst) const {
+  int dim_emb = all_values.dim.shape[1];
+  size_t off = (size_t)index * dim_emb;
+  if (dtype == kFloat32) {
+    decode(all_values.data + off, dst, dim_emb, dtype);
+  } else {
+    decode(packed + off, dst, dim_emb, dtype);
+  }
+}
+
+ParameterCollection::ParameterCollection(size_t capacity)
+  : capacity_(capacity), values_size_(0), grads_size_(0) {
+  size_t bytes = capacity * sizeof(float);
+  void *v = mmap(nullptr, bytes, PROT_NONE,
+      MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+  void *g = mmap(nullptr, bytes, PROT_NONE,
+      MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+  if (v == MAP_FAILED || g == MAP_FAILED) {
+    if (v != MAP_FAILED) munmap(v, bytes);
+    if (g != MAP_FAILED) munmap(g, bytes);
+    RNNPP_CHECK(false, "Failed to reserve " << bytes << " bytes for parameters");
+  }
+  values_ = static_cast<float*>(v);
+  grads_ = static_cast<float*>(g);
+}
+
+ParameterCollection::~ParameterCollection() {
+  for (int i=0; i < lookup_parameters.size(); ++i) {
+    delete lookup_parameters[i].touched;
+    delete[] lookup_parameters[i].is_touched;
+  }
+  munmap(values_, capacity_ * sizeof(float));
+  munmap(grads_, capacity_ * sizeof(float));
+}
 
-  int num_words = dim.shape[0];
-  int dim_emb = dim.shape[1];
-  values.resize(num_words);
-  grads.resize(num_words);
-  for (int i=0; i < num_words; ++i) {
-    values[i] = Tensor();
-    values[i].dim = Dim({1, dim_emb});
-    values[i].data = all_values.data + i * dim_emb;
+float *ParameterCollection::allocate(float *buf, size_t &used, size_t n) {
+  size_t m = aligned(n);
+  RNNPP_CHECK(used + m <= capacity_,
+      "ParameterCollection is full: " << used << " + " << m << " > " << capacity_);
 
-    grads[i] = Tensor();
-    grads[i].dim = Dim({1, dim_emb});
-    grads[i].data = all_grads.data + i * dim_emb;
+  // make the pages the new floats reach into accessible
+  size_t page = sysconf(_SC_PAGESIZE);
+  size_t begin = (used * sizeof(float) + page - 1) / page * page;
+  size_t end = std::min(((used + m) * sizeof(float) + page - 1) / page * page,
+      capacity_ * sizeof(float));
+  if (end > begin) {
+    char *base = reinterpret_cast<char*>(buf);
+    RNNPP_CHECK(mprotect(base + begin, end - begin, PROT_READ | PROT_WRITE) == 0,
+        "Failed to commit " << end - begin << " bytes for parameters");
   }
+
+  float *p = buf + used;
+  used += m;
+  return p;
+}
+
+// number of floats holding n values of dtype
+static size_t values_floats(size_t n, DType dtype) {
+  return dtype == kFloat32 ? n : (n * dtype_size(dtype) + 3) / 4;
+}
+
+Parameter ParameterCollection::place_parameter(const Dim &d, DType dtype,
+    const std::string &name) {
+  float *v = allocate(values_, values_size_, values_floats(d.elements(), dtype));
+  float *g = allocate(grads_, grads_size_, d.elements());
+  Parameter p(d, dtype, v, g);
+
+  parameters.push_back(p);
+  parameter_names.push_back(
+      name.empty() ? "parameter_" + std::to_string(parameters.size() - 1) : name);
+  return p;
+}
+
+LookupParameter ParameterCollection::place_lookup_parameter(const Dim &d, DType dtype,
+    const std::string &name) {
+  float *v = allocate(values_, values_size_, values_floats(d.elements(), dtype));
+  float *g = allocate(grads_, grads_size_, d.elements());
+  LookupParameter p(d, dtype, v, g);
+
+  lookup_parameters.push_back(p);
+  lookup_parameter_names.push_back(
+      name.empty() ? "lookup_parameter_" + std::to_string(lookup_parameters.size() - 1) : name);
+  return p;
+}
+
+Parameter ParameterCollection::add_parameter(const Dim &d, DType dtype,
+    const std::string &name, Initializer *init) {
+  Parameter p = place_parameter(d, dtype, name);
+  init_values(p.value.data, p.packed, d, dtype, init);
+  return p;
+}
+
+LookupParameter ParameterCollection::add_lookup_parameter(const Dim &d, DType dtype,
+    const std::string &name, Initializer *init) {
+  LookupParameter p = place_lookup_parameter(d, dtype, name);
+  init_values(p.all_values.data, p.packed, d, dtype, init);
+  return p;
+}
+
+void ParameterCollection::zero_grads() {
+  memset(grads_, 0, grads_size_ * sizeof(float));
+  for (int i=0; i < lookup_parameters.size(); ++i) {
+    LookupParameter &p = lookup_parameters[i];
+    for (int j=0; j < p.touched->size(); ++j) {
+      p.is_touched[(*p.touched)[j]] = 0;
+    }
+    p.touched->clear();
+  }
+}
+
+float ParameterCollection::grad_norm() const {
+  const size_t block = 1 << 24;
+  double s = 0.;
+  for (size_t off=0; off < grads_size_; off += block) {
+    s += sum_squares(grads_ + off, std::min(block, grads_size_ - off));
+  }
+  return sqrt(s);
 }
 
+ParameterReplica::ParameterReplica(const ParameterCollection &model)
+  : grads_size_(model.grads_size()) {
+  size_t bytes = std::max(grads_size_, (size_t)1) * sizeof(float);
+  void *g = mmap(nullptr, bytes, PROT_READ | PROT_WRITE,
+      MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+  RNNPP_CHECK(g != MAP_FAILED, "Failed to reserve " << bytes << " bytes for gradients");
+  grads_ = static_cast<float*>(g);
+
+  for (int i=0; i < model.parameters.size(); ++i) {
+    Parameter p = model.parameters[i];
+    p.grad.data = grads_ + (p.grad.data - model.grads());
+    parameters.push_back(p);
+  }
+  for (int i=0; i < model.lookup_parameters.size(); ++i) {
+    const LookupParameter &p = model.lookup_parameters[i];
+    float *v = p.dtype == kFloat32 ? p.all_values.data : reinterpret_cast<float*>(p.packed);
+    lookup_parameters.push_back(LookupParameter(p.all_values.dim, p.dtype, v,
+          grads_ + (p.all_grads.data - model.grads())));
+  }
 }
+
+ParameterReplica::~ParameterReplica() {
+  for (int i=0; i < lookup_parameters.size(); ++i) {
+    delete lookup_parameters[i].touched;
+    delete[] lookup_parameters[i].is_touched;
+  }
+  munmap(grads_, std::max(grads_size_, (size_t)1) * sizeof(float));
+}
+
+void ParameterReplica::zero_grads() {
+  for (int i=0; i < parameters.size(); ++i) {
+    Parameter &p = parameters[i];
+    memset(p.grad.data, 0, p.grad.dim.elements() * sizeof(float));
+  }
+  // only touched rows can be nonzero, and clearing just those keeps the
+  // rest of the buffer unbacked
+  for (int i=0; i < lookup_parameters.size(); ++i) {
+    LookupParameter &p = lookup_parameters[i];
+    int dim_emb = p.all_values.dim.shape[1];
+    for (int j=0; j < p.touched->size(); ++j) {
+      int r = (*p.touched)[j];
+      memset(p.all_grads.data + (size_t)r * dim_emb, 0, dim_emb * sizeof(float));
+      p.is_touched[r] = 0;
+    }
+    p.touched->clear();
+  }
+}
+
+} // namespace rnnpp
@@ -1,49 +1,227 @@
 #ifndef RNNPP_PARAMETER_H_
 #define RNNPP_PARAMETER_H_
 
+#include <stddef.h>
+
+#include <string>
+#include <vector>
+
 #include "dim.h"
+#include "dtype.h"
+#include "initializer.h"
 #include "tensor.h"
 
 namespace rnnpp {
 
-class Initializer {
-  public:
-    Initializer() {}
-    ~Initializer() {}
-
-    void init(Tensor &t);
-};
-
+/**
+ * A dense parameter.
+ * With dtype kFloat32 the value lives in value.data. With kFloat16 or
+ * kBFloat16 value.data is nullptr and the value is kept in packed, which
+ * read() and write() convert from and to float. Gradients are always float.
+ */
 class Parameter {
   public:
-    Parameter() {}
+    Parameter(): dtype(kFloat32), packed(nullptr) {}
 
-    Parameter(const Dim &dim) {
-      value.data = new float[dim.size()];
-      value.dim = dim;
-      grad.data = new float[dim.size()];
-      grad.dim = dim;
-    }
+    Parameter(const Dim &dim, DType dtype=kFloat32);
+
+    /**
+     * A view of storage owned by someone else. For half types value
+     * points to the packed values.
+     */
+    Parameter(const Dim &dim, DType dtype, float *value, float *grad);
 
     ~Parameter() {}
 
+    void read(float *dst) const;
+
+    void write(const float *src);
+
     Tensor value;
     Tensor grad;
+
+    DType dtype;
+    uint16_t *packed;
 };
 
+/**
+ * A table of embeddings.
+ * Rows that receive a gradient are recorded with touch() so that the
+ * optimizer updates and clears only those rows.
+ */
 class LookupParameter {
   public:
-    LookupParameter() {}
+    LookupParameter()
+      : dtype(kFloat32), packed(nullptr), touched(nullptr), is_touched(nullptr) {}
+
+    LookupParameter(const Dim &dim, DType dtype=kFloat32);
 
-    LookupParameter(const Dim &dim);
+    /**
+     * A view of storage owned by someone else. With grads nullptr the
+     * table is frozen: it has no gradient and is never updated.
+     */
+    LookupParameter(const Dim &dim, DType dtype, float *values, float *grads);
 
     ~LookupParameter() {}
 
+    /**
+     * Writes row `index` as float into dst.
+     */
+    void read_row(int index, float *dst) const;
+
+    bool frozen() const { return all_grads.data == nullptr; }
+
+    /**
+     * Records that row `index` has a gradient to be applied.
+     */
+    void touch(int index) {
+      if (!is_touched[index]) {
+        is_touched[index] = 1;
+        touched->push_back(index);
+      }
+    }
+
+    /**
+     * Views of row `index`. value() has no data unless dtype is kFloat32.
+     */
+    Tensor value(int index) const {
+      return row(all_values.data, index);
+    }
+
+    Tensor grad(int index) const {
+      return row(all_grads.data, index);
+    }
+
     Tensor all_values;
     Tensor all_grads;
 
-    std::vector<Tensor> values;
-    std::vector<Tensor> grads;
+    DType dtype;
+    uint16_t *packed;
+
+    // rows touched since the last update, shared by copies
+    std::vector<int> *touched;
+    char *is_touched;
+
+  private:
+    Tensor row(float *data, int index) const {
+      int dim_emb = all_values.dim.shape[1];
+      Tensor t;
+      t.dim = Dim({1, dim_emb});
+      t.data = data ? data + (size_t)index * dim_emb : nullptr;
+      return t;
+    }
+};
+
+/**
+ * Owns the storage of a model. All values are placed in one contiguous
+ * buffer and all gradients in another, and the parameters it returns are
+ * views of them. Each parameter starts at a multiple of kAlign floats and
+ * the padding between parameters stays zero.
+ *
+ * capacity floats of address space are reserved for each buffer up front,
+ * inaccessible, and pages are made accessible as parameters are added, so
+ * the buffers never move and views stay valid. Only accessible pages count
+ * against the commit limit, and only the pages written are backed by
+ * memory. The default, kDefaultCapacity floats (1 GiB) per buffer, can be
+ * raised for larger models, also through the constructor of an Optimizer.
+ */
+class ParameterCollection {
+  public:
+    static const size_t kDefaultCapacity = 1ULL << 28;
+
+    ParameterCollection(size_t capacity=kDefaultCapacity);
+
+    ~ParameterCollection();
+
+    /**
+     * Adds a parameter initialized by init, or from N(0, 1) if init is
+     * nullptr. An empty name is replaced by "parameter_<i>" (or
+     * "lookup_parameter_<i>").
+     */
+    Parameter add_parameter(const Dim &d, DType dtype=kFloat32,
+        const std::string &name="", Initializer *init=nullptr);
+
+    LookupParameter add_lookup_parameter(const Dim &d, DType dtype=kFloat32,
+        const std::string &name="", Initializer *init=nullptr);
+
+    float *values() const { return values_; }
+
+    float *grads() const { return grads_; }
+
+    // floats in use, including padding
+    size_t values_size() const { return values_size_; }
+
+    size_t grads_size() const { return grads_size_; }
+
+    // floats reserved for each buffer
+    size_t capacity() const { return capacity_; }
+
+    void zero_grads();
+
+    // L2 norm of all gradients
+    float grad_norm() const;
+
+    static const int kAlign = 16;
+
+    static size_t aligned(size_t n) { return (n + kAlign - 1) / kAlign * kAlign; }
+
+    std::vector<Parameter> parameters;
+    std::vector<LookupParameter> lookup_parameters;
+
+    std::vector<std::string> parameter_names;
+    std::vector<std::string> lookup_parameter_names;
+
+  private:
+    ParameterCollection(const ParameterCollection&);
+    ParameterCollection &operator=(const ParameterCollection&);
+
+    friend void load_checkpoint(const std::string &path, ParameterCollection &model);
+
+    float *allocate(float *buf, size_t &used, size_t n);
+
+    // views of newly allocated storage, left uninitialized
+    Parameter place_parameter(const Dim &d, DType dtype, const std::string &name);
+
+    LookupParameter place_lookup_parameter(const Dim &d, DType dtype,
+        const std::string &name);
+
+    size_t capacity_;
+    float *values_;
+    float *grads_;
+    size_t values_size_;
+    size_t grads_size_;
+};
+
+/**
+ * Gradients of a ParameterCollection kept apart from it, for one worker
+ * thread. The parameters share the values of the collection but their
+ * gradients and touched rows are private, in a buffer laid out like the
+ * gradients of the collection. Like that buffer it is reserved without
+ * being backed, so only the rows a worker touches use memory.
+ * Parameters added to the collection afterwards are not in the replica.
+ */
+class ParameterReplica {
+  public:
+    ParameterReplica(const ParameterCollection &model);
+
+    ~ParameterReplica();
+
+    float *grads() const { return grads_; }
+
+    size_t grads_size() const { return grads_size_; }
+
+    void zero_grads();
+
+    // views in the order of model.parameters and model.lookup_parameters
+    std::vector<Parameter> parameters;
+    std::vector<LookupParameter> lookup_parameters;
+
+  private:
+    ParameterReplica(const ParameterReplica&);
+    ParameterReplica &operator=(const ParameterReplica&);
+
+    float *grads_;
+    size_t grads_size_;
 };
 
 } // namespace rnnpp
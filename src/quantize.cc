@@ -0,0 +1,167 @@
+#include <math.h>
+
+#include <algorithm>
+#include <vector>
+
+#if defined(__AVX512VNNI__) && defined(__AVX512BW__)
+#include <immintrin.h>
+#endif
+
+#include "error.h"
+#include "quantize.h"
+
+namespace rnnpp {
+
+QuantizedTensor::QuantizedTensor(const Dim &d): dim(d) {
+  data = new int8_t[dim.size()];
+  scales = new float[rows()];
+  row_sums = new int32_t[rows()];
+}
+
+void quantize_rows(const float *src, int rows, int cols, QuantizedTensor &dst) {
+  for (int r=0; r < rows; ++r) {
+    const float *x = src + r * cols;
+    float amax = 0.f;
+    for (int c=0; c < cols; ++c) {
+      amax = std::max(amax, fabsf(x[c]));
+    }
+    float scale = amax > 0.f ? amax / 127.f : 1.f;
+    float inv = 1.f / scale;
+
+    int8_t *q = dst.data + r * cols;
+    int32_t s = 0;
+    for (int c=0; c < cols; ++c) {
+      int v = (int)lrintf(x[c] * inv);
+      v = std::max(-127, std::min(127, v));
+      q[c] = v;
+      s += v;
+    }
+    dst.scales[r] = scale;
+    dst.row_sums[r] = s;
+  }
+}
+
+void dequantize_row(const QuantizedTensor &src, int row, float *dst) {
+  int cols = src.cols();
+  const int8_t *q = src.data + row * cols;
+  float scale = src.scales[row];
+  for (int c=0; c < cols; ++c) {
+    dst[c] = q[c] * scale;
+  }
+}
+
+QuantizedParameter quantize(const Parameter &p) {
+  const Dim &d = p.value.dim;
+  RNNPP_CHECK(d.shape.size() == 2, "Only matrices can be quantized: " << d);
+
+  std::vector<float> v(d.size());
+  p.read(v.data());
+
+  QuantizedParameter q;
+  q.value = QuantizedTensor(d);
+  quantize_rows(v.data(), d[0], d[1], q.value);
+  return q;
+}
+
+QuantizedLookupParameter quantize(const LookupParameter &lp) {
+  const Dim &d = lp.all_values.dim;
+  int num_words = d[0];
+  int dim_emb = d[1];
+
+  QuantizedLookupParameter q;
+  q.all_values = QuantizedTensor(d);
+
+  QuantizedTensor row;
+  std::vector<float> v(dim_emb);
+  for (int i=0; i < num_words; ++i) {
+    lp.read_row(i, v.data());
+    row.dim = Dim({1, dim_emb});
+    row.data = q.all_values.data + i * dim_emb;
+    row.scales = q.all_values.scales + i;
+    row.row_sums = q.all_values.row_sums + i;
+    quantize_rows(v.data(), 1, dim_emb, row);
+  }
+  return q;
+}
+
+int32_t dot_u8s8(const uint8_t *a, const int8_t *b, int n) {
+  int k = 0;
+  int32_t acc = 0;
+#if defined(__AVX512VNNI__) && defined(__AVX512BW__)
+  __m512i vacc = _mm512_setzero_si512();
+  for (; k + 64 <= n; k += 64) {
+    __m512i va = _mm512_loadu_si512(a + k);
+    __m512i vb = _mm512_loadu_si512(b + k);
+    vacc = _mm512_dpbusd_epi32(vacc, va, vb);
+  }
+  if (k < n) {
+    __mmask64 m = ~0ULL >> (64 - (n - k));
+    __m512i va = _mm512_maskz_loadu_epi8(m, a + k);
+    __m512i vb = _mm512_maskz_loadu_epi8(m, b + k);
+    vacc = _mm512_dpbusd_epi32(vacc, va, vb);
+    k = n;
+  }
+  acc = _mm512_reduce_add_epi32(vacc);
+#endif
+  for (; k < n; ++k) {
+    acc += (int32_t)a[k] * (int32_t)b[k];
+  }
+  return acc;
+}
+
+static inline float activate(float v, Activation act) {
+  switch (act) {
+    case kTanh: return tanhf(v);
+    case kSigmoid: return 1.f / (1.f + expf(-v));
+    default: return v;
+  }
+}
+
+void matmul_int8(const QuantizedTensor &w, const Tensor &x, const Tensor *bias,
+    Activation act, Tensor &dest) {
+  int M = w.rows();
+  int K = w.cols();
+  int N = x.dim[1];
+
+  RNNPP_CHECK(x.dim[0] == K, "Invalid dimension in matmul_int8");
+  RNNPP_CHECK(dest.dim[0] == M, "Invalid dimension in matmul_int8");
+  RNNPP_CHECK(dest.dim[1] == N, "Invalid dimension in matmul_int8");
+  RNNPP_CHECK(bias == nullptr || bias->dim.size() == M, "Invalid bias in matmul_int8");
+
+  // Columns of x are quantized to int8 and stored shifted by 128 as uint8
+  // so that the u8 x s8 dot product applies; the shift is removed with
+  // 128 * row_sums of w.
+  std::vector<uint8_t> xq(K * N);
+  std::vector<float> xs(N);
+
+  for (int b=0; b < x.batch_size(); ++b) {
+    const float *xd = x.data + b * x.dim.size();
+    for (int n=0; n < N; ++n) {
+      float amax = 0.f;
+      for (int k=0; k < K; ++k) {
+        amax = std::max(amax, fabsf(xd[k * x.dim.stride[0] + n * x.dim.stride[1]]));
+      }
+      float scale = amax > 0.f ? amax / 127.f : 1.f;
+      float inv = 1.f / scale;
+      uint8_t *q = xq.data() + n * K;
+      for (int k=0; k < K; ++k) {
+        int v = (int)lrintf(xd[k * x.dim.stride[0] + n * x.dim.stride[1]] * inv);
+        q[k] = std::max(-127, std::min(127, v)) + 128;
+      }
+      xs[n] = scale;
+    }
+
+    float *dd = dest.data + b * dest.dim.size();
+    for (int m=0; m < M; ++m) {
+      const int8_t *wr = w.data + m * K;
+      float bm = bias ? bias->data[m] : 0.f;
+      for (int n=0; n < N; ++n) {
+        int32_t acc = dot_u8s8(xq.data() + n * K, wr, K) - 128 * w.row_sums[m];
+        float v = acc * w.scales[m] * xs[n] + bm;
+        dd[m * dest.dim.stride[0] + n * dest.dim.stride[1]] = activate(v, act);
+      }
+    }
+  }
+}
+
+} // namespace rnnpp
@@ -0,0 +1,82 @@
+#ifndef RNNPP_QUANTIZE_H_
+#define RNNPP_QUANTIZE_H_
+
+#include <stdint.h>
+
+#include "dim.h"
+#include "parameter.h"
+#include "tensor.h"
+
+namespace rnnpp {
+
+enum Activation {
+  kLinear,
+  kTanh,
+  kSigmoid,
+};
+
+/**
+ * Symmetric int8 quantization of a matrix with one scale per row:
+ * x_{r, c} ~= data_{r, c} * scales_r
+ * row_sums_r = sum_c data_{r, c}
+ */
+class QuantizedTensor {
+  public:
+    QuantizedTensor(): data(nullptr), scales(nullptr), row_sums(nullptr) {}
+
+    QuantizedTensor(const Dim &d);
+
+    ~QuantizedTensor() {}
+
+    int rows() const { return dim[0]; }
+
+    int cols() const { return dim.size() / dim[0]; }
+
+    Dim dim;
+    int8_t *data;
+    float *scales;
+    int32_t *row_sums;
+};
+
+class QuantizedParameter {
+  public:
+    QuantizedParameter() {}
+
+    ~QuantizedParameter() {}
+
+    QuantizedTensor value;
+};
+
+class QuantizedLookupParameter {
+  public:
+    QuantizedLookupParameter() {}
+
+    ~QuantizedLookupParameter() {}
+
+    QuantizedTensor all_values;
+};
+
+// Post-training quantization of a trained parameter.
+QuantizedParameter quantize(const Parameter &p);
+
+QuantizedLookupParameter quantize(const LookupParameter &lp);
+
+void quantize_rows(const float *src, int rows, int cols, QuantizedTensor &dst);
+
+void dequantize_row(const QuantizedTensor &src, int row, float *dst);
+
+// sum_k a_k * b_k with a unsigned and b signed
+int32_t dot_u8s8(const uint8_t *a, const int8_t *b, int n);
+
+/**
+ * dest = act(w * x + bias)  (M, N) = (M, K) x (K, N)
+ * x is quantized on the fly with one scale per column and the
+ * product is accumulated in int32. Dequantization, bias and activation are
+ * applied while each output is written. bias is (M, 1) and may be nullptr.
+ */
+void matmul_int8(const QuantizedTensor &w, const Tensor &x, const Tensor *bias,
+    Activation act, Tensor &dest);
+
+} // namespace rnnpp
+
+#endif // RNNPP_QUANTIZE_H_
@@ -0,0 +1,141 @@
+#include <algorithm>
+
+#include "error.h"
+#include "initializer.h"
+#include "rnn.h"
+#include "rnnpp.h"
+
+namespace rnnpp {
+
+PackedSequences pack_sequences(const std::vector<std::vector<float>> &seqs, int dim) {
+  PackedSequences p;
+  p.dim = dim;
+  int n = seqs.size();
+  RNNPP_CHECK(n > 0, "No sequences to pack");
+  std::vector<int> lengths(n);
+  for (int i=0; i < n; ++i) {
+    RNNPP_CHECK(seqs[i].size() % dim == 0 && !seqs[i].empty(),
+        "Sequence " << i << " of " << seqs[i].size() << " values has no steps of " << dim);
+    lengths[i] = seqs[i].size() / dim;
+  }
+  p.order.resize(n);
+  for (int i=0; i < n; ++i) {
+    p.order[i] = i;
+  }
+  std::stable_sort(p.order.begin(), p.order.end(),
+      [&lengths](int a, int b) { return lengths[a] > lengths[b]; });
+
+  int T = lengths[p.order[0]];
+  p.batch_sizes.assign(T, 0);
+  for (int i=0; i < n; ++i) {
+    for (int t=0; t < lengths[i]; ++t) {
+      ++p.batch_sizes[t];
+    }
+  }
+  p.offsets.assign(T + 1, 0);
+  for (int t=0; t < T; ++t) {
+    p.offsets[t + 1] = p.offsets[t] + p.batch_sizes[t];
+  }
+  p.data.resize((size_t)p.n_tokens() * dim);
+  for (int t=0; t < T; ++t) {
+    for (int b=0; b < p.batch_sizes[t]; ++b) {
+      const float *src = &seqs[p.order[b]][(size_t)t * dim];
+      std::copy(src, src + dim, &p.data[((size_t)p.offsets[t] + b) * dim]);
+    }
+  }
+  return p;
+}
+
+LSTMBuilder::LSTMBuilder(ParameterCollection &model, int input_dim, int hidden_dim)
+  : input_dim(input_dim), hidden_dim(hidden_dim) {
+  int H = hidden_dim;
+  GlorotInitializer glorot;
+  UniformInitializer zero(0., 0.);
+  w = model.add_parameter(Dim({4 * H, input_dim + H}), kFloat32, "", &glorot);
+  b = model.add_parameter(Dim({4 * H, 1}), kFloat32, "", &zero);
+  for (int k=H; k < 2 * H; ++k) {
+    b.value.data[k] = 1.;
+  }
+}
+
+void LSTMBuilder::start_new_sequence(Graph &g, int batch_size) {
+  zeros_.assign((size_t)2 * hidden_dim * batch_size, 0.f);
+  start_new_sequence(g, input(g, Dim({2 * hidden_dim, 1}, batch_size), zeros_));
+}
+
+void LSTMBuilder::start_new_sequence(Graph &g, const Expression &state) {
+  RNNPP_CHECK(state.g_ == &g, "The state belongs to another graph");
+  w_ = parameter(g, w);
+  b_ = parameter(g, b);
+  state_ = state;
+}
+
+Expression LSTMBuilder::add_input(const Expression &x) {
+  state_ = lstm_cell(x, state_, w_, b_);
+  return slice_rows(state_, 0, hidden_dim);
+}
+
+GRUBuilder::GRUBuilder(ParameterCollection &model, int input_dim, int hidden_dim)
+  : input_dim(input_dim), hidden_dim(hidden_dim) {
+  int H = hidden_dim;
+  GlorotInitializer glorot;
+  UniformInitializer zero(0., 0.);
+  wx = model.add_parameter(Dim({3 * H, input_dim}), kFloat32, "", &glorot);
+  wh = model.add_parameter(Dim({3 * H, H}), kFloat32, "", &glorot);
+  bx = model.add_parameter(Dim({3 * H, 1}), kFloat32, "", &zero);
+  bh = model.add_parameter(Dim({3 * H, 1}), kFloat32, "", &zero);
+}
+
+void GRUBuilder::start_new_sequence(Graph &g, int batch_size) {
+  zeros_.assign((size_t)hidden_dim * batch_size, 0.f);
+  start_new_sequence(g, input(g, Dim({hidden_dim, 1}, batch_size), zeros_));
+}
+
+void GRUBuilder::start_new_sequence(Graph &g, const Expression &state) {
+  RNNPP_CHECK(state.g_ == &g, "The state belongs to another graph");
+  wx_ = parameter(g, wx);
+  wh_ = parameter(g, wh);
+  bx_ = parameter(g, bx);
+  bh_ = parameter(g, bh);
+  state_ = state;
+}
+
+Expression GRUBuilder::add_input(const Expression &x) {
+  state_ = gru_cell(x, state_, wx_, wh_, bx_, bh_);
+  return state_;
+}
+
+Expression GRUBuilder::transduce(const Expression &xs) {
+  return gru_sequence(xs, state_, wx_, wh_, bx_, bh_);
+}
+
+Expression GRUBuilder::transduce(const Expression &xs, const std::vector<int> &batch_sizes) {
+  RNNPP_CHECK(!batch_sizes.empty(), "No batch sizes for packed sequences");
+  return gru_sequence(xs, state_, wx_, wh_, bx_, bh_, batch_sizes);
+}
+
+StackedGRUBuilder::StackedGRUBuilder(ParameterCollection &model, int n_layers,
+    int input_dim, int hidden_dim, bool bidirectional, int num_threads)
+  : n_layers(n_layers), bidirectional(bidirectional), num_threads(num_threads) {
+  RNNPP_CHECK(n_layers > 0, "Invalid number of layers: " << n_layers);
+  int n_dirs = bidirectional ? 2 : 1;
+  for (int l=0; l < n_layers; ++l) {
+    for (int d=0; d < n_dirs; ++d) {
+      cells.push_back(GRUBuilder(model, l == 0 ? input_dim : n_dirs * hidden_dim, hidden_dim));
+    }
+  }
+}
+
+Expression StackedGRUBuilder::transduce(const Expression &xs) {
+  Graph &g = *xs.g_;
+  std::vector<Expression> weights;
+  for (auto &c : cells) {
+    weights.push_back(parameter(g, c.wx));
+    weights.push_back(parameter(g, c.wh));
+    weights.push_back(parameter(g, c.bx));
+    weights.push_back(parameter(g, c.bh));
+  }
+  return gru_stack(xs, weights, n_layers, bidirectional, num_threads);
+}
+
+} // namespace rnnpp
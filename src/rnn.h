@@ -0,0 +1,163 @@
+#ifndef RNNPP_RNN_H_
+#define RNNPP_RNN_H_
+
+#include <vector>
+
+#include "expr.h"
+#include "graph.h"
+#include "parameter.h"
+
+namespace rnnpp {
+
+/**
+ * Sequences of different lengths packed for GRUSequence: the tokens of
+ * all sequences in time major order, longest sequence first, with no
+ * padding. Row offsets[t] + b is step t of the b-th longest sequence,
+ * which is sequence order[b] of the input, and batch_sizes[t] sequences
+ * have a step t.
+ */
+struct PackedSequences {
+  int dim;
+  std::vector<float> data;
+  std::vector<int> batch_sizes;
+  std::vector<int> offsets;
+  std::vector<int> order;
+
+  int n_tokens() const { return offsets.back(); }
+};
+
+/**
+ * Packs sequences of dim-sized steps; seqs[i] has length * dim values.
+ * Sequences of the same length keep their order.
+ */
+PackedSequences pack_sequences(const std::vector<std::vector<float>> &seqs, int dim);
+
+/**
+ * A single layer LSTM made of fused LSTMCell nodes, two nodes per step.
+ * The weights of the four gates are stacked in one (4H, D + H) matrix,
+ * initialized Glorot uniform, and the forget gate bias starts at 1.
+ *
+ *   LSTMBuilder lstm(model, D, H);
+ *   lstm.start_new_sequence(g, batch_size);
+ *   for (...) h = lstm.add_input(x);
+ *
+ * The initial zero state is owned by the builder, which must outlive the
+ * forward and backward passes of the graph.
+ */
+class LSTMBuilder {
+  public:
+    LSTMBuilder(ParameterCollection &model, int input_dim, int hidden_dim);
+
+    /**
+     * Starts a sequence on g from the zero state, or from the state
+     * [h; c] (2H, 1) of another expression.
+     */
+    void start_new_sequence(Graph &g, int batch_size=1);
+    void start_new_sequence(Graph &g, const Expression &state);
+
+    /**
+     * Runs one step and returns h (H, 1).
+     */
+    Expression add_input(const Expression &x);
+
+    // the current state [h; c]
+    Expression state() const { return state_; }
+
+    int input_dim;
+    int hidden_dim;
+
+    Parameter w;
+    Parameter b;
+
+  private:
+    Expression w_;
+    Expression b_;
+    Expression state_;
+    std::vector<float> zeros_;
+};
+/**
+ * A single layer GRU made of fused GRUCell nodes, one node per step.
+ * The input and recurrent weights of the reset, update and candidate gates
+ * are stacked in W_x (3H, D) and W_h (3H, H), initialized Glorot uniform,
+ * with zero biases b_x and b_h. The recurrent bias of the candidate is
+ * scaled by the reset gate, as in cuDNN.
+ */
+class GRUBuilder {
+  public:
+    GRUBuilder(ParameterCollection &model, int input_dim, int hidden_dim);
+
+    /**
+     * Starts a sequence on g from the zero state, or from the state h
+     * (H, 1) of another expression.
+     */
+    void start_new_sequence(Graph &g, int batch_size=1);
+    void start_new_sequence(Graph &g, const Expression &state);
+
+    /**
+     * Runs one step and returns h (H, 1).
+     */
+    Expression add_input(const Expression &x);
+
+    /**
+     * Runs a whole sequence xs (T, B, D) from the current state with one
+     * GRUSequence node and returns the states of all steps (T, B, H).
+     * The current state is not advanced.
+     */
+    Expression transduce(const Expression &xs);
+
+    /**
+     * Runs packed sequences: xs is (D, 1) with a batch of all tokens, as
+     * in PackedSequences, and so is the result (H, 1). The current state
+     * is for the sequences sorted longest first, or shared by all.
+     */
+    Expression transduce(const Expression &xs, const std::vector<int> &batch_sizes);
+
+    Expression state() const { return state_; }
+
+    int input_dim;
+    int hidden_dim;
+
+    Parameter wx;
+    Parameter wh;
+    Parameter bx;
+    Parameter bh;
+
+  private:
+    Expression wx_;
+    Expression wh_;
+    Expression bx_;
+    Expression bh_;
+    Expression state_;
+    std::vector<float> zeros_;
+};
+
+/**
+ * n_layers GRU layers, forward only or bidirectional, run over a whole
+ * sequence by one GRUStack node. Layer l and direction d are cells[l *
+ * n_dirs + d]; the input of every layer but the first is the
+ * concatenation of the states of both directions below.
+ *
+ *   StackedGRUBuilder rnn(model, 4, D, H, true);
+ *   Expression ys = rnn.transduce(xs);   // (T, B, D) -> (T, B, 2H)
+ *
+ * The steps are scheduled as a wavefront on num_threads threads (0 for
+ * all hardware threads), for forward and backward.
+ */
+class StackedGRUBuilder {
+  public:
+    StackedGRUBuilder(ParameterCollection &model, int n_layers, int input_dim,
+        int hidden_dim, bool bidirectional=false, int num_threads=0);
+
+    Expression transduce(const Expression &xs);
+
+    int n_layers;
+    bool bidirectional;
+    int num_threads;
+
+    std::vector<GRUBuilder> cells;
+};
+
+
+} // namespace rnnpp
+
+#endif // RNNPP_RNN_H_
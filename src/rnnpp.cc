@@ -24,6 +24,14 @@ Expression input(Graph &g, const Dim &dim, std::vector<float> &value) {
   return e;
 }
 
+Expression input(Graph &g, const Tensor &value) {
+  int i = g.nodes().size();
+  Node* node = new TensorInputNode(value, {i});
+  g.add_node(node);
+  Expression e(&g, i);
+  return e;
+}
+
 Expression parameter(Graph &g, const Parameter &p) {
   int i = g.nodes().size();
   Node* node = new ParameterNode(p, {i});
@@ -42,6 +50,50 @@ Expression lookup(Graph &g, const LookupParameter &p, int index) {
   return e;
 }
 
+Expression lookup(Graph &g, const LookupParameter &p, const std::vector<int> &indices) {
+  int i = g.nodes().size();
+  Node* node = new BatchedLookupNode(p, indices, {i});
+  g.add_node(node);
+  g.add_parameter_node(i);
+  Expression e(&g, i);
+  return e;
+}
+
+Expression embedding_bag(Graph &g, const LookupParameter &p,
+    const std::vector<int> &indices, const std::vector<int> &offsets, BagMode mode) {
+  int i = g.nodes().size();
+  Node* node = new EmbeddingBagNode(p, indices, offsets, mode, {i});
+  g.add_node(node);
+  g.add_parameter_node(i);
+  Expression e(&g, i);
+  return e;
+}
+
+Expression lookup(Graph &g, const QuantizedLookupParameter &p, int index) {
+  int i = g.nodes().size();
+  Node* node = new QuantizedLookupNode(p, index, {i});
+  g.add_node(node);
+  Expression e(&g, i);
+  return e;
+}
+
+Expression operator*(const QuantizedParameter &w, const Expression &x) {
+  int i = x.g_->nodes().size();
+  Node* node = new QuantizedMult({x.id()}, {i}, w, kLinear);
+  x.g_->add_node(node);
+  Expression e(x.g_, i);
+  return e;
+}
+
+Expression affine(const QuantizedParameter &w, const Expression &x,
+    const Expression &b, Activation act) {
+  int i = x.g_->nodes().size();
+  Node* node = new QuantizedMult({x.id(), b.id()}, {i}, w, act);
+  x.g_->add_node(node);
+  Expression e(x.g_, i);
+  return e;
+}
+
 
 Expression squared_distance(const Expression &a, const Expression &b) {
   int i = a.g_->nodes().size();
@@ -51,6 +103,30 @@ Expression squared_distance(const Expression &a, const Expression &b) {
   return e;
 }
 
+Expression pickneglogsoftmax(const Expression &x, int target) {
+  return pickneglogsoftmax(x, std::vector<int>(1, target));
+}
+
+Expression pickneglogsoftmax(const Expression &x, const std::vector<int> &targets) {
+  int i = x.g_->nodes().size();
+  Node* node = new PickNegLogSoftmax({x.id()}, {i}, targets);
+  x.g_->add_node(node);
+  Expression e(x.g_, i);
+  return e;
+}
+
+Expression candidate_softmax_loss(const Expression &h, const Expression &w,
+    const Expression &bias, const std::vector<int> &begin, const std::vector<int> &end,
+    const std::vector<int> &target, const std::vector<float> &shift,
+    const std::vector<int> &ids) {
+  int i = h.g_->nodes().size();
+  Node* node = new CandidateSoftmaxLoss({h.id(), w.id(), bias.id()}, {i}, begin, end,
+      target, shift, ids);
+  h.g_->add_node(node);
+  Expression e(h.g_, i);
+  return e;
+}
+
 Expression sum(const Expression &x, int axis) {
   int i = x.g_->nodes().size();
   Node* node = new Sum({x.id()}, {i}, axis);
@@ -76,5 +152,73 @@ Expression sigmoid(const Expression &x) {
   return e;
 }
 
+Expression slice_rows(const Expression &x, int begin, int end) {
+  int i = x.g_->nodes().size();
+  Node* node = new SliceRows({x.id()}, {i}, begin, end);
+  x.g_->add_node(node);
+  Expression e(x.g_, i);
+  return e;
+}
+
+Expression lstm_cell(const Expression &x, const Expression &state,
+    const Expression &w, const Expression &b) {
+  int i = x.g_->nodes().size();
+  Node* node = new LSTMCell({x.id(), state.id(), w.id(), b.id()}, {i});
+  x.g_->add_node(node);
+  Expression e(x.g_, i);
+  return e;
+}
+
+Expression gru_cell(const Expression &x, const Expression &h, const Expression &wx,
+    const Expression &wh, const Expression &bx, const Expression &bh) {
+  int i = x.g_->nodes().size();
+  Node* node = new GRUCell({x.id(), h.id(), wx.id(), wh.id(), bx.id(), bh.id()}, {i});
+  x.g_->add_node(node);
+  Expression e(x.g_, i);
+  return e;
+}
+
+Expression gru_sequence(const Expression &xs, const Expression &h0, const Expression &wx,
+    const Expression &wh, const Expression &bx, const Expression &bh,
+    const std::vector<int> &batch_sizes) {
+  int i = xs.g_->nodes().size();
+  Node* node = new GRUSequence({xs.id(), h0.id(), wx.id(), wh.id(), bx.id(), bh.id()}, {i},
+      batch_sizes);
+  xs.g_->add_node(node);
+  Expression e(xs.g_, i);
+  return e;
+}
+
+Expression gru_stack(const Expression &xs, const std::vector<Expression> &weights,
+    int n_layers, bool bidirectional, int num_threads) {
+  std::vector<int> ids(1, xs.id());
+  for (auto &w : weights) {
+    ids.push_back(w.id());
+  }
+  int i = xs.g_->nodes().size();
+  Node* node = new GRUStack(ids, {i}, n_layers, bidirectional, num_threads);
+  xs.g_->add_node(node);
+  Expression e(xs.g_, i);
+  return e;
+}
+
+Expression attention(const Expression &enc, const Expression &q,
+    const std::vector<int> &lengths) {
+  int i = enc.g_->nodes().size();
+  Node* node = new Attention({enc.id(), q.id()}, {i}, lengths);
+  enc.g_->add_node(node);
+  Expression e(enc.g_, i);
+  return e;
+}
+
+Expression attention(const Expression &enc, const Expression &q, const Expression &w,
+    const std::vector<int> &lengths) {
+  int i = enc.g_->nodes().size();
+  Node* node = new Attention({enc.id(), q.id(), w.id()}, {i}, lengths);
+  enc.g_->add_node(node);
+  Expression e(enc.g_, i);
+  return e;
+}
+
 
 } // namespace rnnpp
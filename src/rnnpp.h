@@ -4,6 +4,7 @@
 #include "dim.h"
 #include "expr.h"
 #include "graph.h"
+#include "quantize.h"
 
 namespace rnnpp {
 
@@ -11,18 +12,79 @@ Expression input(Graph &g, std::vector<float> &value);
 
 Expression input(Graph &g, const Dim &dim, std::vector<float> &value);
 
+// value without a copy and detached: it gets no gradient. Its data must
+// outlive the forward and backward passes of g.
+Expression input(Graph &g, const Tensor &value);
+
 Expression parameter(Graph &g, const Parameter &p);
 
 Expression lookup(Graph &g, const LookupParameter &lp, int index);
 
+// one node for all indices, batched along the indices
+Expression lookup(Graph &g, const LookupParameter &lp, const std::vector<int> &indices);
+
+// sum, mean or max of the rows of each bag; bag b starts at offsets[b]
+Expression embedding_bag(Graph &g, const LookupParameter &lp,
+    const std::vector<int> &indices, const std::vector<int> &offsets,
+    BagMode mode=kBagSum);
+
+Expression lookup(Graph &g, const QuantizedLookupParameter &lp, int index);
+
+Expression operator*(const QuantizedParameter &w, const Expression &x);
+
+// act(w * x + b), computed in a single int8 kernel
+Expression affine(const QuantizedParameter &w, const Expression &x,
+    const Expression &b, Activation act=kLinear);
+
 Expression squared_distance(const Expression &a, const Expression &b);
 
+// -log softmax(x)_target, fused; with a batch, one target per element
+Expression pickneglogsoftmax(const Expression &x, int target);
+Expression pickneglogsoftmax(const Expression &x, const std::vector<int> &targets);
+
+// -log softmax of each example over a subset of the rows w and biases
+// gathered by lookup(); see CandidateSoftmaxLoss
+Expression candidate_softmax_loss(const Expression &h, const Expression &w,
+    const Expression &bias, const std::vector<int> &begin, const std::vector<int> &end,
+    const std::vector<int> &target, const std::vector<float> &shift=std::vector<float>(),
+    const std::vector<int> &ids=std::vector<int>());
+
 Expression sum(const Expression &x, int axis);
 
 Expression tanh(const Expression &x);
 
 Expression sigmoid(const Expression &x);
 
+// rows [begin, end) of each batch element
+Expression slice_rows(const Expression &x, int begin, int end);
+
+// next LSTM state [h; c] from x, the state [h; c], W (4H, D + H) and b (4H, 1)
+Expression lstm_cell(const Expression &x, const Expression &state,
+    const Expression &w, const Expression &b);
+
+// next GRU state h from x, h, W_x (3H, D), W_h (3H, H), b_x and b_h (3H, 1)
+Expression gru_cell(const Expression &x, const Expression &h, const Expression &wx,
+    const Expression &wh, const Expression &bx, const Expression &bh);
+
+// GRU states (T, B, H) of a whole sequence xs (T, B, D) from h0, or of
+// packed sequences with batch_sizes (see GRUSequence)
+Expression gru_sequence(const Expression &xs, const Expression &h0, const Expression &wx,
+    const Expression &wh, const Expression &bx, const Expression &bh,
+    const std::vector<int> &batch_sizes=std::vector<int>());
+
+// states of the last layer of a GRUStack over xs (T, B, D); weights holds
+// W_x, W_h, b_x and b_h of every layer and direction
+Expression gru_stack(const Expression &xs, const std::vector<Expression> &weights,
+    int n_layers, bool bidirectional, int num_threads=0);
+
+// context sum_t a_t e_t with a = softmax(q^T e_t), or softmax(q^T W e_t), of
+// the states enc (T, B, H) or (T, H) for queries q with batch size B;
+// example b sees its first lengths_b states (see Attention)
+Expression attention(const Expression &enc, const Expression &q,
+    const std::vector<int> &lengths=std::vector<int>());
+Expression attention(const Expression &enc, const Expression &q, const Expression &w,
+    const std::vector<int> &lengths=std::vector<int>());
+
 
 } // namespace rnnpp
 #endif // RNNPP_H_
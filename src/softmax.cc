@@ -0,0 +1,218 @@
+#include <math.h>
+
+#include "error.h"
+#include "initializer.h"
+#include "rnnpp.h"
+#include "softmax.h"
+
+namespace rnnpp {
+
+AliasSampler::AliasSampler(const std::vector<float> &weights, uint64_t seed)
+  : seed_(seed), counter_(0) {
+  int n = weights.size();
+  RNNPP_CHECK(n > 0, "No weights to sample from");
+  double total = 0.;
+  for (int i=0; i < n; ++i) {
+    RNNPP_CHECK(weights[i] >= 0., "Negative weight " << weights[i] << " of " << i);
+    total += weights[i];
+  }
+  RNNPP_CHECK(total > 0., "All weights are zero");
+
+  // columns below the mean are topped up by one above it
+  prob_.resize(n);
+  threshold_.resize(n);
+  alias_.resize(n);
+  std::vector<double> scaled(n);
+  std::vector<int> small, large;
+  for (int i=0; i < n; ++i) {
+    prob_[i] = weights[i] / total;
+    scaled[i] = weights[i] / total * n;
+    alias_[i] = i;
+    if (scaled[i] < 1.) {
+      small.push_back(i);
+    } else {
+      large.push_back(i);
+    }
+  }
+  while (!small.empty() && !large.empty()) {
+    int s = small.back();
+    int l = large.back();
+    small.pop_back();
+    threshold_[s] = scaled[s];
+    alias_[s] = l;
+    scaled[l] -= 1. - scaled[s];
+    if (scaled[l] < 1.) {
+      large.pop_back();
+      small.push_back(l);
+    }
+  }
+  // what is left is 1 up to rounding
+  for (int i : small) threshold_[i] = 1.;
+  for (int i : large) threshold_[i] = 1.;
+}
+
+int AliasSampler::sample() {
+  int i;
+  sample(1, &i);
+  return i;
+}
+
+// draw d uses words 2 * (d % 2) and 2 * (d % 2) + 1 of Philox block d / 2:
+// a column from the first and a uniform in [0, 1) with 24 bits from the
+// second, so the draws do not depend on how they are split into calls
+void AliasSampler::sample(int n, int *dst) {
+  uint32_t key[2] = {(uint32_t)seed_, (uint32_t)(seed_ >> 32)};
+  uint64_t size = prob_.size();
+  uint32_t w[4];
+  for (int i=0; i < n; ++i, ++counter_) {
+    if (i == 0 || counter_ % 2 == 0) {
+      uint64_t block = counter_ / 2;
+      uint32_t ctr[4] = {(uint32_t)block, (uint32_t)(block >> 32), 0, 0};
+      philox4x32(ctr, key, w);
+    }
+    int k = 2 * (counter_ % 2);
+    int col = (int)(((uint64_t)w[k] * size) >> 32);
+    float u = (w[k + 1] >> 8) * (1.f / 16777216.f);
+    dst[i] = u < threshold_[col] ? col : alias_[col];
+  }
+}
+
+SampledSoftmaxBuilder::SampledSoftmaxBuilder(ParameterCollection &model, int hidden_dim,
+    const std::vector<float> &counts, int n_samples, float power, uint64_t seed)
+  : hidden_dim(hidden_dim), vocab_size(counts.size()), n_samples(n_samples) {
+  RNNPP_CHECK(n_samples > 0, "Invalid number of samples: " << n_samples);
+  std::vector<float> q(counts.size());
+  for (int i=0; i < q.size(); ++i) {
+    q[i] = powf(counts[i], power);
+  }
+  sampler = AliasSampler(q, seed);
+
+  GlorotInitializer glorot;
+  UniformInitializer zero(0., 0.);
+  w = model.add_lookup_parameter(Dim({vocab_size, hidden_dim}), kFloat32, "", &glorot);
+  b = model.add_lookup_parameter(Dim({vocab_size, 1}), kFloat32, "", &zero);
+}
+
+Expression SampledSoftmaxBuilder::loss(const Expression &h,
+    const std::vector<int> &targets) {
+  int B = targets.size();
+  int S = n_samples;
+  samples_.resize(S);
+  sampler.sample(S, samples_.data());
+
+  // rows: the targets, then the samples shared by all examples
+  std::vector<int> rows(targets);
+  rows.insert(rows.end(), samples_.begin(), samples_.end());
+  std::vector<float> shift(B + S);
+  for (int j=0; j < B + S; ++j) {
+    RNNPP_CHECK(rows[j] >= 0 && rows[j] < vocab_size, "Word out of range: " << rows[j]);
+    shift[j] = logf(S * sampler.prob(rows[j]));
+  }
+  std::vector<int> target(B);
+  for (int i=0; i < B; ++i) {
+    target[i] = i;
+  }
+  Graph &g = *h.g_;
+  return candidate_softmax_loss(h, lookup(g, w, rows), lookup(g, b, rows),
+      std::vector<int>(B, B), std::vector<int>(B, B + S), target, shift, rows);
+}
+
+Expression SampledSoftmaxBuilder::full_loss(const Expression &h,
+    const std::vector<int> &targets) {
+  int B = targets.size();
+  std::vector<int> rows(vocab_size);
+  for (int j=0; j < vocab_size; ++j) {
+    rows[j] = j;
+  }
+  Graph &g = *h.g_;
+  return candidate_softmax_loss(h, lookup(g, w, rows), lookup(g, b, rows),
+      std::vector<int>(B, 0), std::vector<int>(B, vocab_size), targets);
+}
+
+ClassFactoredSoftmaxBuilder::ClassFactoredSoftmaxBuilder(ParameterCollection &model,
+    int hidden_dim, const std::vector<int> &class_begin)
+  : hidden_dim(hidden_dim), class_begin(class_begin) {
+  n_classes = (int)class_begin.size() - 1;
+  RNNPP_CHECK(n_classes > 0 && class_begin[0] == 0, "Invalid class boundaries");
+  for (int c=0; c < n_classes; ++c) {
+    RNNPP_CHECK(class_begin[c] < class_begin[c + 1], "Class " << c << " is empty");
+  }
+  vocab_size = class_begin.back();
+  word_class.resize(vocab_size);
+  for (int c=0; c < n_classes; ++c) {
+    for (int i=class_begin[c]; i < class_begin[c + 1]; ++i) {
+      word_class[i] = c;
+    }
+  }
+
+  GlorotInitializer glorot;
+  UniformInitializer zero(0., 0.);
+  wc = model.add_lookup_parameter(Dim({n_classes, hidden_dim}), kFloat32, "", &glorot);
+  bc = model.add_lookup_parameter(Dim({n_classes, 1}), kFloat32, "", &zero);
+  w = model.add_lookup_parameter(Dim({vocab_size, hidden_dim}), kFloat32, "", &glorot);
+  b = model.add_lookup_parameter(Dim({vocab_size, 1}), kFloat32, "", &zero);
+}
+
+Expression ClassFactoredSoftmaxBuilder::loss(const Expression &h,
+    const std::vector<int> &targets) {
+  int B = targets.size();
+  Graph &g = *h.g_;
+
+  std::vector<int> classes(B);
+  std::vector<int> all_classes(n_classes);
+  for (int c=0; c < n_classes; ++c) {
+    all_classes[c] = c;
+  }
+
+  // the words of every class in the batch, each class once
+  std::vector<int> rows;
+  std::vector<int> start(n_classes, -1);
+  std::vector<int> begin(B), end(B), target(B);
+  for (int i=0; i < B; ++i) {
+    RNNPP_CHECK(targets[i] >= 0 && targets[i] < vocab_size,
+        "Word out of range: " << targets[i]);
+    int c = word_class[targets[i]];
+    classes[i] = c;
+    if (start[c] < 0) {
+      start[c] = rows.size();
+      for (int j=class_begin[c]; j < class_begin[c + 1]; ++j) {
+        rows.push_back(j);
+      }
+    }
+    begin[i] = start[c];
+    end[i] = start[c] + class_begin[c + 1] - class_begin[c];
+    target[i] = start[c] + targets[i] - class_begin[c];
+  }
+
+  Expression class_loss = candidate_softmax_loss(h, lookup(g, wc, all_classes),
+      lookup(g, bc, all_classes), std::vector<int>(B, 0), std::vector<int>(B, n_classes),
+      classes);
+  Expression word_loss = candidate_softmax_loss(h, lookup(g, w, rows), lookup(g, b, rows),
+      begin, end, target);
+  return class_loss + word_loss;
+}
+
+std::vector<int> frequency_classes(const std::vector<float> &counts, int n_classes) {
+  int V = counts.size();
+  RNNPP_CHECK(n_classes > 0 && n_classes <= V,
+      "Cannot split " << V << " words into " << n_classes << " classes");
+  double total = 0.;
+  for (int i=0; i < V; ++i) {
+    total += counts[i];
+  }
+  std::vector<int> class_begin(1, 0);
+  double cum = 0.;
+  for (int i=0; i < V; ++i) {
+    int c = class_begin.size();
+    // leave at least one word for each class still to come
+    bool full = cum >= total * c / n_classes && i > class_begin.back();
+    if (c < n_classes && (full || V - i == n_classes - c)) {
+      class_begin.push_back(i);
+    }
+    cum += counts[i];
+  }
+  class_begin.push_back(V);
+  return class_begin;
+}
+
+} // namespace rnnpp
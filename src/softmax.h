@@ -0,0 +1,115 @@
+#ifndef RNNPP_SOFTMAX_H_
+#define RNNPP_SOFTMAX_H_
+
+#include <stdint.h>
+
+#include <vector>
+
+#include "expr.h"
+#include "graph.h"
+#include "parameter.h"
+
+namespace rnnpp {
+
+/**
+ * Draws from a fixed discrete distribution in O(1) with Vose's alias
+ * method. Random numbers come from Philox with the seed as key and a
+ * counter, so a sampler with the same seed gives the same draws.
+ */
+class AliasSampler {
+  public:
+    AliasSampler(): seed_(0), counter_(0) {}
+
+    // weights need not sum to 1
+    AliasSampler(const std::vector<float> &weights, uint64_t seed=0);
+
+    int sample();
+    void sample(int n, int *dst);
+
+    float prob(int i) const { return prob_[i]; }
+
+    int size() const { return prob_.size(); }
+
+  private:
+    std::vector<float> prob_;
+    // column i gives i if u < threshold_i and alias_i otherwise
+    std::vector<float> threshold_;
+    std::vector<int> alias_;
+    uint64_t seed_;
+    uint64_t counter_;
+};
+
+/**
+ * Output layer over V words trained with sampled softmax: each batch
+ * scores its targets and n_samples negatives shared by all examples,
+ * drawn with replacement from counts^power, with logits corrected by
+ * log(n_samples * q(word)) and accidental hits left out. Only the rows
+ * of the targets and the negatives get gradients, sparsely, through
+ * the LookupParameters w (V, H) and b (V, 1).
+ *
+ * h has H values per batch element, in any shape.
+ */
+class SampledSoftmaxBuilder {
+  public:
+    SampledSoftmaxBuilder(ParameterCollection &model, int hidden_dim,
+        const std::vector<float> &counts, int n_samples, float power=0.75, uint64_t seed=0);
+
+    // sampled loss (1) of each example, for training
+    Expression loss(const Expression &h, const std::vector<int> &targets);
+
+    // -log p(target | h) over all V words
+    Expression full_loss(const Expression &h, const std::vector<int> &targets);
+
+    int hidden_dim;
+    int vocab_size;
+    int n_samples;
+
+    LookupParameter w;
+    LookupParameter b;
+
+    AliasSampler sampler;
+
+  private:
+    std::vector<int> samples_;
+};
+
+/**
+ * Class factored output layer: p(word | h) = p(class | h) p(word | class,
+ * h), where class c holds the words [class_begin_c, class_begin_{c+1}).
+ * Each example costs n_classes + |class| logits instead of V, and only
+ * the rows of the classes in the batch get gradients. Both layers are
+ * LookupParameters: wc (n_classes, H), bc and w (V, H), b.
+ *
+ * h has H values per batch element, in any shape.
+ */
+class ClassFactoredSoftmaxBuilder {
+  public:
+    ClassFactoredSoftmaxBuilder(ParameterCollection &model, int hidden_dim,
+        const std::vector<int> &class_begin);
+
+    // -log p(target | h) of each example, exact
+    Expression loss(const Expression &h, const std::vector<int> &targets);
+
+    int hidden_dim;
+    int vocab_size;
+    int n_classes;
+
+    LookupParameter wc;
+    LookupParameter bc;
+    LookupParameter w;
+    LookupParameter b;
+
+    std::vector<int> class_begin;
+    std::vector<int> word_class;
+};
+
+/**
+ * Splits words 0, ..., V - 1 into n_classes contiguous classes of about
+ * the same total count, as class_begin with n_classes + 1 entries. With
+ * words sorted by decreasing count, frequent words get small classes.
+ */
+std::vector<int> frequency_classes(const std::vector<float> &counts, int n_classes);
+
+} // namespace rnnpp
+
+#endif // RNNPP_SOFTMAX_H_
@@ -1,6 +1,14 @@
+#include <math.h>
+#include <string.h>
+
 #include <algorithm>
+#include <cmath>
 #include <iostream>
 
+#ifdef __AVX__
+#include <immintrin.h>
+#endif
+
 #include "error.h"
 #include "tensor.h"
 
@@ -36,73 +44,644 @@ Tensor Tensor::batch_elem(int bid) {
 }
 
 
-void _sum(std::vector<int> &dst_index, 
-    int pos, int axis, const Tensor &src, Tensor &dst) {
+void sum_to(const Tensor &src, Tensor &dst) {
+  int nd = src.dim.shape.size();
+  int ns = dst.dim.shape.size();
+  std::vector<int> dst_stride(nd, 0);
+  for (int k=0; k < ns; ++k) {
+    if (dst.dim.shape[k] != 1) {
+      dst_stride[nd - ns + k] = dst.dim.stride[k];
+    }
+  }
 
   int ss = src.dim.size();
   int ds = dst.dim.size();
+  int dst_batch = dst.dim.batch_size > 1;
+  dst = Scalar(0.);
+  for (int b=0; b < src.batch_size(); ++b) {
+    for (int i=0; i < ss; ++i) {
+      int r = i;
+      int offset = 0;
+      for (int k=0; k < nd; ++k) {
+        int idx = r / src.dim.stride[k];
+        r -= idx * src.dim.stride[k];
+        offset += idx * dst_stride[k];
+      }
+      dst.data[offset + b * dst_batch * ds] += src.data[i + b * ss];
+    }
+  }
+}
 
-  if (pos == dst.dim.shape.size()-1) {
-    for (dst_index[pos]=0; dst_index[pos] < dst.dim.shape[pos]; dst_index[pos] += 1) {
+float sum(const float *x, int n) {
+  if (n > 256) {
+    int h = (n / 2) & ~31;
+    return sum(x, h) + sum(x + h, n - h);
+  }
 
-      int offset1 = 0;
-      if (axis > -1) {
-        for (int k=0; k < dst_index.size(); ++k) {
-          offset1 += dst_index[k] * dst.dim.stride[k];
-//          std::cout << dst_index[k] << ",";
-        }
-//        std::cout << std::endl;
+  int i = 0;
+  float s = 0.;
+#ifdef __AVX__
+  __m256 a0 = _mm256_setzero_ps();
+  __m256 a1 = _mm256_setzero_ps();
+  __m256 a2 = _mm256_setzero_ps();
+  __m256 a3 = _mm256_setzero_ps();
+  for (; i + 32 <= n; i += 32) {
+    a0 = _mm256_add_ps(a0, _mm256_loadu_ps(x + i));
+    a1 = _mm256_add_ps(a1, _mm256_loadu_ps(x + i + 8));
+    a2 = _mm256_add_ps(a2, _mm256_loadu_ps(x + i + 16));
+    a3 = _mm256_add_ps(a3, _mm256_loadu_ps(x + i + 24));
+  }
+  __m256 a = _mm256_add_ps(_mm256_add_ps(a0, a1), _mm256_add_ps(a2, a3));
+  __m128 q = _mm_add_ps(_mm256_castps256_ps128(a), _mm256_extractf128_ps(a, 1));
+  q = _mm_add_ps(q, _mm_movehl_ps(q, q));
+  q = _mm_add_ss(q, _mm_movehdup_ps(q));
+  s = _mm_cvtss_f32(q);
+#else
+  float acc[8] = {0., 0., 0., 0., 0., 0., 0., 0.};
+  for (; i + 8 <= n; i += 8) {
+    for (int j=0; j < 8; ++j) {
+      acc[j] += x[i + j];
+    }
+  }
+  s = ((acc[0] + acc[1]) + (acc[2] + acc[3])) + ((acc[4] + acc[5]) + (acc[6] + acc[7]));
+#endif
+  for (; i < n; ++i) {
+    s += x[i];
+  }
+  return s;
+}
+
+float sum_squares(const float *x, int n) {
+  if (n > 256) {
+    int h = (n / 2) & ~31;
+    return sum_squares(x, h) + sum_squares(x + h, n - h);
+  }
+
+  int i = 0;
+  float s = 0.;
+#ifdef __AVX__
+  __m256 a0 = _mm256_setzero_ps();
+  __m256 a1 = _mm256_setzero_ps();
+  for (; i + 16 <= n; i += 16) {
+    __m256 v0 = _mm256_loadu_ps(x + i);
+    __m256 v1 = _mm256_loadu_ps(x + i + 8);
+    a0 = _mm256_add_ps(a0, _mm256_mul_ps(v0, v0));
+    a1 = _mm256_add_ps(a1, _mm256_mul_ps(v1, v1));
+  }
+  __m256 a = _mm256_add_ps(a0, a1);
+  __m128 q = _mm_add_ps(_mm256_castps256_ps128(a), _mm256_extractf128_ps(a, 1));
+  q = _mm_add_ps(q, _mm_movehl_ps(q, q));
+  q = _mm_add_ss(q, _mm_movehdup_ps(q));
+  s = _mm_cvtss_f32(q);
+#endif
+  for (; i < n; ++i) {
+    s += x[i] * x[i];
+  }
+  return s;
+}
+
+float max(const float *x, int n) {
+  int i = 0;
+  float m = -INFINITY;
+#ifdef __AVX__
+  if (n >= 8) {
+    __m256 a = _mm256_loadu_ps(x);
+    for (i=8; i + 8 <= n; i += 8) {
+      a = _mm256_max_ps(a, _mm256_loadu_ps(x + i));
+    }
+    float lanes[8];
+    _mm256_storeu_ps(lanes, a);
+    for (int j=0; j < 8; ++j) {
+      m = std::max(m, lanes[j]);
+    }
+  }
+#endif
+  for (; i < n; ++i) {
+    m = std::max(m, x[i]);
+  }
+  return m;
+}
+
+float logsumexp(const float *x, int n) {
+  float m = max(x, n);
+  if (std::isinf(m)) {
+    return m;
+  }
+  float buf[256];
+  float s = 0.;
+  for (int i=0; i < n; i += 256) {
+    int k = std::min(256, n - i);
+    for (int j=0; j < k; ++j) {
+      buf[j] = expf(x[i + j] - m);
+    }
+    s += sum(buf, k);
+  }
+  return m + logf(s);
+}
+
+float online_logsumexp(const float *x, int n) {
+  float m = -INFINITY;
+  float s = 0.;
+  float buf[256];
+  for (int i=0; i < n; i += 256) {
+    int k = std::min(256, n - i);
+    // the block is still in L1 when it is read again for the exps
+    float bm = max(x + i, k);
+    if (bm > m) {
+      s *= expf(m - bm);
+      m = bm;
+    }
+    if (std::isinf(m)) {
+      continue;
+    }
+    for (int j=0; j < k; ++j) {
+      buf[j] = expf(x[i + j] - m);
+    }
+    s += sum(buf, k);
+  }
+  if (std::isinf(m)) {
+    return m;
+  }
+  return m + logf(s);
+}
+
+// a ranks before b
+struct TopKBefore {
+  const float *x;
+
+  bool operator()(int a, int b) const {
+    return x[a] > x[b] || (x[a] == x[b] && a < b);
+  }
+};
+
+void top_k(const float *x, int n, int k, int *idx) {
+  k = std::min(k, n);
+  if (k <= 0) {
+    return;
+  }
+  // a max-heap under TopKBefore keeps the worst candidate on top
+  TopKBefore before = {x};
+  for (int i=0; i < k; ++i) {
+    idx[i] = i;
+  }
+  std::make_heap(idx, idx + k, before);
+  for (int i=k; i < n; ++i) {
+    // i only ties with earlier indices, which rank before it
+    if (x[i] > x[idx[0]]) {
+      std::pop_heap(idx, idx + k, before);
+      idx[k - 1] = i;
+      std::push_heap(idx, idx + k, before);
+    }
+  }
+  std::sort_heap(idx, idx + k, before);
+}
+
+void reduce_sum(const float *src, int outer, int len, int inner, float *dst) {
+  if (inner == 1) {
+    for (int o=0; o < outer; ++o) {
+      dst[o] += sum(src + o * len, len);
+    }
+    return;
+  }
+
+  std::vector<float> s(inner);
+  std::vector<float> c(inner);
+  for (int o=0; o < outer; ++o) {
+    std::fill(s.begin(), s.end(), 0.f);
+    std::fill(c.begin(), c.end(), 0.f);
+    for (int j=0; j < len; ++j) {
+      const float *x = src + (o * len + j) * inner;
+      for (int k=0; k < inner; ++k) {
+        float y = x[k] - c[k];
+        float t = s[k] + y;
+        c[k] = (t - s[k]) - y;
+        s[k] = t;
       }
+    }
+    float *d = dst + o * inner;
+    for (int k=0; k < inner; ++k) {
+      d[k] += s[k];
+    }
+  }
+}
 
-      int j = 0;
-      int offset2base = 0;
-      for (int k=0; k < src.dim.stride.size(); ++k) {
-        if (k==axis) {
-          continue;
-        }
-        offset2base += dst_index[j] * src.dim.stride[k];
-        j += 1;
+void reduce_max(const float *src, int outer, int len, int inner, float *dst) {
+  if (inner == 1) {
+    for (int o=0; o < outer; ++o) {
+      dst[o] = max(src + o * len, len);
+    }
+    return;
+  }
+
+  for (int o=0; o < outer; ++o) {
+    float *d = dst + o * inner;
+    std::fill(d, d + inner, -INFINITY);
+    for (int j=0; j < len; ++j) {
+      const float *x = src + (o * len + j) * inner;
+      for (int k=0; k < inner; ++k) {
+        d[k] = std::max(d[k], x[k]);
+      }
+    }
+  }
+}
+
+void reduce_logsumexp(const float *src, int outer, int len, int inner, float *dst) {
+  if (inner == 1) {
+    for (int o=0; o < outer; ++o) {
+      dst[o] = logsumexp(src + o * len, len);
+    }
+    return;
+  }
+
+  std::vector<float> m(inner);
+  std::vector<float> s(inner);
+  std::vector<float> c(inner);
+  reduce_max(src, outer, len, inner, dst);
+  for (int o=0; o < outer; ++o) {
+    float *d = dst + o * inner;
+    std::copy(d, d + inner, m.begin());
+    std::fill(s.begin(), s.end(), 0.f);
+    std::fill(c.begin(), c.end(), 0.f);
+    for (int j=0; j < len; ++j) {
+      const float *x = src + (o * len + j) * inner;
+      for (int k=0; k < inner; ++k) {
+        float y = expf(x[k] - m[k]) - c[k];
+        float t = s[k] + y;
+        c[k] = (t - s[k]) - y;
+        s[k] = t;
+      }
+    }
+    for (int k=0; k < inner; ++k) {
+      d[k] = std::isinf(m[k]) ? m[k] : m[k] + logf(s[k]);
+    }
+  }
+}
+
+enum ReduceOp {
+  kReduceSum,
+  kReduceMax,
+  kReduceLogSumExp,
+};
+
+// Splits src into [outer][len][inner] for the given axis and calls the
+// matching kernel once per batch element (or once over the batch).
+static void reduce(const Tensor &src, Tensor &dst, int axis, ReduceOp op) {
+  int nd = src.dim.shape.size();
+  int ss = src.dim.size();
+  int ds = dst.dim.size();
+  RNNPP_CHECK(axis >= -1 && axis <= nd, "Invalid axis: " << axis);
+
+  void (*kernel)(const float*, int, int, int, float*);
+  if (op == kReduceSum) kernel = reduce_sum;
+  else if (op == kReduceMax) kernel = reduce_max;
+  else kernel = reduce_logsumexp;
+
+  if (axis == nd) { // along batch
+    kernel(src.data, 1, src.batch_size(), ss, dst.data);
+    return;
+  }
+
+  int outer = 1;
+  int len = ss;
+  int inner = 1;
+  if (axis != -1) {
+    len = src.dim.shape[axis];
+    for (int k=0; k < axis; ++k) outer *= src.dim.shape[k];
+    for (int k=axis+1; k < nd; ++k) inner *= src.dim.shape[k];
+  }
+
+  int dst_batch = dst.batch_size() > 1;
+  for (int b=0; b < src.batch_size(); ++b) {
+    kernel(src.data + b * ss, outer, len, inner, dst.data + b * dst_batch * ds);
+  }
+}
+
+void sum(const Tensor &src, Tensor &dst, int axis) {
+  reduce(src, dst, axis, kReduceSum);
+}
+
+void mean(const Tensor &src, Tensor &dst, int axis) {
+  int nd = src.dim.shape.size();
+  int n;
+  if (axis == -1) n = src.dim.size();
+  else if (axis == nd) n = src.batch_size();
+  else n = src.dim.shape[axis];
+
+  dst = Scalar(0.);
+  reduce(src, dst, axis, kReduceSum);
+  dst /= Scalar(n);
+}
+
+void max(const Tensor &src, Tensor &dst, int axis) {
+  reduce(src, dst, axis, kReduceMax);
+}
+
+void logsumexp(const Tensor &src, Tensor &dst, int axis) {
+  reduce(src, dst, axis, kReduceLogSumExp);
+}
+
+float sum(const Tensor &src) {
+  return sum(src.data, src.dim.size() * src.dim.batch_size);
+}
+
+// rows ahead to prefetch; enough to cover a miss at a few ns per row
+static const int kPrefetchRows = 8;
+
+static inline void prefetch_row(const float *row, int dim, int rw) {
+  const char *p = reinterpret_cast<const char*>(row);
+  for (int k=0; k < dim * (int)sizeof(float); k += 64) {
+    if (rw) {
+      __builtin_prefetch(p + k, 1);
+    } else {
+      __builtin_prefetch(p + k, 0);
+    }
+  }
+}
+
+void gather_rows(const float *table, int dim, const int *idx, int n, float *dst) {
+  for (int b=0; b < n; ++b) {
+    if (b + kPrefetchRows < n) {
+      prefetch_row(table + (size_t)idx[b + kPrefetchRows] * dim, dim, 0);
+    }
+    memcpy(dst + (size_t)b * dim, table + (size_t)idx[b] * dim, dim * sizeof(float));
+  }
+}
+
+void scatter_add_rows(const float *src, int dim, const int *idx, const int *order,
+    int n, float *table) {
+  for (int j=0; j < n; ++j) {
+    if (j + kPrefetchRows < n) {
+      prefetch_row(table + (size_t)idx[order[j + kPrefetchRows]] * dim, dim, 1);
+    }
+    int b = order[j];
+    float *row = table + (size_t)idx[b] * dim;
+    const float *s = src + (size_t)b * dim;
+    for (int k=0; k < dim; ++k) {
+      row[k] += s[k];
+    }
+  }
+}
+
+void bag_rows(const float *table, int dim, const int *idx, const int *offsets,
+    int n_bags, int n, BagMode mode, float *dst, int *argmax) {
+  for (int b=0; b < n_bags; ++b) {
+    int begin = offsets[b];
+    int end = b + 1 < n_bags ? offsets[b + 1] : n;
+    float *d = dst + (size_t)b * dim;
+
+    if (mode == kBagMax) {
+      int *a = argmax + (size_t)b * dim;
+      for (int k=0; k < dim; ++k) {
+        d[k] = begin < end ? -INFINITY : 0.f;
+        a[k] = -1;
       }
+    } else {
+      memset(d, 0, dim * sizeof(float));
+    }
 
-      if (axis == -1) { // sum all elements
-        for (int b=0; b < src.batch_size(); ++b) {
-          for (int i=0; i < src.dim.size(); ++i) {
-            dst.data[b * ds] += src.data[i + b * ss];
+    for (int j=begin; j < end; ++j) {
+      if (j + kPrefetchRows < n) {
+        prefetch_row(table + (size_t)idx[j + kPrefetchRows] * dim, dim, 0);
+      }
+      const float *row = table + (size_t)idx[j] * dim;
+      if (mode == kBagMax) {
+        int *a = argmax + (size_t)b * dim;
+        for (int k=0; k < dim; ++k) {
+          if (row[k] > d[k] || a[k] < 0) {
+            d[k] = row[k];
+            a[k] = j;
           }
         }
-      } else if (axis == src.dim.shape.size()) { // sum along batch
-        for (int b=0; b < src.batch_size(); ++b) {
-          int offset2 = offset2base;
-          dst.data[offset1] += src.data[offset2 + b * ss];
-        }
-      } else { // sum along axis
-        for (int b=0; b < src.batch_size(); ++b) {
-          for (int i=0; i < src.dim.shape[axis]; ++i) {
-            int offset2 = offset2base + i * src.dim.stride[axis];
-            dst.data[offset1 + b * ds] += src.data[offset2 + b * ss];
-          }
+      } else {
+        for (int k=0; k < dim; ++k) {
+          d[k] += row[k];
         }
       }
     }
-  } else {
-    for (dst_index[pos]=0; dst_index[pos] < dst.dim.shape[pos]; dst_index[pos] += 1) {
-      _sum(dst_index, pos+1, axis, src, dst);
+
+    if (mode == kBagMean && end > begin) {
+      float s = 1.f / (end - begin);
+      for (int k=0; k < dim; ++k) {
+        d[k] *= s;
+      }
     }
   }
 }
 
+void scatter_add_bags(const float *src, int dim, const int *idx, const int *bag,
+    const float *scale, const int *order, int n, float *table) {
+  for (int i=0; i < n; ++i) {
+    if (i + kPrefetchRows < n) {
+      prefetch_row(table + (size_t)idx[order[i + kPrefetchRows]] * dim, dim, 1);
+    }
+    int j = order[i];
+    float *row = table + (size_t)idx[j] * dim;
+    const float *s = src + (size_t)bag[j] * dim;
+    float c = scale ? scale[bag[j]] : 1.f;
+    for (int k=0; k < dim; ++k) {
+      row[k] += c * s[k];
+    }
+  }
+}
 
-void sum(const Tensor &src, Tensor &dst, int axis) {
-  std::vector<int> dst_index(dst.dim.shape.size(), 0);
-  _sum(dst_index, 0, axis, src, dst);
+// y += a * x
+static inline void axpy(float a, const float *x, float *y, int n) {
+  int i = 0;
+#ifdef __AVX__
+  __m256 va = _mm256_set1_ps(a);
+  for (; i + 8 <= n; i += 8) {
+    __m256 vy = _mm256_add_ps(_mm256_loadu_ps(y + i), _mm256_mul_ps(va, _mm256_loadu_ps(x + i)));
+    _mm256_storeu_ps(y + i, vy);
+  }
+#endif
+  for (; i < n; ++i) {
+    y[i] += a * x[i];
+  }
 }
 
-float sum(const Tensor &src) {
-  float ret;
-  for (int i=0; i < src.dim.size(); ++i) {
-    ret += src.data[i];
+#ifdef __AVX__
+static inline float hsum(__m256 a) {
+  __m128 q = _mm_add_ps(_mm256_castps256_ps128(a), _mm256_extractf128_ps(a, 1));
+  q = _mm_add_ps(q, _mm_movehl_ps(q, q));
+  q = _mm_add_ss(q, _mm_movehdup_ps(q));
+  return _mm_cvtss_f32(q);
+}
+#endif
+
+// ci[j] += x . b_j for j in [j, n), with b_j = b + j * ldb
+static void dot_rows(const float *x, const float *b, size_t ldb, float *ci, int j, int n,
+    int k) {
+#ifdef __AVX__
+  // four rows of b share the loads of x
+  for (; j + 4 <= n; j += 4) {
+    const float *b0 = b + j * ldb;
+    const float *b1 = b0 + ldb;
+    const float *b2 = b1 + ldb;
+    const float *b3 = b2 + ldb;
+    __m256 s0 = _mm256_setzero_ps();
+    __m256 s1 = _mm256_setzero_ps();
+    __m256 s2 = _mm256_setzero_ps();
+    __m256 s3 = _mm256_setzero_ps();
+    int p = 0;
+    for (; p + 8 <= k; p += 8) {
+      __m256 vx = _mm256_loadu_ps(x + p);
+      s0 = _mm256_add_ps(s0, _mm256_mul_ps(vx, _mm256_loadu_ps(b0 + p)));
+      s1 = _mm256_add_ps(s1, _mm256_mul_ps(vx, _mm256_loadu_ps(b1 + p)));
+      s2 = _mm256_add_ps(s2, _mm256_mul_ps(vx, _mm256_loadu_ps(b2 + p)));
+      s3 = _mm256_add_ps(s3, _mm256_mul_ps(vx, _mm256_loadu_ps(b3 + p)));
+    }
+    float d0 = hsum(s0), d1 = hsum(s1), d2 = hsum(s2), d3 = hsum(s3);
+    for (; p < k; ++p) {
+      d0 += x[p] * b0[p];
+      d1 += x[p] * b1[p];
+      d2 += x[p] * b2[p];
+      d3 += x[p] * b3[p];
+    }
+    ci[j] += d0;
+    ci[j + 1] += d1;
+    ci[j + 2] += d2;
+    ci[j + 3] += d3;
+  }
+#endif
+  for (; j < n; ++j) {
+    const float *y = b + j * ldb;
+    float d = 0.;
+    for (int p=0; p < k; ++p) {
+      d += x[p] * y[p];
+    }
+    ci[j] += d;
+  }
+}
+
+void gemm_nt(const float *a, const float *b, float *c, int m, int n, int k) {
+  // rows of b in blocks of about 64 KB, so that a large b, such as an
+  // output layer, is read from memory once for all rows of a
+  int block = std::max(4, 16384 / std::max(k, 1) / 4 * 4);
+  for (int j0=0; j0 < n; j0 += block) {
+    int j1 = std::min(n, j0 + block);
+    for (int i=0; i < m; ++i) {
+      dot_rows(a + (size_t)i * k, b, k, c + (size_t)i * n, j0, j1, k);
+    }
+  }
+}
+
+void gemm_nn(const float *a, const float *b, float *c, int m, int n, int k) {
+  for (int i=0; i < m; ++i) {
+    const float *ai = a + (size_t)i * k;
+    float *ci = c + (size_t)i * n;
+    for (int p=0; p < k; ++p) {
+      if (ai[p] != 0.f) {
+        axpy(ai[p], b + (size_t)p * n, ci, n);
+      }
+    }
+  }
+}
+
+void gemm_tn(const float *a, const float *b, float *c, int m, int n, int k) {
+  for (int p=0; p < k; ++p) {
+    const float *ap = a + (size_t)p * m;
+    const float *bp = b + (size_t)p * n;
+    for (int i=0; i < m; ++i) {
+      if (ap[i] != 0.f) {
+        axpy(ap[i], bp, c + (size_t)i * n, n);
+      }
+    }
+  }
+}
+
+void dot_strided(const float *x, const float *b, size_t ldb, int n, int k, float *y) {
+  memset(y, 0, n * sizeof(float));
+  dot_rows(x, b, ldb, y, 0, n, k);
+}
+
+void axpy_strided(const float *w, const float *b, size_t ldb, int n, int k, float *y) {
+  int j = 0;
+#ifdef __AVX__
+  // four rows per pass over y
+  for (; j + 4 <= n; j += 4) {
+    const float *b0 = b + j * ldb;
+    const float *b1 = b0 + ldb;
+    const float *b2 = b1 + ldb;
+    const float *b3 = b2 + ldb;
+    __m256 w0 = _mm256_set1_ps(w[j]);
+    __m256 w1 = _mm256_set1_ps(w[j + 1]);
+    __m256 w2 = _mm256_set1_ps(w[j + 2]);
+    __m256 w3 = _mm256_set1_ps(w[j + 3]);
+    int p = 0;
+    for (; p + 8 <= k; p += 8) {
+      __m256 s01 = _mm256_add_ps(_mm256_mul_ps(w0, _mm256_loadu_ps(b0 + p)),
+          _mm256_mul_ps(w1, _mm256_loadu_ps(b1 + p)));
+      __m256 s23 = _mm256_add_ps(_mm256_mul_ps(w2, _mm256_loadu_ps(b2 + p)),
+          _mm256_mul_ps(w3, _mm256_loadu_ps(b3 + p)));
+      _mm256_storeu_ps(y + p, _mm256_add_ps(_mm256_loadu_ps(y + p),
+          _mm256_add_ps(s01, s23)));
+    }
+    for (; p < k; ++p) {
+      y[p] += w[j] * b0[p] + w[j + 1] * b1[p] + w[j + 2] * b2[p] + w[j + 3] * b3[p];
+    }
+  }
+#endif
+  for (; j < n; ++j) {
+    axpy(w[j], b + j * ldb, y, k);
+  }
+}
+
+#ifdef __AVX2__
+// exp(x) (cephes expf), exact to a few ulp for x in [-87, 88]
+static inline __m256 exp_approx(__m256 x) {
+  x = _mm256_min_ps(x, _mm256_set1_ps(88.3762626647949f));
+  x = _mm256_max_ps(x, _mm256_set1_ps(-87.3365447504019f));
+  __m256 fx = _mm256_round_ps(_mm256_mul_ps(x, _mm256_set1_ps(1.44269504088896341f)),
+      _MM_FROUND_TO_NEAREST_INT | _MM_FROUND_NO_EXC);
+  x = _mm256_sub_ps(x, _mm256_mul_ps(fx, _mm256_set1_ps(0.693359375f)));
+  x = _mm256_sub_ps(x, _mm256_mul_ps(fx, _mm256_set1_ps(-2.12194440e-4f)));
+
+  __m256 y = _mm256_set1_ps(1.9875691500E-4f);
+  y = _mm256_add_ps(_mm256_mul_ps(y, x), _mm256_set1_ps(1.3981999507E-3f));
+  y = _mm256_add_ps(_mm256_mul_ps(y, x), _mm256_set1_ps(8.3334519073E-3f));
+  y = _mm256_add_ps(_mm256_mul_ps(y, x), _mm256_set1_ps(4.1665795894E-2f));
+  y = _mm256_add_ps(_mm256_mul_ps(y, x), _mm256_set1_ps(1.6666665459E-1f));
+  y = _mm256_add_ps(_mm256_mul_ps(y, x), _mm256_set1_ps(5.0000001201E-1f));
+  y = _mm256_add_ps(_mm256_mul_ps(_mm256_mul_ps(y, x), x), _mm256_add_ps(x, _mm256_set1_ps(1.f)));
+
+  __m256i e = _mm256_slli_epi32(_mm256_add_epi32(_mm256_cvtps_epi32(fx),
+        _mm256_set1_epi32(127)), 23);
+  return _mm256_mul_ps(y, _mm256_castsi256_ps(e));
+}
+
+static inline __m256 sigmoid_approx(__m256 x) {
+  __m256 one = _mm256_set1_ps(1.f);
+  __m256 e = exp_approx(_mm256_sub_ps(_mm256_setzero_ps(), x));
+  return _mm256_div_ps(one, _mm256_add_ps(one, e));
+}
+#endif
+
+void apply_sigmoid(float *x, int n) {
+  int i = 0;
+#ifdef __AVX2__
+  for (; i + 8 <= n; i += 8) {
+    _mm256_storeu_ps(x + i, sigmoid_approx(_mm256_loadu_ps(x + i)));
+  }
+#endif
+  for (; i < n; ++i) {
+    x[i] = 1.f / (1.f + expf(-x[i]));
+  }
+}
+
+void apply_tanh(float *x, int n) {
+  int i = 0;
+#ifdef __AVX2__
+  // tanh(x) = 2 sigmoid(2x) - 1
+  __m256 two = _mm256_set1_ps(2.f);
+  __m256 one = _mm256_set1_ps(1.f);
+  for (; i + 8 <= n; i += 8) {
+    __m256 s = sigmoid_approx(_mm256_mul_ps(two, _mm256_loadu_ps(x + i)));
+    _mm256_storeu_ps(x + i, _mm256_sub_ps(_mm256_mul_ps(two, s), one));
+  }
+#endif
+  for (; i < n; ++i) {
+    x[i] = tanhf(x[i]);
   }
-  return ret;
 }
 
 // (M, N) = (M, K) x (K, N)
@@ -197,6 +197,8 @@ class Scalar: public internal::Exp<Scalar> {
 };
 
 
+class BroadcastTensor;
+
 class Tensor: public internal::Exp<Tensor> {
   public:
     Tensor(): dim(Dim()), data(nullptr) {}
@@ -270,6 +272,12 @@ class Tensor: public internal::Exp<Tensor> {
 
     Tensor batch_elem(int bid);
 
+    /**
+     * Returns a read-only view of this tensor with dimension d,
+     * see BroadcastTensor.
+     */
+    BroadcastTensor broadcast_to(const Dim &d) const;
+
     int batch_size() const { return dim.batch_size; }
 
     float *data;
@@ -277,6 +285,55 @@ class Tensor: public internal::Exp<Tensor> {
 };
 
 
+/**
+ * NumPy-style broadcast view of a tensor.
+ * Shapes are aligned from the last axis; an axis of size 1 (or a missing
+ * leading axis) is read with stride 0, so nothing is copied.
+ */
+class BroadcastTensor: public internal::Exp<BroadcastTensor> {
+  public:
+    BroadcastTensor(const Tensor &src, const Dim &d)
+      : data_(src.data), out_stride_(d.stride), src_size_(src.dim.size()),
+        src_batch_(src.dim.batch_size), batch_(d.batch_size) {
+      int nd = d.shape.size();
+      int ns = src.dim.shape.size();
+      src_stride_.resize(nd, 0);
+      for (int k=0; k < ns; ++k) {
+        int j = nd - ns + k;
+        if (src.dim.shape[k] != 1) {
+          src_stride_[j] = src.dim.stride[k];
+        }
+      }
+    }
+
+    ~BroadcastTensor() {}
+
+    inline const float eval(int i, int b) const {
+      int offset = 0;
+      for (int k=0; k < out_stride_.size(); ++k) {
+        int idx = i / out_stride_[k];
+        i -= idx * out_stride_[k];
+        offset += idx * src_stride_[k];
+      }
+      return data_[offset + b * (src_batch_ > 1) * src_size_];
+    }
+
+    int batch_size() const { return batch_; }
+
+  private:
+    const float *data_;
+    std::vector<int> out_stride_;
+    std::vector<int> src_stride_;
+    int src_size_;
+    int src_batch_;
+    int batch_;
+};
+
+inline BroadcastTensor Tensor::broadcast_to(const Dim &d) const {
+  return BroadcastTensor(*this, d);
+}
+
+
 template<typename lhs_t> 
 inline internal::BinaryMapExp<internal::Mult, lhs_t, Scalar>
 operator* (const internal::Exp<lhs_t> &lhs, const Scalar &s) {
@@ -310,9 +367,100 @@ void nest(std::ostream &os, const std::vector<int> &shape, const std::vector<int
 void matmul(const Tensor &lhs, const Tensor &rhs, Tensor &dest);
 
 
-void _sum(std::vector<int> &dst_index, int pos, int axis, const Tensor &src, Tensor &dst);
-// dst_{i, k} = sum_j src_{i, j, k}
+// dst = src reduced over the axes (and batch) along which dst was broadcast
+void sum_to(const Tensor &src, Tensor &dst);
+
+/**
+ * Reductions over contiguous memory. src is laid out as [outer][len][inner]
+ * and dst as [outer][inner]; the reduction runs over len.
+ * Contiguous sums (inner == 1) use pairwise summation and strided sums use
+ * Kahan compensation, so do not build with -ffast-math.
+ */
+float sum(const float *x, int n);
+float sum_squares(const float *x, int n);
+float max(const float *x, int n);
+float logsumexp(const float *x, int n);
+// logsumexp in a single pass over x, a block at a time, rescaling the
+// running sum whenever the maximum grows
+float online_logsumexp(const float *x, int n);
+
+/**
+ * idx = the indices of the k largest of x[0..n), largest first, with ties
+ * broken by the smaller index. A min-heap of k candidates, so O(n log k).
+ */
+void top_k(const float *x, int n, int k, int *idx);
+
+// dst += sum
+void reduce_sum(const float *src, int outer, int len, int inner, float *dst);
+// dst = max
+void reduce_max(const float *src, int outer, int len, int inner, float *dst);
+// dst = log sum exp
+void reduce_logsumexp(const float *src, int outer, int len, int inner, float *dst);
+
+/**
+ * axis == -1:   dst_b = reduce_i src_{i, b}
+ * axis == ndim: dst_i = reduce_b src_{i, b}
+ * otherwise:    dst_{i, k, b} = reduce_j src_{i, j, k, b}
+ * sum adds into dst, the others overwrite it.
+ */
 void sum(const Tensor &src, Tensor &dst, int axis);
+void mean(const Tensor &src, Tensor &dst, int axis);
+void max(const Tensor &src, Tensor &dst, int axis);
+void logsumexp(const Tensor &src, Tensor &dst, int axis);
+
+// sum of all elements including batch
+float sum(const Tensor &src);
+
+/**
+ * Row kernels for lookup tables of rows of length dim.
+ * gather_rows:      dst_b = table_{idx_b}
+ * scatter_add_rows: table_{idx_b} += src_b, visiting b in the given order
+ * Both prefetch the rows a few steps ahead, since the indices are random.
+ */
+void gather_rows(const float *table, int dim, const int *idx, int n, float *dst);
+void scatter_add_rows(const float *src, int dim, const int *idx, const int *order,
+    int n, float *table);
+
+enum BagMode {
+  kBagSum,
+  kBagMean,
+  kBagMax,
+};
+
+/**
+ * Reduces the rows table_{idx_j} of each bag b, j in [offsets_b, offsets_{b+1})
+ * with the last bag ending at n, into dst_b. Empty bags give zeros.
+ * For kBagMax, argmax_{b, k} is the j the maximum came from, or -1.
+ */
+void bag_rows(const float *table, int dim, const int *idx, const int *offsets,
+    int n_bags, int n, BagMode mode, float *dst, int *argmax);
+
+// table_{idx_j} += scale_{bag_j} * src_{bag_j}, visiting j in the given order
+void scatter_add_bags(const float *src, int dim, const int *idx, const int *bag,
+    const float *scale, const int *order, int n, float *table);
+
+/**
+ * Row-major GEMMs that add into c.
+ * gemm_nt: c_{i, j} += sum_p a_{i, p} b_{j, p}   (m x k times (n x k)^T)
+ * gemm_nn: c_{i, j} += sum_p a_{i, p} b_{p, j}   (m x k times k x n)
+ * gemm_tn: c_{i, j} += sum_p a_{p, i} b_{p, j}   ((k x m)^T times k x n)
+ */
+void gemm_nt(const float *a, const float *b, float *c, int m, int n, int k);
+void gemm_nn(const float *a, const float *b, float *c, int m, int n, int k);
+void gemm_tn(const float *a, const float *b, float *c, int m, int n, int k);
+
+/**
+ * Kernels over n rows b_j = b + j * ldb of length k, such as the states
+ * of one example in a time major batch.
+ * dot_strided:  y_j = x . b_j
+ * axpy_strided: y += sum_j w_j b_j
+ */
+void dot_strided(const float *x, const float *b, size_t ldb, int n, int k, float *y);
+void axpy_strided(const float *w, const float *b, size_t ldb, int n, int k, float *y);
+
+// x = sigmoid(x) and x = tanh(x) in place, to about 1e-7 absolute error
+void apply_sigmoid(float *x, int n);
+void apply_tanh(float *x, int n);
 
 void _concatenate(std::vector<int> &dst_index, int pos, const std::vector<Tensor> &xs,
     Tensor &dst, int axis);
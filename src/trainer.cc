@@ -0,0 +1,344 @@
+#include <string.h>
+
+#include <algorithm>
+#include <exception>
+#include <thread>
+
+#include "error.h"
+#include "rnnpp.h"
+#include "trainer.h"
+
+namespace rnnpp {
+
+// runs f(0), ..., f(nt - 1) on nt threads, the first on the calling one,
+// and rethrows the first exception any of them threw
+template<typename F>
+static void parallel_for(int nt, F f) {
+  std::vector<std::exception_ptr> errors(nt);
+  auto run = [&](int t) {
+    try {
+      f(t);
+    } catch (...) {
+      errors[t] = std::current_exception();
+    }
+  };
+
+  std::vector<std::thread> threads;
+  for (int t=1; t < nt; ++t) {
+    threads.push_back(std::thread(run, t));
+  }
+  run(0);
+  for (auto &th : threads) {
+    th.join();
+  }
+  for (int t=0; t < nt; ++t) {
+    if (errors[t]) {
+      std::rethrow_exception(errors[t]);
+    }
+  }
+}
+
+static void delete_replicas(std::vector<ParameterReplica*> &replicas) {
+  for (int t=0; t < replicas.size(); ++t) {
+    delete replicas[t];
+  }
+  replicas.clear();
+}
+
+// replicas for n threads, rebuilt if parameters were added since
+static void prepare_replicas(std::vector<ParameterReplica*> &replicas,
+    const ParameterCollection &model, int n) {
+  if (!replicas.empty() && replicas[0]->grads_size() != model.grads_size()) {
+    delete_replicas(replicas);
+  }
+  while (replicas.size() < n) {
+    replicas.push_back(new ParameterReplica(model));
+  }
+}
+
+static void prepare_arenas(std::vector<Arena*> &arenas, int n) {
+  while (arenas.size() < n) {
+    arenas.push_back(new Arena());
+  }
+}
+
+static void delete_arenas(std::vector<Arena*> &arenas) {
+  for (int t=0; t < arenas.size(); ++t) {
+    delete arenas[t];
+  }
+  arenas.clear();
+}
+
+static size_t capacity(const std::vector<Arena*> &arenas) {
+  size_t n = 0;
+  for (int t=0; t < arenas.size(); ++t) {
+    n += arenas[t]->capacity();
+  }
+  return n;
+}
+
+HogwildTrainer::~HogwildTrainer() {
+  delete_replicas(replicas_);
+  delete_arenas(arenas_);
+}
+
+size_t HogwildTrainer::arena_capacity() const {
+  return capacity(arenas_);
+}
+
+float HogwildTrainer::train(int n_examples, const LossBuilder &loss) {
+  if (n_examples <= 0) {
+    return 0.;
+  }
+  int nt = num_threads > 0 ? num_threads : std::thread::hardware_concurrency();
+  nt = std::max(1, std::min(nt, n_examples));
+
+  prepare_replicas(replicas_, optimizer_.model, nt);
+  prepare_arenas(arenas_, nt);
+  optimizer_.start_hogwild();
+
+  std::vector<double> losses(nt, 0.);
+  parallel_for(nt, [&](int t) {
+    ParameterReplica &r = *replicas_[t];
+    Arena &arena = *arenas_[t];
+    Graph g;
+    int begin = (long long)n_examples * t / nt;
+    int end = (long long)n_examples * (t + 1) / nt;
+    try {
+      for (int i=begin; i < end; ++i) {
+        g.clear();
+        arena.reset();
+        ArenaScope scope(arena);
+        Expression e = loss(g, r, i);
+        losses[t] += as_scalar(e.forward());
+        e.backward();
+        optimizer_.update(r);
+      }
+    } catch (...) {
+      r.zero_grads();
+      throw;
+    }
+  });
+
+  double total = 0.;
+  for (int t=0; t < nt; ++t) {
+    total += losses[t];
+  }
+  return total / n_examples;
+}
+
+DataParallelTrainer::~DataParallelTrainer() {
+  delete_replicas(replicas_);
+  delete_arenas(arenas_);
+}
+
+size_t DataParallelTrainer::arena_capacity() const {
+  return capacity(arenas_);
+}
+
+float DataParallelTrainer::train_batch(const std::vector<int> &batch,
+    const LossBuilder &loss) {
+  int n = batch.size();
+  if (n == 0) {
+    return 0.;
+  }
+  int nt = num_threads > 0 ? num_threads : std::thread::hardware_concurrency();
+  nt = std::max(1, std::min(nt, n));
+  prepare_replicas(replicas_, optimizer_.model, nt);
+  prepare_arenas(arenas_, nt);
+
+  std::vector<double> losses(nt, 0.);
+  try {
+    parallel_for(nt, [&](int t) {
+      ParameterReplica &r = *replicas_[t];
+      Arena &arena = *arenas_[t];
+      Graph g;
+      int begin = (long long)n * t / nt;
+      int end = (long long)n * (t + 1) / nt;
+      for (int i=begin; i < end; ++i) {
+        g.clear();
+        arena.reset();
+        ArenaScope scope(arena);
+        Expression e = loss(g, r, batch[i]);
+        losses[t] += as_scalar(e.forward());
+        e.backward();
+      }
+    });
+  } catch (...) {
+    for (int t=0; t < nt; ++t) {
+      replicas_[t]->zero_grads();
+    }
+    throw;
+  }
+
+  reduce(nt);
+  optimizer_.update();
+
+  double total = 0.;
+  for (int t=0; t < nt; ++t) {
+    total += losses[t];
+  }
+  return total;
+}
+
+float DataParallelTrainer::train(int n_examples, int batch_size, const LossBuilder &loss) {
+  RNNPP_CHECK(batch_size > 0, "Invalid batch size: " << batch_size);
+  double total = 0.;
+  std::vector<int> batch;
+  for (int begin=0; begin < n_examples; begin += batch_size) {
+    batch.clear();
+    for (int i=begin; i < std::min(n_examples, begin + batch_size); ++i) {
+      batch.push_back(i);
+    }
+    total += train_batch(batch, loss);
+  }
+  return n_examples > 0 ? total / n_examples : 0.;
+}
+
+// a run of the gradient buffer
+struct GradRange {
+  size_t offset;
+  size_t n;
+};
+
+void DataParallelTrainer::reduce(int nt) {
+  // floats per block; nt blocks of this size fit in L2
+  const size_t block = 2048;
+  ParameterCollection &model = optimizer_.model;
+  float *grads = model.grads();
+
+  std::vector<GradRange> ranges;
+  for (int i=0; i < model.parameters.size(); ++i) {
+    const Parameter &p = model.parameters[i];
+    GradRange r = {(size_t)(p.grad.data - grads), (size_t)p.grad.dim.size()};
+    if (!ranges.empty() && ranges.back().offset + ranges.back().n == r.offset) {
+      ranges.back().n += r.n;
+    } else {
+      ranges.push_back(r);
+    }
+  }
+  for (int i=0; i < model.lookup_parameters.size(); ++i) {
+    LookupParameter &p = model.lookup_parameters[i];
+    int dim_emb = p.all_values.dim.shape[1];
+    size_t base = p.all_grads.data - grads;
+    // the model gets the union of the touched rows; the replicas are
+    // cleared here and their rows zeroed by the reduction
+    std::vector<int> rows;
+    for (int t=0; t < nt; ++t) {
+      LookupParameter &q = replicas_[t]->lookup_parameters[i];
+      for (int j=0; j < q.touched->size(); ++j) {
+        rows.push_back((*q.touched)[j]);
+        q.is_touched[(*q.touched)[j]] = 0;
+      }
+      q.touched->clear();
+    }
+    std::sort(rows.begin(), rows.end());
+    rows.erase(std::unique(rows.begin(), rows.end()), rows.end());
+    for (int j=0; j < rows.size(); ++j) {
+      GradRange r = {base + (size_t)rows[j] * dim_emb, (size_t)dim_emb};
+      ranges.push_back(r);
+      p.touch(rows[j]);
+    }
+  }
+
+  size_t total = 0;
+  for (int i=0; i < ranges.size(); ++i) {
+    total += ranges[i].n;
+  }
+
+  std::vector<float*> r(nt);
+  for (int t=0; t < nt; ++t) {
+    r[t] = replicas_[t]->grads();
+  }
+
+  // thread k sums floats [total * k / nt, total * (k + 1) / nt) of the ranges
+  parallel_for(nt, [&](int k) {
+    size_t begin = total * k / nt;
+    size_t end = total * (k + 1) / nt;
+    size_t pos = 0;
+    for (int i=0; i < ranges.size() && pos < end; ++i) {
+      size_t lo = std::max(begin, pos);
+      size_t hi = std::min(end, pos + ranges[i].n);
+      for (size_t a=lo; a < hi; a += block) {
+        size_t off = ranges[i].offset + (a - pos);
+        size_t m = std::min(block, hi - a);
+        for (int s=1; s < nt; s *= 2) {
+          for (int t=0; t + s < nt; t += 2 * s) {
+            float *x = r[t] + off;
+            const float *y = r[t + s] + off;
+            for (size_t j=0; j < m; ++j) {
+              x[j] += y[j];
+            }
+          }
+        }
+        float *g = grads + off;
+        for (size_t j=0; j < m; ++j) {
+          g[j] += r[0][off + j];
+        }
+        for (int t=0; t < nt; ++t) {
+          memset(r[t] + off, 0, m * sizeof(float));
+        }
+      }
+      pos += ranges[i].n;
+    }
+  });
+}
+
+TruncatedBPTTTrainer::TruncatedBPTTTrainer(Optimizer &optimizer, const Dim &state_dim)
+  : optimizer_(optimizer), next_(0) {
+  zeros_.assign((size_t)state_dim.size() * state_dim.batch_size, 0.f);
+  state_.dim = state_dim;
+  reset_state();
+}
+
+void TruncatedBPTTTrainer::reset_state() {
+  state_.data = zeros_.data();
+}
+
+size_t TruncatedBPTTTrainer::arena_capacity() const {
+  return arenas_[0].capacity() + arenas_[1].capacity();
+}
+
+float TruncatedBPTTTrainer::train(int n_windows, const WindowReader &read,
+    const WindowLoss &loss) {
+  if (n_windows <= 0) {
+    return 0.;
+  }
+  read(0, inputs_[0]);
+
+  double total = 0.;
+  for (int w=0; w < n_windows; ++w) {
+    std::vector<float> &inputs = inputs_[w % 2];
+    std::thread reader;
+    if (w + 1 < n_windows) {
+      reader = std::thread(read, w + 1, std::ref(inputs_[(w + 1) % 2]));
+    }
+
+    try {
+      // the other arena holds the carried state
+      Arena &arena = arenas_[next_];
+      graph_.clear();
+      arena.reset();
+      ArenaScope scope(arena);
+
+      Expression carried = input(graph_, state_);
+      Expression state = carried;
+      Expression e = loss(graph_, inputs, state);
+      RNNPP_CHECK(state.g_ == &graph_ && state.id() != carried.id() && state.id() <= e.id(),
+          "The loss of a window must set the state to carry");
+      total += as_scalar(e.forward());
+      e.backward();
+      optimizer_.update();
+
+      state_ = graph_.outputs[state.id()];
+      next_ = 1 - next_;
+    } catch (...) {
+      if (reader.joinable()) reader.join();
+      throw;
+    }
+    if (reader.joinable()) reader.join();
+  }
+  return total / n_windows;
+}
+
+} // namespace rnnpp
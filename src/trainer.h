@@ -0,0 +1,172 @@
+#ifndef RNNPP_TRAINER_H_
+#define RNNPP_TRAINER_H_
+
+#include <functional>
+#include <vector>
+
+#include "arena.h"
+#include "expr.h"
+#include "graph.h"
+#include "optimizer.h"
+#include "parameter.h"
+
+namespace rnnpp {
+
+/**
+ * Builds the loss of example i on g with the parameters of r, which are
+ * the worker's views of the model. Called from several threads at once,
+ * so it must not change shared state.
+ */
+typedef std::function<Expression(Graph &g, ParameterReplica &r, int i)> LossBuilder;
+
+/**
+ * Lock-free multithreaded training (Hogwild!).
+ * train() splits the examples into one contiguous shard per thread. A
+ * worker builds a Graph per example, runs backward into its own
+ * ParameterReplica and applies the update straight to the shared values
+ * with Optimizer::update(ParameterReplica&), without waiting for the
+ * other workers. See there for what races are allowed. With one thread
+ * this is the same as calling Optimizer::update() after every example,
+ * except that skipped rows get no catch-up.
+ */
+class HogwildTrainer {
+  public:
+    HogwildTrainer(Optimizer &optimizer, int num_threads=0)
+      : num_threads(num_threads), optimizer_(optimizer) {}
+
+    ~HogwildTrainer();
+
+    /**
+     * One pass over examples 0, ..., n_examples - 1. Returns the mean loss.
+     */
+    float train(int n_examples, const LossBuilder &loss);
+
+    // floats held by the arenas of the workers
+    size_t arena_capacity() const;
+
+    // 0 for all hardware threads
+    int num_threads;
+
+  private:
+    HogwildTrainer(const HogwildTrainer&);
+    HogwildTrainer &operator=(const HogwildTrainer&);
+
+    Optimizer &optimizer_;
+    std::vector<ParameterReplica*> replicas_;
+    // one per worker, reset for every example
+    std::vector<Arena*> arenas_;
+};
+
+/**
+ * Synchronous data-parallel training.
+ * train_batch() gives each thread a contiguous slice of the minibatch.
+ * A worker builds each example on its own Graph and Arena and
+ * accumulates the gradients in its own ParameterReplica; the replicas are then summed into the model
+ * and Optimizer::update() is called once.
+ *
+ * The sum is a tree over the replicas, ((r0 + r1) + (r2 + r3)) + ...,
+ * done a block of the gradient buffer at a time so a block of every
+ * replica stays in cache, with the blocks split over the threads. Every
+ * element is summed in the same order whatever the scheduling, so the
+ * result is bitwise reproducible for a given number of threads. Only
+ * dense parameters and the lookup rows some worker touched are reduced.
+ */
+class DataParallelTrainer {
+  public:
+    DataParallelTrainer(Optimizer &optimizer, int num_threads=0)
+      : num_threads(num_threads), optimizer_(optimizer) {}
+
+    ~DataParallelTrainer();
+
+    /**
+     * One update on the examples in batch. Returns their summed loss.
+     */
+    float train_batch(const std::vector<int> &batch, const LossBuilder &loss);
+
+    /**
+     * One pass over examples 0, ..., n_examples - 1 in minibatches of
+     * batch_size. Returns the mean loss.
+     */
+    float train(int n_examples, int batch_size, const LossBuilder &loss);
+
+    // floats held by the arenas of the workers
+    size_t arena_capacity() const;
+
+    // 0 for all hardware threads
+    int num_threads;
+
+  private:
+    DataParallelTrainer(const DataParallelTrainer&);
+    DataParallelTrainer &operator=(const DataParallelTrainer&);
+
+    // adds the gradients of the first nt replicas to the model and clears them
+    void reduce(int nt);
+
+    Optimizer &optimizer_;
+    std::vector<ParameterReplica*> replicas_;
+    // one per worker, reset for every example
+    std::vector<Arena*> arenas_;
+};
+
+/**
+ * Reads the inputs of window w of a stream into inputs, reusing its
+ * storage. Runs on another thread than the training.
+ */
+typedef std::function<void(int w, std::vector<float> &inputs)> WindowReader;
+
+/**
+ * Builds the loss of a window on g. state is the state carried from the
+ * previous window and must be set to a new expression, the state to
+ * carry to the next one.
+ */
+typedef std::function<Expression(Graph &g, std::vector<float> &inputs, Expression &state)>
+  WindowLoss;
+
+/**
+ * Truncated backpropagation through time over a stream.
+ * Each window is built on the same Graph, with its tensors in one of two
+ * Arenas used in turn, then runs forward, backward and
+ * Optimizer::update(). The state the window ends with is passed to the
+ * next one as a detached input viewing its tensor in the arena, which
+ * is only reset two windows later, so nothing is copied. While a window
+ * trains, a thread reads the inputs of the next one into the other of
+ * two buffers.
+ *
+ * Once the arenas have grown to the largest window, training allocates
+ * nothing, so memory stays constant however long the stream is.
+ */
+class TruncatedBPTTTrainer {
+  public:
+    // state_dim is the dim of the state, including its batch size
+    TruncatedBPTTTrainer(Optimizer &optimizer, const Dim &state_dim);
+
+    /**
+     * Trains on windows 0, ..., n_windows - 1, carrying the state from
+     * the last call. Returns the mean loss.
+     */
+    float train(int n_windows, const WindowReader &read, const WindowLoss &loss);
+
+    // starts the next window from the zero state
+    void reset_state();
+
+    // floats held by the arenas
+    size_t arena_capacity() const;
+
+  private:
+    TruncatedBPTTTrainer(const TruncatedBPTTTrainer&);
+    TruncatedBPTTTrainer &operator=(const TruncatedBPTTTrainer&);
+
+    Optimizer &optimizer_;
+    Graph graph_;
+    Arena arenas_[2];
+    std::vector<float> inputs_[2];
+    std::vector<float> zeros_;
+    // the carried state, in arenas_[1 - next_] or zeros_
+    Tensor state_;
+    // arena of the next window
+    int next_;
+};
+
+} // namespace rnnpp
+
+#endif // RNNPP_TRAINER_H_
@@ -0,0 +1,58 @@
+#include <gtest/gtest.h>
+
+#include "../src/arena.h"
+
+using namespace rnnpp;
+
+TEST(ArenaTest, Reuse) {
+  Arena arena(64);
+  float *a = arena.allocate(10);
+  float *b = arena.allocate(10);
+  EXPECT_EQ(b - a, 16);
+  // the second pass gets the same memory
+  arena.reset();
+  EXPECT_EQ(arena.allocate(10), a);
+  EXPECT_EQ(arena.capacity(), 64);
+}
+
+TEST(ArenaTest, MergeBlocks) {
+  Arena arena(64);
+  for (int i=0; i < 10; ++i) {
+    arena.allocate(40);
+  }
+  size_t capacity = arena.capacity();
+  EXPECT_GE(capacity, 10 * 48);
+  arena.reset();
+  EXPECT_EQ(arena.capacity(), capacity);
+  // one block now holds the whole pass
+  float *a = arena.allocate(40);
+  for (int i=1; i < 10; ++i) {
+    EXPECT_EQ(arena.allocate(40), a + i * 48);
+  }
+  EXPECT_EQ(arena.capacity(), capacity);
+}
+
+TEST(ArenaTest, Scope) {
+  Arena outer, inner;
+  {
+    ArenaScope s1(outer);
+    alloc_floats(100);
+    {
+      ArenaScope s2(inner);
+      alloc_floats(100);
+    }
+    alloc_floats(100);
+  }
+  float *p = alloc_floats(100);
+  delete[] p;
+  EXPECT_GT(outer.capacity(), 0);
+  EXPECT_GT(inner.capacity(), 0);
+
+  outer.reset();
+  float *a = outer.allocate(1);
+  outer.reset();
+  {
+    ArenaScope s(outer);
+    EXPECT_EQ(alloc_floats(1), a);
+  }
+}
@@ -0,0 +1,227 @@
+#include <iostream>
+#include <stdio.h>
+#include <string.h>
+
+#include <gtest/gtest.h>
+
+#include "../src/checkpoint.h"
+#include "../src/expr.h"
+#include "../src/graph.h"
+#include "../src/optimizer.h"
+#include "../src/parameter.h"
+#include "../src/rnnpp.h"
+
+using namespace rnnpp;
+
+
+class CheckpointTest: public ::testing::Test {
+  protected:
+    void SetUp() {
+      path = ::testing::TempDir() + "rnnpp_checkpoint_test.bin";
+      w = model.add_parameter(Dim({3, 5}), kFloat32, "w");
+      lp = model.add_lookup_parameter(Dim({100, 7}), kFloat32, "embed");
+      b = model.add_parameter(Dim({5, 1}), kBFloat16, "b");
+    };
+
+    void TearDown() {
+      remove(path.c_str());
+    }
+
+    std::string path;
+    ParameterCollection model;
+    Parameter w;
+    LookupParameter lp;
+    Parameter b;
+};
+
+TEST_F(CheckpointTest, Header) {
+  save_checkpoint(path, model);
+
+  uint64_t payload_offset, payload_size;
+  std::vector<CheckpointEntry> entries =
+    read_checkpoint_header(path, &payload_offset, &payload_size);
+  ASSERT_EQ(entries.size(), 3);
+  EXPECT_EQ(payload_offset % kCheckpointPageSize, 0);
+  EXPECT_EQ(payload_size, model.values_size() * sizeof(float));
+
+  EXPECT_EQ(entries[0].name, "w");
+  EXPECT_EQ(entries[0].kind, 0);
+  EXPECT_EQ(entries[0].dtype, kFloat32);
+  EXPECT_EQ(entries[0].dim.shape, std::vector<int>({3, 5}));
+  EXPECT_EQ(entries[0].offset, 0);
+  EXPECT_EQ(entries[0].nbytes, 60);
+
+  EXPECT_EQ(entries[1].name, "embed");
+  EXPECT_EQ(entries[1].kind, 1);
+  EXPECT_EQ(entries[1].offset, 64);
+
+  EXPECT_EQ(entries[2].name, "b");
+  EXPECT_EQ(entries[2].dtype, kBFloat16);
+  EXPECT_EQ(entries[2].nbytes, 10);
+  for (int i=0; i < entries.size(); ++i) {
+    EXPECT_EQ(entries[i].offset % 64, 0);
+  }
+}
+
+TEST_F(CheckpointTest, LoadIntoEmpty) {
+  save_checkpoint(path, model);
+
+  ParameterCollection loaded;
+  load_checkpoint(path, loaded);
+  ASSERT_EQ(loaded.parameters.size(), 2);
+  ASSERT_EQ(loaded.lookup_parameters.size(), 1);
+  EXPECT_EQ(loaded.parameter_names[1], "b");
+  EXPECT_EQ(loaded.lookup_parameter_names[0], "embed");
+
+  Parameter w2 = loaded.parameters[0];
+  for (int i=0; i < 15; ++i) {
+    EXPECT_EQ(w2.value.data[i], w.value.data[i]);
+  }
+  LookupParameter lp2 = loaded.lookup_parameters[0];
+  for (int i=0; i < 700; ++i) {
+    EXPECT_EQ(lp2.all_values.data[i], lp.all_values.data[i]);
+  }
+  EXPECT_EQ(lp2.value(99).data[6], lp.value(99).data[6]);
+
+  std::vector<float> b1(5), b2(5);
+  b.read(b1.data());
+  loaded.parameters[1].read(b2.data());
+  EXPECT_EQ(b1, b2);
+
+  // writes stay private to the process
+  w2.value.data[0] = 123.;
+  ParameterCollection again;
+  load_checkpoint(path, again);
+  EXPECT_EQ(again.parameters[0].value.data[0], w.value.data[0]);
+
+  // parameters can still be added after loading
+  Parameter c = loaded.add_parameter(Dim({2, 2}));
+  EXPECT_EQ(c.value.data, loaded.values() + loaded.values_size() - 16);
+}
+
+TEST_F(CheckpointTest, LoadIntoExisting) {
+  save_checkpoint(path, model);
+  float w0 = w.value.data[3];
+  w.value.data[3] = -1.;
+
+  // existing views see the loaded values
+  load_checkpoint(path, model);
+  EXPECT_EQ(w.value.data[3], w0);
+}
+
+TEST_F(CheckpointTest, Mismatch) {
+  save_checkpoint(path, model);
+
+  ParameterCollection other;
+  other.add_parameter(Dim({3, 5}), kFloat32, "w");
+  other.add_lookup_parameter(Dim({100, 8}), kFloat32, "embed");
+  other.add_parameter(Dim({5, 1}), kBFloat16, "b");
+  EXPECT_THROW(load_checkpoint(path, other), std::runtime_error);
+
+  ParameterCollection small(500);
+  EXPECT_THROW(load_checkpoint(path, small), std::runtime_error);
+  EXPECT_TRUE(small.parameters.empty());
+
+  FILE *fp = fopen(path.c_str(), "wb");
+  fputs("not a checkpoint", fp);
+  fclose(fp);
+  ParameterCollection empty;
+  EXPECT_THROW(load_checkpoint(path, empty), std::runtime_error);
+}
+
+// a payload that is not page aligned, as written on a system with smaller
+// pages, is read instead of mapped
+TEST_F(CheckpointTest, LoadUnalignedPayload) {
+  save_checkpoint(path, model);
+  uint64_t payload_offset, payload_size;
+  read_checkpoint_header(path, &payload_offset, &payload_size);
+
+  std::string file;
+  FILE *fp = fopen(path.c_str(), "rb");
+  char buf[4096];
+  size_t n;
+  while ((n = fread(buf, 1, sizeof(buf), fp)) > 0) {
+    file.append(buf, n);
+  }
+  fclose(fp);
+  uint64_t shifted = payload_offset + 64;
+  file.insert(payload_offset, 64, '\0');
+  memcpy(&file[16], &shifted, sizeof(shifted));
+  fp = fopen(path.c_str(), "wb");
+  fwrite(file.data(), 1, file.size(), fp);
+  fclose(fp);
+
+  ParameterCollection loaded;
+  load_checkpoint(path, loaded);
+  ASSERT_EQ(loaded.parameters.size(), 2);
+  for (int i=0; i < 15; ++i) {
+    EXPECT_EQ(loaded.parameters[0].value.data[i], w.value.data[i]);
+  }
+  for (int i=0; i < 700; ++i) {
+    EXPECT_EQ(loaded.lookup_parameters[0].all_values.data[i], lp.all_values.data[i]);
+  }
+  MappedLookupParameter frozen(path, "embed");
+  EXPECT_EQ(frozen.value(42).data[3], lp.value(42).data[3]);
+}
+
+// whether path is mapped in this process
+static bool is_mapped(const std::string &path) {
+  std::string maps;
+  FILE *fp = fopen("/proc/self/maps", "r");
+  char buf[4096];
+  size_t n;
+  while ((n = fread(buf, 1, sizeof(buf), fp)) > 0) {
+    maps.append(buf, n);
+  }
+  fclose(fp);
+  return maps.find(path) != std::string::npos;
+}
+
+TEST_F(CheckpointTest, MapLookupParameter) {
+  save_checkpoint(path, model);
+
+  MappedLookupParameter frozen(path, "embed");
+  EXPECT_TRUE(frozen.frozen());
+  EXPECT_FALSE(lp.frozen());
+  EXPECT_EQ(frozen.all_values.dim.shape, std::vector<int>({100, 7}));
+  EXPECT_EQ(frozen.all_grads.data, nullptr);
+  EXPECT_EQ(frozen.touched, nullptr);
+  for (int i=0; i < 700; ++i) {
+    EXPECT_EQ(frozen.all_values.data[i], lp.all_values.data[i]);
+  }
+
+  Graph g;
+  Expression x = lookup(g, frozen, 42);
+  Expression e = sum(x, -1);
+  e.forward();
+  e.backward();
+  Tensor y = g.outputs[x.id()];
+  for (int i=0; i < 7; ++i) {
+    EXPECT_EQ(y.data[i], lp.value(42).data[i]);
+  }
+
+  EXPECT_THROW(MappedLookupParameter(path, "w"), std::runtime_error);
+}
+
+TEST_F(CheckpointTest, MappedLookupParameterUnmaps) {
+  save_checkpoint(path, model);
+  {
+    MappedLookupParameter frozen(path, "embed");
+    EXPECT_TRUE(is_mapped(path));
+  }
+  EXPECT_FALSE(is_mapped(path));
+}
+
+TEST_F(CheckpointTest, MapHalfLookupParameter) {
+  ParameterCollection m;
+  LookupParameter half = m.add_lookup_parameter(Dim({10, 33}), kFloat16, "half");
+  save_checkpoint(path, m);
+
+  MappedLookupParameter frozen(path, "half");
+  std::vector<float> a(33), b(33);
+  for (int r=0; r < 10; ++r) {
+    half.read_row(r, a.data());
+    frozen.read_row(r, b.data());
+    EXPECT_EQ(a, b);
+  }
+}
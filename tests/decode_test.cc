@@ -0,0 +1,154 @@
+#include <math.h>
+
+#include <gtest/gtest.h>
+
+#include "../src/decode.h"
+#include "../src/expr.h"
+#include "../src/graph.h"
+#include "../src/optimizer.h"
+#include "../src/rnn.h"
+#include "../src/rnnpp.h"
+
+using namespace rnnpp;
+
+class DecodeTest: public ::testing::Test {
+  protected:
+    void SetUp() {
+      embeddings = optimizer.add_lookup_parameter({n_vocab, n_in});
+      w_out = optimizer.add_parameter({n_vocab, n_hidden});
+      b_out = optimizer.add_parameter({n_vocab, 1});
+      fill(embeddings.all_values, 3.f);
+      fill(w_out.value, 4.f);
+      fill(b_out.value, 0.5f);
+      // long enough sequences to tell beam search from greedy
+      b_out.value.data[bos] = -2.f;
+      b_out.value.data[eos] = -2.f;
+    }
+
+    static void fill(Tensor &t, float scale) {
+      for (int i=0; i < t.dim.size(); ++i) {
+        t.data[i] = scale * sinf(1.3f * i + 0.4f);
+      }
+    }
+
+    /**
+     * Scores tokens after bos by running a graph from the start for every
+     * step, with log_softmax in double.
+     */
+    template<typename Builder>
+    double score(Builder &rnn, const std::vector<float> &state,
+        const std::vector<int> &tokens) {
+      Graph g;
+      std::vector<float> s = state;
+      rnn.start_new_sequence(g, input(g, Dim({(int)s.size(), 1}), s));
+      // lookup gives a row, the cells take a column
+      std::vector<std::vector<float>> xs(tokens.size());
+      double total = 0.;
+      int prev = bos;
+      for (int t=0; t < tokens.size(); ++t) {
+        const float *row = embeddings.value(prev).data;
+        xs[t].assign(row, row + n_in);
+        Tensor h = rnn.add_input(input(g, Dim({n_in, 1}), xs[t])).forward();
+        std::vector<double> logits(n_vocab);
+        double m = -1e30;
+        for (int j=0; j < n_vocab; ++j) {
+          logits[j] = b_out.value.data[j];
+          for (int k=0; k < n_hidden; ++k) {
+            logits[j] += (double)w_out.value.data[j * n_hidden + k] * h.data[k];
+          }
+          m = std::max(m, logits[j]);
+        }
+        double z = 0.;
+        for (int j=0; j < n_vocab; ++j) z += exp(logits[j] - m);
+        total += logits[tokens[t]] - m - log(z);
+        prev = tokens[t];
+      }
+      return total;
+    }
+
+    const int n_vocab = 4;
+    const int n_in = 3;
+    const int n_hidden = 5;
+    const int bos = 0;
+    const int eos = 1;
+    SGDOptimizer optimizer;
+    LookupParameter embeddings;
+    Parameter w_out;
+    Parameter b_out;
+};
+
+TEST_F(DecodeTest, GreedyLSTM) {
+  LSTMBuilder lstm(optimizer.model, n_in, n_hidden);
+  BeamSearchDecoder decoder(lstm, embeddings, w_out, b_out, 1);
+  std::vector<Hypothesis> hyps = decoder.decode(bos, eos, 6);
+  ASSERT_EQ(hyps.size(), 1);
+
+  // greedy decoding with a graph
+  std::vector<float> zeros(2 * n_hidden, 0.f);
+  std::vector<int> tokens;
+  for (int t=0; t < 6; ++t) {
+    int best = 0;
+    double best_score = -1e30;
+    for (int j=0; j < n_vocab; ++j) {
+      std::vector<int> ext = tokens;
+      ext.push_back(j);
+      double s = score(lstm, zeros, ext);
+      if (s > best_score) {
+        best = j;
+        best_score = s;
+      }
+    }
+    tokens.push_back(best);
+    if (best == eos) break;
+  }
+  EXPECT_EQ(hyps[0].tokens, tokens);
+  EXPECT_NEAR(hyps[0].score, score(lstm, zeros, tokens), 1e-4);
+}
+
+// With a beam wider than the number of hypotheses nothing is pruned, so
+// the result is every sequence up to max_length, best first.
+TEST_F(DecodeTest, ExhaustiveGRU) {
+  GRUBuilder gru(optimizer.model, n_in, n_hidden);
+  std::vector<float> state(n_hidden);
+  for (int k=0; k < n_hidden; ++k) state[k] = 0.2f * k - 0.3f;
+
+  int max_length = 3;
+  BeamSearchDecoder decoder(gru, embeddings, w_out, b_out, 64);
+  std::vector<Hypothesis> hyps = decoder.decode(state, bos, eos, max_length);
+
+  // 1 + 3 + 9 sequences end with eos and 27 reach max_length
+  ASSERT_EQ(hyps.size(), 40);
+  for (int i=0; i < hyps.size(); ++i) {
+    const std::vector<int> &tokens = hyps[i].tokens;
+    bool finished = tokens.back() == eos;
+    EXPECT_TRUE(finished || tokens.size() == max_length);
+    for (int t=0; t + 1 < tokens.size(); ++t) {
+      EXPECT_NE(tokens[t], eos);
+    }
+    EXPECT_NEAR(hyps[i].score, score(gru, state, tokens), 1e-4);
+    if (i > 0) {
+      EXPECT_GE(hyps[i - 1].score, hyps[i].score);
+    }
+  }
+}
+
+TEST_F(DecodeTest, Beam) {
+  LSTMBuilder lstm(optimizer.model, n_in, n_hidden);
+  std::vector<float> state(2 * n_hidden);
+  for (int k=0; k < state.size(); ++k) state[k] = 0.3f * cosf(k);
+
+  BeamSearchDecoder decoder(lstm, embeddings, w_out, b_out, 3);
+  std::vector<Hypothesis> hyps = decoder.decode(state, bos, eos, 8);
+  ASSERT_EQ(hyps.size(), 3);
+  for (int i=0; i < hyps.size(); ++i) {
+    EXPECT_NEAR(hyps[i].score, score(lstm, state, hyps[i].tokens), 1e-4);
+  }
+
+  // the decoder can be reused and sees updated weights
+  std::vector<Hypothesis> again = decoder.decode(state, bos, eos, 8);
+  EXPECT_EQ(again[0].tokens, hyps[0].tokens);
+  EXPECT_EQ(again[0].score, hyps[0].score);
+  b_out.value.data[eos] += 100.f;
+  hyps = decoder.decode(state, bos, eos, 8);
+  EXPECT_EQ(hyps[0].tokens, std::vector<int>(1, eos));
+}
@@ -29,6 +29,11 @@ TEST_F(DimTest, Stride) {
   EXPECT_EQ(d1.stride[2], 1);
 }
 
+TEST_F(DimTest, Elements) {
+  EXPECT_EQ(d1.elements(), 12);
+  EXPECT_EQ(Dim({10000000, 300}).elements(), 3000000000ULL);
+}
+
 TEST_F(DimTest, Equal) {
   EXPECT_TRUE(d1 == d2);
   EXPECT_FALSE(d1 == d3);
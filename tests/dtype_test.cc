@@ -0,0 +1,99 @@
+#include <iostream>
+#include <math.h>
+
+#include <gtest/gtest.h>
+
+#include "../src/dtype.h"
+#include "../src/graph.h"
+#include "../src/optimizer.h"
+#include "../src/rnnpp.h"
+
+using namespace rnnpp;
+
+
+class DTypeTest: public ::testing::Test {
+  protected:
+    void SetUp() {
+      for (int i=0; i < 37; ++i) {
+        values.push_back(0.37f * (i - 18));
+      }
+    };
+
+    std::vector<float> values;
+};
+
+TEST_F(DTypeTest, Size) {
+  EXPECT_EQ(dtype_size(kFloat32), 4);
+  EXPECT_EQ(dtype_size(kFloat16), 2);
+  EXPECT_EQ(dtype_size(kBFloat16), 2);
+}
+
+TEST_F(DTypeTest, Name) {
+  EXPECT_EQ(dtype_from_name("fp16"), kFloat16);
+  EXPECT_EQ(dtype_from_name(dtype_name(kBFloat16)), kBFloat16);
+}
+
+TEST_F(DTypeTest, HalfExact) {
+  EXPECT_EQ(float_to_half(1.f), 0x3c00);
+  EXPECT_EQ(float_to_half(-2.f), 0xc000);
+  EXPECT_EQ(float_to_half(65504.f), 0x7bff);
+  EXPECT_EQ(float_to_half(1e6f), 0x7c00);
+  EXPECT_EQ(half_to_float(0x3555), 0.333251953125f);
+  EXPECT_EQ(half_to_float(0x0001), powf(2.f, -24));
+  EXPECT_EQ(half_to_float(float_to_half(powf(2.f, -20))), powf(2.f, -20));
+}
+
+TEST_F(DTypeTest, HalfRoundToNearestEven) {
+  // 1 + 2^-11 lies halfway between 1 and 1 + 2^-10
+  EXPECT_EQ(float_to_half(1.f + powf(2.f, -11)), 0x3c00);
+  EXPECT_EQ(float_to_half(1.f + 3 * powf(2.f, -11)), 0x3c02);
+}
+
+TEST_F(DTypeTest, BFloat16Exact) {
+  EXPECT_EQ(float_to_bfloat16(1.f), 0x3f80);
+  EXPECT_EQ(bfloat16_to_float(0xc000), -2.f);
+  EXPECT_EQ(float_to_bfloat16(1.f + powf(2.f, -8)), 0x3f80);
+  EXPECT_EQ(float_to_bfloat16(1.f + 3 * powf(2.f, -8)), 0x3f82);
+}
+
+TEST_F(DTypeTest, RoundTrip) {
+  std::vector<uint16_t> packed(values.size());
+  std::vector<float> out(values.size());
+
+  encode(values.data(), packed.data(), values.size(), kFloat16);
+  decode(packed.data(), out.data(), values.size(), kFloat16);
+  for (int i=0; i < values.size(); ++i) {
+    EXPECT_EQ(packed[i], float_to_half(values[i]));
+    EXPECT_NEAR(out[i], values[i], fabs(values[i]) * 1e-3);
+  }
+
+  encode(values.data(), packed.data(), values.size(), kBFloat16);
+  decode(packed.data(), out.data(), values.size(), kBFloat16);
+  for (int i=0; i < values.size(); ++i) {
+    EXPECT_EQ(packed[i], float_to_bfloat16(values[i]));
+    EXPECT_NEAR(out[i], values[i], fabs(values[i]) * 1e-2);
+  }
+}
+
+TEST_F(DTypeTest, HalfParameter) {
+  Graph g;
+  SGDOptimizer optimizer;
+  Parameter p = optimizer.add_parameter({2, 3}, kFloat16);
+  EXPECT_EQ(p.value.data, nullptr);
+
+  Expression e = parameter(g, p);
+  const Tensor &t = e.forward();
+  for (int i=0; i < 6; ++i) {
+    EXPECT_EQ(t.data[i], half_to_float(p.packed[i]));
+  }
+}
+
+TEST_F(DTypeTest, BFloat16Lookup) {
+  Graph g;
+  LookupParameter lp(Dim({4, 5}), kBFloat16);
+  Expression e = lookup(g, lp, 2);
+  const Tensor &t = e.forward();
+  for (int i=0; i < 5; ++i) {
+    EXPECT_EQ(t.data[i], bfloat16_to_float(lp.packed[2 * 5 + i]));
+  }
+}
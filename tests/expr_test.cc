@@ -21,7 +21,7 @@ class ExprTest: public ::testing::Test {
 
     Expression expr;
     Graph g;
-    Optimizer optimizer;
+    SGDOptimizer optimizer;
     Parameter p1, p2;
 };
 
@@ -0,0 +1,183 @@
+#include <iostream>
+#include <math.h>
+
+#include <gtest/gtest.h>
+
+#include "../src/initializer.h"
+#include "../src/optimizer.h"
+
+using namespace rnnpp;
+
+
+class InitializerTest: public ::testing::Test {
+  protected:
+    void SetUp() {
+      set_seed(1234);
+    };
+
+    Tensor make(const Dim &d) {
+      Tensor t;
+      t.dim = d;
+      t.data = new float[d.size()];
+      return t;
+    }
+
+    void stats(const Tensor &t, double &mean, double &var) {
+      int n = t.dim.size();
+      mean = 0.;
+      for (int i=0; i < n; ++i) mean += t.data[i];
+      mean /= n;
+      var = 0.;
+      for (int i=0; i < n; ++i) var += (t.data[i] - mean) * (t.data[i] - mean);
+      var /= n;
+    }
+};
+
+TEST_F(InitializerTest, PhiloxKnownAnswers) {
+  uint32_t out[4];
+
+  uint32_t c0[4] = {0, 0, 0, 0};
+  uint32_t k0[2] = {0, 0};
+  philox4x32(c0, k0, out);
+  EXPECT_EQ(out[0], 0x6627e8d5u);
+  EXPECT_EQ(out[1], 0xe169c58du);
+  EXPECT_EQ(out[2], 0xbc57ac4cu);
+  EXPECT_EQ(out[3], 0x9b00dbd8u);
+
+  uint32_t c1[4] = {0x243f6a88, 0x85a308d3, 0x13198a2e, 0x03707344};
+  uint32_t k1[2] = {0xa4093822, 0x299f31d0};
+  philox4x32(c1, k1, out);
+  EXPECT_EQ(out[0], 0xd16cfe09u);
+  EXPECT_EQ(out[1], 0x94fdcceb);
+  EXPECT_EQ(out[2], 0x5001e420u);
+  EXPECT_EQ(out[3], 0x24126ea1u);
+}
+
+TEST_F(InitializerTest, UniformLayout) {
+  int n = 100;
+  std::vector<float> x(n);
+  fill_uniform(x.data(), n, 0., 1., 77, 5);
+
+  uint32_t key[2] = {77, 0};
+  for (int i=0; i < n; ++i) {
+    uint32_t b = 8 * (i / 32) + i % 8;
+    uint32_t ctr[4] = {b, 0, 5, 0};
+    uint32_t w[4];
+    philox4x32(ctr, key, w);
+    EXPECT_FLOAT_EQ(x[i], (w[(i % 32) / 8] >> 8) * powf(2.f, -24));
+  }
+}
+
+TEST_F(InitializerTest, NormalMatchesReference) {
+  int n = 64;
+  std::vector<float> x(n);
+  fill_normal(x.data(), n, 0., 1., 77, 5);
+
+  uint32_t key[2] = {77, 0};
+  for (int i=0; i < n; ++i) {
+    int k = (i % 32) / 8;
+    uint32_t b = 8 * (i / 32) + i % 8;
+    uint32_t ctr[4] = {b, 0, 5, 0};
+    uint32_t w[4];
+    philox4x32(ctr, key, w);
+    int k0 = k & ~1;
+    double u1 = ((w[k0] >> 8) + 1) * pow(2., -24);
+    double th = (w[k0 + 1] >> 8) * pow(2., -24) * 2. * M_PI - M_PI;
+    double r = sqrt(-2. * log(u1));
+    double expected = k % 2 == 0 ? r * cos(th) : r * sin(th);
+    EXPECT_NEAR(x[i], expected, 1e-5 * std::max(1., fabs(expected)));
+  }
+}
+
+TEST_F(InitializerTest, IndependentOfThreads) {
+  int n = 1000003;
+  std::vector<float> a(n), b(n), c(n);
+  fill_normal(a.data(), n, 0., 1., 9, 3, 1);
+  fill_normal(b.data(), n, 0., 1., 9, 3, 4);
+  fill_normal(c.data(), n, 0., 1., 9, 3, 7);
+  EXPECT_EQ(a, b);
+  EXPECT_EQ(a, c);
+}
+
+TEST_F(InitializerTest, Normal) {
+  Tensor t = make(Dim({1000, 1000}));
+  NormalInitializer(2., 3.).init(t);
+  double mean, var;
+  stats(t, mean, var);
+  EXPECT_NEAR(mean, 2., 0.01);
+  EXPECT_NEAR(var, 9., 0.05);
+}
+
+TEST_F(InitializerTest, Seed) {
+  Tensor a = make(Dim({10, 10}));
+  Tensor b = make(Dim({10, 10}));
+  NormalInitializer init;
+
+  set_seed(42);
+  init.init(a);
+  set_seed(42);
+  init.init(b);
+  EXPECT_EQ(a.data[17], b.data[17]);
+
+  // the next tensor gets a new stream
+  init.init(b);
+  EXPECT_NE(a.data[17], b.data[17]);
+}
+
+TEST_F(InitializerTest, Glorot) {
+  Tensor t = make(Dim({300, 500}));
+  GlorotInitializer().init(t);
+  float a = sqrtf(6. / 800.);
+  double mean, var;
+  stats(t, mean, var);
+  for (int i=0; i < t.dim.size(); ++i) {
+    ASSERT_LE(fabsf(t.data[i]), a);
+  }
+  EXPECT_NEAR(var, a * a / 3., 1e-4);
+
+  GlorotInitializer(false).init(t);
+  stats(t, mean, var);
+  EXPECT_NEAR(var, 2. / 800., 1e-4);
+}
+
+TEST_F(InitializerTest, He) {
+  Tensor t = make(Dim({300, 500}));
+  HeInitializer().init(t);
+  double mean, var;
+  stats(t, mean, var);
+  EXPECT_NEAR(var, 2. / 500., 1e-4);
+}
+
+TEST_F(InitializerTest, Orthogonal) {
+  for (auto d : {Dim({3, 5}), Dim({5, 3}), Dim({4, 4})}) {
+    Tensor t = make(d);
+    OrthogonalInitializer(2.).init(t);
+    int rows = d[0], cols = d[1];
+    if (rows <= cols) {
+      for (int i=0; i < rows; ++i) {
+        for (int j=0; j < rows; ++j) {
+          double s = 0.;
+          for (int k=0; k < cols; ++k) s += t.data[i * cols + k] * t.data[j * cols + k];
+          EXPECT_NEAR(s, i == j ? 4. : 0., 1e-5);
+        }
+      }
+    } else {
+      for (int i=0; i < cols; ++i) {
+        for (int j=0; j < cols; ++j) {
+          double s = 0.;
+          for (int k=0; k < rows; ++k) s += t.data[k * cols + i] * t.data[k * cols + j];
+          EXPECT_NEAR(s, i == j ? 4. : 0., 1e-5);
+        }
+      }
+    }
+  }
+}
+
+TEST_F(InitializerTest, AddParameter) {
+  SGDOptimizer optimizer;
+  UniformInitializer init(-0.5, 0.5);
+  Parameter p = optimizer.add_parameter({20, 20}, kFloat32, "w", &init);
+  for (int i=0; i < 400; ++i) {
+    ASSERT_LE(fabsf(p.value.data[i]), 0.5);
+  }
+}
@@ -0,0 +1,70 @@
+#include <iostream>
+
+#include <gtest/gtest.h>
+
+#include "../src/expr.h"
+#include "../src/graph.h"
+#include "../src/gradcheck.h"
+#include "../src/lazy.h"
+#include "../src/optimizer.h"
+#include "../src/rnnpp.h"
+
+using namespace rnnpp;
+
+
+class LazyTest: public ::testing::Test {
+  protected:
+    void SetUp() {
+      p1 = optimizer.add_parameter({2, 3});
+      p2 = optimizer.add_parameter({2, 3});
+    };
+
+    SGDOptimizer optimizer;
+    Graph g;
+    Parameter p1, p2;
+};
+
+TEST_F(LazyTest, SingleNode) {
+  Expression x = parameter(g, p1);
+  Expression y = parameter(g, p2);
+  int n = g.nodes().size();
+  Expression z = sum(tanh(lazy(x) * lazy(y)) - square(lazy(x)) / 2.f + 1.f, -1);
+  EXPECT_EQ(g.nodes().size(), n + 1);
+  EXPECT_EQ(g.nodes().back()->args.size(), 2);
+}
+
+TEST_F(LazyTest, MatchesUnfused) {
+  Expression x = parameter(g, p1);
+  Expression y = parameter(g, p2);
+  Expression fused = sum(square(lazy(x) - lazy(y)), -1) / 4.f;
+  Expression unfused = sum(squared_distance(x, y), -1) / 4;
+
+  float a = as_scalar(fused.forward());
+  float b = as_scalar(unfused.forward());
+  EXPECT_NEAR(a, b, 1e-5);
+}
+
+TEST_F(LazyTest, ElementwiseGradient) {
+  Expression x = parameter(g, p1);
+  Expression y = parameter(g, p2);
+  Expression z = lazy(x) * sigmoid(lazy(y)) - exp(-lazy(x)) / (2.f + square(lazy(y)));
+  Expression loss = sum(z, -1);
+  EXPECT_TRUE(gradient_check(loss));
+}
+
+TEST_F(LazyTest, SumGradient) {
+  Expression x = parameter(g, p1);
+  Expression y = parameter(g, p2);
+  Expression z = sum(tanh(lazy(x) + lazy(y) * 3.f), -1) * 0.5f;
+  EXPECT_TRUE(gradient_check(z));
+}
+
+TEST_F(LazyTest, SumAlongBatch) {
+  std::vector<float> x_val{1., 2., 3., 4., 5., 6.};
+  Expression x = input(g, Dim({1, 2}, 3), x_val);
+  Expression z = sum(square(lazy(x)), 2) / 3.f;
+  const Tensor &t = z.forward();
+  EXPECT_EQ(t.dim.batch_size, 1);
+  EXPECT_FLOAT_EQ(t(0, 0), (1. + 9. + 25.) / 3.);
+  EXPECT_FLOAT_EQ(t(0, 1), (4. + 16. + 36.) / 3.);
+}
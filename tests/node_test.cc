@@ -1,4 +1,5 @@
 #include <iostream>
+#include <math.h>
 
 #include <gtest/gtest.h>
 
@@ -20,15 +21,19 @@ class GradientTest: public ::testing::Test {
       p2 = optimizer.add_parameter({3, 2});
 
       p3 = optimizer.add_parameter({2, 3});
+
+      p_col = optimizer.add_parameter({2, 1});
+      p_row = optimizer.add_parameter({1, 3});
     };
 
     static Expression to_scalar(const Expression& e) {
       return sum(e, -1);
     }
-    Optimizer optimizer;
+    SGDOptimizer optimizer;
 
     Graph g;
     Parameter p1, p2, p3;
+    Parameter p_col, p_row;
 };
 
 TEST_F(GradientTest, Lookup) {
@@ -41,6 +46,28 @@ TEST_F(GradientTest, Lookup) {
   EXPECT_TRUE(gradient_check(z));
 }
 
+TEST_F(GradientTest, Reuse) {
+  Expression x = parameter(g, p1);
+  Expression y = tanh(x);
+  Expression z = to_scalar(cmult(y, y) + x);
+  EXPECT_TRUE(gradient_check(z));
+}
+
+// Add passes its gradient to both addends, so a later gradient of x must
+// not reach y
+TEST_F(GradientTest, ReuseAddend) {
+  Expression x = parameter(g, p1);
+  Expression y = parameter(g, p3);
+  Expression z = to_scalar(x + y) + to_scalar(tanh(x));
+  z.forward();
+  z.backward();
+  const Tensor &dy = g.grads[y.id()];
+  for (int i=0; i < dy.dim.size(); ++i) {
+    EXPECT_FLOAT_EQ(dy.data[i], 1.f);
+  }
+  EXPECT_TRUE(gradient_check(z));
+}
+
 TEST_F(GradientTest, Concat) {
   Expression x = parameter(g, p1);
   Expression y = parameter(g, p3);
@@ -55,6 +82,34 @@ TEST_F(GradientTest, Add) {
   EXPECT_TRUE(gradient_check(z));
 }
 
+TEST_F(GradientTest, AddBroadcast) {
+  Expression x = parameter(g, p1);
+  Expression b = parameter(g, p_col);
+  Expression z = to_scalar(tanh(x + b));
+  EXPECT_TRUE(gradient_check(z));
+}
+
+TEST_F(GradientTest, AddBroadcastRowCol) {
+  Expression x = parameter(g, p_row);
+  Expression y = parameter(g, p_col);
+  Expression z = to_scalar(tanh(x + y));
+  EXPECT_TRUE(gradient_check(z));
+}
+
+TEST_F(GradientTest, CwiseMult) {
+  Expression x = parameter(g, p1);
+  Expression y = parameter(g, p3);
+  Expression z = to_scalar(cmult(x, y));
+  EXPECT_TRUE(gradient_check(z));
+}
+
+TEST_F(GradientTest, CwiseMultBroadcast) {
+  Expression x = parameter(g, p1);
+  Expression y = parameter(g, p_row);
+  Expression z = to_scalar(tanh(cmult(x, y)));
+  EXPECT_TRUE(gradient_check(z));
+}
+
 TEST_F(GradientTest, Mult) {
   Expression x = parameter(g, p1);
   Expression y = parameter(g, p2);
@@ -69,6 +124,13 @@ TEST_F(GradientTest, Divide) {
   EXPECT_TRUE(gradient_check(z));
 }
 
+TEST_F(GradientTest, DivideBroadcast) {
+  Expression x = parameter(g, p1);
+  Expression y = parameter(g, p_col);
+  Expression z = to_scalar(x / sigmoid(y));
+  EXPECT_TRUE(gradient_check(z));
+}
+
 TEST_F(GradientTest, DivideConst) {
   Expression x = parameter(g, p1);
   Expression z = to_scalar(x / 4);
@@ -87,6 +149,12 @@ TEST_F(GradientTest, Sum) {
   EXPECT_TRUE(gradient_check(z));
 }
 
+TEST_F(GradientTest, SumAxis) {
+  Expression x = parameter(g, p1);
+  Expression z = to_scalar(tanh(sum(x, 1)));
+  EXPECT_TRUE(gradient_check(z));
+}
+
 TEST_F(GradientTest, SquaredDistance) {
   Expression x = parameter(g, p1);
   Expression y = parameter(g, p3);
@@ -94,6 +162,91 @@ TEST_F(GradientTest, SquaredDistance) {
   EXPECT_TRUE(gradient_check(z));
 }
 
+TEST_F(GradientTest, PickNegLogSoftmax) {
+  Expression x = parameter(g, p_col);
+  Expression z = pickneglogsoftmax(x, 1);
+  EXPECT_TRUE(gradient_check(z));
+}
+
+TEST_F(GradientTest, PickNegLogSoftmaxBatch) {
+  std::vector<float> v = {0.5, -1., 2., 0.3, 1., -0.2};
+  Expression x = input(g, Dim({3, 1}, 2), v);
+  Expression y = parameter(g, p1) * x;
+  Expression z = to_scalar(pickneglogsoftmax(y, {0, 1}));
+  EXPECT_TRUE(gradient_check(z));
+}
+
+TEST(PickNegLogSoftmaxTest, Forward) {
+  // large logits overflow a naive softmax
+  std::vector<float> v = {1000., 1001., 999., -50., 0.1, 0.2, 0.3, 0.4, 3., -1e30, 2., 1.};
+  Graph g;
+  Expression x = input(g, Dim({4, 1}, 3), v);
+  Tensor y = pickneglogsoftmax(x, {1, 3, 0}).forward();
+  ASSERT_EQ(y.dim.batch_size, 3);
+  ASSERT_EQ(y.dim.size(), 1);
+  int targets[] = {1, 3, 0};
+  for (int b=0; b < 3; ++b) {
+    double m = -1e300;
+    for (int j=0; j < 4; ++j) m = std::max(m, (double)v[b * 4 + j]);
+    double s = 0.;
+    for (int j=0; j < 4; ++j) s += exp(v[b * 4 + j] - m);
+    EXPECT_NEAR(y.data[b], m + log(s) - v[b * 4 + targets[b]], 1e-4);
+  }
+}
+
+TEST_F(GradientTest, Attention) {
+  // states (T, B, H) = (4, 2, 3) and one query per batch element
+  Parameter p_enc = optimizer.add_parameter({4, 2, 3});
+  Parameter p_q = optimizer.add_parameter({3, 1});
+  std::vector<float> scale = {1., -0.5, 2., 0.7, 1.5, -1.};
+  std::vector<float> out = {0.3, -1., 0.8, 1.2, 0.5, -0.4};
+  Expression q = cmult(parameter(g, p_q), input(g, Dim({3, 1}, 2), scale));
+  Expression c = attention(parameter(g, p_enc), q, {4, 3});
+  Expression z = to_scalar(cmult(c, input(g, Dim({3, 1}, 2), out)));
+  EXPECT_TRUE(gradient_check(z));
+}
+
+TEST_F(GradientTest, AttentionBilinear) {
+  // states (T, H) = (5, 3) shared by both queries (2, 1)
+  Parameter p_enc = optimizer.add_parameter({5, 3});
+  std::vector<float> scale = {1., -0.5, 2., 0.7};
+  std::vector<float> out = {0.3, -1., 0.8, 1.2, 0.5, -0.4};
+  Expression q = cmult(parameter(g, p_col), input(g, Dim({2, 1}, 2), scale));
+  Expression c = attention(parameter(g, p_enc), q, parameter(g, p1), {2, 5});
+  Expression z = to_scalar(cmult(c, input(g, Dim({3, 1}, 2), out)));
+  EXPECT_TRUE(gradient_check(z));
+}
+
+TEST(AttentionTest, Forward) {
+  // long enough for several blocks, with scores far apart
+  const int T = 300, B = 2, H = 64;
+  std::vector<float> e(T * B * H), q(B * H);
+  for (int i=0; i < e.size(); ++i) e[i] = sinf(0.37f * i) + 0.5f * cosf(0.011f * i);
+  for (int i=0; i < q.size(); ++i) q[i] = 3.f * cosf(0.9f * i);
+  std::vector<int> lengths = {T, 170};
+  Graph g;
+  Tensor c = attention(input(g, Dim({T, B, H}), e), input(g, Dim({H, 1}, B), q),
+      lengths).forward();
+  ASSERT_EQ(c.dim.batch_size, B);
+  ASSERT_EQ(c.dim.size(), H);
+  for (int b=0; b < B; ++b) {
+    std::vector<double> s(lengths[b]);
+    double m = -1e300;
+    for (int t=0; t < lengths[b]; ++t) {
+      s[t] = 0.;
+      for (int k=0; k < H; ++k) s[t] += (double)q[b * H + k] * e[(t * B + b) * H + k];
+      m = std::max(m, s[t]);
+    }
+    double z = 0.;
+    for (int t=0; t < lengths[b]; ++t) z += exp(s[t] - m);
+    for (int k=0; k < H; ++k) {
+      double ck = 0.;
+      for (int t=0; t < lengths[b]; ++t) ck += exp(s[t] - m) / z * e[(t * B + b) * H + k];
+      EXPECT_NEAR(c.data[b * H + k], ck, 1e-4);
+    }
+  }
+}
+
 TEST_F(GradientTest, Tanh) {
   Expression x = parameter(g, p1);
   Expression z = to_scalar(tanh(x));
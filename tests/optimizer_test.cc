@@ -0,0 +1,355 @@
+#include <iostream>
+#include <math.h>
+
+#include <gtest/gtest.h>
+
+#include "../src/expr.h"
+#include "../src/graph.h"
+#include "../src/optimizer.h"
+#include "../src/rnnpp.h"
+
+using namespace rnnpp;
+
+
+// Sets known values and gradients on a (37, 3) parameter so that both the
+// vectorized body and the scalar tail of each kernel are exercised.
+class OptimizerTest: public ::testing::Test {
+  protected:
+    void SetUp() {
+      for (int i=0; i < 111; ++i) {
+        w0.push_back(0.01f * (i - 55));
+        g0.push_back(0.02f * ((i * 7) % 13 - 6));
+      }
+    };
+
+    Parameter init(Optimizer &optimizer) {
+      Parameter p = optimizer.add_parameter({37, 3});
+      for (int i=0; i < 111; ++i) {
+        p.value.data[i] = w0[i];
+      }
+      return p;
+    }
+
+    void set_grad(Parameter &p) {
+      for (int i=0; i < 111; ++i) {
+        p.grad.data[i] = g0[i];
+      }
+    }
+
+    std::vector<float> w0;
+    std::vector<float> g0;
+};
+
+TEST_F(OptimizerTest, SGD) {
+  SGDOptimizer optimizer(0.5);
+  Parameter p = init(optimizer);
+  set_grad(p);
+  optimizer.update();
+  for (int i=0; i < 111; ++i) {
+    EXPECT_FLOAT_EQ(p.value.data[i], w0[i] - 0.5f * g0[i]);
+    EXPECT_EQ(p.grad.data[i], 0.f);
+  }
+}
+
+TEST_F(OptimizerTest, SGDMomentum) {
+  SGDOptimizer optimizer(0.5, 0.9);
+  Parameter p = init(optimizer);
+  std::vector<float> w(w0), v(111, 0.f);
+  for (int t=0; t < 3; ++t) {
+    set_grad(p);
+    optimizer.update();
+    for (int i=0; i < 111; ++i) {
+      v[i] = 0.9f * v[i] + g0[i];
+      w[i] -= 0.5f * v[i];
+    }
+  }
+  for (int i=0; i < 111; ++i) {
+    EXPECT_NEAR(p.value.data[i], w[i], 1e-5);
+    EXPECT_EQ(p.grad.data[i], 0.f);
+  }
+}
+
+TEST_F(OptimizerTest, Adam) {
+  AdamOptimizer optimizer(0.01);
+  Parameter p = init(optimizer);
+  std::vector<double> w(w0.begin(), w0.end()), m(111, 0.), v(111, 0.);
+  for (int t=1; t <= 3; ++t) {
+    set_grad(p);
+    optimizer.update();
+    for (int i=0; i < 111; ++i) {
+      m[i] = 0.9 * m[i] + 0.1 * g0[i];
+      v[i] = 0.999 * v[i] + 0.001 * g0[i] * g0[i];
+      double mh = m[i] / (1. - pow(0.9, t));
+      double vh = v[i] / (1. - pow(0.999, t));
+      w[i] -= 0.01 * mh / (sqrt(vh) + 1e-8);
+    }
+  }
+  for (int i=0; i < 111; ++i) {
+    EXPECT_NEAR(p.value.data[i], w[i], 1e-5);
+    EXPECT_EQ(p.grad.data[i], 0.f);
+  }
+}
+
+TEST_F(OptimizerTest, Adagrad) {
+  AdagradOptimizer optimizer(0.1);
+  Parameter p = init(optimizer);
+  std::vector<double> w(w0.begin(), w0.end()), h(111, 0.);
+  for (int t=0; t < 3; ++t) {
+    set_grad(p);
+    optimizer.update();
+    for (int i=0; i < 111; ++i) {
+      h[i] += g0[i] * g0[i];
+      w[i] -= 0.1 * g0[i] / (sqrt(h[i]) + 1e-8);
+    }
+  }
+  for (int i=0; i < 111; ++i) {
+    EXPECT_NEAR(p.value.data[i], w[i], 1e-5);
+  }
+}
+
+TEST_F(OptimizerTest, RMSProp) {
+  RMSPropOptimizer optimizer(0.01, 0.9);
+  Parameter p = init(optimizer);
+  std::vector<double> w(w0.begin(), w0.end()), h(111, 0.);
+  for (int t=0; t < 3; ++t) {
+    set_grad(p);
+    optimizer.update();
+    for (int i=0; i < 111; ++i) {
+      h[i] = 0.9 * h[i] + 0.1 * g0[i] * g0[i];
+      w[i] -= 0.01 * g0[i] / (sqrt(h[i]) + 1e-8);
+    }
+  }
+  for (int i=0; i < 111; ++i) {
+    EXPECT_NEAR(p.value.data[i], w[i], 1e-5);
+  }
+}
+
+TEST_F(OptimizerTest, AdamHalf) {
+  AdamOptimizer optimizer(0.01);
+  Parameter p = optimizer.add_parameter({37, 3}, kBFloat16);
+  p.write(w0.data());
+  set_grad(p);
+  optimizer.update();
+
+  std::vector<float> w(111);
+  p.read(w.data());
+  for (int i=0; i < 111; ++i) {
+    // the first Adam step moves each weight by lr * sign(g)
+    float expected = w0[i] - (g0[i] > 0 ? 0.01f : g0[i] < 0 ? -0.01f : 0.f);
+    EXPECT_NEAR(w[i], expected, 4e-3);
+    EXPECT_EQ(p.grad.data[i], 0.f);
+  }
+}
+
+// Rows of a lookup parameter are updated only when touched. After every
+// row has been touched again they must agree with a dense parameter that
+// saw zero gradients in between.
+void check_lazy(Optimizer &dense, Optimizer &sparse) {
+  Parameter p = dense.add_parameter({10, 11});
+  LookupParameter lp = sparse.add_lookup_parameter({10, 11});
+  for (int i=0; i < 110; ++i) {
+    p.value.data[i] = lp.all_values.data[i];
+  }
+  std::vector<float> w0(lp.all_values.data, lp.all_values.data + 110);
+
+  std::vector<std::vector<int>> rows{{2, 5}, {}, {2}, {}, {}};
+  for (int t=0; t < rows.size(); ++t) {
+    for (int r : rows[t]) {
+      for (int j=0; j < 11; ++j) {
+        p.grad.data[r * 11 + j] = 0.1f * (j - r);
+        lp.grad(r).data[j] = 0.1f * (j - r);
+      }
+      lp.touch(r);
+    }
+    dense.update();
+    sparse.update();
+  }
+
+  // rows that were never touched keep their values
+  EXPECT_EQ(lp.all_values.data[0], w0[0]);
+  EXPECT_EQ(lp.all_values.data[9 * 11], w0[9 * 11]);
+
+  for (int r=0; r < 10; ++r) {
+    lp.touch(r);
+  }
+  dense.update();
+  sparse.update();
+  for (int i=0; i < 110; ++i) {
+    EXPECT_NEAR(lp.all_values.data[i], p.value.data[i], 1e-5);
+    EXPECT_EQ(lp.all_grads.data[i], 0.f);
+  }
+  EXPECT_EQ(lp.touched->size(), 0);
+}
+
+TEST_F(OptimizerTest, LookupSGDMomentum) {
+  SGDOptimizer dense(0.5, 0.9), sparse(0.5, 0.9);
+  check_lazy(dense, sparse);
+}
+
+TEST_F(OptimizerTest, LookupAdagrad) {
+  AdagradOptimizer dense, sparse;
+  check_lazy(dense, sparse);
+}
+
+TEST_F(OptimizerTest, LookupRMSProp) {
+  RMSPropOptimizer dense(0.01), sparse(0.01);
+  check_lazy(dense, sparse);
+}
+
+TEST_F(OptimizerTest, LookupBackward) {
+  SGDOptimizer optimizer(1.);
+  LookupParameter lp = optimizer.add_lookup_parameter({4, 3});
+  std::vector<float> w0(lp.all_values.data, lp.all_values.data + 12);
+
+  Graph g;
+  Expression e = sum(lookup(g, lp, 1) + lookup(g, lp, 1), -1);
+  e.forward();
+  e.backward();
+  ASSERT_EQ(lp.touched->size(), 1);
+  optimizer.update();
+
+  for (int i=0; i < 12; ++i) {
+    float expected = i / 3 == 1 ? w0[i] - 2.f : w0[i];
+    EXPECT_FLOAT_EQ(lp.all_values.data[i], expected);
+  }
+}
+
+TEST_F(OptimizerTest, BatchedLookup) {
+  SGDOptimizer optimizer(1.);
+  LookupParameter lp = optimizer.add_lookup_parameter({5, 3});
+  std::vector<int> indices = {3, 0, 3, 4};
+
+  Graph g;
+  Expression x = lookup(g, lp, indices);
+  Tensor y = x.forward();
+  ASSERT_EQ(g.nodes().size(), 1);
+  ASSERT_EQ(y.dim.batch_size, 4);
+  for (int b=0; b < 4; ++b) {
+    for (int k=0; k < 3; ++k) {
+      EXPECT_EQ(y.data[b * 3 + k], lp.value(indices[b]).data[k]);
+    }
+  }
+}
+
+TEST_F(OptimizerTest, BatchedLookupBackward) {
+  SGDOptimizer optimizer(1.);
+  LookupParameter lp = optimizer.add_lookup_parameter({5, 3});
+  std::vector<float> w0(lp.all_values.data, lp.all_values.data + 15);
+
+  Graph g;
+  Expression e = sum(lookup(g, lp, {3, 0, 3, 4, 3}), -1);
+  e.forward();
+  e.backward();
+  ASSERT_EQ(lp.touched->size(), 3);
+  optimizer.update();
+
+  float counts[5] = {1, 0, 0, 3, 1};
+  for (int i=0; i < 15; ++i) {
+    EXPECT_FLOAT_EQ(lp.all_values.data[i], w0[i] - counts[i / 3]);
+  }
+}
+
+// bags {1, 3, 1}, {0}, {}, {2, 4} of a (5, 3) table
+static void check_embedding_bag(BagMode mode) {
+  SGDOptimizer optimizer(1.);
+  LookupParameter lp = optimizer.add_lookup_parameter({5, 3});
+  std::vector<float> w0(lp.all_values.data, lp.all_values.data + 15);
+  std::vector<int> indices = {1, 3, 1, 0, 2, 4};
+  std::vector<int> offsets = {0, 3, 4, 4};
+  std::vector<int> ends = {3, 4, 4, 6};
+
+  Graph g;
+  Expression x = embedding_bag(g, lp, indices, offsets, mode);
+  Expression e = sum(x, -1);
+  e.forward();
+  const Tensor &y = g.outputs[x.id()];
+  ASSERT_EQ(g.nodes().size(), 2);
+  ASSERT_EQ(y.dim.batch_size, 4);
+
+  std::vector<float> expected_w(w0);
+  for (int b=0; b < 4; ++b) {
+    int count = ends[b] - offsets[b];
+    for (int k=0; k < 3; ++k) {
+      float r = mode == kBagMax ? -INFINITY : 0.f;
+      int best = -1;
+      for (int j=offsets[b]; j < ends[b]; ++j) {
+        float v = w0[indices[j] * 3 + k];
+        if (mode != kBagMax) {
+          r += v;
+        } else if (v > r) {
+          r = v;
+          best = indices[j];
+        }
+      }
+      if (count == 0) r = 0.f;
+      if (mode == kBagMean && count > 0) r /= count;
+      EXPECT_FLOAT_EQ(y.data[b * 3 + k], r);
+
+      if (mode == kBagMax) {
+        if (best >= 0) expected_w[best * 3 + k] -= 1.f;
+      } else {
+        for (int j=offsets[b]; j < ends[b]; ++j) {
+          expected_w[indices[j] * 3 + k] -= mode == kBagMean ? 1.f / count : 1.f;
+        }
+      }
+    }
+  }
+
+  e.backward();
+  optimizer.update();
+  for (int i=0; i < 15; ++i) {
+    EXPECT_FLOAT_EQ(lp.all_values.data[i], expected_w[i]);
+  }
+}
+
+TEST_F(OptimizerTest, EmbeddingBagSum) {
+  check_embedding_bag(kBagSum);
+}
+
+TEST_F(OptimizerTest, EmbeddingBagMean) {
+  check_embedding_bag(kBagMean);
+}
+
+TEST_F(OptimizerTest, EmbeddingBagMax) {
+  check_embedding_bag(kBagMax);
+}
+
+TEST_F(OptimizerTest, MixedCollection) {
+  AdagradOptimizer optimizer(0.1);
+  Parameter p1 = optimizer.add_parameter({3, 3});
+  Parameter p2 = optimizer.add_parameter({2, 5});
+  LookupParameter lp = optimizer.add_lookup_parameter({4, 3});
+  Parameter p3 = optimizer.add_parameter({5, 1}, kBFloat16);
+  Parameter p4 = optimizer.add_parameter({1, 7});
+
+  std::vector<Parameter> ps{p1, p2, p4};
+  std::vector<std::vector<float>> w0;
+  for (auto &p : ps) {
+    w0.push_back(std::vector<float>(p.value.data, p.value.data + p.value.dim.size()));
+    p.grad = Scalar(0.5);
+  }
+  optimizer.update();
+
+  // each element moves by lr * g / |g| on the first step
+  for (int k=0; k < ps.size(); ++k) {
+    for (int i=0; i < ps[k].value.dim.size(); ++i) {
+      EXPECT_NEAR(ps[k].value.data[i], w0[k][i] - 0.1f, 1e-6);
+      EXPECT_EQ(ps[k].grad.data[i], 0.f);
+    }
+  }
+  // padding between parameters stays zero
+  EXPECT_EQ(optimizer.model.values()[9], 0.f);
+  EXPECT_EQ(optimizer.model.grads()[9], 0.f);
+}
+
+TEST_F(OptimizerTest, Capacity) {
+  SGDOptimizer large(0.1, 0., 1ULL << 30);
+  EXPECT_EQ(large.model.capacity(), 1ULL << 30);
+
+  AdamOptimizer small(0.001, 0.9, 0.999, 1e-8, 1000);
+  EXPECT_EQ(small.model.capacity(), 1000);
+  Parameter p = init(small);
+  set_grad(p);
+  small.update();
+  EXPECT_THROW(small.add_parameter({40, 30}), std::runtime_error);
+}
@@ -1,4 +1,6 @@
 #include <iostream>
+#include <math.h>
+#include <sys/mman.h>
 
 #include <gtest/gtest.h>
 
@@ -32,3 +34,112 @@ TEST_F(ParameterTest, InitLookupParameter) {
 }
 
 
+
+TEST_F(ParameterTest, CollectionLayout) {
+  ParameterCollection model;
+  Parameter p1 = model.add_parameter(Dim({3, 5}));
+  LookupParameter lp = model.add_lookup_parameter(Dim({4, 2}));
+  Parameter p2 = model.add_parameter(Dim({7, 1}), kFloat16);
+
+  EXPECT_EQ(p1.value.data, model.values());
+  EXPECT_EQ(p1.grad.data, model.grads());
+  EXPECT_EQ(lp.all_values.data, model.values() + 16);
+  EXPECT_EQ(lp.all_grads.data, model.grads() + 16);
+  EXPECT_EQ(reinterpret_cast<float*>(p2.packed), model.values() + 32);
+  EXPECT_EQ(p2.grad.data, model.grads() + 32);
+  EXPECT_EQ(model.values_size(), 48);
+  EXPECT_EQ(model.grads_size(), 48);
+  EXPECT_EQ((size_t)model.values() % 64, 0);
+
+  ASSERT_EQ(model.parameters.size(), 2);
+  ASSERT_EQ(model.lookup_parameters.size(), 1);
+  EXPECT_EQ(model.parameters[1].packed, p2.packed);
+}
+
+TEST_F(ParameterTest, CollectionGrads) {
+  ParameterCollection model;
+  Parameter p1 = model.add_parameter(Dim({3, 5}));
+  Parameter p2 = model.add_parameter(Dim({2, 2}));
+  EXPECT_EQ(model.grad_norm(), 0.);
+
+  p1.grad = Scalar(1.);
+  p2.grad = Scalar(2.);
+  EXPECT_FLOAT_EQ(model.grad_norm(), sqrtf(15. + 16.));
+
+  model.zero_grads();
+  for (int i=0; i < 15; ++i) {
+    EXPECT_EQ(p1.grad.data[i], 0.);
+  }
+  EXPECT_EQ(model.grad_norm(), 0.);
+}
+
+TEST_F(ParameterTest, CollectionCapacity) {
+  // pages are made accessible as parameters are added, across page
+  // boundaries and up to the capacity
+  ParameterCollection model(10000);
+  Parameter p1 = model.add_parameter(Dim({3000, 1}));
+  LookupParameter lp = model.add_lookup_parameter(Dim({100, 50}));
+  Parameter p2 = model.add_parameter(Dim({1000, 1}));
+  for (int i=0; i < 3000; ++i) {
+    p1.value.data[i] = i;
+    p1.grad.data[i] = -i;
+  }
+  for (int i=0; i < 5000; ++i) {
+    lp.all_values.data[i] = 2 * i;
+    lp.all_grads.data[i] = 0.;
+  }
+  p2.value.data[999] = 1.;
+  p2.grad.data[999] = 1.;
+  EXPECT_EQ(p1.value.data[2999], 2999.);
+  EXPECT_EQ(lp.all_values.data[4999], 9998.);
+
+  EXPECT_THROW(model.add_parameter(Dim({1000, 1})), std::runtime_error);
+  EXPECT_EQ(model.parameters.size(), 2);
+}
+
+// leaves the values as they are, here untouched and unbacked
+class NoInitializer: public Initializer {
+  public:
+    void init(Tensor &t) {}
+};
+
+TEST_F(ParameterTest, CollectionPastIntRange) {
+  // a (10000000, 300) table has 3e9 elements, more than an int holds
+  const int rows = 10000000, dim_emb = 300;
+  ParameterCollection model(1ULL << 32);
+  Parameter p = model.add_parameter(Dim({3, 5}));
+  NoInitializer none;
+  LookupParameter lp = model.add_lookup_parameter(Dim({rows, dim_emb}), kFloat32,
+      "big", &none);
+  EXPECT_EQ(lp.all_values.data, model.values() + 16);
+  EXPECT_EQ(model.values_size(), 16 + 3000000000ULL);
+  EXPECT_EQ(model.grads_size(), 16 + 3000000000ULL);
+
+  std::vector<float> out(dim_emb);
+  for (int k=0; k < dim_emb; ++k) {
+    lp.value(rows - 1).data[k] = k;
+  }
+  lp.read_row(rows - 1, out.data());
+  EXPECT_EQ(out[dim_emb - 1], dim_emb - 1);
+  EXPECT_EQ(model.values()[model.values_size() - 1], dim_emb - 1);
+}
+
+TEST_F(ParameterTest, ReadRowPastIntRange) {
+  // rows of a (7200000, 300) half table start past 2^31 elements from
+  // row 7158279 on; only the pages written are backed
+  const int rows = 7200000, dim_emb = 300;
+  size_t bytes = (size_t)rows * dim_emb * sizeof(uint16_t);
+  void *m = mmap(nullptr, bytes, PROT_READ | PROT_WRITE,
+      MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+  ASSERT_NE(m, MAP_FAILED);
+  LookupParameter lp(Dim({rows, dim_emb}), kFloat16, static_cast<float*>(m), nullptr);
+
+  std::vector<float> row(dim_emb), out(dim_emb);
+  for (int k=0; k < dim_emb; ++k) {
+    row[k] = 0.25f * (k % 7);
+  }
+  encode(row.data(), lp.packed + (size_t)(rows - 1) * dim_emb, dim_emb, kFloat16);
+  lp.read_row(rows - 1, out.data());
+  EXPECT_EQ(out, row);
+  munmap(m, bytes);
+}
@@ -0,0 +1,112 @@
+#include <iostream>
+#include <math.h>
+
+#include <gtest/gtest.h>
+
+#include "../src/graph.h"
+#include "../src/optimizer.h"
+#include "../src/quantize.h"
+#include "../src/rnnpp.h"
+#include "../src/tensor.h"
+
+using namespace rnnpp;
+
+
+class QuantizeTest: public ::testing::Test {
+  protected:
+    void SetUp() {
+      std::vector<float> w_data;
+      for (int i=0; i < 3 * 70; ++i) w_data.push_back(sinf(i * 0.7f));
+      w = Tensor(Dim({3, 70}), w_data);
+
+      std::vector<float> x_data;
+      for (int i=0; i < 70 * 2 * 2; ++i) x_data.push_back(cosf(i * 0.3f));
+      x = Tensor(Dim({70, 2}, 2), x_data);
+    };
+
+    Tensor w, x;
+};
+
+TEST_F(QuantizeTest, QuantizeRows) {
+  QuantizedTensor q(w.dim);
+  quantize_rows(w.data, 3, 70, q);
+
+  std::vector<float> row(70);
+  for (int r=0; r < 3; ++r) {
+    dequantize_row(q, r, row.data());
+    int s = 0;
+    for (int c=0; c < 70; ++c) {
+      EXPECT_NEAR(row[c], w(r, c), q.scales[r] * 0.5f + 1e-6);
+      s += q.data[r * 70 + c];
+    }
+    EXPECT_EQ(q.row_sums[r], s);
+  }
+}
+
+TEST_F(QuantizeTest, DotU8S8) {
+  std::vector<uint8_t> a(131);
+  std::vector<int8_t> b(131);
+  int32_t expected = 0;
+  for (int i=0; i < 131; ++i) {
+    a[i] = (i * 37) % 256;
+    b[i] = (i * 11) % 255 - 127;
+    expected += a[i] * b[i];
+  }
+  EXPECT_EQ(dot_u8s8(a.data(), b.data(), 131), expected);
+  EXPECT_EQ(dot_u8s8(a.data(), b.data(), 5), expected - dot_u8s8(a.data() + 5, b.data() + 5, 126));
+}
+
+TEST_F(QuantizeTest, MatmulInt8) {
+  QuantizedTensor q(w.dim);
+  quantize_rows(w.data, 3, 70, q);
+
+  std::vector<float> bias_data{0.5, -1., 2.};
+  Tensor bias(Dim({3, 1}), bias_data);
+
+  Tensor ref;
+  ref.dim = Dim({3, 2}, 2);
+  ref.data = new float[ref.dim.size() * ref.dim.batch_size];
+  matmul(w, x, ref);
+
+  Tensor res;
+  res.dim = Dim({3, 2}, 2);
+  res.data = new float[res.dim.size() * res.dim.batch_size];
+  matmul_int8(q, x, &bias, kTanh, res);
+
+  for (int i=0; i < res.dim.size() * res.dim.batch_size; ++i) {
+    float expected = tanhf(ref.data[i] + bias_data[(i % 6) / 2]);
+    EXPECT_NEAR(res.data[i], expected, 0.05);
+  }
+}
+
+TEST_F(QuantizeTest, Affine) {
+  Graph g;
+  SGDOptimizer optimizer;
+  Parameter p_w = optimizer.add_parameter({4, 3});
+  Parameter p_b = optimizer.add_parameter({4, 1});
+  QuantizedParameter q_w = quantize(p_w);
+
+  std::vector<float> x_val{1., -0.5, 0.25};
+  Expression x = input(g, Dim({3, 1}), x_val);
+  Expression b = parameter(g, p_b);
+  Expression y = sigmoid(parameter(g, p_w) * x + b);
+  Expression yq = affine(q_w, x, b, kSigmoid);
+
+  Tensor expected = y.forward();
+  Tensor actual = yq.forward();
+  for (int i=0; i < 4; ++i) {
+    EXPECT_NEAR(actual.data[i], expected.data[i], 0.02);
+  }
+}
+
+TEST_F(QuantizeTest, Lookup) {
+  Graph g;
+  LookupParameter lp(Dim({5, 8}));
+  QuantizedLookupParameter q = quantize(lp);
+
+  Expression e = lookup(g, q, 3);
+  const Tensor &t = e.forward();
+  for (int i=0; i < 8; ++i) {
+    EXPECT_NEAR(t.data[i], lp.value(3).data[i], q.all_values.scales[3] * 0.5f + 1e-6);
+  }
+}
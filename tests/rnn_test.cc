@@ -0,0 +1,364 @@
+#include <iostream>
+#include <math.h>
+
+#include <gtest/gtest.h>
+
+#include "../src/expr.h"
+#include "../src/gradcheck.h"
+#include "../src/graph.h"
+#include "../src/optimizer.h"
+#include "../src/rnn.h"
+#include "../src/rnnpp.h"
+
+using namespace rnnpp;
+
+static double sigmoid_ref(double x) {
+  return 1. / (1. + exp(-x));
+}
+
+class RNNTest: public ::testing::Test {
+  protected:
+    void SetUp() {
+      for (int t=0; t < n_steps; ++t) {
+        std::vector<float> x;
+        for (int i=0; i < n_in * n_batch; ++i) {
+          x.push_back(0.3f * sin(1.7f * i + t) - 0.1f);
+        }
+        xs.push_back(x);
+      }
+    }
+
+    static Expression to_scalar(const Expression &e) {
+      return sum(e, -1);
+    }
+
+    const int n_in = 3;
+    const int n_hidden = 4;
+    const int n_steps = 3;
+    const int n_batch = 2;
+    std::vector<std::vector<float>> xs;
+    SGDOptimizer optimizer;
+    Graph g;
+};
+
+TEST_F(RNNTest, LSTMForward) {
+  LSTMBuilder lstm(optimizer.model, n_in, n_hidden);
+  int D = n_in, H = n_hidden;
+  for (int k=0; k < 4 * H; ++k) {
+    lstm.b.value.data[k] = 0.1 * k - 0.7;
+  }
+
+  lstm.start_new_sequence(g, n_batch);
+  Expression h;
+  for (int t=0; t < n_steps; ++t) {
+    h = lstm.add_input(input(g, Dim({n_in, 1}, n_batch), xs[t]));
+  }
+  Tensor y = h.forward();
+  ASSERT_EQ(y.dim.batch_size, n_batch);
+  ASSERT_EQ(y.dim[0], H);
+
+  const float *w = lstm.w.value.data;
+  const float *bias = lstm.b.value.data;
+  for (int b=0; b < n_batch; ++b) {
+    std::vector<double> hr(H, 0.), cr(H, 0.);
+    for (int t=0; t < n_steps; ++t) {
+      std::vector<double> a(4 * H);
+      for (int j=0; j < 4 * H; ++j) {
+        a[j] = bias[j];
+        for (int k=0; k < D; ++k) a[j] += w[j * (D + H) + k] * xs[t][b * D + k];
+        for (int k=0; k < H; ++k) a[j] += w[j * (D + H) + D + k] * hr[k];
+      }
+      for (int k=0; k < H; ++k) {
+        cr[k] = sigmoid_ref(a[H + k]) * cr[k] + sigmoid_ref(a[k]) * tanh(a[2 * H + k]);
+        hr[k] = sigmoid_ref(a[3 * H + k]) * tanh(cr[k]);
+      }
+    }
+    for (int k=0; k < H; ++k) {
+      EXPECT_NEAR(y.data[b * H + k], hr[k], 1e-5);
+    }
+  }
+}
+
+TEST_F(RNNTest, LSTMGradient) {
+  LSTMBuilder lstm(optimizer.model, n_in, n_hidden);
+  lstm.start_new_sequence(g);
+  Expression h;
+  for (int t=0; t < n_steps; ++t) {
+    h = lstm.add_input(input(g, Dim({n_in, 1}), xs[t]));
+  }
+  Expression z = to_scalar(h);
+  EXPECT_TRUE(gradient_check(z));
+}
+
+TEST_F(RNNTest, GRUForward) {
+  GRUBuilder gru(optimizer.model, n_in, n_hidden);
+  int D = n_in, H = n_hidden;
+  for (int k=0; k < 3 * H; ++k) {
+    gru.bx.value.data[k] = 0.1 * k - 0.5;
+    gru.bh.value.data[k] = 0.3 - 0.05 * k;
+  }
+
+  gru.start_new_sequence(g, n_batch);
+  Expression h;
+  for (int t=0; t < n_steps; ++t) {
+    h = gru.add_input(input(g, Dim({n_in, 1}, n_batch), xs[t]));
+  }
+  Tensor y = h.forward();
+  ASSERT_EQ(y.dim.batch_size, n_batch);
+  ASSERT_EQ(y.dim[0], H);
+
+  const float *wx = gru.wx.value.data;
+  const float *wh = gru.wh.value.data;
+  for (int b=0; b < n_batch; ++b) {
+    std::vector<double> hr(H, 0.);
+    for (int t=0; t < n_steps; ++t) {
+      std::vector<double> ax(3 * H), ah(3 * H);
+      for (int j=0; j < 3 * H; ++j) {
+        ax[j] = gru.bx.value.data[j];
+        ah[j] = gru.bh.value.data[j];
+        for (int k=0; k < D; ++k) ax[j] += wx[j * D + k] * xs[t][b * D + k];
+        for (int k=0; k < H; ++k) ah[j] += wh[j * H + k] * hr[k];
+      }
+      for (int k=0; k < H; ++k) {
+        double r = sigmoid_ref(ax[k] + ah[k]);
+        double z = sigmoid_ref(ax[H + k] + ah[H + k]);
+        double n = tanh(ax[2 * H + k] + r * ah[2 * H + k]);
+        hr[k] = (1. - z) * n + z * hr[k];
+      }
+    }
+    for (int k=0; k < H; ++k) {
+      EXPECT_NEAR(y.data[b * H + k], hr[k], 1e-5);
+    }
+  }
+}
+
+TEST_F(RNNTest, GRUGradient) {
+  GRUBuilder gru(optimizer.model, n_in, n_hidden);
+  for (int k=0; k < 3 * n_hidden; ++k) {
+    gru.bh.value.data[k] = 0.2 - 0.03 * k;
+  }
+  gru.start_new_sequence(g);
+  Expression h;
+  for (int t=0; t < n_steps; ++t) {
+    h = gru.add_input(input(g, Dim({n_in, 1}), xs[t]));
+  }
+  Expression z = to_scalar(h);
+  EXPECT_TRUE(gradient_check(z));
+}
+
+TEST_F(RNNTest, GRUSequence) {
+  GRUBuilder gru(optimizer.model, n_in, n_hidden);
+  int H = n_hidden;
+  for (int k=0; k < 3 * H; ++k) {
+    gru.bh.value.data[k] = 0.2 - 0.03 * k;
+  }
+  std::vector<float> seq;
+  for (int t=0; t < n_steps; ++t) {
+    seq.insert(seq.end(), xs[t].begin(), xs[t].end());
+  }
+
+  gru.start_new_sequence(g, n_batch);
+  Expression h;
+  for (int t=0; t < n_steps; ++t) {
+    h = gru.add_input(input(g, Dim({n_in, 1}, n_batch), xs[t]));
+  }
+  Tensor y_step = h.forward();
+
+  Graph g2;
+  gru.start_new_sequence(g2, n_batch);
+  Expression ys = gru.transduce(input(g2, Dim({n_steps, n_batch, n_in}), seq));
+  Tensor y = ys.forward();
+  ASSERT_EQ(y.dim[0], n_steps);
+  ASSERT_EQ(y.dim[1], n_batch);
+  ASSERT_EQ(y.dim[2], H);
+  for (int j=0; j < n_batch * H; ++j) {
+    EXPECT_NEAR(y.data[(n_steps - 1) * n_batch * H + j], y_step.data[j], 1e-6);
+  }
+}
+
+TEST_F(RNNTest, GRUSequenceGradient) {
+  GRUBuilder gru(optimizer.model, n_in, n_hidden);
+  for (int k=0; k < 3 * n_hidden; ++k) {
+    gru.bh.value.data[k] = 0.2 - 0.03 * k;
+  }
+  std::vector<float> seq;
+  for (int t=0; t < n_steps; ++t) {
+    seq.insert(seq.end(), xs[t].begin(), xs[t].end());
+  }
+  // xs is a parameter so that its gradient is checked too
+  Parameter p = optimizer.add_parameter({n_steps, n_batch, n_in});
+  std::copy(seq.begin(), seq.end(), p.value.data);
+  gru.start_new_sequence(g, n_batch);
+  Expression ys = gru.transduce(parameter(g, p));
+  Expression z = to_scalar(tanh(ys));
+  EXPECT_TRUE(gradient_check(z));
+}
+
+// states (T, B, H) of one GRU direction over xs (T, B, D) from zero
+static std::vector<double> gru_ref(const GRUBuilder &gru, const std::vector<double> &xs,
+    int T, int B, bool reverse) {
+  int D = gru.input_dim, H = gru.hidden_dim;
+  const float *wx = gru.wx.value.data, *wh = gru.wh.value.data;
+  const float *bx = gru.bx.value.data, *bh = gru.bh.value.data;
+  std::vector<double> ys((size_t)T * B * H);
+  for (int b=0; b < B; ++b) {
+    std::vector<double> h(H, 0.);
+    for (int s=0; s < T; ++s) {
+      int t = reverse ? T - 1 - s : s;
+      const double *x = &xs[((size_t)t * B + b) * D];
+      std::vector<double> ax(3 * H), ah(3 * H);
+      for (int j=0; j < 3 * H; ++j) {
+        ax[j] = bx[j];
+        ah[j] = bh[j];
+        for (int k=0; k < D; ++k) ax[j] += wx[j * D + k] * x[k];
+        for (int k=0; k < H; ++k) ah[j] += wh[j * H + k] * h[k];
+      }
+      for (int k=0; k < H; ++k) {
+        double r = sigmoid_ref(ax[k] + ah[k]);
+        double z = sigmoid_ref(ax[H + k] + ah[H + k]);
+        double n = tanh(ax[2 * H + k] + r * ah[2 * H + k]);
+        h[k] = (1. - z) * n + z * h[k];
+        ys[((size_t)t * B + b) * H + k] = h[k];
+      }
+    }
+  }
+  return ys;
+}
+
+TEST_F(RNNTest, StackedGRUForward) {
+  const int n_layers = 3;
+  for (bool bidirectional : {false, true}) {
+    StackedGRUBuilder rnn(optimizer.model, n_layers, n_in, n_hidden, bidirectional, 2);
+    int n_dirs = bidirectional ? 2 : 1;
+    for (auto &c : rnn.cells) {
+      for (int k=0; k < 3 * n_hidden; ++k) {
+        c.bh.value.data[k] = 0.2 - 0.03 * k;
+      }
+    }
+    std::vector<float> seq;
+    for (int t=0; t < n_steps; ++t) {
+      seq.insert(seq.end(), xs[t].begin(), xs[t].end());
+    }
+
+    Graph g;
+    Tensor y = rnn.transduce(input(g, Dim({n_steps, n_batch, n_in}), seq)).forward();
+    int Y = n_dirs * n_hidden;
+    ASSERT_EQ(y.dim[2], Y);
+
+    std::vector<double> x(seq.begin(), seq.end());
+    for (int l=0; l < n_layers; ++l) {
+      std::vector<double> next((size_t)n_steps * n_batch * Y);
+      for (int d=0; d < n_dirs; ++d) {
+        std::vector<double> h = gru_ref(rnn.cells[l * n_dirs + d], x, n_steps, n_batch, d == 1);
+        for (size_t i=0; i < (size_t)n_steps * n_batch; ++i) {
+          for (int k=0; k < n_hidden; ++k) {
+            next[i * Y + d * n_hidden + k] = h[i * n_hidden + k];
+          }
+        }
+      }
+      x = next;
+    }
+    for (int i=0; i < x.size(); ++i) {
+      EXPECT_NEAR(y.data[i], x[i], 1e-5);
+    }
+  }
+}
+
+TEST_F(RNNTest, StackedGRUGradient) {
+  StackedGRUBuilder rnn(optimizer.model, 2, n_in, n_hidden, true, 2);
+  Parameter p = optimizer.add_parameter({n_steps, n_batch, n_in});
+  for (int t=0; t < n_steps; ++t) {
+    std::copy(xs[t].begin(), xs[t].end(), p.value.data + t * n_in * n_batch);
+  }
+  Expression z = to_scalar(tanh(rnn.transduce(parameter(g, p))));
+  EXPECT_TRUE(gradient_check(z));
+}
+
+TEST_F(RNNTest, StackedGRUThreads) {
+  // each step is computed the same way on any number of threads
+  StackedGRUBuilder rnn(optimizer.model, 3, n_in, n_hidden, true);
+  Parameter p = optimizer.add_parameter({n_steps, n_batch, n_in});
+  for (int t=0; t < n_steps; ++t) {
+    std::copy(xs[t].begin(), xs[t].end(), p.value.data + t * n_in * n_batch);
+  }
+  std::vector<std::vector<float>> grads;
+  for (int nt : {1, 4}) {
+    rnn.num_threads = nt;
+    optimizer.model.zero_grads();
+    Graph g;
+    Expression z = to_scalar(tanh(rnn.transduce(parameter(g, p))));
+    z.forward();
+    z.backward();
+    grads.push_back(std::vector<float>(optimizer.model.grads(),
+          optimizer.model.grads() + optimizer.model.grads_size()));
+  }
+  EXPECT_EQ(grads[0], grads[1]);
+}
+
+static std::vector<std::vector<float>> ragged_sequences(int dim) {
+  std::vector<std::vector<float>> seqs;
+  for (int len : {2, 5, 1, 5, 3}) {
+    std::vector<float> s;
+    for (int i=0; i < len * dim; ++i) {
+      s.push_back(0.4f * cos(0.9f * i + len) - 0.05f);
+    }
+    seqs.push_back(s);
+  }
+  return seqs;
+}
+
+TEST_F(RNNTest, PackSequences) {
+  std::vector<std::vector<float>> seqs = ragged_sequences(n_in);
+  PackedSequences p = pack_sequences(seqs, n_in);
+  EXPECT_EQ(p.order, std::vector<int>({1, 3, 4, 0, 2}));
+  EXPECT_EQ(p.batch_sizes, std::vector<int>({5, 4, 3, 2, 2}));
+  EXPECT_EQ(p.n_tokens(), 16);
+  for (int t=0; t < p.batch_sizes.size(); ++t) {
+    for (int b=0; b < p.batch_sizes[t]; ++b) {
+      for (int k=0; k < n_in; ++k) {
+        EXPECT_EQ(p.data[(p.offsets[t] + b) * n_in + k], seqs[p.order[b]][t * n_in + k]);
+      }
+    }
+  }
+}
+
+TEST_F(RNNTest, GRUPacked) {
+  GRUBuilder gru(optimizer.model, n_in, n_hidden);
+  for (int k=0; k < 3 * n_hidden; ++k) {
+    gru.bh.value.data[k] = 0.2 - 0.03 * k;
+  }
+  std::vector<std::vector<float>> seqs = ragged_sequences(n_in);
+  PackedSequences p = pack_sequences(seqs, n_in);
+
+  gru.start_new_sequence(g);
+  Tensor y = gru.transduce(input(g, Dim({n_in, 1}, p.n_tokens()), p.data),
+      p.batch_sizes).forward();
+  ASSERT_EQ(y.dim[0], n_hidden);
+  ASSERT_EQ(y.dim.batch_size, p.n_tokens());
+
+  // every sequence on its own
+  for (int b=0; b < seqs.size(); ++b) {
+    std::vector<double> x(seqs[p.order[b]].begin(), seqs[p.order[b]].end());
+    int len = x.size() / n_in;
+    std::vector<double> h = gru_ref(gru, x, len, 1, false);
+    for (int t=0; t < len; ++t) {
+      for (int k=0; k < n_hidden; ++k) {
+        EXPECT_NEAR(y.data[(p.offsets[t] + b) * n_hidden + k], h[t * n_hidden + k], 1e-5);
+      }
+    }
+  }
+}
+
+TEST_F(RNNTest, GRUPackedGradient) {
+  GRUBuilder gru(optimizer.model, n_in, n_hidden);
+  for (int k=0; k < 3 * n_hidden; ++k) {
+    gru.bh.value.data[k] = 0.2 - 0.03 * k;
+  }
+  PackedSequences p = pack_sequences(ragged_sequences(n_in), n_in);
+  // a projection of the input checks the gradient of xs
+  Parameter w_in = optimizer.add_parameter({n_in, n_in});
+  gru.start_new_sequence(g, p.batch_sizes[0]);
+  Expression xs = parameter(g, w_in) * input(g, Dim({n_in, 1}, p.n_tokens()), p.data);
+  Expression z = to_scalar(tanh(gru.transduce(xs, p.batch_sizes)));
+  EXPECT_TRUE(gradient_check(z));
+}
@@ -0,0 +1,198 @@
+#include <math.h>
+
+#include <algorithm>
+
+#include <gtest/gtest.h>
+
+#include "../src/expr.h"
+#include "../src/graph.h"
+#include "../src/optimizer.h"
+#include "../src/rnnpp.h"
+#include "../src/softmax.h"
+
+using namespace rnnpp;
+
+static float total(const Tensor &t) {
+  float s = 0.;
+  for (int i=0; i < t.dim.batch_size; ++i) s += t.data[i];
+  return s;
+}
+
+// central differences of the summed loss against backward, for every
+// value of the inputs xs viewing vs
+static void check_gradients(Expression &loss, const std::vector<Expression> &xs,
+    const std::vector<std::vector<float>*> &vs) {
+  loss.forward();
+  loss.backward();
+  Graph &g = *loss.g_;
+  for (int i=0; i < xs.size(); ++i) {
+    std::vector<float> &v = *vs[i];
+    std::vector<float> grad(g.grads[xs[i].id()].data, g.grads[xs[i].id()].data + v.size());
+    for (int j=0; j < v.size(); ++j) {
+      float old = v[j];
+      v[j] = old + 1e-2f;
+      float e_p = total(loss.forward());
+      v[j] = old - 1e-2f;
+      float e_m = total(loss.forward());
+      v[j] = old;
+      EXPECT_NEAR(grad[j], (e_p - e_m) / 2e-2f, 2e-3) << "input " << i << " value " << j;
+    }
+  }
+}
+
+// -log softmax over the candidates in double
+static double reference(const float *h, const std::vector<float> &w,
+    const std::vector<float> &bias, const std::vector<int> &cand, int target, int H,
+    const std::vector<float> &shift) {
+  std::vector<double> l;
+  double lt = 0., m = -1e300;
+  for (int j : cand) {
+    double v = bias[j] - (shift.empty() ? 0. : shift[j]);
+    for (int k=0; k < H; ++k) v += (double)h[k] * w[j * H + k];
+    l.push_back(v);
+    if (j == target) lt = v;
+    m = std::max(m, v);
+  }
+  double s = 0.;
+  for (double v : l) s += exp(v - m);
+  return m + log(s) - lt;
+}
+
+TEST(SoftmaxTest, CandidateSoftmaxLoss) {
+  const int H = 3, B = 4, n = 7;
+  std::vector<float> hv(H * B), wv(H * n), bv(n);
+  for (int i=0; i < hv.size(); ++i) hv[i] = 0.7f * sinf(1.1f * i);
+  for (int i=0; i < wv.size(); ++i) wv[i] = 0.9f * cosf(0.7f * i + 0.2f);
+  for (int i=0; i < bv.size(); ++i) bv[i] = 0.1f * i - 0.3f;
+
+  // examples 0 and 1 share rows [3, 7) with targets 0 and 1 outside them,
+  // and row 5 has the id of target row 0; examples 2 and 3 have their
+  // targets inside [0, 3) and [1, 3)
+  std::vector<int> begin = {3, 3, 0, 1};
+  std::vector<int> end = {7, 7, 3, 3};
+  std::vector<int> target = {0, 1, 2, 1};
+  std::vector<float> shift = {0.1, -0.2, 0., 0.3, 0.5, -0.1, 0.2};
+  std::vector<int> ids = {10, 11, 12, 13, 14, 10, 16};
+
+  Graph g;
+  Expression h = input(g, Dim({H, 1}, B), hv);
+  Expression w = input(g, Dim({1, H}, n), wv);
+  Expression bias = input(g, Dim({1, 1}, n), bv);
+  Expression loss = candidate_softmax_loss(h, w, bias, begin, end, target, shift, ids);
+
+  Tensor y = loss.forward();
+  ASSERT_EQ(y.dim.batch_size, B);
+  std::vector<std::vector<int>> cand = {{0, 3, 4, 6}, {1, 3, 4, 5, 6}, {0, 1, 2}, {1, 2}};
+  for (int b=0; b < B; ++b) {
+    EXPECT_NEAR(y.data[b], reference(&hv[b * H], wv, bv, cand[b], target[b], H, shift),
+        1e-5);
+  }
+  check_gradients(loss, {h, w, bias}, {&hv, &wv, &bv});
+}
+
+TEST(SoftmaxTest, AliasSampler) {
+  std::vector<float> weights = {1., 0., 5., 2., 0.5, 1.5};
+  AliasSampler sampler(weights, 7);
+  int n = 200000;
+  std::vector<int> draws(n);
+  sampler.sample(n, draws.data());
+  std::vector<int> count(weights.size(), 0);
+  for (int i : draws) {
+    ASSERT_TRUE(i >= 0 && i < weights.size());
+    ++count[i];
+  }
+  EXPECT_EQ(count[1], 0);
+  for (int i=0; i < weights.size(); ++i) {
+    EXPECT_NEAR(sampler.prob(i), weights[i] / 10., 1e-6);
+    EXPECT_NEAR((double)count[i] / n, weights[i] / 10., 0.005);
+  }
+
+  // the same seed gives the same draws
+  AliasSampler again(weights, 7);
+  for (int i=0; i < 100; ++i) {
+    EXPECT_EQ(again.sample(), draws[i]);
+  }
+}
+
+TEST(SoftmaxTest, FrequencyClasses) {
+  std::vector<float> counts = {100, 50, 20, 10, 5, 5, 4, 3, 2, 1};
+  std::vector<int> c = frequency_classes(counts, 4);
+  EXPECT_EQ(c, std::vector<int>({0, 1, 2, 3, 10}));
+  // more classes than the counts can balance still gives non empty ones
+  c = frequency_classes(std::vector<float>(5, 0.f), 5);
+  EXPECT_EQ(c, std::vector<int>({0, 1, 2, 3, 4, 5}));
+}
+
+class SoftmaxBuilderTest: public ::testing::Test {
+  protected:
+    void SetUp() {
+      for (int i=0; i < V; ++i) counts.push_back(100.f / (i + 1));
+      for (int i=0; i < H * B; ++i) hv.push_back(sinf(0.9f * i));
+    }
+
+    const int V = 30;
+    const int H = 4;
+    const int B = 5;
+    std::vector<float> counts;
+    std::vector<float> hv;
+    std::vector<int> targets = {0, 7, 29, 7, 12};
+    SGDOptimizer optimizer;
+};
+
+TEST_F(SoftmaxBuilderTest, Sampled) {
+  SampledSoftmaxBuilder out(optimizer.model, H, counts, 8);
+  for (int i=0; i < V * H; ++i) out.w.all_values.data[i] = 0.5f * cosf(0.3f * i);
+
+  // the full loss is log_softmax over all words
+  Graph g;
+  Tensor y = out.full_loss(input(g, Dim({H, 1}, B), hv), targets).forward();
+  std::vector<int> all(V);
+  for (int j=0; j < V; ++j) all[j] = j;
+  std::vector<float> w(out.w.all_values.data, out.w.all_values.data + V * H);
+  std::vector<float> b(V, 0.f);
+  for (int i=0; i < B; ++i) {
+    EXPECT_NEAR(y.data[i], reference(&hv[i * H], w, b, all, targets[i], H,
+        std::vector<float>()), 1e-4);
+  }
+
+  // only the targets and the samples get gradients
+  Graph g2;
+  Expression loss = out.loss(input(g2, Dim({H, 1}, B), hv), targets);
+  loss.forward();
+  loss.backward();
+  std::vector<int> touched = *out.w.touched;
+  EXPECT_LE(touched.size(), B + 8);
+  for (int t : targets) {
+    EXPECT_NE(std::find(touched.begin(), touched.end(), t), touched.end());
+  }
+  for (int j=0; j < V; ++j) {
+    if (std::find(touched.begin(), touched.end(), j) != touched.end()) continue;
+    for (int k=0; k < H; ++k) {
+      EXPECT_EQ(out.w.all_grads.data[j * H + k], 0.f);
+    }
+  }
+}
+
+TEST_F(SoftmaxBuilderTest, ClassFactored) {
+  ClassFactoredSoftmaxBuilder out(optimizer.model, H, frequency_classes(counts, 5));
+  EXPECT_EQ(out.n_classes, 5);
+  for (int i=0; i < V * H; ++i) out.w.all_values.data[i] = 0.5f * cosf(0.3f * i);
+
+  // a normalized distribution: scoring every word from the same h sums to 1
+  std::vector<float> h;
+  std::vector<int> words(V);
+  for (int j=0; j < V; ++j) {
+    h.insert(h.end(), hv.begin(), hv.begin() + H);
+    words[j] = j;
+  }
+  Graph g;
+  Tensor y = out.loss(input(g, Dim({H, 1}, V), h), words).forward();
+  double p = 0.;
+  for (int j=0; j < V; ++j) p += exp(-y.data[j]);
+  EXPECT_NEAR(p, 1., 1e-5);
+
+  Graph g2;
+  Expression x = input(g2, Dim({H, 1}, B), hv);
+  Expression loss = out.loss(x, targets);
+  check_gradients(loss, {x}, {&hv});
+}
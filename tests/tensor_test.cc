@@ -1,4 +1,6 @@
+#include <algorithm>
 #include <iostream>
+#include <math.h>
 
 #include <gtest/gtest.h>
 
@@ -184,6 +186,139 @@ TEST_F(TensorTest, SumAlongBatch) {
   EXPECT_EQ(dst(1, 1), 10.);
 }
 
+TEST_F(TensorTest, SumLarge) {
+  int n = 1000003;
+  std::vector<float> x(n);
+  double expected = 0.;
+  for (int i=0; i < n; ++i) {
+    x[i] = 0.1f + 1e-3f * sinf(i);
+    expected += x[i];
+  }
+  EXPECT_NEAR(sum(x.data(), n), expected, fabs(expected) * 1e-6);
+
+  Tensor t(Dim({n}), x);
+  EXPECT_NEAR(sum(t), expected, fabs(expected) * 1e-6);
+}
+
+TEST_F(TensorTest, SumAxisLarge) {
+  int rows = 3, len = 20000, cols = 5;
+  std::vector<float> x(rows * len * cols);
+  for (int i=0; i < x.size(); ++i) x[i] = 0.3f + 1e-2f * cosf(i);
+  Tensor t(Dim({rows, len, cols}), x);
+
+  Tensor dst;
+  dst.dim = Dim({rows, cols});
+  dst.data = new float[dst.dim.size()];
+  dst = Scalar(0.);
+  sum(t, dst, 1);
+  for (int r=0; r < rows; ++r) {
+    for (int c=0; c < cols; ++c) {
+      double expected = 0.;
+      for (int j=0; j < len; ++j) expected += x[(r * len + j) * cols + c];
+      EXPECT_NEAR(dst(r, c), expected, fabs(expected) * 1e-6);
+    }
+  }
+}
+
+TEST_F(TensorTest, SumAlongBatchLarge) {
+  int batch = 50000;
+  std::vector<float> x(2 * batch);
+  double expected[2] = {0., 0.};
+  for (int i=0; i < x.size(); ++i) {
+    x[i] = 1.f / 3.f + 1e-3f * i / x.size();
+    expected[i % 2] += x[i];
+  }
+  Tensor t(Dim({2}, batch), x);
+
+  Tensor dst;
+  dst.dim = Dim({2});
+  dst.data = new float[dst.dim.size()];
+  dst = Scalar(0.);
+  sum(t, dst, 1);
+  EXPECT_NEAR(dst(0), expected[0], expected[0] * 1e-6);
+  EXPECT_NEAR(dst(1), expected[1], expected[1] * 1e-6);
+}
+
+TEST_F(TensorTest, Mean) {
+  Tensor dst;
+  dst.dim = Dim({2}, 2);
+  dst.data = new float[dst.dim.size() * dst.dim.batch_size];
+  mean(m_batch, dst, 0);
+  EXPECT_EQ(dst.batch_elem(0)(0), 1.);
+  EXPECT_EQ(dst.batch_elem(0)(1), 2.);
+  EXPECT_EQ(dst.batch_elem(1)(0), 5.);
+  EXPECT_EQ(dst.batch_elem(1)(1), 6.);
+}
+
+TEST_F(TensorTest, Max) {
+  Tensor dst;
+  dst.dim = Dim({3});
+  dst.data = new float[dst.dim.size()];
+  max(m1, dst, 1);
+  EXPECT_EQ(dst(0), 1.);
+  EXPECT_EQ(dst(1), 3.);
+  EXPECT_EQ(dst(2), 5.);
+
+  std::vector<float> x(1001);
+  for (int i=0; i < x.size(); ++i) x[i] = -fabs(i - 613.f);
+  EXPECT_EQ(max(x.data(), x.size()), 0.);
+}
+
+TEST_F(TensorTest, LogSumExp) {
+  std::vector<float> x(4099);
+  double m = -1e30;
+  for (int i=0; i < x.size(); ++i) {
+    x[i] = 50.f * sinf(i * 0.37f);
+    m = std::max(m, (double)x[i]);
+  }
+  double s = 0.;
+  for (int i=0; i < x.size(); ++i) s += exp(x[i] - m);
+  double expected = m + log(s);
+  EXPECT_NEAR(logsumexp(x.data(), x.size()), expected, 1e-4);
+  EXPECT_NEAR(online_logsumexp(x.data(), x.size()), expected, 1e-4);
+  // increasing, so every element raises the maximum of its lane
+  std::vector<float> up(100);
+  for (int i=0; i < up.size(); ++i) up[i] = 0.5f * i;
+  EXPECT_NEAR(online_logsumexp(up.data(), up.size()), logsumexp(up.data(), up.size()), 1e-4);
+  float neg_inf[3] = {-INFINITY, -INFINITY, -INFINITY};
+  EXPECT_EQ(online_logsumexp(neg_inf, 3), -INFINITY);
+
+  Tensor t(Dim({1, 4099}), x);
+  Tensor dst;
+  dst.dim = Dim({1});
+  dst.data = new float[dst.dim.size()];
+  logsumexp(t, dst, 1);
+  EXPECT_NEAR(dst(0), expected, 1e-4);
+
+  Tensor t2(Dim({4099, 1}), x);
+  logsumexp(t2, dst, 0);
+  EXPECT_NEAR(dst(0), expected, 1e-4);
+}
+
+TEST_F(TensorTest, TopK) {
+  // rounded so that there are ties
+  std::vector<float> x(1000);
+  for (int i=0; i < x.size(); ++i) {
+    x[i] = roundf(20.f * sinf(i * 0.73f));
+  }
+  std::vector<int> order(x.size());
+  for (int i=0; i < order.size(); ++i) order[i] = i;
+  std::stable_sort(order.begin(), order.end(),
+      [&](int a, int b) { return x[a] > x[b]; });
+
+  for (int k : {1, 7, 64, 1000}) {
+    std::vector<int> idx(k);
+    top_k(x.data(), x.size(), k, idx.data());
+    for (int i=0; i < k; ++i) {
+      EXPECT_EQ(idx[i], order[i]);
+    }
+  }
+
+  std::vector<int> idx(5, -1);
+  top_k(x.data(), 3, 5, idx.data());
+  EXPECT_EQ(idx[3], -1);
+}
+
 TEST_F(TensorTest, ElementAdd) {
   Tensor res;
   res.dim = m1.dim;
@@ -197,6 +332,53 @@ TEST_F(TensorTest, ElementAdd) {
   EXPECT_EQ(res(2, 1), 11.);
 }
 
+TEST_F(TensorTest, BroadcastAdd) {
+  std::vector<float> col_data{10., 20., 30.};
+  Tensor col(Dim({3, 1}), col_data);
+  std::vector<float> row_data{100., 200.};
+  Tensor row(Dim({2}), row_data);
+
+  Tensor res;
+  res.dim = m1.dim;
+  res.data = new float[res.dim.size()];
+  res = m1 + col.broadcast_to(m1.dim);
+  EXPECT_EQ(res(0, 0), 10.);
+  EXPECT_EQ(res(0, 1), 11.);
+  EXPECT_EQ(res(2, 0), 34.);
+  EXPECT_EQ(res(2, 1), 35.);
+
+  res = col.broadcast_to(m1.dim) + row.broadcast_to(m1.dim);
+  EXPECT_EQ(res(0, 0), 110.);
+  EXPECT_EQ(res(1, 1), 220.);
+  EXPECT_EQ(res(2, 0), 130.);
+}
+
+TEST_F(TensorTest, BroadcastDim) {
+  Dim d = broadcast(Dim({3, 1}, 2), Dim({4}));
+  EXPECT_EQ(d.shape.size(), 2);
+  EXPECT_EQ(d[0], 3);
+  EXPECT_EQ(d[1], 4);
+  EXPECT_EQ(d.batch_size, 2);
+  EXPECT_THROW(broadcast(Dim({3, 2}), Dim({3})), std::runtime_error);
+}
+
+TEST_F(TensorTest, SumTo) {
+  Tensor col;
+  col.dim = Dim({3, 1});
+  col.data = new float[col.dim.size()];
+  sum_to(m1, col);
+  EXPECT_EQ(col(0, 0), 1.);
+  EXPECT_EQ(col(1, 0), 5.);
+  EXPECT_EQ(col(2, 0), 9.);
+
+  Tensor row;
+  row.dim = Dim({2});
+  row.data = new float[row.dim.size()];
+  sum_to(m_batch2, row);
+  EXPECT_EQ(row(0), 18.);
+  EXPECT_EQ(row(1), 24.);
+}
+
 TEST_F(TensorTest, ScalarMultiply) {
   Tensor res;
   res.dim = m1.dim;
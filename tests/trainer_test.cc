@@ -0,0 +1,306 @@
+#include <iostream>
+#include <math.h>
+
+#include <gtest/gtest.h>
+
+#include "../src/expr.h"
+#include "../src/graph.h"
+#include "../src/optimizer.h"
+#include "../src/parameter.h"
+#include "../src/rnn.h"
+#include "../src/rnnpp.h"
+#include "../src/trainer.h"
+
+using namespace rnnpp;
+
+// Regresses x_i * w onto a target, where x_i is row i % n_vocab of a
+// lookup table.
+class TrainerTest: public ::testing::Test {
+  protected:
+    void SetUp() {
+      for (int i=0; i < n_examples; ++i) {
+        std::vector<float> y(2);
+        y[0] = 0.1f * (i % n_vocab) - 0.5f;
+        y[1] = 0.05f * ((i * 3) % n_vocab);
+        targets.push_back(y);
+      }
+    }
+
+    void init(Optimizer &optimizer, Parameter &w, LookupParameter &lp) {
+      lp = optimizer.add_lookup_parameter({n_vocab, 4});
+      w = optimizer.add_parameter({4, 2});
+      for (int i=0; i < n_vocab * 4; ++i) {
+        lp.all_values.data[i] = 0.1f * ((i * 7) % 11) - 0.5f;
+      }
+      for (int i=0; i < 8; ++i) {
+        w.value.data[i] = 0.1f * (i - 4);
+      }
+    }
+
+    Expression loss(Graph &g, const Parameter &w, const LookupParameter &lp, int i) {
+      Expression y = lookup(g, lp, i % n_vocab) * parameter(g, w);
+      return squared_distance(y, input(g, Dim({1, 2}), targets[i]));
+    }
+
+    LossBuilder builder() {
+      return [this](Graph &g, ParameterReplica &r, int i) {
+        return loss(g, r.parameters[0], r.lookup_parameters[0], i);
+      };
+    }
+
+    const int n_vocab = 10;
+    const int n_examples = 200;
+    std::vector<std::vector<float>> targets;
+};
+
+TEST_F(TrainerTest, ReplicaGradients) {
+  SGDOptimizer optimizer;
+  Parameter w;
+  LookupParameter lp;
+  init(optimizer, w, lp);
+  ParameterReplica r(optimizer.model);
+  ASSERT_EQ(r.parameters[0].value.data, w.value.data);
+  ASSERT_EQ(r.lookup_parameters[0].all_values.data, lp.all_values.data);
+
+  Graph g;
+  Expression e = loss(g, r.parameters[0], r.lookup_parameters[0], 3);
+  e.forward();
+  e.backward();
+
+  EXPECT_EQ(lp.touched->size(), 0);
+  EXPECT_EQ(r.lookup_parameters[0].touched->size(), 1);
+  EXPECT_EQ(optimizer.model.grad_norm(), 0.f);
+  float s = 0.;
+  for (int i=0; i < r.grads_size(); ++i) {
+    s += fabs(r.grads()[i]);
+  }
+  EXPECT_GT(s, 0.f);
+
+  r.zero_grads();
+  EXPECT_EQ(r.lookup_parameters[0].touched->size(), 0);
+  for (int i=0; i < r.grads_size(); ++i) {
+    EXPECT_EQ(r.grads()[i], 0.f);
+  }
+}
+
+TEST_F(TrainerTest, HogwildOneThread) {
+  SGDOptimizer a(0.05), b(0.05);
+  Parameter wa, wb;
+  LookupParameter la, lb;
+  init(a, wa, la);
+  init(b, wb, lb);
+
+  HogwildTrainer trainer(a, 1);
+  trainer.train(n_examples, builder());
+
+  for (int i=0; i < n_examples; ++i) {
+    Graph g;
+    Expression e = loss(g, wb, lb, i);
+    e.forward();
+    e.backward();
+    b.update();
+  }
+
+  for (int i=0; i < 8; ++i) {
+    EXPECT_EQ(wa.value.data[i], wb.value.data[i]);
+  }
+  for (int i=0; i < n_vocab * 4; ++i) {
+    EXPECT_EQ(la.all_values.data[i], lb.all_values.data[i]);
+  }
+}
+
+TEST_F(TrainerTest, HogwildConverges) {
+  AdagradOptimizer optimizer(0.1);
+  Parameter w;
+  LookupParameter lp;
+  init(optimizer, w, lp);
+
+  HogwildTrainer trainer(optimizer, 4);
+  float first = trainer.train(n_examples, builder());
+  float last = first;
+  for (int epoch=0; epoch < 30; ++epoch) {
+    last = trainer.train(n_examples, builder());
+  }
+  EXPECT_LT(last, 0.1 * first);
+}
+
+TEST_F(TrainerTest, HogwildConstantMemory) {
+  SGDOptimizer optimizer(0.05);
+  Parameter w;
+  LookupParameter lp;
+  init(optimizer, w, lp);
+
+  HogwildTrainer trainer(optimizer, 2);
+  trainer.train(n_examples, builder());
+  size_t capacity = trainer.arena_capacity();
+  EXPECT_GT(capacity, 0);
+  for (int epoch=0; epoch < 5; ++epoch) {
+    trainer.train(n_examples, builder());
+  }
+  EXPECT_EQ(trainer.arena_capacity(), capacity);
+}
+
+TEST_F(TrainerTest, DataParallelConstantMemory) {
+  SGDOptimizer optimizer(0.01);
+  Parameter w;
+  LookupParameter lp;
+  init(optimizer, w, lp);
+
+  DataParallelTrainer trainer(optimizer, 2);
+  trainer.train(n_examples, 16, builder());
+  size_t capacity = trainer.arena_capacity();
+  EXPECT_GT(capacity, 0);
+  for (int epoch=0; epoch < 5; ++epoch) {
+    trainer.train(n_examples, 16, builder());
+  }
+  EXPECT_EQ(trainer.arena_capacity(), capacity);
+}
+
+TEST_F(TrainerTest, DataParallelOneThread) {
+  SGDOptimizer a(0.01), b(0.01);
+  Parameter wa, wb;
+  LookupParameter la, lb;
+  init(a, wa, la);
+  init(b, wb, lb);
+
+  int batch_size = 16;
+  DataParallelTrainer trainer(a, 1);
+  trainer.train(n_examples, batch_size, builder());
+
+  for (int begin=0; begin < n_examples; begin += batch_size) {
+    for (int i=begin; i < std::min(n_examples, begin + batch_size); ++i) {
+      Graph g;
+      Expression e = loss(g, wb, lb, i);
+      e.forward();
+      e.backward();
+    }
+    b.update();
+  }
+
+  for (int i=0; i < 8; ++i) {
+    EXPECT_EQ(wa.value.data[i], wb.value.data[i]);
+  }
+  for (int i=0; i < n_vocab * 4; ++i) {
+    EXPECT_EQ(la.all_values.data[i], lb.all_values.data[i]);
+  }
+}
+
+TEST_F(TrainerTest, DataParallelReproducible) {
+  SGDOptimizer a(0.01), b(0.01), c(0.01);
+  Parameter wa, wb, wc;
+  LookupParameter la, lb, lc;
+  init(a, wa, la);
+  init(b, wb, lb);
+  init(c, wc, lc);
+
+  DataParallelTrainer ta(a, 3), tb(b, 3), tc(c, 1);
+  for (int epoch=0; epoch < 3; ++epoch) {
+    ta.train(n_examples, 20, builder());
+    tb.train(n_examples, 20, builder());
+    tc.train(n_examples, 20, builder());
+  }
+
+  // bitwise equal for the same number of threads, and up to rounding
+  // for a different one
+  for (int i=0; i < 8; ++i) {
+    EXPECT_EQ(wa.value.data[i], wb.value.data[i]);
+    EXPECT_NEAR(wa.value.data[i], wc.value.data[i], 1e-5);
+  }
+  for (int i=0; i < n_vocab * 4; ++i) {
+    EXPECT_EQ(la.all_values.data[i], lb.all_values.data[i]);
+    EXPECT_NEAR(la.all_values.data[i], lc.all_values.data[i], 1e-5);
+  }
+  EXPECT_EQ(la.touched->size(), 0);
+}
+
+// Window w of a stream of 2-dim inputs: steps w * n_steps ... (w + 1) *
+// n_steps, the last one only as a target.
+static void read_window(int w, std::vector<float> &inputs) {
+  const int n_steps = 4;
+  inputs.clear();
+  for (int t=w * n_steps; t <= (w + 1) * n_steps; ++t) {
+    inputs.push_back(0.5f * sin(0.3f * t));
+    inputs.push_back(0.5f * cos(0.7f * t));
+  }
+}
+
+// predicts the next input from the GRU state
+static Expression window_loss(Graph &g, GRUBuilder &gru, Parameter &w_out,
+    std::vector<float> &inputs, Expression &state) {
+  int n_steps = inputs.size() / 2 - 1;
+  gru.start_new_sequence(g, state);
+  Expression w = parameter(g, w_out);
+  std::vector<Expression> losses;
+  for (int t=0; t < n_steps; ++t) {
+    Tensor x, y;
+    x.dim = y.dim = Dim({2, 1});
+    x.data = &inputs[2 * t];
+    y.data = &inputs[2 * t + 2];
+    Expression h = gru.add_input(input(g, x));
+    losses.push_back(squared_distance(w * h, input(g, y)));
+  }
+  state = gru.state();
+  Expression e = losses[0];
+  for (int t=1; t < n_steps; ++t) {
+    e = e + losses[t];
+  }
+  return e;
+}
+
+TEST_F(TrainerTest, TruncatedBPTT) {
+  SGDOptimizer a(0.05), b(0.05);
+  GRUBuilder ga(a.model, 2, 3), gb(b.model, 2, 3);
+  Parameter wa = a.add_parameter({2, 3}), wb = b.add_parameter({2, 3});
+  std::copy(ga.wx.value.data, ga.wx.value.data + 18, gb.wx.value.data);
+  std::copy(ga.wh.value.data, ga.wh.value.data + 27, gb.wh.value.data);
+  std::copy(wa.value.data, wa.value.data + 6, wb.value.data);
+
+  const int n_windows = 12;
+  TruncatedBPTTTrainer trainer(a, Dim({3, 1}));
+  WindowLoss loss = [&](Graph &g, std::vector<float> &inputs, Expression &state) {
+    return window_loss(g, ga, wa, inputs, state);
+  };
+  float first = trainer.train(n_windows, read_window, loss);
+
+  // a graph per window, with the state copied out
+  std::vector<float> state(3, 0.f), inputs;
+  for (int w=0; w < n_windows; ++w) {
+    Graph g;
+    read_window(w, inputs);
+    Expression s = input(g, Dim({3, 1}), state);
+    Expression e = window_loss(g, gb, wb, inputs, s);
+    e.forward();
+    e.backward();
+    b.update();
+    const Tensor &next = g.outputs[s.id()];
+    state.assign(next.data, next.data + 3);
+  }
+  for (int i=0; i < 27; ++i) {
+    EXPECT_EQ(ga.wh.value.data[i], gb.wh.value.data[i]);
+  }
+  for (int i=0; i < 6; ++i) {
+    EXPECT_EQ(wa.value.data[i], wb.value.data[i]);
+  }
+
+  float last = first;
+  for (int epoch=0; epoch < 20; ++epoch) {
+    trainer.reset_state();
+    last = trainer.train(n_windows, read_window, loss);
+  }
+  EXPECT_LT(last, first);
+}
+
+TEST_F(TrainerTest, TruncatedBPTTConstantMemory) {
+  SGDOptimizer optimizer(0.01);
+  GRUBuilder gru(optimizer.model, 2, 8);
+  Parameter w = optimizer.add_parameter({2, 8});
+  TruncatedBPTTTrainer trainer(optimizer, Dim({8, 1}));
+  WindowLoss loss = [&](Graph &g, std::vector<float> &inputs, Expression &state) {
+    return window_loss(g, gru, w, inputs, state);
+  };
+  trainer.train(3, read_window, loss);
+  size_t capacity = trainer.arena_capacity();
+  EXPECT_GT(capacity, 0);
+  trainer.train(50, read_window, loss);
+  EXPECT_EQ(trainer.arena_capacity(), capacity);
+}